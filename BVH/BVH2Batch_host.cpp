@@ -0,0 +1,140 @@
+#include <algorithm>
+#include <cfloat>
+#include <vector>
+
+#include "omp.h"
+#include "BVH2Common.h"
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// CPU-only batched ray queries for external users. Rays are sorted by direction octant and Morton code of origin,
+// so that neighbouring rays in a chunk are coherent, then chunks are traced in parallel with packet traversal
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+static constexpr size_t BATCH_CHUNK_SIZE = 256; //rays traced by one thread at once, multiple of RAY_PACKET_SIZE
+
+static inline uint64_t spread_bits_10(uint64_t v)
+{
+  v &= 0x3FF;
+  v = (v | (v << 16)) & 0x030000FF;
+  v = (v | (v <<  8)) & 0x0300F00F;
+  v = (v | (v <<  4)) & 0x030C30C3;
+  v = (v | (v <<  2)) & 0x09249249;
+  return v;
+}
+
+//a_getRay(i, pos, dir) reads i-th ray, a_traceChunk(pos, dir, count, first) traces rays in sorted order,
+//first is index of the first ray of chunk in sorted arrays. Returns permutation, order[sorted_id] = original_id
+template<typename GetRay, typename TraceChunk>
+static std::vector<uint32_t> trace_sorted(size_t count, GetRay a_getRay, TraceChunk a_traceChunk)
+{
+  std::vector<float4> pos(count), dir(count);
+  for (size_t i = 0; i < count; i++)
+    a_getRay(i, pos[i], dir[i]);
+
+  float3 bmin(FLT_MAX, FLT_MAX, FLT_MAX), bmax(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+  for (size_t i = 0; i < count; i++)
+  {
+    bmin = min(bmin, to_float3(pos[i]));
+    bmax = max(bmax, to_float3(pos[i]));
+  }
+  const float3 scale = 1023.0f / max(bmax - bmin, float3(1e-6f, 1e-6f, 1e-6f));
+
+  std::vector<std::pair<uint64_t, uint32_t>> keys(count);
+  #pragma omp parallel for schedule(static)
+  for (long long i = 0; i < (long long)count; i++)
+  {
+    const float3 c = (to_float3(pos[i]) - bmin) * scale;
+    const uint64_t octant = (dir[i].x < 0.0f ? 1 : 0) | (dir[i].y < 0.0f ? 2 : 0) | (dir[i].z < 0.0f ? 4 : 0);
+    const uint64_t morton = spread_bits_10(uint64_t(c.x)) | (spread_bits_10(uint64_t(c.y)) << 1) | (spread_bits_10(uint64_t(c.z)) << 2);
+    keys[i] = std::make_pair((octant << 30) | morton, uint32_t(i));
+  }
+  std::sort(keys.begin(), keys.end());
+
+  std::vector<uint32_t> order(count);
+  std::vector<float4> sortedPos(count), sortedDir(count);
+  #pragma omp parallel for schedule(static)
+  for (long long i = 0; i < (long long)count; i++)
+  {
+    order[i]     = keys[i].second;
+    sortedPos[i] = pos[keys[i].second];
+    sortedDir[i] = dir[keys[i].second];
+  }
+
+  const long long chunks = (long long)((count + BATCH_CHUNK_SIZE - 1) / BATCH_CHUNK_SIZE);
+  #pragma omp parallel for schedule(dynamic)
+  for (long long c = 0; c < chunks; c++)
+  {
+    const size_t first = size_t(c) * BATCH_CHUNK_SIZE;
+    const size_t n     = std::min(BATCH_CHUNK_SIZE, count - first);
+    a_traceChunk(sortedPos.data() + first, sortedDir.data() + first, n, first);
+  }
+
+  return order;
+}
+
+void BVHRT::RayQuery_NearestHitBatch(const RayBatchSoA& a_rays, CRT_Hit* out_hits, size_t count)
+{
+  auto getRay = [&](size_t i, float4& pos, float4& dir)
+  {
+    pos = float4(a_rays.pos_x[i], a_rays.pos_y[i], a_rays.pos_z[i], a_rays.t_near ? a_rays.t_near[i] : 0.0f);
+    dir = float4(a_rays.dir_x[i], a_rays.dir_y[i], a_rays.dir_z[i], a_rays.t_far  ? a_rays.t_far[i]  : FLT_MAX);
+  };
+
+  std::vector<CRT_Hit> sortedHits(count);
+  auto order = trace_sorted(count, getRay, [&](const float4* pos, const float4* dir, size_t n, size_t first)
+  {
+    RayQuery_NearestHitPacket(pos, dir, sortedHits.data() + first, uint32_t(n));
+  });
+
+  #pragma omp parallel for schedule(static)
+  for (long long i = 0; i < (long long)count; i++)
+    out_hits[order[i]] = sortedHits[i];
+}
+
+void BVHRT::RayQuery_AnyHitBatch(const RayBatchSoA& a_rays, bool* out_hits, size_t count)
+{
+  auto getRay = [&](size_t i, float4& pos, float4& dir)
+  {
+    pos = float4(a_rays.pos_x[i], a_rays.pos_y[i], a_rays.pos_z[i], a_rays.t_near ? a_rays.t_near[i] : 0.0f);
+    dir = float4(a_rays.dir_x[i], a_rays.dir_y[i], a_rays.dir_z[i], a_rays.t_far  ? a_rays.t_far[i]  : FLT_MAX);
+  };
+
+  std::vector<uint8_t> sortedHits(count);
+  auto order = trace_sorted(count, getRay, [&](const float4* pos, const float4* dir, size_t n, size_t first)
+  {
+    for (size_t i = 0; i < n; i++)
+      sortedHits[first + i] = RayQuery_AnyHit(pos[i], dir[i]) ? 1 : 0;
+  });
+
+  #pragma omp parallel for schedule(static)
+  for (long long i = 0; i < (long long)count; i++)
+    out_hits[order[i]] = sortedHits[i] != 0;
+}
+
+size_t BVHRT::RayQuery_NearestHitStream(const RaySource& a_source, const HitSink& a_sink, size_t a_chunkSize)
+{
+  //only one chunk of rays and hits is resident in memory at once
+  std::vector<float4> pos(a_chunkSize), dir(a_chunkSize);
+  std::vector<CRT_Hit> sortedHits(a_chunkSize), hits(a_chunkSize);
+  size_t total = 0;
+
+  while (true)
+  {
+    const size_t count = std::min(a_source(pos.data(), dir.data(), a_chunkSize), a_chunkSize);
+    if (count == 0)
+      break;
+
+    auto getRay = [&](size_t i, float4& p, float4& d) { p = pos[i]; d = dir[i]; };
+    auto order = trace_sorted(count, getRay, [&](const float4* p, const float4* d, size_t n, size_t first)
+    {
+      RayQuery_NearestHitPacket(p, d, sortedHits.data() + first, uint32_t(n));
+    });
+
+    for (size_t i = 0; i < count; i++)
+      hits[order[i]] = sortedHits[i];
+    a_sink(hits.data(), count);
+    total += count;
+  }
+
+  return total;
+}
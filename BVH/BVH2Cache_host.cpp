@@ -0,0 +1,142 @@
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+
+#include "BVH2Common.h"
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// CPU-side cache of BLAS built for custom geometry (SDF bricks, octree nodes etc.). BLAS depends only on the list of
+// boxes and build/layout presets, so it is stored in cache folder in a file named after the hash of all of them.
+// For models loaded from file it can be stored next to the model instead, keyed by file content, so that the key
+// is known without deriving and hashing boxes
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+static constexpr uint32_t BLAS_CACHE_MAGIC   = 0x53414C42; //"BLAS"
+static constexpr uint32_t BLAS_CACHE_VERSION = 1;          //change version if BVHNodePair or builders change
+
+struct BLASCacheHeader
+{
+  uint32_t magic;
+  uint32_t version;
+  uint64_t hash;
+  uint64_t boxCount;
+  uint64_t nodeCount;
+};
+
+//FNV-1a
+static uint64_t hash_bytes(const void* a_data, size_t a_size, uint64_t a_hash = 14695981039346656037ull)
+{
+  const uint8_t* bytes = (const uint8_t*)a_data;
+  for (size_t i = 0; i < a_size; i++)
+  {
+    a_hash ^= bytes[i];
+    a_hash *= 1099511628211ull;
+  }
+  return a_hash;
+}
+
+uint64_t BVHRT::BLASCacheKey(uint32_t a_typeId, const CRT_AABB* boxMinMaxF8, size_t a_boxNumber) const
+{
+  uint64_t hash = hash_bytes(&BLAS_CACHE_VERSION, sizeof(uint32_t));
+  hash = hash_bytes(&a_typeId, sizeof(uint32_t), hash);
+  hash = hash_bytes(m_buildName.data(), m_buildName.size(), hash);
+  hash = hash_bytes(m_layoutName.data(), m_layoutName.size(), hash);
+  return hash_bytes(boxMinMaxF8, a_boxNumber*sizeof(CRT_AABB), hash);
+}
+
+//FNV-1a over 64-bit words, it is much faster than byte version for large files
+static uint64_t hash_words(const char* a_data, size_t a_size, uint64_t a_hash)
+{
+  const size_t words = a_size/sizeof(uint64_t);
+  for (size_t i = 0; i < words; i++)
+  {
+    uint64_t w;
+    memcpy(&w, a_data + i*sizeof(uint64_t), sizeof(uint64_t));
+    a_hash ^= w;
+    a_hash *= 1099511628211ull;
+  }
+  return hash_bytes(a_data + words*sizeof(uint64_t), a_size - words*sizeof(uint64_t), a_hash);
+}
+
+uint64_t BVHRT::BLASSidecarKey(const char* a_geomTypeName, const char* a_fileName) const
+{
+  uint64_t hash = hash_bytes(&BLAS_CACHE_VERSION, sizeof(uint32_t));
+  hash = hash_bytes(a_geomTypeName, strlen(a_geomTypeName), hash);
+  hash = hash_bytes(m_buildName.data(), m_buildName.size(), hash);
+  hash = hash_bytes(m_layoutName.data(), m_layoutName.size(), hash);
+  hash = hash_bytes(&m_reorderSBSMorton, sizeof(bool), hash); //loader options that change order of boxes
+
+  std::ifstream fs(a_fileName, std::ios::binary);
+  std::vector<char> buf(1 << 24);
+  size_t fileSize = 0;
+  while (fs.good())
+  {
+    fs.read(buf.data(), buf.size());
+    const size_t count = size_t(fs.gcount());
+    //chunk size is a multiple of 8, so only the last chunk can have tail bytes
+    hash = hash_words(buf.data(), count, hash);
+    fileSize += count;
+  }
+  return hash_bytes(&fileSize, sizeof(size_t), hash);
+}
+
+static std::string blas_cache_path(const std::string& a_folder, uint64_t a_key)
+{
+  char name[32];
+  snprintf(name, sizeof(name), "blas_%016llx.bin", (unsigned long long)a_key);
+  return a_folder + "/" + name;
+}
+
+std::string BVHRT::BLASCachePath(uint32_t a_typeId, const CRT_AABB* boxMinMaxF8, size_t a_boxNumber, uint64_t* a_key) const
+{
+  if (!m_blasSidecarPath.empty())
+  {
+    *a_key = hash_bytes(&a_typeId, sizeof(uint32_t), m_blasSidecarKey);
+    return m_blasSidecarPath;
+  }
+  if (m_blasCacheFolder.empty())
+    return "";
+  *a_key = BLASCacheKey(a_typeId, boxMinMaxF8, a_boxNumber);
+  return blas_cache_path(m_blasCacheFolder, *a_key);
+}
+
+bool BVHRT::LoadCachedBLAS(const std::string& a_path, uint64_t a_key, size_t a_boxNumber, std::vector<BVHNodePair>& a_nodes) const
+{
+  std::ifstream fs(a_path, std::ios::binary);
+  if (!fs.is_open())
+    return false;
+
+  BLASCacheHeader header;
+  fs.read((char*)&header, sizeof(BLASCacheHeader));
+  if (!fs.good() || header.magic != BLAS_CACHE_MAGIC || header.version != BLAS_CACHE_VERSION ||
+      header.hash != a_key || header.boxCount != a_boxNumber || header.nodeCount == 0)
+    return false;
+
+  a_nodes.resize(header.nodeCount);
+  fs.read((char*)a_nodes.data(), header.nodeCount*sizeof(BVHNodePair));
+  return fs.good();
+}
+
+void BVHRT::SaveCachedBLAS(const std::string& a_path, uint64_t a_key, size_t a_boxNumber, const std::vector<BVHNodePair>& a_nodes) const
+{
+  //write to temporary file first, so that other process never reads partially written cache
+  const std::string tmpPath = a_path + ".tmp";
+  {
+    std::ofstream fs(tmpPath, std::ios::binary);
+    if (!fs.is_open())
+    {
+      printf("[BVHRT::SaveCachedBLAS] cannot write BLAS cache to %s\n", tmpPath.c_str());
+      return;
+    }
+
+    BLASCacheHeader header;
+    header.magic     = BLAS_CACHE_MAGIC;
+    header.version   = BLAS_CACHE_VERSION;
+    header.hash      = a_key;
+    header.boxCount  = a_boxNumber;
+    header.nodeCount = a_nodes.size();
+    fs.write((const char*)&header, sizeof(BLASCacheHeader));
+    fs.write((const char*)a_nodes.data(), a_nodes.size()*sizeof(BVHNodePair));
+  }
+  std::rename(tmpPath.c_str(), a_path.c_str());
+}
@@ -178,7 +178,8 @@ void BVHRT::TricubicLocalSurfaceIntersection(uint32_t type, const float3 ray_dir
   {
     hit = true;
   }
-  else if (m_preset.sdf_node_intersect == SDF_OCTREE_NODE_INTERSECT_ST)
+  else if (m_preset.sdf_node_intersect == SDF_OCTREE_NODE_INTERSECT_ST ||
+           m_preset.sdf_node_intersect == SDF_OCTREE_NODE_INTERSECT_ST_RELAXED) //no cheap Lipschitz bound for tricubic, plain ST
   {
     const unsigned ST_max_iters = 256;
     float dist = start_dist;
@@ -315,6 +316,47 @@ void BVHRT::LocalSurfaceIntersection(uint32_t type, const float3 ray_dir, uint32
     }
     hit = (dist <= EPS);
   }
+  else if (m_preset.sdf_node_intersect == SDF_OCTREE_NODE_INTERSECT_ST_RELAXED)
+  {
+    // over-relaxed sphere tracing from "Enhanced Sphere Tracing", Keinert et al., 2014.
+    // Steps are bounded by Lipschitz constant of trilinear field: each component of its gradient 
+    // is an interpolation of differences along edges of the node, so it never exceeds max of them.
+    const unsigned ST_max_iters = 256;
+    float Lx = std::max(std::max(std::abs(values[4]-values[0]), std::abs(values[5]-values[1])), 
+                        std::max(std::abs(values[6]-values[2]), std::abs(values[7]-values[3])));
+    float Ly = std::max(std::max(std::abs(values[2]-values[0]), std::abs(values[3]-values[1])), 
+                        std::max(std::abs(values[6]-values[4]), std::abs(values[7]-values[5])));
+    float Lz = std::max(std::max(std::abs(values[1]-values[0]), std::abs(values[3]-values[2])), 
+                        std::max(std::abs(values[5]-values[4]), std::abs(values[7]-values[6])));
+    float L_inv = 1.0f / std::max(std::sqrt(Lx*Lx + Ly*Ly + Lz*Lz)*length(ray_dir), EPS);
+
+    float omega = 1.6f;
+    float step = 0.0f;
+    float prev_r = 0.0f;
+    float dist = start_dist;
+
+    while (iter < ST_max_iters)
+    {
+      float r = dist * L_inv;
+      if (omega > 1.0f && r + prev_r < step)
+      {
+        //unbounding spheres of the last two points do not overlap, surface could be skipped,
+        //so step back and continue with plain sphere tracing
+        step -= omega*step;
+        omega = 1.0f;
+      }
+      else if (dist <= EPS || t >= qFar)
+        break;
+      else
+        step = omega*r;
+      
+      prev_r = r;
+      t += step;
+      dist = start_sign*eval_dist_trilinear(values, start_q + t * ray_dir);
+      iter++;
+    }
+    hit = (dist <= EPS);
+  }
   else //if (m_preset.sdf_node_intersect == SDF_OCTREE_NODE_INTERSECT_ANALYTIC ||
        //    m_preset.sdf_node_intersect == SDF_OCTREE_NODE_INTERSECT_NEWTON ||
        //    m_preset.sdf_node_intersect == SDF_OCTREE_NODE_INTERSECT_IT)
@@ -722,10 +764,14 @@ float BVHRT::load_tricubic_distance_values(uint32_t nodeId, float3 voxelPos, uin
   return vmin;
 }
 
-float BVHRT::load_distance_values(uint32_t nodeId, float3 voxelPos, uint32_t v_size, float sz_inv, const SdfSBSHeader &header, float values[8])
+float BVHRT::load_distance_values(uint32_t sdfId, uint32_t nodeId, float3 voxelPos, uint32_t v_size, float sz_inv, const SdfSBSHeader &header, float values[8])
 {
   float vmin = 1e6f;
 #ifndef DISABLE_SDF_SBS
+#ifndef KERNEL_SLICER
+  if (nodeId < m_SdfSBSNodePages.size() && m_SdfSBSNodePages[nodeId].x != uint32_t(-1) && !SBSPageTouch(nodeId))
+    return SBSCoarseDistanceValues(nodeId, voxelPos, header, values);
+#endif
   if (header.aux_data == SDF_SBS_NODE_LAYOUT_ID32F_IRGB32F ||
       header.aux_data == SDF_SBS_NODE_LAYOUT_ID32F_IRGB32F_IN)
   {
@@ -749,6 +795,11 @@ float BVHRT::load_distance_values(uint32_t nodeId, float3 voxelPos, uint32_t v_s
     uint32_t max_val = header.bytes_per_value == 4 ? 0xFFFFFFFF : ((1 << bits) - 1);
     float d_max = 1.73205081f * sz_inv;
     float mult = 2 * d_max / max_val;
+#ifndef KERNEL_SLICER
+    SBSDecodeFunc decode = sdfId < m_SdfSBSDecoders.size() ? m_SdfSBSDecoders[sdfId] : nullptr;
+    if (decode != nullptr)
+      return decode(m_SdfSBSData.data() + v_off, SBS_v_to_i(voxelPos.x, voxelPos.y, voxelPos.z, v_size, header.brick_pad), d_max, values);
+#endif
     for (int i = 0; i < 8; i++)
     {
       uint3 vPos = uint3(voxelPos) + uint3((i & 4) >> 2, (i & 2) >> 1, i & 1);
@@ -761,6 +812,47 @@ float BVHRT::load_distance_values(uint32_t nodeId, float3 voxelPos, uint32_t v_s
   return vmin;
 }
 
+//values of 8 brick corners, i.e. trilinear field of the brick as a single voxel (coarse LOD)
+float BVHRT::load_brick_corner_values(uint32_t sdfId, uint32_t nodeId, uint32_t v_size, float sz_inv, const SdfSBSHeader &header, float values[8])
+{
+  float vmin = 1e6f;
+#ifndef DISABLE_SDF_SBS
+  const uint32_t bs = header.brick_size;
+#ifndef KERNEL_SLICER
+  if (nodeId < m_SdfSBSNodePages.size() && m_SdfSBSNodePages[nodeId].x != uint32_t(-1) && !SBSPageTouch(nodeId))
+  {
+    float voxel_values[8];
+    for (int i = 0; i < 8; i++)
+    {
+      float3 voxelPos = float3(((i & 4) >> 2)*(bs - 1), ((i & 2) >> 1)*(bs - 1), (i & 1)*(bs - 1));
+      SBSCoarseDistanceValues(nodeId, voxelPos, header, voxel_values);
+      values[i] = voxel_values[i];
+      vmin = std::min(vmin, values[i]);
+    }
+    return vmin;
+  }
+#endif
+  uint32_t v_off = m_SdfSBSNodes[nodeId].data_offset;
+  uint32_t vals_per_int = 4 / header.bytes_per_value;
+  uint32_t bits = 8 * header.bytes_per_value;
+  uint32_t max_val = header.bytes_per_value == 4 ? 0xFFFFFFFF : ((1 << bits) - 1);
+  float d_max = 1.73205081f * sz_inv;
+  float mult = 2 * d_max / max_val;
+  const bool float_values = header.aux_data == SDF_SBS_NODE_LAYOUT_ID32F_IRGB32F ||
+                            header.aux_data == SDF_SBS_NODE_LAYOUT_ID32F_IRGB32F_IN;
+  for (int i = 0; i < 8; i++)
+  {
+    uint32_t vId = SBS_v_to_i(((i & 4) >> 2)*bs, ((i & 2) >> 1)*bs, (i & 1)*bs, v_size, header.brick_pad);
+    if (float_values)
+      values[i] = m_SdfSBSDataF[m_SdfSBSData[v_off + vId]];
+    else
+      values[i] = -d_max + mult * ((m_SdfSBSData[v_off + vId / vals_per_int] >> (bits * (vId % vals_per_int))) & max_val);
+    vmin = std::min(vmin, values[i]);
+  }
+#endif
+  return vmin;
+}
+
 void BVHRT::OctreeBrickIntersect(uint32_t type, const float3 ray_pos, const float3 ray_dir,
                                  float tNear, uint32_t instId, uint32_t geomId,
                                  uint32_t bvhNodeId, uint32_t a_count,
@@ -796,7 +888,28 @@ void BVHRT::OctreeBrickIntersect(uint32_t type, const float3 ray_pos, const floa
 
   float2 brick_fNearFar = RayBoxIntersection2(ray_pos, SafeInverse(ray_dir), brick_min_pos, brick_max_pos);
   float old_t = pHit->t;
-  while (brick_fNearFar.x < brick_fNearFar.y && pHit->t == old_t)
+
+#ifndef KERNEL_SLICER
+  const uint32_t *occupancy = SBSOccupancyMask(sdfId, primId);
+  if (occupancy != nullptr && m_preset.interpolation_mode == INTERPOLATION_MODE_TRILINEAR && occupancy[0] == 0)
+    return; //no voxels with surface in this brick
+#endif
+
+  //screen-space LOD: the whole brick is smaller than lod_pixel_threshold pixels, so intersect trilinear
+  //field of its corners instead of marching through every voxel
+  //ray starting inside the brick is marched per voxel, as coarse field can't be intersected from a point inside it
+  const bool coarseLod = m_preset.lod_mode == LOD_MODE_SCREEN_SPACE && m_preset.interpolation_mode == INTERPOLATION_MODE_TRILINEAR &&
+                         sz_inv < m_preset.lod_pixel_threshold*m_lodPixelAngle*std::max(brick_fNearFar.x, tNear)*length(ray_dir) &&
+                         brick_fNearFar.x < brick_fNearFar.y && tNear < brick_fNearFar.x;
+  if (coarseLod && load_brick_corner_values(sdfId, nodeId, v_size, sz_inv, header, trilinear_values) <= 0.0f)
+  {
+    start_q = (ray_pos + brick_fNearFar.x*ray_dir - brick_min_pos) * (0.5f*sz);
+    qFar = (brick_fNearFar.y - brick_fNearFar.x) * (0.5f*sz);
+    LocalSurfaceIntersection(type, ray_dir, instId, geomId, trilinear_values, nodeId, primId, sz_inv, 0.0f, qFar, brick_fNearFar, start_q, /*in */
+                             pHit); /*out*/
+  }
+
+  while (!coarseLod && brick_fNearFar.x < brick_fNearFar.y && pHit->t == old_t)
   {
     float3 hit_pos = ray_pos + brick_fNearFar.x*ray_dir;
     float3 local_pos = (hit_pos - brick_min_pos) * (0.5f*sz*header.brick_size);
@@ -808,9 +921,23 @@ void BVHRT::OctreeBrickIntersect(uint32_t type, const float3 ray_pos, const floa
 
     float vmin = 0;
 
+#ifndef KERNEL_SLICER
+    //voxel has no surface, skip it without decoding its values
+    if (occupancy != nullptr && m_preset.interpolation_mode == INTERPOLATION_MODE_TRILINEAR)
+    {
+      uint32_t vId = (uint32_t(voxelPos.x)*header.brick_size + uint32_t(voxelPos.y))*header.brick_size + uint32_t(voxelPos.z);
+      if ((occupancy[1 + vId/32] & (1u << (vId%32))) == 0)
+      {
+        fNearFar = RayBoxIntersection2(ray_pos, SafeInverse(ray_dir), min_pos, max_pos);
+        brick_fNearFar.x += std::max(0.0f, fNearFar.y-brick_fNearFar.x) + 1e-6f;
+        continue;
+      }
+    }
+#endif
+
     if (m_preset.interpolation_mode == INTERPOLATION_MODE_TRILINEAR)
     {
-      vmin = load_distance_values(nodeId, voxelPos, v_size, sz_inv, header, trilinear_values);
+      vmin = load_distance_values(sdfId, nodeId, voxelPos, v_size, sz_inv, header, trilinear_values);
     }
     else
     {
@@ -885,7 +1012,7 @@ void BVHRT::OctreeBrickIntersect(uint32_t type, const float3 ray_pos, const floa
 
           if (neighbor_nodeId != INVALID_IDX)
           {
-            load_distance_values(neighbor_nodeId, neighbor_voxelPos, v_size, sz_inv, header, values_n);
+            load_distance_values(sdfId, neighbor_nodeId, neighbor_voxelPos, v_size, sz_inv, header, values_n);
             normals[i] = normalize(eval_dist_trilinear_diff(values_n, dp - dVoxelPos));
           }
         }
@@ -2237,11 +2364,38 @@ SdfHit BVHRT::sdf_sphere_tracing(uint32_t type, uint32_t sdf_id, const float3 &m
   
   int iter = 0;
   float d = eval_distance_sdf(type, sdf_id, pos + t * dir);
-  while (iter < 1000 && d > EPS && t < tFar)
+  if (m_preset.sdf_node_intersect == SDF_OCTREE_NODE_INTERSECT_ST_RELAXED)
   {
-    t += d + EPS;
-    d = eval_distance_sdf(type, sdf_id, pos + t * dir);
-    iter++;
+    //over-relaxed sphere tracing, see LocalSurfaceIntersection
+    float omega = 1.6f;
+    float step = 0.0f;
+    float prev_d = 0.0f;
+    while (iter < 1000)
+    {
+      if (omega > 1.0f && d + prev_d < step)
+      {
+        step -= omega*step;
+        omega = 1.0f;
+      }
+      else if (d <= EPS || t >= tFar)
+        break;
+      else
+        step = omega*d + EPS;
+
+      prev_d = d;
+      t += step;
+      d = eval_distance_sdf(type, sdf_id, pos + t * dir);
+      iter++;
+    }
+  }
+  else
+  {
+    while (iter < 1000 && d > EPS && t < tFar)
+    {
+      t += d + EPS;
+      d = eval_distance_sdf(type, sdf_id, pos + t * dir);
+      iter++;
+    }
   }
 
   if (d > EPS)
@@ -2249,7 +2403,16 @@ SdfHit BVHRT::sdf_sphere_tracing(uint32_t type, uint32_t sdf_id, const float3 &m
 
   float3 p0 = pos + t * dir;
   float3 norm = float3(0,0,1);
+  float3 grad = float3(0,0,0);
   if (need_norm)
+    eval_distance_and_grad_sdf(type, sdf_id, p0, grad);
+
+  //analytic gradient of the cell with hit point, central differences only for types/interpolations without it
+  if (need_norm && dot(grad, grad) > 0.0f)
+  {
+    norm = normalize(grad);
+  }
+  else if (need_norm)
   {
     const float h = 0.001;
     float ddx = (eval_distance_sdf(type, sdf_id, p0 + float3(h, 0, 0)) -
@@ -2272,18 +2435,36 @@ SdfHit BVHRT::sdf_sphere_tracing(uint32_t type, uint32_t sdf_id, const float3 &m
 }
 
 float BVHRT::eval_distance_sdf(uint32_t type, uint32_t sdf_id, float3 pos)
+{
+  float3 grad;
+  return eval_distance_and_grad_sdf(type, sdf_id, pos, grad);
+}
+
+//distance and its gradient over pos, gradient is zero if it is not available analytically
+float BVHRT::eval_distance_and_grad_sdf(uint32_t type, uint32_t sdf_id, float3 pos, float3 &grad)
 {
   float val = 1000;
+  grad = float3(0,0,0);
   switch (type)
   {
 #ifndef DISABLE_SDF_GRID
   case TYPE_SDF_GRID:
-    val = eval_distance_sdf_grid(sdf_id, pos);
+    val = eval_distance_and_grad_sdf_grid(sdf_id, pos, grad);
     break;
 #endif
 #ifndef DISABLE_SDF_SBS
   case TYPE_SDF_SBS:
-    val = eval_distance_sdf_sbs(sdf_id, pos);
+    val = eval_distance_and_grad_sdf_sbs(sdf_id, pos, grad);
+    break;
+#endif
+#ifndef DISABLE_SDF_FRAME_OCTREE
+  case TYPE_SDF_FRAME_OCTREE:
+    val = eval_distance_and_grad_sdf_frame_octree(sdf_id, pos, grad);
+    break;
+#endif
+#ifndef DISABLE_SDF_FRAME_OCTREE_COMPACT
+  case TYPE_COCTREE_V3:
+    val = eval_distance_and_grad_sdf_coctree_v3(sdf_id, pos, grad);
     break;
 #endif
   default:
@@ -2295,6 +2476,13 @@ float BVHRT::eval_distance_sdf(uint32_t type, uint32_t sdf_id, float3 pos)
 #ifndef DISABLE_SDF_GRID
 float BVHRT::eval_distance_sdf_grid(uint32_t grid_id, float3 pos)
 {
+  float3 grad;
+  return eval_distance_and_grad_sdf_grid(grid_id, pos, grad);
+}
+
+float BVHRT::eval_distance_and_grad_sdf_grid(uint32_t grid_id, float3 pos, float3 &grad)
+{
+  grad = float3(0,0,0);
   uint32_t off = m_SdfGridOffsets[grid_id];
   uint3 size = m_SdfGridSizes[grid_id];
 
@@ -2311,6 +2499,7 @@ float BVHRT::eval_distance_sdf_grid(uint32_t grid_id, float3 pos)
   {
     if (vox_u.x < size.x-1 && vox_u.y < size.y-1 && vox_u.z < size.z-1)
     {
+      float values[8];
       for (uint32_t i=0;i<2;i++)
       {
         for (uint32_t j=0;j<2;j++)
@@ -2320,10 +2509,12 @@ float BVHRT::eval_distance_sdf_grid(uint32_t grid_id, float3 pos)
             float qx = (1 - dp.x + i*(2*dp.x-1));
             float qy = (1 - dp.y + j*(2*dp.y-1));
             float qz = (1 - dp.z + k*(2*dp.z-1));   
-            res += qx*qy*qz*m_SdfGridData[off + (vox_u.z + k)*size.x*size.y + (vox_u.y + j)*size.x + (vox_u.x + i)];   
+            values[4*i + 2*j + k] = m_SdfGridData[off + (vox_u.z + k)*size.x*size.y + (vox_u.y + j)*size.x + (vox_u.x + i)];
+            res += qx*qy*qz*values[4*i + 2*j + k];
           }      
         }
       }
+      grad = eval_dist_trilinear_diff(values, dp) * (0.5f*grid_size_f);
     }
     else
     {
@@ -2436,18 +2627,40 @@ float BVHRT::eval_distance_sdf_svs(uint32_t svs_id, float3 pos)
 #ifndef DISABLE_SDF_SBS
 float BVHRT::eval_distance_sdf_sbs(uint32_t sbs_id, float3 pos)
 {
+  float3 grad;
+  return eval_distance_and_grad_sdf_sbs(sbs_id, pos, grad);
+}
+
+float BVHRT::eval_distance_and_grad_sdf_sbs(uint32_t sbs_id, float3 pos, float3 &grad)
+{
+  grad = float3(0,0,0);
   uint32_t type = m_geomData[sbs_id].type;
   // assert (type == TYPE_SDF_SBS); // || type == TYPE_SDF_SBS_COL || type == TYPE_SDF_SBS_TEX
-  uint32_t leftNodeOffset = eval_distance_traverse_bvh(sbs_id, pos);
+  uint32_t sdfId =  m_geomData[sbs_id].offset.x;
+  uint32_t a_start = SBS_INDEX_UNKNOWN;
 
-  if (leftNodeOffset == 0xFFFFFFFF)
-    return 11.f; // cannot be used for ST
-  // printf("NodeOffset: %d\n", leftNodeOffset);
+#ifndef KERNEL_SLICER
+  //one box per brick in BLAS, so brick id from index is the same as a_start from BLAS leaf
+  if (sdfId < m_SdfSBSIndex.size() && !m_SdfSBSIndex[sdfId].keys.empty())
+  {
+    a_start = SBSBrickIndexLookup(sdfId, pos);
+    if (a_start == SBS_INDEX_MISS)
+      return 11.f;
+  }
+#endif
 
-  uint32_t globalAABBId = startEnd[sbs_id].x + EXTRACT_START(leftNodeOffset); // + aabbId
-  uint32_t start_count_packed = m_primIdCount[globalAABBId];
-  uint32_t a_start = EXTRACT_START(start_count_packed);
-  uint32_t a_count = EXTRACT_COUNT(start_count_packed);
+  if (a_start == SBS_INDEX_UNKNOWN)
+  {
+    uint32_t leftNodeOffset = eval_distance_traverse_bvh(sbs_id, pos);
+
+    if (leftNodeOffset == 0xFFFFFFFF)
+      return 11.f; // cannot be used for ST
+    // printf("NodeOffset: %d\n", leftNodeOffset);
+
+    uint32_t globalAABBId = startEnd[sbs_id].x + EXTRACT_START(leftNodeOffset); // + aabbId
+    uint32_t start_count_packed = m_primIdCount[globalAABBId];
+    a_start = EXTRACT_START(start_count_packed);
+  }
 
   #ifdef USE_TRICUBIC
   float values[64];
@@ -2462,7 +2675,6 @@ float BVHRT::eval_distance_sdf_sbs(uint32_t sbs_id, float3 pos)
 
   qNear = 1.0f;
 
-  uint32_t sdfId =  m_geomData[sbs_id].offset.x;
   primId = a_start; //id of bbox in BLAS
   nodeId = primId + m_SdfSBSRoots[sdfId];
   SdfSBSHeader header = m_SdfSBSHeaders[sdfId];
@@ -2493,13 +2705,14 @@ float BVHRT::eval_distance_sdf_sbs(uint32_t sbs_id, float3 pos)
     float3 max_pos = min_pos + d*float3(1,1,1);
     start_q = (pos - min_pos) * (0.5f*sz*header.brick_size);
 
-    load_distance_values(nodeId, voxelPos, v_size, sz_inv, header, values);
+    load_distance_values(sdfId, nodeId, voxelPos, v_size, sz_inv, header, values);
 
 #ifdef USE_TRICUBIC
     float point[3] = {start_q.x, start_q.y, start_q.z};
     res_dist = tricubicInterpolation(values, point);
 #else
     res_dist = eval_dist_trilinear(values, start_q);
+    grad = eval_dist_trilinear_diff(values, start_q) / d;
 #endif
   }
   return res_dist;
@@ -2509,6 +2722,13 @@ float BVHRT::eval_distance_sdf_sbs(uint32_t sbs_id, float3 pos)
 #ifndef DISABLE_SDF_FRAME_OCTREE_COMPACT
 float BVHRT::eval_distance_sdf_coctree_v3(uint32_t octree_id, float3 pos)
 {
+  float3 grad;
+  return eval_distance_and_grad_sdf_coctree_v3(octree_id, pos, grad);
+}
+
+float BVHRT::eval_distance_and_grad_sdf_coctree_v3(uint32_t octree_id, float3 pos, float3 &grad)
+{
+  grad = float3(0,0,0);
 #if ON_CPU==1
   assert(COctreeV3::VERSION == 3); //if version is changed, this function should be revisited, as some changes may be needed
 #endif
@@ -2576,10 +2796,14 @@ float BVHRT::eval_distance_sdf_coctree_v3(uint32_t octree_id, float3 pos)
         float3 max_pos = min_pos + d*float3(1,1,1);
         start_q = (pos - min_pos) * (0.5f*level_sz*header.brick_size);
 
-        float vmin = COctreeV3_LoadDistanceValues(curr_node.nodeId, voxelPos, v_size, sz_inv, header, 0u, values);
+        float vmin = COctreeV3_LoadDistanceValues(curr_node.nodeId, voxelPos, v_size, sz_inv, header, 
+                                                  coctree_v3_header.sim_compression*curr_node.info, values);
 
         if (vmin <= 0.f)
+        {
           res_dist = eval_dist_trilinear(values, start_q);
+          grad = eval_dist_trilinear_diff(values, start_q) / d;
+        }
         else
           res_dist = 13.f;
       }
@@ -2617,6 +2841,11 @@ float BVHRT::eval_distance_sdf_coctree_v3(uint32_t octree_id, float3 pos)
 
 uint32_t BVHRT::eval_distance_traverse_bvh(uint32_t geomId, float3 pos)
 {
+#ifndef KERNEL_SLICER
+  if (geomId < m_quantBvhRoots.size() && m_quantBvhRoots[geomId].escapeIndex != 0)
+    return eval_distance_traverse_bvh_quantized(geomId, pos);
+#endif
+
   const uint32_t bvhOffset = m_geomData[geomId].bvhOffset;
 
   uint32_t stack[STACK_SIZE];
@@ -2743,6 +2972,12 @@ BVHRT::tricubicInterpolationDerrivative(const float grid[64], const float dp[3],
 
 #ifndef DISABLE_SDF_FRAME_OCTREE
 float BVHRT::eval_distance_sdf_frame_octree(uint32_t octree_id, float3 position)
+{
+  float3 grad;
+  return eval_distance_and_grad_sdf_frame_octree(octree_id, position, grad);
+}
+
+float BVHRT::eval_distance_and_grad_sdf_frame_octree(uint32_t octree_id, float3 position, float3 &grad)
 {
   float3 pos = clamp(0.5f*(position + 1.0f), 0.0f, 1.0f);
   uint32_t idx = m_SdfFrameOctreeRoots[octree_id];
@@ -2761,6 +2996,9 @@ float BVHRT::eval_distance_sdf_frame_octree(uint32_t octree_id, float3 position)
   //printf("\n");
   //printf("%u last dp \n",idx);
 
+  //node covers d*2 of [-1,1]^3 cube
+  grad = eval_dist_trilinear_diff(m_SdfFrameOctreeNodes[idx].values, dp) * (0.5f/d);
+
   //bilinear sampling
   return (1-dp.x)*(1-dp.y)*(1-dp.z)*m_SdfFrameOctreeNodes[idx].values[0] + 
          (1-dp.x)*(1-dp.y)*(  dp.z)*m_SdfFrameOctreeNodes[idx].values[1] + 
@@ -3046,6 +3284,15 @@ float BVHRT::COctreeV3_LoadDistanceValues(uint32_t brickOffset, float3 voxelPos,
   //early exit if voxel is not present
   if ((m_SdfCompactOctreeV3Data[brickOffset + PFlagPos/32] & (1u << (PFlagPos%32))) == 0)
     return 1e6f;
+
+#ifndef KERNEL_SLICER
+  if (m_COctreeV3Decoder != nullptr)
+  {
+    m_COctreeV3Decoder(m_SdfCompactOctreeV3Data.data() + brickOffset, voxelPosU, header.brick_pad, header.uv_size, transform_code, values);
+    COctreeV3_RotateCorners(transform_code, values);
+    return -1.0f;
+  }
+#endif
   
   //this voxel is guaranteed to have surface
   const uint32_t line_distances_offset_bits = 16;
@@ -3103,11 +3350,35 @@ float BVHRT::COctreeV3_LoadDistanceValues(uint32_t brickOffset, float3 voxelPos,
     uint32_t dist1 = ((m_SdfCompactOctreeV3Data[brickOffset + off_5 + vId1 / vals_per_int] >> (bits * (vId1 % vals_per_int))) & max_val);
     values[2*i+1] = min_val + range * dist1;
   }
+  COctreeV3_RotateCorners(transform_code, values);
   return -1.0f;
 #endif
   return vmin;
 }
 
+void BVHRT::COctreeV3_RotateCorners(uint32_t transform_code, float values[8] /*in, out*/)
+{
+#ifndef DISABLE_SDF_FRAME_OCTREE_COMPACT
+  //values were loaded in the corner order of the referenced brick,
+  //each corner of the rotated voxel takes the value of the corner it is mapped to
+  if ((transform_code & 0xFF) == 0)
+    return;
+
+  float4x4 rot_transform = m_SdfCompactOctreeRotTransforms[transform_code & 0xFF];
+  float src_values[8];
+  for (int i = 0; i < 8; i++)
+    src_values[i] = values[i];
+
+  for (int i = 0; i < 8; i++)
+  {
+    float3 corner = float3((i & 4) >> 2, (i & 2) >> 1, i & 1) - 0.5f;
+    float3 src_corner = to_float3(rot_transform * to_float4(corner, 0.0f)) + 1.0f; //0.5 to get corner, 0.5 to round
+    uint32_t srcId = (uint32_t(src_corner.x) << 2) | (uint32_t(src_corner.y) << 1) | uint32_t(src_corner.z);
+    values[i] = src_values[srcId];
+  }
+#endif
+}
+
 void BVHRT::COctreeV3_BrickIntersect(uint32_t type, const float3 ray_pos, const float3 ray_dir,
                                      float tNear, uint32_t instId, uint32_t geomId, const COctreeV3Header &header,
                                      uint32_t brickOffset, float3 p, float sz, uint32_t transform_code,
@@ -3408,6 +3679,19 @@ void BVHRT::BVH2TraverseF32(const float3 ray_pos, const float3 ray_dir, float tN
                                 uint32_t instId, uint32_t geomId, bool stopOnFirstHit,
                                 CRT_Hit* pHit)
 {
+#ifndef KERNEL_SLICER
+  if (geomId < m_wideBvhOffsets.size() && m_wideBvhOffsets[geomId] != uint32_t(-1))
+  {
+    BVHWideTraverseF32(ray_pos, ray_dir, tNear, instId, geomId, stopOnFirstHit, pHit);
+    return;
+  }
+  if (geomId < m_quantBvhRoots.size() && m_quantBvhRoots[geomId].escapeIndex != 0)
+  {
+    BVH2QuantizedTraverseF32(ray_pos, ray_dir, tNear, instId, geomId, stopOnFirstHit, pHit);
+    return;
+  }
+#endif
+
   const uint32_t bvhOffset = m_geomData[geomId].bvhOffset;
 
   uint32_t stack[STACK_SIZE];
@@ -90,6 +90,19 @@ struct InstanceData
   float4x4 transformInvTransposed; //for normals
 };
 
+#ifndef KERNEL_SLICER
+#include <functional>
+
+struct SBSPager;
+
+// SoA input of batched ray queries, t_near and t_far can be null (0 and FLT_MAX are used then)
+struct RayBatchSoA
+{
+  const float *pos_x, *pos_y, *pos_z, *t_near;
+  const float *dir_x, *dir_y, *dir_z, *t_far;
+};
+#endif
+
 // main class
 //
 struct BVHRT : public ISceneObject
@@ -144,10 +157,13 @@ struct BVHRT : public ISceneObject
 
   void SetPreset(const MultiRenderPreset& a_preset){ m_preset = a_preset; }
   MultiRenderPreset GetPreset() const { return m_preset; }
+  //angle covered by one pixel, used by LOD_MODE_SCREEN_SPACE; zero disables LOD (e.g. orthographic camera)
+  void SetLodPixelAngle(float a_pixelAngle) { m_lodPixelAngle = a_pixelAngle; }
 
   //common functions for a few Sdf...Function interfaces
 #ifndef KERNEL_SLICER 
   float eval_distance(float3 pos) override;
+  void eval_distance(const float3 *pos, float *dist, unsigned n) override;
 #endif
 
   //overiding SdfGridFunction interface
@@ -172,6 +188,118 @@ struct BVHRT : public ISceneObject
   bool    RayQuery_AnyHitMotion(LiteMath::float4 posAndNear, LiteMath::float4 dirAndFar, float time = 0.0f) override
   { return RayQuery_AnyHit(posAndNear, dirAndFar); }
 
+  //results of SBS brick index lookup, unknown is also the initial value when index is not used (GPU)
+  static constexpr uint32_t SBS_INDEX_MISS    = 0xFFFFFFFF; //point is not inside any brick
+  static constexpr uint32_t SBS_INDEX_UNKNOWN = 0xFFFFFFFE; //point is on a brick border, BLAS should be used
+
+#ifndef KERNEL_SLICER
+  //CPU-only packet traversal, intended for coherent rays (i.e. primary rays from one screen tile)
+  //gives the same result as calling RayQuery_NearestHit for every ray
+  static constexpr uint32_t RAY_PACKET_SIZE = 16;
+  void RayQuery_NearestHitPacket(const float4* posAndNear, const float4* dirAndFar, CRT_Hit* out_hits, uint32_t count);
+  void BVH2TraversePacketF32(const float3* ray_pos, const float3* ray_dir, const float* tNear, uint32_t activeMask,
+                             uint32_t instId, uint32_t geomId, CRT_Hit* pHits);
+  //box test of the whole packet, AVX-512, AVX2 or scalar version is chosen by CPU features. a_allowSIMD = false gives the scalar one
+  using PacketBoxTestFunc = uint32_t (*)(const float* ox, const float* oy, const float* oz,
+                                         const float* ix, const float* iy, const float* iz,
+                                         const float* tNear, const float* tFar,
+                                         float3 boxMin, float3 boxMax, float* tm_out);
+  static PacketBoxTestFunc GetPacketBoxTest(bool a_allowSIMD = true);
+  void SetPacketSIMD(bool a_allowSIMD) { m_packetBoxTest = GetPacketBoxTest(a_allowSIMD); }
+
+  //CPU-only batched queries, rays are sorted by direction octant and origin and traced in parallel chunks
+  //results are returned in the original order of rays
+  void RayQuery_NearestHitBatch(const RayBatchSoA& a_rays, CRT_Hit* out_hits, size_t count);
+  void RayQuery_AnyHitBatch(const RayBatchSoA& a_rays, bool* out_hits, size_t count);
+
+  //streaming variant for ray sets that do not fit in memory. a_source fills up to maxCount rays and returns their number
+  //(0 ends the stream), a_sink receives hits for them in the same order. Returns total number of traced rays
+  using RaySource = std::function<size_t(float4* posAndNear, float4* dirAndFar, size_t maxCount)>;
+  using HitSink   = std::function<void(const CRT_Hit* hits, size_t count)>;
+  size_t RayQuery_NearestHitStream(const RaySource& a_source, const HitSink& a_sink, size_t a_chunkSize = (1u << 20));
+
+  //puts BLAS of geometry to m_allNodePairs and CPU-only wide arrays, or only to quantized arrays, according to build presets
+  void AppendBLAS(uint32_t a_geomId, const std::vector<BVHNodePair>& a_nodes);
+  bool HasCustomCPUBLAS(uint32_t a_geomId) const;
+
+  //CPU-only traversal of wide BLAS, used by BVH2TraverseF32 if geometry has one
+  void AppendWideTreeData(uint32_t a_geomId, const std::vector<BVHNodePair>& a_nodes, int a_width);
+  void BVHWideTraverseF32(const float3 ray_pos, const float3 ray_dir, float tNear, 
+                          uint32_t instId, uint32_t geomId, bool stopOnFirstHit,
+                          CRT_Hit *pHit);
+
+  //CPU-only traversal of quantized BLAS, used by BVH2TraverseF32 and eval_distance_traverse_bvh if geometry has one
+  bool AppendQuantizedTreeData(uint32_t a_geomId, const std::vector<BVHNodePair>& a_nodes, int a_bits);
+  void BVH2QuantizedTraverseF32(const float3 ray_pos, const float3 ray_dir, float tNear, 
+                                uint32_t instId, uint32_t geomId, bool stopOnFirstHit,
+                                CRT_Hit *pHit);
+  uint32_t eval_distance_traverse_bvh_quantized(uint32_t geomId, float3 pos);
+
+  //dynamic scenes: after UpdateInstance, CommitScene refits TLAS in place and rebuilds it
+  //only if its SAH cost became a_threshold times larger than right after the last rebuild
+  void SetTLASRebuildThreshold(float a_threshold) { m_tlasRebuildThreshold = a_threshold; }
+  uint32_t GetTLASRebuildCount() const { return m_tlasRebuildCount; }
+  bool RefitTLAS();
+
+  //O(1) point location in SBS, used by eval_distance_sdf_sbs instead of eval_distance_traverse_bvh if enabled
+  struct SBSBrickIndex
+  {
+    std::vector<uint32_t> lodSizes; //all LODs present in SBS, finest first
+    std::vector<uint64_t> keys;     //open addressing hash table, key is (lod_size, x, y, z) of brick
+    std::vector<uint32_t> bricks;   //brick id for each key
+    uint64_t mask = 0;
+  };
+  void SetSBSPointIndex(bool a_enable) { m_buildSBSPointIndex = a_enable; }
+  void BuildSBSBrickIndex(uint32_t a_sdfId, const SdfSBSView& a_sbs);
+  uint32_t SBSBrickIndexLookup(uint32_t a_sdfId, float3 pos) const;
+
+  //CPU-only per-brick masks of voxels that contain surface (min of 8 corner values <= 0), OctreeBrickIntersect skips
+  //other voxels without decoding them. Mask of a brick is 1 word with number of such voxels and brick_size^3 bits
+  void SetSBSOccupancyMasks(bool a_enable) { m_buildSBSOccupancy = a_enable; }
+  //SBS loaded by AddCustomGeom_FromFile is reordered along Z-order curve if it is not already, unless disabled here
+  void SetSBSMortonReorder(bool a_enable) { m_reorderSBSMorton = a_enable; }
+  void BuildSBSOccupancyMasks(uint32_t a_sdfId, uint32_t a_bricksCount);
+  const uint32_t* SBSOccupancyMask(uint32_t a_sdfId, uint32_t a_brickId) const
+  {
+    if (a_sdfId >= m_SdfSBSOccupancyOffsets.size() || m_SdfSBSOccupancyOffsets[a_sdfId] == uint32_t(-1))
+      return nullptr;
+    const uint32_t brick_size = m_SdfSBSHeaders[a_sdfId].brick_size;
+    const uint32_t wordsPerBrick = 1 + (brick_size*brick_size*brick_size + 31)/32;
+    return m_SdfSBSOccupancy.data() + m_SdfSBSOccupancyOffsets[a_sdfId] + size_t(a_brickId)*wordsPerBrick;
+  }
+
+  //CPU-only out-of-core SBS. Nodes and 8 corner values of each brick (coarse LOD) are resident, brick values are
+  //loaded from SBS container file (see sdf_scene_mapped.h) by a background thread into a fixed-size LRU pool.
+  //Until a brick is resident, its values are interpolated from the coarse LOD. Only distance-only layouts are supported
+  uint32_t AddGeom_SdfSBS_OutOfCore(const std::string& a_containerPath, size_t a_poolBytes, ISceneObject *fake_this);
+  //puts loaded bricks to pool, must be called between frames. a_wait waits until all requested bricks are loaded
+  void UpdateStreaming(bool a_wait = false);
+  bool SBSPageTouch(uint32_t nodeId);
+  float SBSCoarseDistanceValues(uint32_t nodeId, float3 voxelPos, const SdfSBSHeader &header, float values[8]);
+
+  //CPU-only voxel decoders specialized for value size and v_size at compile time, nullptr if combination is not supported.
+  //They are chosen once per geometry in AddGeom_SdfSBS and AddGeom_COctreeV3, a_allowSIMD = false gives the scalar SBS decoder
+  using SBSDecodeFunc       = float (*)(const uint32_t* a_data, uint32_t a_vId0, float a_dMax, float values[8]);
+  using COctreeV3DecodeFunc = void (*)(const uint32_t* a_brick, int3 voxelPosU, uint32_t a_pad, uint32_t a_uvSize,
+                                       uint32_t transform_code, float values[8]);
+  static SBSDecodeFunc       GetSBSDecoder(uint32_t bytes_per_value, uint32_t v_size, bool a_allowSIMD = true);
+  static COctreeV3DecodeFunc GetCOctreeV3Decoder(uint32_t bits_per_value, uint32_t v_size);
+
+  //BLAS of custom geometry is saved to and loaded from a_folder, file name is a hash of boxes and build presets,
+  //so the same model loaded again skips BVH build. Empty folder (default) disables cache
+  void SetBLASCacheFolder(const std::string& a_folder) { m_blasCacheFolder = a_folder; }
+  //BLAS of custom geometry loaded by AddCustomGeom_FromFile is saved next to the model as <model>.blas. Its key is
+  //a hash of file content, loader options and build presets, so boxes are not hashed. Has priority over cache folder
+  void SetBLASSidecarCache(bool a_enable) { m_blasSidecarCache = a_enable; }
+  uint32_t GetBLASCacheHits() const { return m_blasCacheHits; }
+  uint64_t BLASCacheKey(uint32_t a_typeId, const CRT_AABB* boxMinMaxF8, size_t a_boxNumber) const;
+  uint64_t BLASSidecarKey(const char* a_geomTypeName, const char* a_fileName) const;
+  std::string BLASCachePath(uint32_t a_typeId, const CRT_AABB* boxMinMaxF8, size_t a_boxNumber, uint64_t* a_key) const;
+  bool LoadCachedBLAS(const std::string& a_path, uint64_t a_key, size_t a_boxNumber, std::vector<BVHNodePair>& a_nodes) const;
+  void SaveCachedBLAS(const std::string& a_path, uint64_t a_key, size_t a_boxNumber, const std::vector<BVHNodePair>& a_nodes) const;
+  uint32_t LoadCustomGeomFromFile(const char *geom_type_name, const char *filename, ISceneObject *fake_this);
+#endif
+
 //protected:
 
   void IntersectAllPrimitivesInLeaf(const float3 ray_pos, const float3 ray_dir,
@@ -247,6 +375,7 @@ struct BVHRT : public ISceneObject
 
   float COctreeV3_LoadDistanceValues(uint32_t brickOffset, float3 voxelPos, uint32_t v_size, float sz_inv, 
                                      const COctreeV3Header &header, uint32_t transform_code, float values[8]);
+  void  COctreeV3_RotateCorners(uint32_t transform_code, float values[8]);
 
   void COctreeV3_BrickIntersect(uint32_t type, const float3 ray_pos, const float3 ray_dir,
                                 float tNear, uint32_t instId, uint32_t geomId, const COctreeV3Header &header,
@@ -296,28 +425,35 @@ struct BVHRT : public ISceneObject
   virtual float eval_dist_trilinear(const float values[8], float3 dp);
   virtual bool need_normal();
   virtual float2 encode_normal(float3 n);
-  float load_distance_values(uint32_t nodeId, float3 voxelPos, uint32_t v_size, float sz_inv, const SdfSBSHeader &header, float values[8]);
+  float load_distance_values(uint32_t sdfId, uint32_t nodeId, float3 voxelPos, uint32_t v_size, float sz_inv, const SdfSBSHeader &header, float values[8]);
+  float load_brick_corner_values(uint32_t sdfId, uint32_t nodeId, uint32_t v_size, float sz_inv, const SdfSBSHeader &header, float values[8]);
   float load_tricubic_distance_values(uint32_t nodeId, float3 voxelPos, uint32_t v_size, float sz_inv, const SdfSBSHeader &header, float values[64]);
   void tricubicInterpolationDerrivative(const float grid[64], const float dp[3], float d_pos[3], float d_grid[64]);
   float tricubicInterpolation(const float grid[64], const float dp[3]);
 
 #ifndef DISABLE_SDF_GRID
   virtual float eval_distance_sdf_grid(unsigned grid_id, float3 p);
+  float eval_distance_and_grad_sdf_grid(unsigned grid_id, float3 p, float3 &grad);
 #endif 
 #ifndef DISABLE_SDF_SVS
   virtual float eval_distance_sdf_svs(unsigned svs_id, float3 p);
 #endif 
 #ifndef DISABLE_SDF_SBS
   virtual float eval_distance_sdf_sbs(unsigned sbs_id, float3 p);
+  float eval_distance_and_grad_sdf_sbs(unsigned sbs_id, float3 p, float3 &grad);
 #endif 
 #ifndef DISABLE_SDF_FRAME_OCTREE
   virtual float eval_distance_sdf_frame_octree(unsigned octree_id, float3 p);
+  float eval_distance_and_grad_sdf_frame_octree(unsigned octree_id, float3 p, float3 &grad);
 #endif
 #ifndef DISABLE_SDF_FRAME_OCTREE_COMPACT
   virtual float eval_distance_sdf_coctree_v3(unsigned octree_id, float3 p);
+  float eval_distance_and_grad_sdf_coctree_v3(unsigned octree_id, float3 p, float3 &grad);
 #endif
   virtual uint32_t eval_distance_traverse_bvh(uint32_t geom_id, float3 pos);
   virtual float eval_distance_sdf(unsigned type, unsigned prim_id, float3 p);
+  //gradient is analytic derivative of interpolation inside the cell, zero if not available (e.g. tricubic)
+  float eval_distance_and_grad_sdf(unsigned type, unsigned prim_id, float3 p, float3 &grad);
   virtual SdfHit sdf_sphere_tracing(unsigned type, unsigned prim_id, const float3 &min_pos, const float3 &max_pos,
                                     float tNear, const float3 &pos, const float3 &dir, bool need_norm);    
 
@@ -479,6 +615,49 @@ std::vector<OpenVDB_Grid> m_VDBData;
   //Bottom Level Acceleration Structure
   std::vector<BVHNodePair> m_allNodePairs;
 
+#ifndef KERNEL_SLICER
+  //CPU-only wide BLAS, built in addition to m_allNodePairs when BuilderPresets::blasWidth is 4 or 8.
+  //Boxes are full precision and binary BLAS is kept for point queries, so it costs memory and saves only node fetches
+  std::vector< BVHNodeWide<4> > m_allNodesWide4;
+  std::vector< BVHNodeWide<8> > m_allNodesWide8;
+  std::vector<uint32_t>         m_wideBvhOffsets; //for each geometry root offset in m_allNodesWide4/8 or uint32_t(-1) if it has no wide BLAS
+
+  //CPU-only quantized BLAS, built instead of m_allNodePairs when BuilderPresets::quantBits is 8 or 16
+  std::vector< BVHNodePairQuantized<uint8_t> >  m_allNodePairsQ8;
+  std::vector< BVHNodePairQuantized<uint16_t> > m_allNodePairsQ16;
+  std::vector<BVHNode>                          m_quantBvhRoots; //for each geometry box of root pair, offset in m_allNodePairsQ8/16 
+                                                                 //(in leftOffset) and number of bits (in escapeIndex, 0 if not quantized)
+
+  //TLAS refit state
+  bool     m_tlasRefitNeeded      = false; //set by UpdateInstance
+  uint32_t m_tlasInstanceCount    = 0;     //number of instances TLAS was built for
+  float    m_tlasBuildSAH         = 0.0f;  //SAH cost of TLAS right after the last rebuild
+  float    m_tlasRebuildThreshold = 1.5f;
+  uint32_t m_tlasRebuildCount     = 0;
+
+  std::string m_blasCacheFolder;
+  uint32_t    m_blasCacheHits = 0;
+  bool        m_blasSidecarCache = false;
+  std::string m_blasSidecarPath; //set only while AddCustomGeom_FromFile loads a model, used by its first custom geometry
+  uint64_t    m_blasSidecarKey = 0;
+
+  std::vector<SBSDecodeFunc> m_SdfSBSDecoders;              //one for each SBS, nullptr if generic decoding is used
+  COctreeV3DecodeFunc        m_COctreeV3Decoder = nullptr;
+  PacketBoxTestFunc          m_packetBoxTest    = GetPacketBoxTest();
+
+  bool m_buildSBSPointIndex = true;
+  std::vector<SBSBrickIndex> m_SdfSBSIndex; //one for each SBS, empty if index was not built
+
+  bool m_buildSBSOccupancy = true;
+  std::vector<uint32_t> m_SdfSBSOccupancy;        //occupancy masks of all bricks
+  std::vector<uint32_t> m_SdfSBSOccupancyOffsets; //offset in m_SdfSBSOccupancy for each SBS, -1 if masks were not built
+
+  bool m_reorderSBSMorton = true;
+
+  std::vector<std::shared_ptr<SBSPager>> m_sbsPagers;
+  std::vector<uint2> m_SdfSBSNodePages; //(pager id, block id) for each SBS node, (-1,-1) if node is always resident
+#endif
+
 
   // Format name the tree build from
   const std::string m_buildName;
@@ -488,6 +667,7 @@ std::vector<OpenVDB_Grid> m_VDBData;
   bool debug_cur_pixel = false;
   
   MultiRenderPreset m_preset;
+  float m_lodPixelAngle = 0.0f;
 
   static constexpr uint32_t m_bitcount[256] = {
     0,1,1,2,1,2,2,3,1,2,2,3,2,3,3,4,1,2,2,3,2,3,3,4,2,3,3,4,3,4,4,5,
@@ -12,6 +12,7 @@
 #include "BVH2Common.h"
 #include "../nurbs/nurbs_common_host.h"
 #include "../utils/sparse_octree_builder.h"
+#include "../sdfScene/sdf_scene_mapped.h"
 #include "../catmul_clark/catmul_clark_host.h"
 #include "../ribbon/ribbon_host.h"
 
@@ -101,6 +102,13 @@ void BVHRT::ClearGeom()
   m_allNodePairs.reserve(std::max<std::size_t>(100000, m_allNodePairs.capacity()));
   m_allNodePairs.resize(0);
 
+  m_allNodesWide4.resize(0);
+  m_allNodesWide8.resize(0);
+  m_wideBvhOffsets.resize(0);
+  m_allNodePairsQ8.resize(0);
+  m_allNodePairsQ16.resize(0);
+  m_quantBvhRoots.resize(0);
+
   m_abstractObjects.reserve(reserveSize);
   m_abstractObjects.resize(0);
 
@@ -108,6 +116,19 @@ void BVHRT::ClearGeom()
 }
 
 uint32_t BVHRT::AddCustomGeom_FromFile(const char *geom_type_name, const char *filename, ISceneObject *fake_this)
+{
+  //sidecar key is computed from the file itself, before boxes are derived from it
+  if (m_blasSidecarCache)
+  {
+    m_blasSidecarPath = std::string(filename) + ".blas";
+    m_blasSidecarKey  = BLASSidecarKey(geom_type_name, filename);
+  }
+  const uint32_t geomId = LoadCustomGeomFromFile(geom_type_name, filename, fake_this);
+  m_blasSidecarPath.clear();
+  return geomId;
+}
+
+uint32_t BVHRT::LoadCustomGeomFromFile(const char *geom_type_name, const char *filename, ISceneObject *fake_this)
 {
   std::string name = geom_type_name;
   if (name == "sdf")
@@ -128,6 +149,13 @@ uint32_t BVHRT::AddCustomGeom_FromFile(const char *geom_type_name, const char *f
   else if (name == "sdf_frame_octree")
   {
     std::cout << "[LoadScene]: sdf frame octree = " << filename << std::endl;
+    if (is_sdf_container(filename))
+    {
+      MappedSdfScene mapped;
+      if (!mapped.open(filename) || mapped.type() != SDF_CONTAINER_FRAME_OCTREE)
+        return 0;
+      return AddGeom_SdfFrameOctree(mapped.frame_octree_view(), fake_this);
+    }
     std::vector<SdfFrameOctreeNode> scene;
     load_sdf_frame_octree(scene, filename);
     return AddGeom_SdfFrameOctree(scene, fake_this);
@@ -142,8 +170,18 @@ uint32_t BVHRT::AddCustomGeom_FromFile(const char *geom_type_name, const char *f
   else if (name == "sdf_sbs")
   {
     std::cout << "[LoadScene]: sdf sbs = " << filename << std::endl;
+    if (is_sdf_container(filename))
+    {
+      //data is copied to BVHRT directly from mapped pages, no Morton reorder here as it needs a full copy
+      MappedSdfScene mapped;
+      if (!mapped.open(filename) || mapped.type() != SDF_CONTAINER_SBS)
+        return 0;
+      return AddGeom_SdfSBS(mapped.sbs_view(), fake_this);
+    }
     SdfSBS scene;
     load_sdf_SBS(scene, filename);
+    if (m_reorderSBSMorton && !is_sbs_morton_ordered(scene))
+      reorder_sbs_morton(scene); //for cache-coherent traversal
     return AddGeom_SdfSBS(scene, fake_this);
   }
   else if (name == "sdf_hp")
@@ -171,6 +209,13 @@ uint32_t BVHRT::AddCustomGeom_FromFile(const char *geom_type_name, const char *f
   else if (name == "sdf_coctree_v3")
   {
     std::cout << "[LoadScene]: SDF compact octree = " << filename << std::endl;
+    if (is_sdf_container(filename))
+    {
+      MappedSdfScene mapped;
+      if (!mapped.open(filename) || mapped.type() != SDF_CONTAINER_COCTREE_V3)
+        return 0;
+      return AddGeom_COctreeV3(mapped.coctree_v3_view(), 0, fake_this);
+    }
     COctreeV3 scene;
     load_coctree_v3(scene, filename);
     return AddGeom_COctreeV3(scene, 0, fake_this);
@@ -182,9 +227,33 @@ uint32_t BVHRT::AddCustomGeom_FromFile(const char *geom_type_name, const char *f
   return 0;
 }
 
+void BVHRT::AppendBLAS(uint32_t a_geomId, const std::vector<BVHNodePair>& a_nodes)
+{
+  auto presets = BuilderPresetsFromString(m_buildName.c_str());
+  AppendWideTreeData(a_geomId, a_nodes, presets.blasWidth);
+
+  //wide BLAS is built from full precision nodes, so quantization is used only for binary one
+  bool quantized = false;
+  if (presets.blasWidth == 2)
+    quantized = AppendQuantizedTreeData(a_geomId, a_nodes, presets.quantBits);
+  else if (presets.quantBits != 0)
+    printf("[BVHRT::AppendBLAS] quantized BLAS is not supported for wide BLAS, full precision is used\n");
+
+  //quantized BLAS has its own ray and point traversal and replaces full precision one, so it is not stored.
+  //GPU kernels and diff render traverse only full precision nodes, that's why quantized presets are CPU-only
+  if (!quantized)
+    m_allNodePairs.insert(m_allNodePairs.end(), a_nodes.begin(), a_nodes.end());
+}
+
+bool BVHRT::HasCustomCPUBLAS(uint32_t a_geomId) const
+{
+  return (a_geomId < m_wideBvhOffsets.size() && m_wideBvhOffsets[a_geomId] != uint32_t(-1)) ||
+         (a_geomId < m_quantBvhRoots.size()  && m_quantBvhRoots[a_geomId].escapeIndex != 0);
+}
+
 void BVHRT::AppendTreeData(const std::vector<BVHNodePair>& a_nodes, const std::vector<uint32_t>& a_indices, const uint32_t *a_triIndices, size_t a_indNumber)
 {
-  m_allNodePairs.insert(m_allNodePairs.end(), a_nodes.begin(), a_nodes.end());
+  AppendBLAS(uint32_t(startEnd.size()), a_nodes);
   m_primIndices.insert(m_primIndices.end(), a_indices.begin(), a_indices.end());
   
   const size_t oldIndexSize  = m_indices.size();
@@ -264,11 +333,24 @@ void BVHRT::UpdateGeom_Triangles3f(uint32_t a_geomId, const float *a_vpos3f, siz
 uint32_t BVHRT::AddGeom_AABB(uint32_t a_typeId, const CRT_AABB* boxMinMaxF8, size_t a_boxNumber, void** a_customPrimPtrs, size_t a_customPrimCount)
 {
   // append data to global arrays and fix offsets
-  auto presets = BuilderPresetsFromString(m_buildName.c_str());
-  auto layout  = LayoutPresetsFromString(m_layoutName.c_str());
-  auto bvhData = BuildBVHFatCustom((const BVHNode*)boxMinMaxF8, a_boxNumber, presets, layout);
+  std::vector<BVHNodePair> nodes;
+  uint64_t cacheKey = 0;
+  const std::string cachePath = BLASCachePath(a_typeId, boxMinMaxF8, a_boxNumber, &cacheKey);
+  m_blasSidecarPath.clear(); //one sidecar per model file
+  if (!cachePath.empty() && LoadCachedBLAS(cachePath, cacheKey, a_boxNumber, nodes))
+  {
+    m_blasCacheHits++;
+  }
+  else
+  {
+    auto presets = BuilderPresetsFromString(m_buildName.c_str());
+    auto layout  = LayoutPresetsFromString(m_layoutName.c_str());
+    nodes = BuildBVHFatCustom((const BVHNode*)boxMinMaxF8, a_boxNumber, presets, layout).nodes;
+    if (!cachePath.empty())
+      SaveCachedBLAS(cachePath, cacheKey, a_boxNumber, nodes);
+  }
   
-  m_allNodePairs.insert(m_allNodePairs.end(), bvhData.nodes.begin(), bvhData.nodes.end());
+  AppendBLAS(uint32_t(startEnd.size()), nodes);
 
   const size_t oldSize = m_primIdCount.size();
   m_primIdCount.resize(oldSize + a_boxNumber);
@@ -615,11 +697,13 @@ uint32_t BVHRT::AddGeom_SdfSBS(SdfSBSView octree, ISceneObject *fake_this, Build
   unsigned v_offset = m_SdfSBSData.size();
   m_SdfSBSRoots.push_back(n_offset);
   m_SdfSBSHeaders.push_back(octree.header);
+  m_SdfSBSDecoders.push_back(GetSBSDecoder(octree.header.bytes_per_value, octree.header.brick_size + 2*octree.header.brick_pad + 1));
   m_SdfSBSNodes.insert(m_SdfSBSNodes.end(), octree.nodes, octree.nodes + octree.size);
   m_SdfSBSData.insert(m_SdfSBSData.end(), octree.values, octree.values + octree.values_count);
 
   for (int i=n_offset; i<m_SdfSBSNodes.size(); i++)
     m_SdfSBSNodes[i].data_offset += v_offset;
+
   
   if (node_layout == SDF_SBS_NODE_LAYOUT_ID32F_IRGB32F|| 
       node_layout == SDF_SBS_NODE_LAYOUT_ID32F_IRGB32F_IN) //indexed layout reqires float values
@@ -636,6 +720,11 @@ uint32_t BVHRT::AddGeom_SdfSBS(SdfSBSView octree, ISceneObject *fake_this, Build
     assert(octree.values_f_count == 0);
   }
 
+  if (m_buildSBSPointIndex)
+    BuildSBSBrickIndex(m_SdfSBSRoots.size() - 1, octree);
+  if (m_buildSBSOccupancy)
+    BuildSBSOccupancyMasks(m_SdfSBSRoots.size() - 1, octree.size);
+
   //create list of bboxes for BLAS
   std::vector<BVHNode> orig_nodes;
 
@@ -1299,7 +1388,7 @@ void add_border_nodes_rec(COctreeV3View octree, uint32_t max_bvh_level,
         float ch_d = d / 2;
         float3 ch_p = 2 * p + float3((i & 4) >> 2, (i & 2) >> 1, i & 1);
         add_border_nodes_rec(octree, max_bvh_level, nodes, octree.data[nodeId + child_pos], ch_p, ch_d, level+1);
-        child_pos++;
+        child_pos += 1 + octree.header.sim_compression;
       }
     }
   }
@@ -1314,9 +1403,27 @@ std::vector<BVHNode> GetBoxes_COctreeV3(COctreeV3View octree, uint32_t max_bvh_l
   return nodes;
 }
 
-void initialize_rot_transforms(std::vector<float4x4> &rot_transforms, int v_size)
+//transform with code r maps voxel of the brick that references another brick to voxel of that brick:
+//u[j] = v[perm[j]] or brick_size-1-v[perm[j]], where perm = r/8 and flipped axes are bits of r%8 (x - 4, y - 2, z - 1).
+//Same codes are produced by sdf_converter::compact_octree_v3_similarity_compression
+void initialize_rot_transforms(std::vector<float4x4> &rot_transforms, int brick_size)
 {
+  const int perms[6][3] = {{0,1,2}, {0,2,1}, {1,0,2}, {1,2,0}, {2,0,1}, {2,1,0}};
+
   rot_transforms.resize(BVHRT::ROT_COUNT, float4x4());
+  for (int r = 0; r < BVHRT::ROT_COUNT; r++)
+  {
+    float4x4 rot;
+    for (int j = 0; j < 3; j++)
+    {
+      bool flip = (r % 8) & (4 >> j);
+      for (int k = 0; k < 3; k++)
+        rot(j, k) = 0.0f;
+      rot(j, perms[r / 8][j]) = flip ? -1.0f : 1.0f;
+      rot(j, 3) = flip ? float(brick_size - 1) : 0.0f;
+    }
+    rot_transforms[r] = rot;
+  }
 }
 
 uint32_t BVHRT::AddGeom_COctreeV3(COctreeV3View octree, unsigned bvh_level, ISceneObject *fake_this, BuildOptions a_qualityLevel)
@@ -1325,14 +1432,14 @@ uint32_t BVHRT::AddGeom_COctreeV3(COctreeV3View octree, unsigned bvh_level, ISce
   assert(COctreeV3::VERSION == 3); //if version is changed, this function should be revisited, as some changes may be needed
 #endif
 
-  int v_size = octree.header.brick_size + 2 * octree.header.brick_pad + 1;
-  initialize_rot_transforms(m_SdfCompactOctreeRotTransforms, v_size);
+  initialize_rot_transforms(m_SdfCompactOctreeRotTransforms, octree.header.brick_size);
 
   assert(m_SdfCompactOctreeV1Data.size() == 0); //only one compact octree per scene is supported
   assert(octree.size > 0);
   assert(octree.size < (1u<<28)); //huge grids shouldn't be here
 
   coctree_v3_header = octree.header;
+  m_COctreeV3Decoder = GetCOctreeV3Decoder(octree.header.bits_per_value, octree.header.brick_size + 2*octree.header.brick_pad + 1);
 
   //SDF octree is always a unit cube
   float4 mn = float4(-1,-1,-1,1);
@@ -1413,29 +1520,100 @@ void DebugPrintBoxes(const std::vector<Box4f>& nodes, const std::string& a_fileN
   } 
 }
 
-void BVHRT::CommitScene(uint32_t a_qualityLevel)
+static float box_surface_area(float3 boxMin, float3 boxMax)
 {
-  assert(m_instanceData.size() > 0);
+  const float3 d = max(boxMax - boxMin, float3(0,0,0));
+  return 2.0f*(d.x*d.y + d.y*d.z + d.z*d.x);
+}
 
-  //if there is only 1 instance, there is no need in TLAS
-  if (m_instanceData.size() > 1)
+//SAH cost of TLAS in BVH2_LEFT_OFFSET layout, root is not stored and nodes 0 and 1 are its children
+static float tlas_sah_cost(const std::vector<BVHNode>& a_nodes)
+{
+  const float C_TRAV = 1.0f;
+  const float C_INST = 2.0f; //entering an instance means transforming the ray and starting BLAS traversal
+
+  float cost = 0.0f;
+  for (const auto& node : a_nodes)
   {
-    std::vector<Box4f> instBoxes(m_instanceData.size());
-    for (size_t i = 0; i < m_instanceData.size(); i++)
-      instBoxes[i] = Box4f(m_instanceData[i].boxMin, m_instanceData[i].boxMax);
-    
-    BuilderPresets presets = {BVH2_LEFT_OFFSET, BVHQuality::HIGH, 1};
-    m_nodesTLAS = BuildBVH((const BVHNode *)instBoxes.data(), instBoxes.size(), presets).nodes;
+    if (node.escapeIndex == LEAF_NORMAL) //dummy node
+      continue;
+    cost += box_surface_area(node.boxMin, node.boxMax)*(((node.leftOffset & LEAF_BIT) == 0) ? C_TRAV : C_INST);
   }
-  else
+
+  const float rootArea = box_surface_area(min(a_nodes[0].boxMin, a_nodes[1].boxMin), max(a_nodes[0].boxMax, a_nodes[1].boxMax));
+  return rootArea > 0.0f ? cost/rootArea : 0.0f;
+}
+
+bool BVHRT::RefitTLAS()
+{
+  if (m_instanceData.size() == 1)
   {
-    m_nodesTLAS.emplace_back();
     m_nodesTLAS[0].boxMin = to_float3(m_instanceData[0].boxMin);
     m_nodesTLAS[0].boxMax = to_float3(m_instanceData[0].boxMax);
-    m_nodesTLAS[0].leftOffset = LEAF_BIT;
-    m_nodesTLAS[0].escapeIndex = LEAF_NORMAL;
+    return true;
+  }
+
+  //children are always stored after their parent, so going backwards updates the tree bottom-up
+  for (int i = int(m_nodesTLAS.size()) - 1; i >= 0; i--)
+  {
+    BVHNode& node = m_nodesTLAS[i];
+    if (node.escapeIndex == LEAF_NORMAL) //dummy node
+      continue;
+
+    if ((node.leftOffset & LEAF_BIT) != 0)
+    {
+      const InstanceData& instance = m_instanceData[EXTRACT_START(node.leftOffset)];
+      node.boxMin = to_float3(instance.boxMin);
+      node.boxMax = to_float3(instance.boxMax);
+    }
+    else
+    {
+      node.boxMin = min(m_nodesTLAS[node.leftOffset].boxMin, m_nodesTLAS[node.leftOffset + 1].boxMin);
+      node.boxMax = max(m_nodesTLAS[node.leftOffset].boxMax, m_nodesTLAS[node.leftOffset + 1].boxMax);
+    }
+  }
+
+  return tlas_sah_cost(m_nodesTLAS) <= m_tlasRebuildThreshold*m_tlasBuildSAH;
+}
+
+void BVHRT::CommitScene(uint32_t a_qualityLevel)
+{
+  assert(m_instanceData.size() > 0);
+
+  //if only instance transforms were changed since the last commit, refitting TLAS is enough
+  //until it becomes too bad, then it is rebuilt with fast builder, as scene is likely animated
+  const bool onlyTransformsChanged = !m_firstSceneCommit && m_tlasInstanceCount == uint32_t(m_instanceData.size());
+  bool needRebuild = !onlyTransformsChanged;
+  if (onlyTransformsChanged && m_tlasRefitNeeded)
+    needRebuild = !RefitTLAS();
+
+  if (needRebuild)
+  {
+    //if there is only 1 instance, there is no need in TLAS
+    if (m_instanceData.size() > 1)
+    {
+      std::vector<Box4f> instBoxes(m_instanceData.size());
+      for (size_t i = 0; i < m_instanceData.size(); i++)
+        instBoxes[i] = Box4f(m_instanceData[i].boxMin, m_instanceData[i].boxMax);
+      
+      BuilderPresets presets = {BVH2_LEFT_OFFSET, onlyTransformsChanged ? BVHQuality::LOW : BVHQuality::HIGH, 1};
+      m_nodesTLAS = BuildBVH((const BVHNode *)instBoxes.data(), instBoxes.size(), presets).nodes;
+      m_tlasBuildSAH = tlas_sah_cost(m_nodesTLAS);
+    }
+    else
+    {
+      m_nodesTLAS.resize(1);
+      m_nodesTLAS[0].boxMin = to_float3(m_instanceData[0].boxMin);
+      m_nodesTLAS[0].boxMax = to_float3(m_instanceData[0].boxMax);
+      m_nodesTLAS[0].leftOffset = LEAF_BIT;
+      m_nodesTLAS[0].escapeIndex = LEAF_NORMAL;
+      m_tlasBuildSAH = 0.0f;
+    }
+    m_tlasInstanceCount = uint32_t(m_instanceData.size());
+    m_tlasRebuildCount++;
   }
 
+  m_tlasRefitNeeded = false;
   m_firstSceneCommit = false;
 
   //Create a vector of pointers from geom data
@@ -1488,7 +1666,7 @@ uint32_t BVHRT::AddInstance(uint32_t a_geomId, const float4x4 &a_matrix)
 
 void BVHRT::UpdateInstance(uint32_t a_instanceId, const float4x4 &a_matrix)
 {
-  if(a_instanceId > m_instanceData.size())
+  if(a_instanceId >= m_instanceData.size())
   {
     std::cout << "[BVHRT::UpdateInstance]: " << "bad instance id == " << a_instanceId << "; size == " << m_instanceData.size() << std::endl;
     return;
@@ -1518,6 +1696,10 @@ void BVHRT::UpdateInstance(uint32_t a_instanceId, const float4x4 &a_matrix)
   m_instanceData[a_instanceId].boxMax = newBox.boxMax;
   m_instanceData[a_instanceId].transform = a_matrix;
   m_instanceData[a_instanceId].transformInv = inverse4x4(a_matrix);
+  m_instanceData[a_instanceId].transformInvTransposed = transpose(inverse4x4(a_matrix));
+
+  //TLAS is refitted in CommitScene, so many instances can be updated at once
+  m_tlasRefitNeeded = true;
 }
 
 std::vector<BVHNode> BVHRT::GetBoxes_SdfGrid(SdfGridView grid)
@@ -1772,10 +1954,19 @@ float BVHRT::eval_distance(float3 pos)
 {
   if (!m_SdfGridData.empty())
     return eval_distance_sdf_grid(0, pos);
+  if (!m_SdfSBSRoots.empty() && m_geomData[0].type == TYPE_SDF_SBS)
+    return eval_distance_sdf_sbs(0, pos);
 
   return 1e6; 
 }
 
+void BVHRT::eval_distance(const float3 *pos, float *dist, unsigned n)
+{
+  #pragma omp parallel for schedule(static)
+  for (int i = 0; i < int(n); i++)
+    dist[i] = eval_distance(pos[i]);
+}
+
 //SdfGridFunction interface implementation
 void BVHRT::init(SdfGridView grid)
 {
@@ -1791,6 +1982,13 @@ std::shared_ptr<ISdfGridFunction> get_SdfGridFunction(SdfGridView scene)
   return rt;    
 }
 
+std::shared_ptr<ISdfGridFunction> get_SdfSBSFunction(SdfSBSView scene)
+{
+  std::shared_ptr<BVHRT> rt(new BVHRT("cbvh_embree2", "SuperTreeletAlignedMerged4"));
+  rt->AddGeom_SdfSBS(scene, rt.get());
+  return rt;
+}
+
 ISceneObject* MakeBVH2CommonRT(const char* a_implName, const char* a_buildName, const char* a_layoutName) 
 {
   return new BVHRT(a_buildName, a_layoutName); 
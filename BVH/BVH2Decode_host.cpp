@@ -0,0 +1,185 @@
+#include <algorithm>
+#include <array>
+#include <utility>
+
+//AVX2 decoder is compiled with target attribute and chosen at runtime, so it does not need -mavx2
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define SBS_DECODE_AVX2
+#include <immintrin.h>
+#endif
+
+#include "BVH2Common.h"
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// CPU-only decoders of voxel values, specialized for every value size and brick size at compile time, so that
+// all divisions, modulos and offsets of 8 voxel corners become constants. Decoder is chosen once for every
+// geometry by its header values. Brick layouts are the same as in load_distance_values and COctreeV3_LoadDistanceValues
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+static constexpr uint32_t MAX_DECODE_V_SIZE = 20; //brick_size up to 16 with brick_pad up to 1
+
+static constexpr uint32_t const_log2(uint32_t v) { return v <= 1 ? 0 : 1 + const_log2(v / 2); }
+
+template<uint32_t BPV, uint32_t V_SIZE>
+struct SBSDecodeConsts
+{
+  static constexpr uint32_t VALS_PER_INT = 4 / BPV;
+  static constexpr uint32_t BITS         = 8 * BPV;
+  static constexpr uint32_t MAX_VAL      = BPV == 4 ? 0xFFFFFFFFu : ((1u << BITS) - 1);
+  //  (000) (001) (010) (011) (100) (101) (110) (111)
+  static constexpr uint32_t V2 = V_SIZE*V_SIZE;
+  static constexpr uint32_t offsets[8] = {0, 1, V_SIZE, V_SIZE + 1, V2, V2 + 1, V2 + V_SIZE, V2 + V_SIZE + 1};
+};
+
+template<uint32_t BPV, uint32_t V_SIZE>
+static float sbs_decode(const uint32_t* a_data, uint32_t a_vId0, float a_dMax, float values[8])
+{
+  using C = SBSDecodeConsts<BPV, V_SIZE>;
+  const float mult = 2 * a_dMax / C::MAX_VAL;
+
+  float vmin = 1e6f;
+  for (int i = 0; i < 8; i++)
+  {
+    const uint32_t vId = a_vId0 + C::offsets[i];
+    values[i] = -a_dMax + mult * ((a_data[vId / C::VALS_PER_INT] >> (C::BITS * (vId % C::VALS_PER_INT))) & C::MAX_VAL);
+    vmin = std::min(vmin, values[i]);
+  }
+  return vmin;
+}
+
+#ifdef SBS_DECODE_AVX2
+//all 8 corners are gathered at once, only for 1 and 2 bytes per value as they fit into signed int
+template<uint32_t BPV, uint32_t V_SIZE>
+__attribute__((target("avx2")))
+static float sbs_decode_avx2(const uint32_t* a_data, uint32_t a_vId0, float a_dMax, float values[8])
+{
+  using C = SBSDecodeConsts<BPV, V_SIZE>;
+  const float mult = 2 * a_dMax / C::MAX_VAL;
+
+  const __m256i vId    = _mm256_add_epi32(_mm256_set1_epi32(int(a_vId0)),
+                                          _mm256_setr_epi32(C::offsets[0], C::offsets[1], C::offsets[2], C::offsets[3],
+                                                            C::offsets[4], C::offsets[5], C::offsets[6], C::offsets[7]));
+  const __m256i word   = _mm256_srli_epi32(vId, const_log2(C::VALS_PER_INT));
+  const __m256i shift  = _mm256_slli_epi32(_mm256_and_si256(vId, _mm256_set1_epi32(C::VALS_PER_INT - 1)), const_log2(C::BITS));
+  const __m256i packed = _mm256_i32gather_epi32((const int*)a_data, word, 4);
+  const __m256i q      = _mm256_and_si256(_mm256_srlv_epi32(packed, shift), _mm256_set1_epi32(C::MAX_VAL));
+  const __m256  v      = _mm256_add_ps(_mm256_set1_ps(-a_dMax), _mm256_mul_ps(_mm256_set1_ps(mult), _mm256_cvtepi32_ps(q)));
+  _mm256_storeu_ps(values, v);
+
+  __m128 m = _mm_min_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+  m = _mm_min_ps(m, _mm_movehl_ps(m, m));
+  m = _mm_min_ss(m, _mm_shuffle_ps(m, m, 1));
+  return std::min(1e6f, _mm_cvtss_f32(m));
+}
+#endif
+
+template<uint32_t BITS, uint32_t V_SIZE>
+static void coctree_v3_decode(const uint32_t* a_brick, int3 voxelPosU, uint32_t a_pad, uint32_t a_uvSize,
+                              uint32_t transform_code, float values[8])
+{
+  constexpr uint32_t VALS_PER_INT      = 32 / BITS;
+  constexpr uint32_t MAX_VAL           = BITS == 32 ? 0xFFFFFFFFu : ((1u << BITS) - 1);
+  constexpr uint32_t SLICE_FLAGS_UINTS = (V_SIZE * V_SIZE + 32 - 1) / 32;
+  constexpr uint32_t FLAGS_UINTS       = V_SIZE * SLICE_FLAGS_UINTS;
+  constexpr uint32_t OFFSETS_UINTS     = (V_SIZE + 2 - 1) / 2; // 16 bits for slice offset
+
+  //<presence_flags><distance_flags><distance_offsets><min value and range><texture coordinates><distances>
+  const uint32_t p_size = V_SIZE - 1;
+  const uint32_t off_1  = (p_size * p_size * p_size + 32 - 1) / 32;
+  const uint32_t off_2  = off_1 + FLAGS_UINTS;
+  const uint32_t off_3  = off_2 + OFFSETS_UINTS;
+  const uint32_t off_5  = off_3 + 2 + 8 * a_uvSize;
+  const uint32_t* distances = a_brick + off_5;
+
+  const float add_transform = (transform_code & 0x80000000u) > 0 ? float(transform_code & 0x7FFFFF00u) / float(0x7FFFFF00u) : 0.0f;
+  const float min_val = -float(a_brick[off_3 + 0]) / float(0xFFFFFFFFu) + add_transform;
+  const float range   =  (float(a_brick[off_3 + 1]) / float(0xFFFFFFFFu)) / MAX_VAL;
+
+  for (int i = 0; i < 4; i++)
+  {
+    const uint32_t sliceId = voxelPosU.x + ((i & 2) >> 1) + a_pad;
+    const uint32_t localId = (voxelPosU.y + (i & 1) + a_pad) * V_SIZE + voxelPosU.z + a_pad;
+    const uint32_t* flags  = a_brick + off_1 + SLICE_FLAGS_UINTS * sliceId;
+
+    const uint32_t b0 = bitCount(localId > 31 ? flags[0] : flags[0] & ((1u << localId) - 1));
+    const uint32_t b1 = bitCount(localId > 32 ? flags[1] & ((1u << (localId - 32)) - 1) : 0u);
+    const uint32_t sliceOffset = (a_brick[off_2 + sliceId / 2] >> (16 * (sliceId % 2))) & 0xFFFFu;
+
+    const uint32_t vId0 = sliceOffset + b0 + b1;
+    const uint32_t vId1 = vId0 + 1;
+    values[2*i+0] = min_val + range * ((distances[vId0 / VALS_PER_INT] >> (BITS * (vId0 % VALS_PER_INT))) & MAX_VAL);
+    values[2*i+1] = min_val + range * ((distances[vId1 / VALS_PER_INT] >> (BITS * (vId1 % VALS_PER_INT))) & MAX_VAL);
+  }
+}
+
+template<uint32_t BPV, uint32_t... V>
+static constexpr std::array<BVHRT::SBSDecodeFunc, sizeof...(V)> make_sbs_decoders(std::integer_sequence<uint32_t, V...>)
+{
+  return {{ &sbs_decode<BPV, V>... }};
+}
+
+#ifdef SBS_DECODE_AVX2
+template<uint32_t BPV, uint32_t... V>
+static constexpr std::array<BVHRT::SBSDecodeFunc, sizeof...(V)> make_sbs_decoders_avx2(std::integer_sequence<uint32_t, V...>)
+{
+  return {{ &sbs_decode_avx2<BPV, V>... }};
+}
+#endif
+
+template<uint32_t BITS, uint32_t... V>
+static constexpr std::array<BVHRT::COctreeV3DecodeFunc, sizeof...(V)> make_coctree_v3_decoders(std::integer_sequence<uint32_t, V...>)
+{
+  return {{ &coctree_v3_decode<BITS, V>... }};
+}
+
+using DecodeSizes = std::make_integer_sequence<uint32_t, MAX_DECODE_V_SIZE + 1>;
+
+BVHRT::SBSDecodeFunc BVHRT::GetSBSDecoder(uint32_t bytes_per_value, uint32_t v_size, bool a_allowSIMD)
+{
+  static const auto decoders1 = make_sbs_decoders<1>(DecodeSizes());
+  static const auto decoders2 = make_sbs_decoders<2>(DecodeSizes());
+  static const auto decoders4 = make_sbs_decoders<4>(DecodeSizes());
+
+  if (v_size < 2 || v_size > MAX_DECODE_V_SIZE)
+    return nullptr;
+
+#ifdef SBS_DECODE_AVX2
+  static const auto decoders1_avx2 = make_sbs_decoders_avx2<1>(DecodeSizes());
+  static const auto decoders2_avx2 = make_sbs_decoders_avx2<2>(DecodeSizes());
+  static const bool has_avx2 = __builtin_cpu_supports("avx2");
+
+  if (a_allowSIMD && has_avx2 && bytes_per_value == 1)
+    return decoders1_avx2[v_size];
+  if (a_allowSIMD && has_avx2 && bytes_per_value == 2)
+    return decoders2_avx2[v_size];
+#endif
+
+  switch (bytes_per_value)
+  {
+    case 1: return decoders1[v_size];
+    case 2: return decoders2[v_size];
+    case 4: return decoders4[v_size];
+    default: return nullptr;
+  }
+}
+
+BVHRT::COctreeV3DecodeFunc BVHRT::GetCOctreeV3Decoder(uint32_t bits_per_value, uint32_t v_size)
+{
+  static const auto decoders6  = make_coctree_v3_decoders<6>(DecodeSizes());
+  static const auto decoders8  = make_coctree_v3_decoders<8>(DecodeSizes());
+  static const auto decoders10 = make_coctree_v3_decoders<10>(DecodeSizes());
+  static const auto decoders16 = make_coctree_v3_decoders<16>(DecodeSizes());
+  static const auto decoders32 = make_coctree_v3_decoders<32>(DecodeSizes());
+
+  if (v_size < 2 || v_size > MAX_DECODE_V_SIZE)
+    return nullptr;
+  switch (bits_per_value)
+  {
+    case 6:  return decoders6[v_size];
+    case 8:  return decoders8[v_size];
+    case 10: return decoders10[v_size];
+    case 16: return decoders16[v_size];
+    case 32: return decoders32[v_size];
+    default: return nullptr;
+  }
+}
@@ -0,0 +1,345 @@
+#include <algorithm>
+#include <cfloat>
+
+//AVX2 and AVX-512 box tests are compiled with target attribute and chosen at runtime, so they do not need -mavx2 or -mavx512f
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define PACKET_BOX_TEST_SIMD
+#include <immintrin.h>
+#endif
+
+#include "BVH2Common.h"
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// CPU-only packet traversal. Every node box is tested against all lanes of the packet at once, with 8-lane AVX2 or
+// 16-lane AVX-512 test if CPU supports it and with branchless scalar loop otherwise. All versions give the same masks
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+static constexpr uint32_t PACKET_SIZE = BVHRT::RAY_PACKET_SIZE;
+static_assert(PACKET_SIZE <= 32, "active mask is stored in uint32_t");
+static_assert(PACKET_SIZE % 16 == 0, "SIMD box tests process 8 or 16 lanes at once");
+
+static inline bool packet_first_hit_is_closest(uint32_t tag)
+{
+  return tag != AbstractObject::TAG_TRIANGLE;
+}
+
+//intersects all lanes of the packet with one box, returns mask of lanes that hit it
+//tm_out is filled with the near intersection distance for every lane
+static uint32_t packet_box_test(const float* ox, const float* oy, const float* oz,
+                                const float* ix, const float* iy, const float* iz,
+                                const float* tNear, const float* tFar,
+                                float3 boxMin, float3 boxMax, float* tm_out)
+{
+  int hit[PACKET_SIZE];
+  for (uint32_t i = 0; i < PACKET_SIZE; i++)
+  {
+    const float lo  = ix[i] * (boxMin.x - ox[i]);
+    const float hi  = ix[i] * (boxMax.x - ox[i]);
+    const float lo1 = iy[i] * (boxMin.y - oy[i]);
+    const float hi1 = iy[i] * (boxMax.y - oy[i]);
+    const float lo2 = iz[i] * (boxMin.z - oz[i]);
+    const float hi2 = iz[i] * (boxMax.z - oz[i]);
+
+    const float tmin = std::max(std::max(std::min(lo, hi), std::min(lo1, hi1)), std::min(lo2, hi2));
+    const float tmax = std::min(std::min(std::max(lo, hi), std::max(lo1, hi1)), std::max(lo2, hi2));
+
+    tm_out[i] = tmin;
+    hit[i] = (tmin <= tmax) & (tmax >= tNear[i]) & (tmin <= tFar[i]);
+  }
+
+  uint32_t mask = 0;
+  for (uint32_t i = 0; i < PACKET_SIZE; i++)
+    mask |= uint32_t(hit[i]) << i;
+  return mask;
+}
+
+#ifdef PACKET_BOX_TEST_SIMD
+//std::min(a,b) is (b < a) ? b : a, and _mm_min_ps(b,a) is the same, including NaN from 0*inf, so operands are swapped
+__attribute__((target("avx2")))
+static uint32_t packet_box_test_avx2(const float* ox, const float* oy, const float* oz,
+                                     const float* ix, const float* iy, const float* iz,
+                                     const float* tNear, const float* tFar,
+                                     float3 boxMin, float3 boxMax, float* tm_out)
+{
+  uint32_t mask = 0;
+  for (uint32_t i = 0; i < PACKET_SIZE; i += 8)
+  {
+    const __m256 vix = _mm256_loadu_ps(ix + i), viy = _mm256_loadu_ps(iy + i), viz = _mm256_loadu_ps(iz + i);
+    const __m256 vox = _mm256_loadu_ps(ox + i), voy = _mm256_loadu_ps(oy + i), voz = _mm256_loadu_ps(oz + i);
+    const __m256 lo  = _mm256_mul_ps(vix, _mm256_sub_ps(_mm256_set1_ps(boxMin.x), vox));
+    const __m256 hi  = _mm256_mul_ps(vix, _mm256_sub_ps(_mm256_set1_ps(boxMax.x), vox));
+    const __m256 lo1 = _mm256_mul_ps(viy, _mm256_sub_ps(_mm256_set1_ps(boxMin.y), voy));
+    const __m256 hi1 = _mm256_mul_ps(viy, _mm256_sub_ps(_mm256_set1_ps(boxMax.y), voy));
+    const __m256 lo2 = _mm256_mul_ps(viz, _mm256_sub_ps(_mm256_set1_ps(boxMin.z), voz));
+    const __m256 hi2 = _mm256_mul_ps(viz, _mm256_sub_ps(_mm256_set1_ps(boxMax.z), voz));
+
+    const __m256 tmin = _mm256_max_ps(_mm256_min_ps(hi2, lo2), _mm256_max_ps(_mm256_min_ps(hi1, lo1), _mm256_min_ps(hi, lo)));
+    const __m256 tmax = _mm256_min_ps(_mm256_max_ps(hi2, lo2), _mm256_min_ps(_mm256_max_ps(hi1, lo1), _mm256_max_ps(hi, lo)));
+
+    _mm256_storeu_ps(tm_out + i, tmin);
+    __m256 hit = _mm256_and_ps(_mm256_cmp_ps(tmin, tmax, _CMP_LE_OQ), _mm256_cmp_ps(tmax, _mm256_loadu_ps(tNear + i), _CMP_GE_OQ));
+    hit = _mm256_and_ps(hit, _mm256_cmp_ps(tmin, _mm256_loadu_ps(tFar + i), _CMP_LE_OQ));
+    mask |= uint32_t(_mm256_movemask_ps(hit)) << i;
+  }
+  return mask;
+}
+
+__attribute__((target("avx512f")))
+static uint32_t packet_box_test_avx512(const float* ox, const float* oy, const float* oz,
+                                       const float* ix, const float* iy, const float* iz,
+                                       const float* tNear, const float* tFar,
+                                       float3 boxMin, float3 boxMax, float* tm_out)
+{
+  uint32_t mask = 0;
+  for (uint32_t i = 0; i < PACKET_SIZE; i += 16)
+  {
+    const __m512 vix = _mm512_loadu_ps(ix + i), viy = _mm512_loadu_ps(iy + i), viz = _mm512_loadu_ps(iz + i);
+    const __m512 vox = _mm512_loadu_ps(ox + i), voy = _mm512_loadu_ps(oy + i), voz = _mm512_loadu_ps(oz + i);
+    const __m512 lo  = _mm512_mul_ps(vix, _mm512_sub_ps(_mm512_set1_ps(boxMin.x), vox));
+    const __m512 hi  = _mm512_mul_ps(vix, _mm512_sub_ps(_mm512_set1_ps(boxMax.x), vox));
+    const __m512 lo1 = _mm512_mul_ps(viy, _mm512_sub_ps(_mm512_set1_ps(boxMin.y), voy));
+    const __m512 hi1 = _mm512_mul_ps(viy, _mm512_sub_ps(_mm512_set1_ps(boxMax.y), voy));
+    const __m512 lo2 = _mm512_mul_ps(viz, _mm512_sub_ps(_mm512_set1_ps(boxMin.z), voz));
+    const __m512 hi2 = _mm512_mul_ps(viz, _mm512_sub_ps(_mm512_set1_ps(boxMax.z), voz));
+
+    const __m512 tmin = _mm512_max_ps(_mm512_min_ps(hi2, lo2), _mm512_max_ps(_mm512_min_ps(hi1, lo1), _mm512_min_ps(hi, lo)));
+    const __m512 tmax = _mm512_min_ps(_mm512_max_ps(hi2, lo2), _mm512_min_ps(_mm512_max_ps(hi1, lo1), _mm512_max_ps(hi, lo)));
+
+    _mm512_storeu_ps(tm_out + i, tmin);
+    __mmask16 hit = _mm512_cmp_ps_mask(tmin, tmax, _CMP_LE_OQ);
+    hit = _mm512_mask_cmp_ps_mask(hit, tmax, _mm512_loadu_ps(tNear + i), _CMP_GE_OQ);
+    hit = _mm512_mask_cmp_ps_mask(hit, tmin, _mm512_loadu_ps(tFar + i), _CMP_LE_OQ);
+    mask |= uint32_t(hit) << i;
+  }
+  return mask;
+}
+#endif
+
+BVHRT::PacketBoxTestFunc BVHRT::GetPacketBoxTest(bool a_allowSIMD)
+{
+#ifdef PACKET_BOX_TEST_SIMD
+  static const bool has_avx512 = __builtin_cpu_supports("avx512f");
+  static const bool has_avx2   = __builtin_cpu_supports("avx2");
+  if (a_allowSIMD && has_avx512)
+    return packet_box_test_avx512;
+  if (a_allowSIMD && has_avx2)
+    return packet_box_test_avx2;
+#endif
+  return packet_box_test;
+}
+
+void BVHRT::BVH2TraversePacketF32(const float3* ray_pos, const float3* ray_dir, const float* tNear, uint32_t activeMask,
+                                  uint32_t instId, uint32_t geomId, CRT_Hit* pHits)
+{
+  struct StackEntry
+  {
+    uint32_t nodeOffset;
+    uint32_t mask;
+  };
+
+  //wide and quantized BLAS have their own traversal, trace rays one by one
+  if (HasCustomCPUBLAS(geomId))
+  {
+    for (uint32_t i = 0; i < PACKET_SIZE; i++)
+      if ((activeMask & (1u << i)) != 0)
+        BVH2TraverseF32(ray_pos[i], ray_dir[i], tNear[i], instId, geomId, false, &pHits[i]);
+    return;
+  }
+
+  const uint32_t bvhOffset = m_geomData[geomId].bvhOffset;
+
+  //SoA copy of the packet, inactive lanes get empty interval so they never hit anything
+  alignas(64) float ox[PACKET_SIZE], oy[PACKET_SIZE], oz[PACKET_SIZE];
+  alignas(64) float ix[PACKET_SIZE], iy[PACKET_SIZE], iz[PACKET_SIZE];
+  alignas(64) float tn[PACKET_SIZE], tf[PACKET_SIZE];
+  alignas(64) float tm0[PACKET_SIZE], tm1[PACKET_SIZE];
+  for (uint32_t i = 0; i < PACKET_SIZE; i++)
+  {
+    const bool active = (activeMask & (1u << i)) != 0;
+    const float3 dirInv = active ? SafeInverse(ray_dir[i]) : float3(1,1,1);
+    ox[i] = active ? ray_pos[i].x : 0.0f;
+    oy[i] = active ? ray_pos[i].y : 0.0f;
+    oz[i] = active ? ray_pos[i].z : 0.0f;
+    ix[i] = dirInv.x;
+    iy[i] = dirInv.y;
+    iz[i] = dirInv.z;
+    tn[i] = active ? tNear[i] : FLT_MAX;
+    tf[i] = active ? pHits[i].t : -FLT_MAX;
+  }
+
+  StackEntry stack[STACK_SIZE];
+  int top = 0;
+  uint32_t leftNodeOffset = 0;
+  uint32_t mask = activeMask;
+  uint32_t doneMask = 0; //lanes that found the closest hit in this BLAS (see first_hit_is_closest)
+
+  while (true)
+  {
+    mask &= ~doneMask;
+
+    if (mask != 0 && (leftNodeOffset & LEAF_BIT) == 0)
+    {
+      const BVHNodePair fatNode = m_allNodePairs[bvhOffset + leftNodeOffset];
+
+      const uint32_t hitMask0 = mask & m_packetBoxTest(ox, oy, oz, ix, iy, iz, tn, tf, fatNode.left.boxMin,  fatNode.left.boxMax,  tm0);
+      const uint32_t hitMask1 = mask & m_packetBoxTest(ox, oy, oz, ix, iy, iz, tn, tf, fatNode.right.boxMin, fatNode.right.boxMax, tm1);
+
+      if (hitMask0 != 0 && hitMask1 != 0)
+      {
+        //rays in packet are coherent, so the child that is closer for most of them goes first
+        int votes = 0;
+        const uint32_t both = hitMask0 & hitMask1;
+        for (uint32_t i = 0; i < PACKET_SIZE; i++)
+          votes += ((both >> i) & 1u) ? (tm0[i] <= tm1[i] ? 1 : -1) : 0;
+
+        const bool leftFirst = votes >= 0;
+        stack[top].nodeOffset = leftFirst ? fatNode.right.leftOffset : fatNode.left.leftOffset;
+        stack[top].mask       = leftFirst ? hitMask1 : hitMask0;
+        top++;
+        leftNodeOffset = leftFirst ? fatNode.left.leftOffset : fatNode.right.leftOffset;
+        mask           = leftFirst ? hitMask0 : hitMask1;
+        continue;
+      }
+      else if (hitMask0 != 0 || hitMask1 != 0)
+      {
+        leftNodeOffset = hitMask0 != 0 ? fatNode.left.leftOffset : fatNode.right.leftOffset;
+        mask           = hitMask0 != 0 ? hitMask0 : hitMask1;
+        continue;
+      }
+    }
+    else if (mask != 0 && leftNodeOffset != 0xFFFFFFFF)
+    {
+      // leaf node, intersect every active ray with it
+      //
+      CRT_LeafInfo leafInfo;
+      leafInfo.aabbId = EXTRACT_START(leftNodeOffset);
+      leafInfo.instId = instId;
+
+      const float SDF_BIAS = 0.1f;
+      for (uint32_t i = 0; i < PACKET_SIZE; i++)
+      {
+        if ((mask & (1u << i)) == 0)
+          continue;
+        const float tNearSdf = std::max(tNear[i], SDF_BIAS);
+        uint32_t hitTag = m_abstractObjectPtrs[geomId]->Intersect(to_float4(ray_pos[i], tNearSdf), to_float4(ray_dir[i], 1e9f), leafInfo, &pHits[i], this);
+        tf[i] = pHits[i].t;
+        if (hitTag != AbstractObject::TAG_NONE && packet_first_hit_is_closest(hitTag))
+          doneMask |= (1u << i);
+      }
+    }
+
+    // pop next node from stack
+    //
+    if (top == 0)
+      break;
+    top--;
+    leftNodeOffset = stack[top].nodeOffset;
+    mask           = stack[top].mask;
+  }
+}
+
+void BVHRT::RayQuery_NearestHitPacket(const float4* posAndNear, const float4* dirAndFar, CRT_Hit* out_hits, uint32_t count)
+{
+  for (uint32_t packetStart = 0; packetStart < count; packetStart += PACKET_SIZE)
+  {
+    const uint32_t packetSize = std::min(PACKET_SIZE, count - packetStart);
+    const float4* pos = posAndNear + packetStart;
+    const float4* dir = dirAndFar  + packetStart;
+    CRT_Hit* hits     = out_hits   + packetStart;
+
+    uint32_t packetMask = 0;
+    for (uint32_t i = 0; i < packetSize; i++)
+    {
+      //any-hit rays and radiance fields (they accumulate transmittance in hit.coords) use scalar path
+      bool scalarOnly = (dir[i].w <= 0.0f);
+#ifndef DISABLE_RF_GRID
+      scalarOnly = scalarOnly || m_RFGridFlags.size() > 0;
+#endif
+      if (scalarOnly)
+      {
+        hits[i] = RayQuery_NearestHit(pos[i], dir[i]);
+        continue;
+      }
+
+      hits[i].t      = dir[i].w;
+      hits[i].primId = uint32_t(-1);
+      hits[i].instId = uint32_t(-1);
+      hits[i].geomId = uint32_t(-1);
+      hits[i].coords[0] = 1.0f;
+      hits[i].coords[1] = 0.0f;
+      hits[i].coords[2] = 0.0f;
+      hits[i].coords[3] = 0.0f;
+      packetMask |= (1u << i);
+    }
+
+    if (packetMask == 0)
+      continue;
+
+    alignas(64) float ox[PACKET_SIZE], oy[PACKET_SIZE], oz[PACKET_SIZE];
+    alignas(64) float ix[PACKET_SIZE], iy[PACKET_SIZE], iz[PACKET_SIZE];
+    alignas(64) float tn[PACKET_SIZE], tf[PACKET_SIZE], tm[PACKET_SIZE];
+    for (uint32_t i = 0; i < PACKET_SIZE; i++)
+    {
+      const bool active = (packetMask & (1u << i)) != 0;
+      const float3 dirInv = active ? SafeInverse(to_float3(dir[i])) : float3(1,1,1);
+      ox[i] = active ? pos[i].x : 0.0f;
+      oy[i] = active ? pos[i].y : 0.0f;
+      oz[i] = active ? pos[i].z : 0.0f;
+      ix[i] = dirInv.x;
+      iy[i] = dirInv.y;
+      iz[i] = dirInv.z;
+      //TLAS test in scalar version is (tmax > tNear), the difference does not matter for boxes
+      tn[i] = active ? pos[i].w : FLT_MAX;
+      tf[i] = active ? hits[i].t : -FLT_MAX;
+    }
+
+    // stackless TLAS traversal, we descend into node if any ray of packet hits it
+    //
+    uint32_t nodeIdx = 0;
+    do
+    {
+      const BVHNode currNode = m_nodesTLAS[nodeIdx];
+      const uint32_t hitMask = packetMask & m_packetBoxTest(ox, oy, oz, ix, iy, iz, tn, tf, currNode.boxMin, currNode.boxMax, tm);
+      const bool isLeaf = (currNode.leftOffset & LEAF_BIT) != 0;
+
+      if (isLeaf && hitMask != 0)
+      {
+        const uint32_t instId = EXTRACT_START(currNode.leftOffset);
+        const uint32_t geomId = m_instanceData[instId].geomId;
+
+        // transform rays with matrix to local space, ray_dir must stay unnormalized
+        //
+        float3 ray_pos[PACKET_SIZE], ray_dir[PACKET_SIZE];
+        float tNear[PACKET_SIZE];
+        for (uint32_t i = 0; i < PACKET_SIZE; i++)
+        {
+          if ((hitMask & (1u << i)) == 0)
+            continue;
+          ray_pos[i] = matmul4x3(m_instanceData[instId].transformInv, to_float3(pos[i]));
+          ray_dir[i] = matmul3x3(m_instanceData[instId].transformInv, to_float3(dir[i]));
+          tNear[i]   = pos[i].w;
+        }
+
+        BVH2TraversePacketF32(ray_pos, ray_dir, tNear, hitMask, instId, geomId, hits);
+
+        for (uint32_t i = 0; i < PACKET_SIZE; i++)
+          tf[i] = ((packetMask >> i) & 1u) ? hits[i].t : -FLT_MAX;
+      }
+
+      nodeIdx = (isLeaf || hitMask == 0) ? currNode.escapeIndex : currNode.leftOffset;
+    } while (nodeIdx != 0 && nodeIdx < 0xFFFFFFFE);
+
+#ifndef DISABLE_MESH
+    for (uint32_t i = 0; i < packetSize; i++)
+    {
+      if ((packetMask & (1u << i)) == 0)
+        continue;
+      if (hits[i].geomId < uint32_t(-1) && ((hits[i].geomId >> SH_TYPE) == TYPE_MESH_TRIANGLE))
+      {
+        const uint2 geomOffsets = m_geomData[hits[i].geomId & GEOM_ID_MASK].offset;
+        hits[i].primId = m_primIndices[geomOffsets.x/3 + hits[i].primId];
+      }
+    }
+#endif
+  }
+}
@@ -0,0 +1,307 @@
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <mutex>
+#include <thread>
+
+#include "BVH2Common.h"
+#include "../sdfScene/sdf_scene_mapped.h"
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// CPU-only out-of-core SBS. Bricks are grouped in blocks (brick data blocks can be shared by a few nodes), every
+// block is either resident in one slot of the pool inside m_SdfSBSData or not. Traversal threads only read slot
+// table, mark slots as used and queue requests. Pool and node offsets are changed only in UpdateStreaming
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+static constexpr uint32_t PAGE_NONE = uint32_t(-1);
+
+//states of block in blockRequested
+static constexpr uint8_t BLOCK_IDLE      = 0;
+static constexpr uint8_t BLOCK_REQUESTED = 1; //queued, being read or resident
+static constexpr uint8_t BLOCK_FAILED    = 2; //read failed, block is never requested again and its bricks stay coarse
+
+struct SBSPager
+{
+  std::string path;
+  uint64_t valuesFileOffset = 0; //in bytes, start of values array in container
+  uint32_t blockWords = 0;
+  uint32_t poolOffset = 0;       //in m_SdfSBSData
+  uint32_t slotsCount = 0;
+  uint32_t nodeBegin  = 0;       //global id of the first node
+  uint32_t frame      = 1;
+
+  std::vector<uint32_t> blockFileOffset;  //in words, data_offset of block in container
+  std::vector<uint32_t> blockSlot;        //PAGE_NONE if not resident
+  std::vector<uint32_t> blockNodeOffsets; //nodes of block are blockNodeIds[blockNodeOffsets[b]..blockNodeOffsets[b+1])
+  std::vector<uint32_t> blockNodeIds;
+  std::vector<uint32_t> slotBlock;        //PAGE_NONE if slot is free
+  std::vector<float>    coarse;           //8 corner values of every node
+  std::unique_ptr<std::atomic<uint32_t>[]> slotLastUse;
+  std::unique_ptr<std::atomic<uint8_t>[]>  blockRequested;
+
+  //background I/O
+  std::mutex mutex;
+  std::condition_variable cv;
+  std::vector<uint32_t> requests;
+  std::vector<std::pair<uint32_t, std::vector<uint32_t>>> loaded;
+  uint32_t inFlight = 0;
+  bool stop = false;
+  std::thread worker;
+
+  void request(uint32_t block)
+  {
+    uint8_t expected = BLOCK_IDLE;
+    if (!blockRequested[block].compare_exchange_strong(expected, BLOCK_REQUESTED))
+      return;
+    std::lock_guard<std::mutex> lock(mutex);
+    requests.push_back(block);
+    cv.notify_all();
+  }
+
+  void io_loop()
+  {
+    std::ifstream fs(path, std::ios::binary);
+    while (true)
+    {
+      std::vector<uint32_t> batch;
+      {
+        std::unique_lock<std::mutex> lock(mutex);
+        cv.wait(lock, [this]{ return stop || !requests.empty(); });
+        if (stop)
+          return;
+        batch.swap(requests);
+        inFlight = uint32_t(batch.size());
+      }
+
+      //read in file order, so that disk access is as sequential as possible
+      std::sort(batch.begin(), batch.end());
+      std::vector<std::pair<uint32_t, std::vector<uint32_t>>> data;
+      data.reserve(batch.size());
+      for (size_t i = 0; i < batch.size(); i++)
+      {
+        std::vector<uint32_t> block(blockWords);
+        fs.seekg(valuesFileOffset + uint64_t(blockFileOffset[batch[i]])*sizeof(uint32_t));
+        fs.read((char*)block.data(), blockWords*sizeof(uint32_t));
+        if (!fs.good())
+        {
+          //block is dropped, its bricks keep using coarse LOD, failure is reported once as block is not requested again
+          printf("[SBSPager] failed to read brick block %u from %s, using coarse LOD for it\n", batch[i], path.c_str());
+          fs.clear();
+          blockRequested[batch[i]].store(BLOCK_FAILED);
+          continue;
+        }
+        data.emplace_back(batch[i], std::move(block));
+      }
+
+      std::lock_guard<std::mutex> lock(mutex);
+      loaded.insert(loaded.end(), std::make_move_iterator(data.begin()), std::make_move_iterator(data.end()));
+      inFlight = 0;
+      cv.notify_all();
+    }
+  }
+
+  ~SBSPager()
+  {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      stop = true;
+      cv.notify_all();
+    }
+    if (worker.joinable())
+      worker.join();
+  }
+};
+
+uint32_t BVHRT::AddGeom_SdfSBS_OutOfCore(const std::string& a_containerPath, size_t a_poolBytes, ISceneObject *fake_this)
+{
+  MappedSdfScene mapped;
+  if (!mapped.open(a_containerPath) || mapped.type() != SDF_CONTAINER_SBS)
+  {
+    printf("[BVHRT::AddGeom_SdfSBS_OutOfCore] %s is not an SBS container\n", a_containerPath.c_str());
+    return uint32_t(-1);
+  }
+
+  SdfSBSView sbs = mapped.sbs_view();
+  const uint32_t layout = sbs.header.aux_data & SDF_SBS_NODE_LAYOUT_MASK;
+  if (layout != SDF_SBS_NODE_LAYOUT_UNDEFINED && layout != SDF_SBS_NODE_LAYOUT_DX)
+  {
+    printf("[BVHRT::AddGeom_SdfSBS_OutOfCore] only distance-only SBS layouts are supported, layout %u, loading it in memory\n", layout);
+    return AddGeom_SdfSBS(sbs, fake_this);
+  }
+
+  auto pager = std::make_shared<SBSPager>();
+  const uint32_t v_size = sbs.header.brick_size + 2*sbs.header.brick_pad + 1;
+  const uint32_t vals_per_int = 4 / sbs.header.bytes_per_value;
+  const uint32_t bits = 8 * sbs.header.bytes_per_value;
+  const uint32_t max_val = sbs.header.bytes_per_value == 4 ? 0xFFFFFFFF : ((1 << bits) - 1);
+  pager->path = a_containerPath;
+  pager->valuesFileOffset = mapped.array_file_offset(1);
+  pager->blockWords = (v_size*v_size*v_size + vals_per_int - 1) / vals_per_int;
+  pager->slotsCount = uint32_t(std::max<size_t>(1, a_poolBytes / (pager->blockWords*sizeof(uint32_t))));
+
+  //group nodes by data blocks
+  std::vector<uint32_t> nodeBlock(sbs.size);
+  pager->blockFileOffset.resize(sbs.size);
+  for (uint32_t i = 0; i < sbs.size; i++)
+    pager->blockFileOffset[i] = sbs.nodes[i].data_offset;
+  std::sort(pager->blockFileOffset.begin(), pager->blockFileOffset.end());
+  pager->blockFileOffset.erase(std::unique(pager->blockFileOffset.begin(), pager->blockFileOffset.end()), pager->blockFileOffset.end());
+  const uint32_t blocksCount = uint32_t(pager->blockFileOffset.size());
+  pager->slotsCount = std::min(pager->slotsCount, blocksCount);
+  if (uint64_t(pager->blockFileOffset.back()) + pager->blockWords > sbs.values_count)
+  {
+    printf("[BVHRT::AddGeom_SdfSBS_OutOfCore] brick data in %s is out of bounds\n", a_containerPath.c_str());
+    return uint32_t(-1);
+  }
+
+  pager->blockNodeOffsets.assign(blocksCount + 1, 0);
+  for (uint32_t i = 0; i < sbs.size; i++)
+  {
+    nodeBlock[i] = uint32_t(std::lower_bound(pager->blockFileOffset.begin(), pager->blockFileOffset.end(), sbs.nodes[i].data_offset) - pager->blockFileOffset.begin());
+    pager->blockNodeOffsets[nodeBlock[i] + 1]++;
+  }
+  for (uint32_t b = 0; b < blocksCount; b++)
+    pager->blockNodeOffsets[b + 1] += pager->blockNodeOffsets[b];
+
+  //coarse LOD is read from mapped file once, pages are released right after
+  pager->coarse.resize(size_t(sbs.size)*8);
+  for (uint32_t i = 0; i < sbs.size; i++)
+  {
+    const float d_max = 1.73205081f * 2.0f/float(sbs.nodes[i].pos_z_lod_size & 0x0000FFFF);
+    const float mult = 2 * d_max / max_val;
+    const uint32_t bs = sbs.header.brick_size;
+    for (int c = 0; c < 8; c++)
+    {
+      const uint32_t vId = SBS_v_to_i(((c & 4) >> 2)*bs, ((c & 2) >> 1)*bs, (c & 1)*bs, v_size, sbs.header.brick_pad);
+      pager->coarse[8*i + c] = -d_max + mult * ((sbs.values[sbs.nodes[i].data_offset + vId / vals_per_int] >> (bits * (vId % vals_per_int))) & max_val);
+    }
+  }
+
+  //nodes point to the beginning of the pool until their block is loaded
+  std::vector<SdfSBSNode> nodes(sbs.nodes, sbs.nodes + sbs.size);
+  for (auto &node : nodes)
+    node.data_offset = 0;
+  std::vector<uint32_t> pool(size_t(pager->slotsCount)*pager->blockWords, 0u);
+  SdfSBSHeader header = sbs.header;
+  mapped.release_pages();
+  mapped.close();
+
+  pager->nodeBegin  = uint32_t(m_SdfSBSNodes.size());
+  pager->poolOffset = uint32_t(m_SdfSBSData.size());
+
+  //occupancy masks can't be built from empty pool
+  const bool buildOccupancy = m_buildSBSOccupancy;
+  m_buildSBSOccupancy = false;
+  uint32_t geomId = AddGeom_SdfSBS(SdfSBSView(header, nodes, pool), fake_this);
+  m_buildSBSOccupancy = buildOccupancy;
+
+  pager->blockNodeIds.resize(sbs.size);
+  std::vector<uint32_t> fill(pager->blockNodeOffsets.begin(), pager->blockNodeOffsets.end() - 1);
+  for (uint32_t i = 0; i < sbs.size; i++)
+    pager->blockNodeIds[fill[nodeBlock[i]]++] = pager->nodeBegin + i;
+
+  pager->blockSlot.assign(blocksCount, PAGE_NONE);
+  pager->slotBlock.assign(pager->slotsCount, PAGE_NONE);
+  pager->slotLastUse.reset(new std::atomic<uint32_t>[pager->slotsCount]);
+  pager->blockRequested.reset(new std::atomic<uint8_t>[blocksCount]);
+  for (uint32_t s = 0; s < pager->slotsCount; s++)
+    pager->slotLastUse[s].store(0);
+  for (uint32_t b = 0; b < blocksCount; b++)
+    pager->blockRequested[b].store(BLOCK_IDLE);
+
+  const uint32_t pagerId = uint32_t(m_sbsPagers.size());
+  m_SdfSBSNodePages.resize(m_SdfSBSNodes.size(), uint2(PAGE_NONE, PAGE_NONE));
+  for (uint32_t i = 0; i < sbs.size; i++)
+    m_SdfSBSNodePages[pager->nodeBegin + i] = uint2(pagerId, nodeBlock[i]);
+
+  SBSPager *p = pager.get();
+  pager->worker = std::thread([p]{ p->io_loop(); });
+  m_sbsPagers.push_back(pager);
+
+  printf("[BVHRT::AddGeom_SdfSBS_OutOfCore] %u bricks in %u blocks, pool of %u blocks (%.1f Mb)\n", sbs.size, blocksCount,
+         pager->slotsCount, pager->slotsCount*pager->blockWords*sizeof(uint32_t)/(1024.0f*1024.0f));
+  return geomId;
+}
+
+bool BVHRT::SBSPageTouch(uint32_t nodeId)
+{
+  const uint2 page = m_SdfSBSNodePages[nodeId];
+  SBSPager &pager = *m_sbsPagers[page.x];
+  const uint32_t slot = pager.blockSlot[page.y];
+  if (slot != PAGE_NONE)
+  {
+    pager.slotLastUse[slot].store(pager.frame, std::memory_order_relaxed);
+    return true;
+  }
+  pager.request(page.y);
+  return false;
+}
+
+float BVHRT::SBSCoarseDistanceValues(uint32_t nodeId, float3 voxelPos, const SdfSBSHeader &header, float values[8])
+{
+  const uint2 page = m_SdfSBSNodePages[nodeId];
+  const SBSPager &pager = *m_sbsPagers[page.x];
+  const float *c = pager.coarse.data() + size_t(nodeId - pager.nodeBegin)*8;
+
+  float vmin = 1e6f;
+  for (int i = 0; i < 8; i++)
+  {
+    const float3 q = (voxelPos + float3((i & 4) >> 2, (i & 2) >> 1, i & 1)) / float(header.brick_size);
+    values[i] = (1-q.x)*(1-q.y)*(1-q.z)*c[0] + (1-q.x)*(1-q.y)*q.z*c[1] + (1-q.x)*q.y*(1-q.z)*c[2] + (1-q.x)*q.y*q.z*c[3] +
+                q.x*(1-q.y)*(1-q.z)*c[4] + q.x*(1-q.y)*q.z*c[5] + q.x*q.y*(1-q.z)*c[6] + q.x*q.y*q.z*c[7];
+    vmin = std::min(vmin, values[i]);
+  }
+  return vmin;
+}
+
+void BVHRT::UpdateStreaming(bool a_wait)
+{
+  for (auto &pagerPtr : m_sbsPagers)
+  {
+    SBSPager &pager = *pagerPtr;
+    std::vector<std::pair<uint32_t, std::vector<uint32_t>>> loaded;
+    {
+      std::unique_lock<std::mutex> lock(pager.mutex);
+      if (a_wait)
+        pager.cv.wait(lock, [&]{ return pager.requests.empty() && pager.inFlight == 0; });
+      loaded.swap(pager.loaded);
+    }
+    if (loaded.size() > pager.slotsCount) //pool is too small for one frame, drop the rest, they will be requested again
+    {
+      for (size_t i = pager.slotsCount; i < loaded.size(); i++)
+        pager.blockRequested[loaded[i].first].store(BLOCK_IDLE);
+      loaded.resize(pager.slotsCount);
+    }
+
+    //free slots first, then least recently used ones
+    std::vector<std::pair<uint32_t, uint32_t>> candidates(pager.slotsCount);
+    for (uint32_t s = 0; s < pager.slotsCount; s++)
+      candidates[s] = std::make_pair(pager.slotBlock[s] == PAGE_NONE ? 0u : pager.slotLastUse[s].load() + 1, s);
+    if (!loaded.empty() && loaded.size() < candidates.size())
+      std::nth_element(candidates.begin(), candidates.begin() + loaded.size(), candidates.end());
+
+    for (size_t i = 0; i < loaded.size(); i++)
+    {
+      const uint32_t block = loaded[i].first;
+      const uint32_t slot  = candidates[i].second;
+      if (pager.slotBlock[slot] != PAGE_NONE)
+      {
+        pager.blockSlot[pager.slotBlock[slot]] = PAGE_NONE;
+        pager.blockRequested[pager.slotBlock[slot]].store(BLOCK_IDLE);
+      }
+
+      const uint32_t offset = pager.poolOffset + slot*pager.blockWords;
+      std::copy(loaded[i].second.begin(), loaded[i].second.end(), m_SdfSBSData.begin() + offset);
+      for (uint32_t n = pager.blockNodeOffsets[block]; n < pager.blockNodeOffsets[block + 1]; n++)
+        m_SdfSBSNodes[pager.blockNodeIds[n]].data_offset = offset;
+      pager.slotBlock[slot]  = block;
+      pager.blockSlot[block] = slot;
+      pager.slotLastUse[slot].store(pager.frame);
+    }
+
+    pager.frame++;
+  }
+}
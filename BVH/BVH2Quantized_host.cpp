@@ -0,0 +1,231 @@
+#include <algorithm>
+#include <cfloat>
+
+#include "BVH2Common.h"
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// CPU-only BLAS with quantized child boxes. Traversal keeps decoded box of the current node on the stack,
+// so child boxes are decoded relative to it exactly as they were encoded in QuantizeBVH2Fat
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+//number of node pairs on the longest path from the root
+static uint32_t fat_tree_depth(const std::vector<BVHNodePair>& a_nodes)
+{
+  uint32_t maxDepth = 0;
+  std::vector< std::pair<uint32_t, uint32_t> > stack;
+  stack.push_back({0, 1});
+  while (!stack.empty())
+  {
+    const auto [pairId, depth] = stack.back();
+    stack.pop_back();
+    maxDepth = std::max(maxDepth, depth);
+
+    const uint32_t children[2] = {a_nodes[pairId].left.leftOffset, a_nodes[pairId].right.leftOffset};
+    for (uint32_t child : children)
+      if (child != 0xFFFFFFFF && (child & LEAF_BIT) == 0)
+        stack.push_back({child, depth + 1});
+  }
+  return maxDepth;
+}
+
+bool BVHRT::AppendQuantizedTreeData(uint32_t a_geomId, const std::vector<BVHNodePair>& a_nodes, int a_bits)
+{
+  if (m_quantBvhRoots.size() <= a_geomId)
+    m_quantBvhRoots.resize(a_geomId + 1, BVHNode{float3(0,0,0), 0, float3(0,0,0), 0});
+  m_quantBvhRoots[a_geomId].escapeIndex = 0;
+
+  if (a_nodes.empty() || a_bits == 0)
+    return false;
+
+  //traversal keeps at most one entry per level on the stack and point query at most two
+  if (fat_tree_depth(a_nodes) + 1 > STACK_SIZE)
+  {
+    printf("[BVHRT::AppendQuantizedTreeData] BLAS %u is too deep for quantized traversal stack, full precision BLAS will be used\n", a_geomId);
+    return false;
+  }
+
+  BVHNode root;
+  if (a_bits == 8)
+  {
+    auto qNodes = QuantizeBVH2Fat<uint8_t>(a_nodes.data(), a_nodes.size(), &root.boxMin, &root.boxMax);
+    root.leftOffset = uint32_t(m_allNodePairsQ8.size());
+    m_allNodePairsQ8.insert(m_allNodePairsQ8.end(), qNodes.begin(), qNodes.end());
+  }
+  else if (a_bits == 16)
+  {
+    auto qNodes = QuantizeBVH2Fat<uint16_t>(a_nodes.data(), a_nodes.size(), &root.boxMin, &root.boxMax);
+    root.leftOffset = uint32_t(m_allNodePairsQ16.size());
+    m_allNodePairsQ16.insert(m_allNodePairsQ16.end(), qNodes.begin(), qNodes.end());
+  }
+  else
+  {
+    printf("[BVHRT::AppendQuantizedTreeData] unsupported number of bits %d, full precision BLAS will be used\n", a_bits);
+    return false;
+  }
+
+  root.escapeIndex = uint32_t(a_bits);
+  m_quantBvhRoots[a_geomId] = root;
+  return true;
+}
+
+static bool quantized_first_hit_is_closest(uint32_t tag)
+{
+  return tag != AbstractObject::TAG_TRIANGLE;
+}
+
+template<typename QT>
+static void quantized_traverse(BVHRT* bvh, const BVHNodePairQuantized<QT>* nodes, float3 rootMin, float3 rootMax,
+                               const float3 ray_pos, const float3 ray_dir, float tNear,
+                               uint32_t instId, uint32_t geomId, bool stopOnFirstHit,
+                               CRT_Hit* pHit)
+{
+  struct StackEntry
+  {
+    uint32_t offset;
+    float3   boxMin;
+    float3   boxMax;
+  };
+
+  StackEntry stack[STACK_SIZE];
+  int top = 0;
+  StackEntry curr = {0, rootMin, rootMax};
+  bool hitFound = false;
+
+  const float3 rayDirInv = SafeInverse(ray_dir);
+  while (top >= 0 && !hitFound)
+  {
+#ifndef DISABLE_RF_GRID
+    if (bvh->m_RFGridFlags.size() > 0 && pHit->coords[0] <= 0.01f)
+      break;
+#endif
+
+    while (top >= 0 && ((curr.offset & LEAF_BIT) == 0))
+    {
+      const BVHNodePairQuantized<QT>& qNode = nodes[curr.offset];
+
+      StackEntry child0, child1;
+      child0.offset = qNode.leftOffset;
+      child1.offset = qNode.rightOffset;
+      DecodeQuantizedBox(qNode.leftMin,  qNode.leftMax,  curr.boxMin, curr.boxMax, &child0.boxMin, &child0.boxMax);
+      DecodeQuantizedBox(qNode.rightMin, qNode.rightMax, curr.boxMin, curr.boxMax, &child1.boxMin, &child1.boxMax);
+
+      const float2 tm0 = RayBoxIntersection2(ray_pos, rayDirInv, child0.boxMin, child0.boxMax);
+      const float2 tm1 = RayBoxIntersection2(ray_pos, rayDirInv, child1.boxMin, child1.boxMax);
+
+#ifndef DISABLE_RF_GRID
+      const bool hitChild0 = (tm0.x <= tm0.y) && (tm0.y >= tNear) && (tm0.x <= pHit->t || !stopOnFirstHit);
+      const bool hitChild1 = (tm1.x <= tm1.y) && (tm1.y >= tNear) && (tm1.x <= pHit->t || !stopOnFirstHit);
+#else
+      const bool hitChild0 = (tm0.x <= tm0.y) && (tm0.y >= tNear) && (tm0.x <= pHit->t);
+      const bool hitChild1 = (tm1.x <= tm1.y) && (tm1.y >= tNear) && (tm1.x <= pHit->t);
+#endif
+
+      if (hitChild0 && hitChild1)
+      {
+        curr       = (tm0.x <= tm1.x) ? child0 : child1;
+        stack[top] = (tm0.x <= tm1.x) ? child1 : child0;
+        top++;
+      }
+      else if (hitChild0 || hitChild1)
+      {
+        curr = hitChild0 ? child0 : child1;
+      }
+      else // both miss, stack.pop()
+      {
+        top--;
+        curr = stack[std::max(top,0)];
+      }
+    }
+
+    // leaf node, intersect primitives
+    //
+    if (top >= 0 && curr.offset != 0xFFFFFFFF)
+    {
+      CRT_LeafInfo leafInfo;
+      leafInfo.aabbId = EXTRACT_START(curr.offset);
+      leafInfo.instId = instId;
+
+      const float SDF_BIAS = 0.1f;
+      const float tNearSdf = std::max(tNear, SDF_BIAS);
+
+      uint32_t hitTag = bvh->m_abstractObjectPtrs[geomId]->Intersect(to_float4(ray_pos, tNearSdf), to_float4(ray_dir, 1e9f), leafInfo, pHit, bvh);
+      hitFound = (hitTag != AbstractObject::TAG_NONE) && (quantized_first_hit_is_closest(hitTag) || stopOnFirstHit);
+    }
+
+    top--;
+    curr = stack[std::max(top,0)];
+  }
+}
+
+//quantized boxes are slightly larger than original ones, so point near the border of a leaf can be inside
+//a few leaves. We visit all of them and return the one where the point is deepest inside
+template<typename QT>
+static uint32_t quantized_point_query(const BVHNodePairQuantized<QT>* nodes, float3 rootMin, float3 rootMax, float3 pos)
+{
+  struct StackEntry
+  {
+    uint32_t offset;
+    float3   boxMin;
+    float3   boxMax;
+  };
+
+  StackEntry stack[STACK_SIZE];
+  int top = 0;
+  stack[top++] = {0, rootMin, rootMax};
+
+  uint32_t bestLeaf  = 0xFFFFFFFF;
+  float    bestDepth = -FLT_MAX;
+
+  while (top > 0)
+  {
+    const StackEntry curr = stack[--top];
+    const BVHNodePairQuantized<QT>& qNode = nodes[curr.offset];
+
+    StackEntry children[2];
+    children[0].offset = qNode.leftOffset;
+    children[1].offset = qNode.rightOffset;
+    DecodeQuantizedBox(qNode.leftMin,  qNode.leftMax,  curr.boxMin, curr.boxMax, &children[0].boxMin, &children[0].boxMax);
+    DecodeQuantizedBox(qNode.rightMin, qNode.rightMax, curr.boxMin, curr.boxMax, &children[1].boxMin, &children[1].boxMax);
+
+    for (int i = 1; i >= 0; i--)
+    {
+      const float3 dMin = pos - children[i].boxMin;
+      const float3 dMax = children[i].boxMax - pos;
+      const float depth = std::min(std::min(std::min(dMin.x, dMin.y), dMin.z), std::min(std::min(dMax.x, dMax.y), dMax.z));
+      if (depth < 0.0f || children[i].offset == 0xFFFFFFFF)
+        continue;
+
+      if ((children[i].offset & LEAF_BIT) == 0)
+        stack[top++] = children[i]; //AppendQuantizedTreeData ensures that the stack is deep enough
+      else if (depth > bestDepth)
+      {
+        bestDepth = depth;
+        bestLeaf  = children[i].offset;
+      }
+    }
+  }
+
+  return bestLeaf;
+}
+
+void BVHRT::BVH2QuantizedTraverseF32(const float3 ray_pos, const float3 ray_dir, float tNear,
+                                     uint32_t instId, uint32_t geomId, bool stopOnFirstHit,
+                                     CRT_Hit *pHit)
+{
+  const BVHNode& root = m_quantBvhRoots[geomId];
+  if (root.escapeIndex == 8)
+    quantized_traverse<uint8_t>(this, m_allNodePairsQ8.data() + root.leftOffset, root.boxMin, root.boxMax,
+                                ray_pos, ray_dir, tNear, instId, geomId, stopOnFirstHit, pHit);
+  else
+    quantized_traverse<uint16_t>(this, m_allNodePairsQ16.data() + root.leftOffset, root.boxMin, root.boxMax,
+                                 ray_pos, ray_dir, tNear, instId, geomId, stopOnFirstHit, pHit);
+}
+
+uint32_t BVHRT::eval_distance_traverse_bvh_quantized(uint32_t geomId, float3 pos)
+{
+  const BVHNode& root = m_quantBvhRoots[geomId];
+  if (root.escapeIndex == 8)
+    return quantized_point_query<uint8_t>(m_allNodePairsQ8.data() + root.leftOffset, root.boxMin, root.boxMax, pos);
+  else
+    return quantized_point_query<uint16_t>(m_allNodePairsQ16.data() + root.leftOffset, root.boxMin, root.boxMax, pos);
+}
@@ -0,0 +1,128 @@
+#include <algorithm>
+#include <cmath>
+#include <functional>
+
+#include "BVH2Common.h"
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// CPU-only acceleration data for SBS, built in AddGeom_SdfSBS.
+// Point location: every brick occupies exactly one cell of the regular grid of its LOD, so containing brick is
+// found by a lookup in open addressing hash table for each LOD present in SBS instead of walking BLAS.
+// Usually SBS has only one or a few LODs, so the query is O(1).
+// Occupancy masks: one bit per voxel that can contain surface, used to skip empty voxels in OctreeBrickIntersect
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+static constexpr uint64_t SBS_INDEX_EMPTY = ~0ull;
+
+static inline uint64_t sbs_index_key(uint32_t lod_size, uint32_t x, uint32_t y, uint32_t z)
+{
+  return (uint64_t(lod_size) << 48) | (uint64_t(z) << 32) | (uint64_t(y) << 16) | uint64_t(x);
+}
+
+static inline uint64_t sbs_index_hash(uint64_t key)
+{
+  key ^= key >> 33;
+  key *= 0xff51afd7ed558ccdull;
+  key ^= key >> 33;
+  return key;
+}
+
+void BVHRT::BuildSBSBrickIndex(uint32_t a_sdfId, const SdfSBSView& a_sbs)
+{
+  if (m_SdfSBSIndex.size() <= a_sdfId)
+    m_SdfSBSIndex.resize(a_sdfId + 1);
+  SBSBrickIndex& index = m_SdfSBSIndex[a_sdfId];
+
+  //table is at most half full
+  size_t capacity = 16;
+  while (capacity < 2*size_t(a_sbs.size))
+    capacity *= 2;
+  index.mask = capacity - 1;
+  index.keys.assign(capacity, SBS_INDEX_EMPTY);
+  index.bricks.assign(capacity, 0);
+  index.lodSizes.clear();
+
+  for (uint32_t i = 0; i < a_sbs.size; i++)
+  {
+    const SdfSBSNode& node = a_sbs.nodes[i];
+    const uint32_t lod_size = node.pos_z_lod_size & 0x0000FFFF;
+    const uint64_t key = sbs_index_key(lod_size, node.pos_xy >> 16, node.pos_xy & 0x0000FFFF, node.pos_z_lod_size >> 16);
+
+    uint64_t slot = sbs_index_hash(key) & index.mask;
+    while (index.keys[slot] != SBS_INDEX_EMPTY && index.keys[slot] != key)
+      slot = (slot + 1) & index.mask;
+    index.keys[slot]   = key;
+    index.bricks[slot] = i;
+
+    if (std::find(index.lodSizes.begin(), index.lodSizes.end(), lod_size) == index.lodSizes.end())
+      index.lodSizes.push_back(lod_size);
+  }
+
+  //finest LOD first, most of the bricks are usually there
+  std::sort(index.lodSizes.begin(), index.lodSizes.end(), std::greater<uint32_t>());
+}
+
+uint32_t BVHRT::SBSBrickIndexLookup(uint32_t a_sdfId, float3 pos) const
+{
+  const SBSBrickIndex& index = m_SdfSBSIndex[a_sdfId];
+  if (pos.x < -1.0f || pos.x > 1.0f || pos.y < -1.0f || pos.y > 1.0f || pos.z < -1.0f || pos.z > 1.0f)
+    return SBS_INDEX_MISS;
+
+  bool onCellBorder = false;
+  for (uint32_t lod_size : index.lodSizes)
+  {
+    const float3 cell = 0.5f*(pos + float3(1,1,1))*float(lod_size);
+    const uint32_t x = std::min(uint32_t(cell.x), lod_size - 1);
+    const uint32_t y = std::min(uint32_t(cell.y), lod_size - 1);
+    const uint32_t z = std::min(uint32_t(cell.z), lod_size - 1);
+    const uint64_t key = sbs_index_key(lod_size, x, y, z);
+
+    uint64_t slot = sbs_index_hash(key) & index.mask;
+    while (index.keys[slot] != SBS_INDEX_EMPTY)
+    {
+      if (index.keys[slot] == key)
+        return index.bricks[slot];
+      slot = (slot + 1) & index.mask;
+    }
+
+    onCellBorder = onCellBorder || (cell.x == std::floor(cell.x)) || (cell.y == std::floor(cell.y)) || (cell.z == std::floor(cell.z));
+  }
+
+  //BLAS boxes are closed, so point exactly on the border of an empty cell can still belong to neighbouring brick
+  return onCellBorder ? SBS_INDEX_UNKNOWN : SBS_INDEX_MISS;
+}
+
+void BVHRT::BuildSBSOccupancyMasks(uint32_t a_sdfId, uint32_t a_bricksCount)
+{
+  if (m_SdfSBSOccupancyOffsets.size() <= a_sdfId)
+    m_SdfSBSOccupancyOffsets.resize(a_sdfId + 1, uint32_t(-1));
+
+  const SdfSBSHeader header = m_SdfSBSHeaders[a_sdfId];
+  const uint32_t v_size = header.brick_size + 2*header.brick_pad + 1;
+  const uint32_t voxelsPerBrick = header.brick_size*header.brick_size*header.brick_size;
+  const uint32_t wordsPerBrick = 1 + (voxelsPerBrick + 31)/32;
+  if (size_t(m_SdfSBSOccupancy.size()) + size_t(a_bricksCount)*wordsPerBrick >= size_t(uint32_t(-1)))
+    return;
+
+  m_SdfSBSOccupancyOffsets[a_sdfId] = uint32_t(m_SdfSBSOccupancy.size());
+  m_SdfSBSOccupancy.resize(m_SdfSBSOccupancy.size() + size_t(a_bricksCount)*wordsPerBrick, 0u);
+
+  #pragma omp parallel for schedule(static)
+  for (int brickId = 0; brickId < int(a_bricksCount); brickId++)
+  {
+    const uint32_t nodeId = m_SdfSBSRoots[a_sdfId] + brickId;
+    const float sz_inv = 2.0f/float(m_SdfSBSNodes[nodeId].pos_z_lod_size & 0x0000FFFF);
+    uint32_t* mask = m_SdfSBSOccupancy.data() + m_SdfSBSOccupancyOffsets[a_sdfId] + size_t(brickId)*wordsPerBrick;
+
+    float values[8];
+    for (uint32_t vId = 0; vId < voxelsPerBrick; vId++)
+    {
+      const float3 voxelPos = float3(vId / (header.brick_size*header.brick_size), (vId / header.brick_size) % header.brick_size, vId % header.brick_size);
+      if (load_distance_values(a_sdfId, nodeId, voxelPos, v_size, sz_inv, header, values) <= 0.0f)
+      {
+        mask[0]++;
+        mask[1 + vId/32] |= 1u << (vId%32);
+      }
+    }
+  }
+}
@@ -0,0 +1,174 @@
+#include <algorithm>
+#include <cfloat>
+
+#include "BVH2Common.h"
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// CPU-only wide BLAS (BVH4/BVH8). All children of a node are tested in one branchless loop over SoA boxes,
+// hit children are pushed to stack sorted by distance, so the order of leaves is the same as for BVH2.
+// Wide nodes are not quantized and binary BLAS is still stored for the same geometry, because point queries
+// (eval_distance_traverse_bvh), GPU kernels and diff render traverse only binary nodes. So wide BLAS reduces
+// the number of node fetches per ray, but increases total BLAS memory. Use "_q8"/"_q16" presets to save memory
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+//number of wide nodes on the longest path from the root, leaves are not counted
+template<uint32_t WIDTH>
+static uint32_t wide_tree_depth(const std::vector< BVHNodeWide<WIDTH> >& a_nodes)
+{
+  uint32_t maxDepth = 0;
+  std::vector< std::pair<uint32_t, uint32_t> > stack = {{0u, 1u}};
+  while (!stack.empty())
+  {
+    const auto [nodeId, depth] = stack.back();
+    stack.pop_back();
+    maxDepth = std::max(maxDepth, depth);
+    for (uint32_t i = 0; i < WIDTH; i++)
+    {
+      const uint32_t child = a_nodes[nodeId].childOffset[i];
+      if (child != LEAF_NORMAL && (child & LEAF_BIT) == 0)
+        stack.push_back({child, depth + 1});
+    }
+  }
+  return maxDepth;
+}
+
+void BVHRT::AppendWideTreeData(uint32_t a_geomId, const std::vector<BVHNodePair>& a_nodes, int a_width)
+{
+  if (m_wideBvhOffsets.size() <= a_geomId)
+    m_wideBvhOffsets.resize(a_geomId + 1, uint32_t(-1));
+  m_wideBvhOffsets[a_geomId] = uint32_t(-1);
+
+  if (a_nodes.empty())
+    return;
+
+  if (a_width == 4)
+  {
+    auto wideNodes = BVH2FatToWide<4>(a_nodes.data(), a_nodes.size());
+    if (wide_tree_depth(wideNodes) > STACK_SIZE)
+    {
+      printf("[BVHRT::AppendWideTreeData] BLAS %u is too deep for wide traversal stack, binary BLAS will be used\n", a_geomId);
+      return;
+    }
+    m_wideBvhOffsets[a_geomId] = uint32_t(m_allNodesWide4.size());
+    m_allNodesWide4.insert(m_allNodesWide4.end(), wideNodes.begin(), wideNodes.end());
+  }
+  else if (a_width == 8)
+  {
+    auto wideNodes = BVH2FatToWide<8>(a_nodes.data(), a_nodes.size());
+    if (wide_tree_depth(wideNodes) > STACK_SIZE)
+    {
+      printf("[BVHRT::AppendWideTreeData] BLAS %u is too deep for wide traversal stack, binary BLAS will be used\n", a_geomId);
+      return;
+    }
+    m_wideBvhOffsets[a_geomId] = uint32_t(m_allNodesWide8.size());
+    m_allNodesWide8.insert(m_allNodesWide8.end(), wideNodes.begin(), wideNodes.end());
+  }
+  else if (a_width != 2)
+  {
+    printf("[BVHRT::AppendWideTreeData] unsupported BLAS width %d, binary BLAS will be used\n", a_width);
+  }
+}
+
+static bool wide_first_hit_is_closest(uint32_t tag)
+{
+  return tag != AbstractObject::TAG_TRIANGLE;
+}
+
+template<uint32_t WIDTH>
+static void wide_traverse(BVHRT* bvh, const BVHNodeWide<WIDTH>* nodes,
+                          const float3 ray_pos, const float3 ray_dir, float tNear,
+                          uint32_t instId, uint32_t geomId, bool stopOnFirstHit,
+                          CRT_Hit* pHit)
+{
+  //every level leaves at most WIDTH-1 children on the stack, AppendWideTreeData ensures that depth <= STACK_SIZE
+  constexpr int WIDE_STACK_SIZE = STACK_SIZE*(WIDTH-1) + 1;
+  uint32_t stack[WIDE_STACK_SIZE];
+  int top = 0;
+  stack[top++] = 0;
+
+  bool hitFound = false;
+  const float3 rayDirInv = SafeInverse(ray_dir);
+
+  while (top > 0 && !hitFound)
+  {
+#ifndef DISABLE_RF_GRID
+    if (bvh->m_RFGridFlags.size() > 0 && pHit->coords[0] <= 0.01f)
+      break;
+#endif
+
+    const uint32_t offset = stack[--top];
+
+    if ((offset & LEAF_BIT) == 0)
+    {
+      const BVHNodeWide<WIDTH>& node = nodes[offset];
+      const float tFar = pHit->t;
+
+      float tmin[WIDTH];
+      int   hit[WIDTH];
+      for (uint32_t i = 0; i < WIDTH; i++)
+      {
+        const float lo  = rayDirInv.x * (node.boxMinX[i] - ray_pos.x);
+        const float hi  = rayDirInv.x * (node.boxMaxX[i] - ray_pos.x);
+        const float lo1 = rayDirInv.y * (node.boxMinY[i] - ray_pos.y);
+        const float hi1 = rayDirInv.y * (node.boxMaxY[i] - ray_pos.y);
+        const float lo2 = rayDirInv.z * (node.boxMinZ[i] - ray_pos.z);
+        const float hi2 = rayDirInv.z * (node.boxMaxZ[i] - ray_pos.z);
+
+        tmin[i]          = std::max(std::max(std::min(lo, hi), std::min(lo1, hi1)), std::min(lo2, hi2));
+        const float tmax = std::min(std::min(std::max(lo, hi), std::max(lo1, hi1)), std::max(lo2, hi2));
+
+#ifndef DISABLE_RF_GRID
+        hit[i] = (tmin[i] <= tmax) & (tmax >= tNear) & ((tmin[i] <= tFar) | !stopOnFirstHit) & (node.childOffset[i] != LEAF_NORMAL);
+#else
+        hit[i] = (tmin[i] <= tmax) & (tmax >= tNear) & (tmin[i] <= tFar) & (node.childOffset[i] != LEAF_NORMAL);
+#endif
+      }
+
+      // push hit children from the farthest to the nearest, so the nearest is popped first
+      //
+      uint32_t order[WIDTH];
+      uint32_t hitNum = 0;
+      for (uint32_t i = 0; i < WIDTH; i++)
+      {
+        if (!hit[i])
+          continue;
+        uint32_t j = hitNum++;
+        while (j > 0 && tmin[order[j-1]] < tmin[i])
+        {
+          order[j] = order[j-1];
+          j--;
+        }
+        order[j] = i;
+      }
+
+      for (uint32_t k = 0; k < hitNum; k++)
+        stack[top++] = node.childOffset[order[k]];
+    }
+    else
+    {
+      // leaf node, intersect primitives
+      //
+      CRT_LeafInfo leafInfo;
+      leafInfo.aabbId = EXTRACT_START(offset);
+      leafInfo.instId = instId;
+
+      const float SDF_BIAS = 0.1f;
+      const float tNearSdf = std::max(tNear, SDF_BIAS);
+
+      uint32_t hitTag = bvh->m_abstractObjectPtrs[geomId]->Intersect(to_float4(ray_pos, tNearSdf), to_float4(ray_dir, 1e9f), leafInfo, pHit, bvh);
+      hitFound = (hitTag != AbstractObject::TAG_NONE) && (wide_first_hit_is_closest(hitTag) || stopOnFirstHit);
+    }
+  }
+}
+
+void BVHRT::BVHWideTraverseF32(const float3 ray_pos, const float3 ray_dir, float tNear,
+                               uint32_t instId, uint32_t geomId, bool stopOnFirstHit,
+                               CRT_Hit *pHit)
+{
+  //width is taken from build name, so it is the same for all geometries
+  const uint32_t wideOffset = m_wideBvhOffsets[geomId];
+  if (!m_allNodesWide8.empty())
+    wide_traverse<8>(this, m_allNodesWide8.data() + wideOffset, ray_pos, ray_dir, tNear, instId, geomId, stopOnFirstHit, pHit);
+  else
+    wide_traverse<4>(this, m_allNodesWide4.data() + wideOffset, ray_pos, ray_dir, tNear, instId, geomId, stopOnFirstHit, pHit);
+}
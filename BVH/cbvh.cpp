@@ -8,6 +8,7 @@
 #include <cfloat>
 #include <algorithm>
 #include <unordered_set>
+#include <string>
 
 #include "cbvh.h"
 #include "embree4/rtcore.h"
@@ -62,7 +63,33 @@ BuilderPresets BuilderPresetsFromString(const char *a_str)
   const std::string a_buildName(a_str);
   presets.quality = BVHQuality::HIGH;
 
-  char symb = a_buildName[a_buildName.size() - 1];
+  //CPU-only BLAS options are given with suffixes, i.e. "cbvh_embree2_wide8" or "cbvh_embree2_q16"
+  //"_wide4"/"_wide8" - additional wide BLAS, "_q8"/"_q16" - BLAS with quantized boxes
+  std::string name = a_buildName;
+  bool suffixFound = true;
+  while (suffixFound)
+  {
+    suffixFound = false;
+    for (auto suffix : {"_wide4", "_wide8", "_q8", "_q16"})
+    {
+      const std::string suf(suffix);
+      if (name.size() > suf.size() && name.compare(name.size() - suf.size(), suf.size(), suf) == 0)
+      {
+        if (suf == "_wide4" || suf == "_wide8")
+          presets.blasWidth = std::stoi(suf.substr(5));
+        else
+          presets.quantBits = std::stoi(suf.substr(2));
+        name = name.substr(0, name.size() - suf.size());
+        suffixFound = true;
+      }
+    }
+  }
+
+  if (name.compare(0, 8, "cbvh_sah") == 0)
+    presets.nativeSAH = true;
+  presets.builderChosen = presets.nativeSAH || name.compare(0, 11, "cbvh_embree") == 0;
+
+  char symb = name.empty() ? ' ' : name[name.size() - 1];
   if (std::isdigit(symb))
     presets.primsInLeaf = int(symb) - int('0');
 
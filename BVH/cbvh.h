@@ -4,6 +4,7 @@
 #include <cstdint>
 #include <cassert>
 #include <iostream>
+#include <limits>
 
 #include "LiteMath.h"
 
@@ -59,6 +60,10 @@
     FMT   format      = BVH2_LEFT_OFFSET;
     BVHQuality quality = BVHQuality::HIGH;  
     int   primsInLeaf = 2;                      ///<! recomended primitives in leaf
+    int   blasWidth   = 2;                      ///<! 4 or 8 to build additional full precision wide BLAS for CPU traversal, 2 means binary BLAS only
+    int   quantBits   = 0;                      ///<! 8 or 16 to store binary BLAS only with quantized child boxes (CPU only), 0 means full precision
+    bool  nativeSAH   = false;                  ///<! always use multithreaded binned SAH builder for custom AABBs instead of embree
+    bool  builderChosen = false;                ///<! builder is named in build name ("cbvh_embree2", "cbvh_sah"), otherwise it is chosen by number of objects
   };
 
   struct LayoutPresets
@@ -106,6 +111,57 @@
     std::vector<uint32_t>    indices;
   };
 
+  /**
+  \brief Wide BVH node for CPU traversal. Boxes of all children are stored in SoA form, 
+         so node is intersected with a single pass over its children that compiler can vectorize.
+  */
+  template<uint32_t WIDTH>
+  struct alignas(4*WIDTH) BVHNodeWide
+  {
+    float boxMinX[WIDTH];
+    float boxMinY[WIDTH];
+    float boxMinZ[WIDTH];
+    float boxMaxX[WIDTH];
+    float boxMaxY[WIDTH];
+    float boxMaxZ[WIDTH];
+    uint  childOffset[WIDTH]; //!< index of child in wide nodes array or leaf (LEAF_BIT is set), the same as BVHNode::leftOffset
+  };
+
+  /**
+  \brief Compressed BVHNodePair for CPU traversal. Child boxes are quantized relative to the box of this pair 
+         (i.e. decoded box of the parent node, known during traversal) with conservative rounding.
+         8-bit version takes 20 bytes and 16-bit version takes 32 bytes instead of 64 for BVHNodePair.
+  */
+  template<typename QT>
+  struct BVHNodePairQuantized
+  {
+    QT   leftMin[3];
+    QT   leftMax[3];
+    QT   rightMin[3];
+    QT   rightMax[3];
+    uint leftOffset;  //!< the same as BVHNodePair::left.leftOffset
+    uint rightOffset; //!< the same as BVHNodePair::right.leftOffset
+  };
+
+  template<typename QT>
+  static inline float DecodeQuantized(QT q, float parentMin, float parentMax)
+  {
+    constexpr QT QMAX = std::numeric_limits<QT>::max();
+    return (q == QMAX) ? parentMax : parentMin + float(q)*((parentMax - parentMin)*(1.0f/float(QMAX)));
+  }
+
+  template<typename QT>
+  static inline void DecodeQuantizedBox(const QT qMin[3], const QT qMax[3], float3 parentMin, float3 parentMax, 
+                                        float3* pBoxMin, float3* pBoxMax)
+  {
+    *pBoxMin = float3(DecodeQuantized(qMin[0], parentMin.x, parentMax.x),
+                      DecodeQuantized(qMin[1], parentMin.y, parentMax.y),
+                      DecodeQuantized(qMin[2], parentMin.z, parentMax.z));
+    *pBoxMax = float3(DecodeQuantized(qMax[0], parentMin.x, parentMax.x),
+                      DecodeQuantized(qMax[1], parentMin.y, parentMax.y),
+                      DecodeQuantized(qMax[2], parentMin.z, parentMax.z));
+  }
+
   struct Interval
   {
     Interval() : start(0), count(0) {}
@@ -202,5 +258,28 @@
   */
   BVHTreeFat BuildBVHFatCustom(const BVHNode* a_nodes, size_t a_objNum, BuilderPresets a_presets, LayoutPresets a_layout);
 
+  /**
+  \brief Multithreaded binned SAH builder for custom geometry, up to 'primsInLeaf' objects per leaf. Used by 'BuildBVHFatCustom' 
+         for large inputs (i.e. millions of SDF bricks) when builder is not named in build name, or when build name is "cbvh_sah".
+  \return BLAS in 'BVHNodePair' format, root pair is the first one
+  */
+  BVHTreeFat BuildBVHFatSAH(const BVHNode* a_nodes, size_t a_objNum, BuilderPresets a_presets);
+
+  /**
+  \brief Collapse binary BLAS in 'BVHNodePair' format to wide BLAS (WIDTH = 4 or 8) for CPU traversal.
+         Empty child slots have 'LEAF_NORMAL' offset and must be skipped by traversal.
+  \return wide nodes, root is the first one
+  */
+  template<uint32_t WIDTH>
+  std::vector< BVHNodeWide<WIDTH> > BVH2FatToWide(const BVHNodePair* a_nodes, size_t a_nodesNum);
+
+  /**
+  \brief Compress binary BLAS in 'BVHNodePair' format (QT = uint8_t or uint16_t). Root pair is quantized 
+         relative to the box returned in (a_rootMin, a_rootMax).
+  \return quantized nodes in the same order as input ones
+  */
+  template<typename QT>
+  std::vector< BVHNodePairQuantized<QT> > QuantizeBVH2Fat(const BVHNodePair* a_nodes, size_t a_nodesNum, float3* a_rootMin, float3* a_rootMax);
+
   BVHTree BuildBVHEmbree(const float4 *a_vertices, size_t a_vertNum, const uint *a_indices, size_t a_indexNum, BVHPresets a_presets);
 #endif
@@ -1,6 +1,8 @@
 #include <fstream>
 #include <chrono>
 #include <unordered_set>
+#include <cmath>
+#include <limits>
 
 #include "cbvh.h"
 
@@ -142,6 +144,173 @@ std::vector<BVHNodePair> CreateFatTreeArray(const std::vector<BVHNode>& a_input)
 }
 
 
+template<uint32_t WIDTH>
+struct TreeConverterWide
+{
+  TreeConverterWide(const BVHNodePair* a_input, std::vector< BVHNodeWide<WIDTH> >& a_out) : m_input(a_input), m_out(a_out) {}
+
+  const BVHNodePair* m_input;
+  std::vector< BVHNodeWide<WIDTH> >& m_out;
+
+  static float SurfaceArea(const BVHNode& a_node)
+  {
+    const float3 d = a_node.boxMax - a_node.boxMin;
+    return d.x*d.y + d.y*d.z + d.z*d.x;
+  }
+
+  uint32_t ProcessBVHNode(uint32_t pairId)
+  {
+    // collapse binary subtree, opening the largest inner child until node is full
+    //
+    BVHNode children[WIDTH];
+    uint32_t childrenNum = 2;
+    children[0] = m_input[pairId].left;
+    children[1] = m_input[pairId].right;
+
+    while (childrenNum < WIDTH)
+    {
+      int   best     = -1;
+      float bestArea = -1.0f;
+      for (uint32_t i = 0; i < childrenNum; i++)
+      {
+        if ((children[i].leftOffset & LEAF_BIT) == 0 && SurfaceArea(children[i]) > bestArea)
+        {
+          best     = int(i);
+          bestArea = SurfaceArea(children[i]);
+        }
+      }
+      if (best < 0)
+        break;
+
+      const BVHNodePair& pair = m_input[children[best].leftOffset];
+      children[best]           = pair.left;
+      children[childrenNum++]  = pair.right;
+    }
+
+    const uint32_t currNodeIndex = uint32_t(m_out.size());
+    m_out.emplace_back();
+
+    for (uint32_t i = 0; i < WIDTH; i++)
+    {
+      uint32_t offset = LEAF_NORMAL;
+      if (i < childrenNum)
+        offset = (children[i].leftOffset & LEAF_BIT) ? children[i].leftOffset : ProcessBVHNode(children[i].leftOffset);
+
+      BVHNodeWide<WIDTH>& node = m_out[currNodeIndex]; // m_out could be reallocated during recursion
+      const bool valid = (i < childrenNum);
+      node.boxMinX[i] = valid ? children[i].boxMin.x : 0.0f;
+      node.boxMinY[i] = valid ? children[i].boxMin.y : 0.0f;
+      node.boxMinZ[i] = valid ? children[i].boxMin.z : 0.0f;
+      node.boxMaxX[i] = valid ? children[i].boxMax.x : 0.0f;
+      node.boxMaxY[i] = valid ? children[i].boxMax.y : 0.0f;
+      node.boxMaxZ[i] = valid ? children[i].boxMax.z : 0.0f;
+      node.childOffset[i] = offset;
+    }
+
+    return currNodeIndex;
+  }
+};
+
+template<uint32_t WIDTH>
+std::vector< BVHNodeWide<WIDTH> > BVH2FatToWide(const BVHNodePair* a_nodes, size_t a_nodesNum)
+{
+  std::vector< BVHNodeWide<WIDTH> > result;
+  if (a_nodesNum == 0)
+    return result;
+
+  result.reserve(a_nodesNum);
+  TreeConverterWide<WIDTH> tc(a_nodes, result);
+  tc.ProcessBVHNode(0);
+
+  result.shrink_to_fit();
+  return result;
+}
+
+template std::vector< BVHNodeWide<4> > BVH2FatToWide<4>(const BVHNodePair* a_nodes, size_t a_nodesNum);
+template std::vector< BVHNodeWide<8> > BVH2FatToWide<8>(const BVHNodePair* a_nodes, size_t a_nodesNum);
+
+template<typename QT>
+struct TreeQuantizer
+{
+  TreeQuantizer(const BVHNodePair* a_input, std::vector< BVHNodePairQuantized<QT> >& a_out) : m_input(a_input), m_out(a_out) {}
+
+  const BVHNodePair* m_input;
+  std::vector< BVHNodePairQuantized<QT> >& m_out;
+
+  // rounding is checked with the same decode function that traversal uses, so decoded box always contains the original one
+  static void QuantizeAxis(float a_min, float a_max, float a_parentMin, float a_parentMax, QT* pMin, QT* pMax)
+  {
+    constexpr int QMAX = std::numeric_limits<QT>::max();
+    const float extent = a_parentMax - a_parentMin;
+    if (!(extent > 0.0f))
+    {
+      *pMin = 0;
+      *pMax = QT(QMAX);
+      return;
+    }
+
+    int qMin = std::max(0,    std::min(QMAX, int(std::floor((a_min - a_parentMin)/extent*float(QMAX)))));
+    int qMax = std::max(qMin, std::min(QMAX, int(std::ceil ((a_max - a_parentMin)/extent*float(QMAX)))));
+    while (qMin > 0 && DecodeQuantized(QT(qMin), a_parentMin, a_parentMax) > a_min)
+      qMin--;
+    while (qMax < QMAX && DecodeQuantized(QT(qMax), a_parentMin, a_parentMax) < a_max)
+      qMax++;
+    
+    *pMin = QT(qMin);
+    *pMax = QT(qMax);
+  }
+
+  static void QuantizeBox(const BVHNode& a_node, float3 a_parentMin, float3 a_parentMax, QT qMin[3], QT qMax[3])
+  {
+    QuantizeAxis(a_node.boxMin.x, a_node.boxMax.x, a_parentMin.x, a_parentMax.x, &qMin[0], &qMax[0]);
+    QuantizeAxis(a_node.boxMin.y, a_node.boxMax.y, a_parentMin.y, a_parentMax.y, &qMin[1], &qMax[1]);
+    QuantizeAxis(a_node.boxMin.z, a_node.boxMax.z, a_parentMin.z, a_parentMax.z, &qMin[2], &qMax[2]);
+  }
+
+  void ProcessBVHNode(uint32_t pairId, float3 a_boxMin, float3 a_boxMax)
+  {
+    const BVHNodePair& pair = m_input[pairId];
+    BVHNodePairQuantized<QT>& qNode = m_out[pairId];
+
+    QuantizeBox(pair.left,  a_boxMin, a_boxMax, qNode.leftMin,  qNode.leftMax);
+    QuantizeBox(pair.right, a_boxMin, a_boxMax, qNode.rightMin, qNode.rightMax);
+    qNode.leftOffset  = pair.left.leftOffset;
+    qNode.rightOffset = pair.right.leftOffset;
+
+    // children are quantized relative to decoded box of their parent, exactly as traversal will see it
+    //
+    float3 childMin, childMax;
+    if ((pair.left.leftOffset & LEAF_BIT) == 0)
+    {
+      DecodeQuantizedBox(qNode.leftMin, qNode.leftMax, a_boxMin, a_boxMax, &childMin, &childMax);
+      ProcessBVHNode(pair.left.leftOffset, childMin, childMax);
+    }
+    if ((pair.right.leftOffset & LEAF_BIT) == 0)
+    {
+      DecodeQuantizedBox(m_out[pairId].rightMin, m_out[pairId].rightMax, a_boxMin, a_boxMax, &childMin, &childMax);
+      ProcessBVHNode(pair.right.leftOffset, childMin, childMax);
+    }
+  }
+};
+
+template<typename QT>
+std::vector< BVHNodePairQuantized<QT> > QuantizeBVH2Fat(const BVHNodePair* a_nodes, size_t a_nodesNum, float3* a_rootMin, float3* a_rootMax)
+{
+  std::vector< BVHNodePairQuantized<QT> > result(a_nodesNum);
+  if (a_nodesNum == 0)
+    return result;
+
+  *a_rootMin = min(a_nodes[0].left.boxMin, a_nodes[0].right.boxMin);
+  *a_rootMax = max(a_nodes[0].left.boxMax, a_nodes[0].right.boxMax);
+
+  TreeQuantizer<QT> tq(a_nodes, result);
+  tq.ProcessBVHNode(0, *a_rootMin, *a_rootMax);
+  return result;
+}
+
+template std::vector< BVHNodePairQuantized<uint8_t>  > QuantizeBVH2Fat<uint8_t> (const BVHNodePair* a_nodes, size_t a_nodesNum, float3* a_rootMin, float3* a_rootMax);
+template std::vector< BVHNodePairQuantized<uint16_t> > QuantizeBVH2Fat<uint16_t>(const BVHNodePair* a_nodes, size_t a_nodesNum, float3* a_rootMin, float3* a_rootMax);
+
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 double g_buildTime;
@@ -167,13 +336,21 @@ BVHTreeFat BuildBVHFat(const float* a_vpos3f,     size_t a_vertNum, size_t a_vBy
 
 BVHTreeFat BuildBVHFatCustom(const BVHNode* a_nodes, size_t a_objNum, BuilderPresets a_presets, LayoutPresets a_layout)
 {
+  // custom primitives are intersected one box per leaf, so both builders get the same leaf size
+  a_presets.primsInLeaf = 1;
+
+  // embree path is not worth it for large number of boxes, native builder is parallel from the top.
+  // Builder named in build name is always used as is
+  const size_t NATIVE_SAH_MIN_OBJECTS = 1 << 16;
+  if (a_presets.nativeSAH || (!a_presets.builderChosen && a_objNum >= NATIVE_SAH_MIN_OBJECTS))
+    return BuildBVHFatSAH(a_nodes, a_objNum, a_presets);
+
   std::vector<BVHNodePair> bvhFat;
   std::vector<uint32_t>   objIndicesReordered;
   
   // (1) build
   {
     a_presets.format    = BVH2_LEFT_OFFSET;
-    a_presets.primsInLeaf = 1;
     auto bvhData        = BuildBVH(a_nodes, a_objNum, a_presets);
     bvhFat              = CreateFatTreeArray(bvhData.nodes);
     objIndicesReordered = bvhData.indicesReordered;
@@ -0,0 +1,385 @@
+#include <vector>
+#include <algorithm>
+#include <cfloat>
+
+#include "omp.h"
+#include "cbvh.h"
+
+using LiteMath::min;
+using LiteMath::max;
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Native binned SAH builder for custom AABBs (i.e. SDF bricks). Top levels of the tree are split with parallel binning,
+// subtrees that are small enough are built independently in parallel and then appended to the output array
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+namespace sah
+{
+  static constexpr uint32_t LEAF_BIT   = 0x80000000;
+  static constexpr uint32_t START_MASK = 0x00FFFFFF;
+  static constexpr uint32_t SIZE_MASK  = 0x7F000000;
+
+  static constexpr int      BINS_NUM           = 32;
+  static constexpr uint32_t PARALLEL_BINNING   = 1 << 16; //ranges larger than this are binned with all threads
+  static constexpr uint32_t SUBTREE_MAX_SIZE   = 1 << 14; //ranges smaller than this become independent subtrees
+
+  //the same packing as BuildBVH uses: first object of the leaf and number of objects
+  static inline uint32_t PackLeaf(uint32_t objId, uint32_t count)
+  {
+    return LEAF_BIT | ((count << 24) & SIZE_MASK) | (objId & START_MASK);
+  }
+
+  struct AABB
+  {
+    float3 boxMin = float3( FLT_MAX);
+    float3 boxMax = float3(-FLT_MAX);
+
+    void include(float3 p)         { boxMin = min(boxMin, p);         boxMax = max(boxMax, p); }
+    void include(const AABB& a_box) { boxMin = min(boxMin, a_box.boxMin); boxMax = max(boxMax, a_box.boxMax); }
+    float halfArea() const
+    {
+      const float3 d = max(boxMax - boxMin, float3(0.0f));
+      return d.x*d.y + d.y*d.z + d.z*d.x;
+    }
+  };
+
+  struct Range
+  {
+    uint32_t begin;
+    uint32_t end;
+    AABB     bounds;   //union of primitive boxes
+    AABB     centers;  //bounds of primitive centers, used for binning
+  };
+
+  struct Bin
+  {
+    AABB     bounds;
+    AABB     centers;
+    uint32_t count = 0;
+  };
+
+  struct Bins
+  {
+    Bin bins[3][BINS_NUM];
+
+    void merge(const Bins& a_other)
+    {
+      for (int axis = 0; axis < 3; axis++)
+      {
+        for (int b = 0; b < BINS_NUM; b++)
+        {
+          bins[axis][b].bounds.include(a_other.bins[axis][b].bounds);
+          bins[axis][b].centers.include(a_other.bins[axis][b].centers);
+          bins[axis][b].count += a_other.bins[axis][b].count;
+        }
+      }
+    }
+  };
+
+  struct Split
+  {
+    int   axis = -1;
+    int   bin  = 0;
+    float cost = FLT_MAX;
+    Range left, right;
+  };
+
+  struct Builder
+  {
+    Builder(const BVHNode* a_boxes, size_t a_objNum, uint32_t a_leafSize) : 
+      m_boxes(a_boxes), m_centers(a_objNum), m_ids(a_objNum), m_leafSize(std::max(a_leafSize, 1u)) {}
+
+    const BVHNode*        m_boxes;
+    std::vector<float3>   m_centers;
+    std::vector<uint32_t> m_ids;
+    uint32_t              m_leafSize; //ranges with this number of objects or less become leaves
+
+    struct Subtree
+    {
+      Range    range;
+      uint32_t parentPair;
+      int      side;
+    };
+
+    static inline int BinId(float a_center, float a_min, float a_scale)
+    {
+      return std::max(0, std::min(BINS_NUM - 1, int((a_center - a_min)*a_scale)));
+    }
+
+    static inline float BinScale(const AABB& a_centers, int a_axis)
+    {
+      const float extent = a_centers.boxMax[a_axis] - a_centers.boxMin[a_axis];
+      return extent > 0.0f ? float(BINS_NUM)*0.9999f/extent : 0.0f;
+    }
+
+    void BinPrimitive(Bins& a_bins, const AABB& a_centers, const float3 a_scale, uint32_t i) const
+    {
+      const uint32_t id  = m_ids[i];
+      const float3   c   = m_centers[id];
+      for (int axis = 0; axis < 3; axis++)
+      {
+        Bin& bin = a_bins.bins[axis][BinId(c[axis], a_centers.boxMin[axis], a_scale[axis])];
+        bin.bounds.include(m_boxes[id].boxMin);
+        bin.bounds.include(m_boxes[id].boxMax);
+        bin.centers.include(c);
+        bin.count++;
+      }
+    }
+
+    Split FindSplit(const Range& a_range) const
+    {
+      const float3 scale = float3(BinScale(a_range.centers, 0), BinScale(a_range.centers, 1), BinScale(a_range.centers, 2));
+
+      Bins bins;
+      const uint32_t size = a_range.end - a_range.begin;
+      if (size >= PARALLEL_BINNING)
+      {
+        std::vector<Bins> threadBins(omp_get_max_threads());
+        #pragma omp parallel for schedule(static)
+        for (int64_t i = a_range.begin; i < int64_t(a_range.end); i++)
+          BinPrimitive(threadBins[omp_get_thread_num()], a_range.centers, scale, uint32_t(i));
+        for (const auto& tb : threadBins)
+          bins.merge(tb);
+      }
+      else
+      {
+        for (uint32_t i = a_range.begin; i < a_range.end; i++)
+          BinPrimitive(bins, a_range.centers, scale, i);
+      }
+
+      // sweep bins from both sides, the cost of split after bin b is A(left)*N(left) + A(right)*N(right)
+      //
+      Split best;
+      for (int axis = 0; axis < 3; axis++)
+      {
+        if (scale[axis] == 0.0f)
+          continue;
+
+        float    rightCost[BINS_NUM];
+        AABB     acc;
+        uint32_t count = 0;
+        for (int b = BINS_NUM - 1; b > 0; b--)
+        {
+          acc.include(bins.bins[axis][b].bounds);
+          count += bins.bins[axis][b].count;
+          rightCost[b] = acc.halfArea()*float(count);
+        }
+
+        acc = AABB();
+        count = 0;
+        for (int b = 0; b < BINS_NUM - 1; b++)
+        {
+          acc.include(bins.bins[axis][b].bounds);
+          count += bins.bins[axis][b].count;
+          const float cost = acc.halfArea()*float(count) + rightCost[b + 1];
+          if (count > 0 && count < size && cost < best.cost)
+          {
+            best.axis = axis;
+            best.bin  = b;
+            best.cost = cost;
+          }
+        }
+      }
+
+      if (best.axis < 0)
+        return best;
+
+      // children bounds are known from bins, so no additional pass over primitives is needed
+      //
+      best.left.begin  = a_range.begin;
+      best.right.end   = a_range.end;
+      uint32_t leftNum = 0;
+      for (int b = 0; b < BINS_NUM; b++)
+      {
+        const Bin& bin = bins.bins[best.axis][b];
+        Range& child = (b <= best.bin) ? best.left : best.right;
+        child.bounds.include(bin.bounds);
+        child.centers.include(bin.centers);
+        if (b <= best.bin)
+          leftNum += bin.count;
+      }
+      best.left.end    = a_range.begin + leftNum;
+      best.right.begin = best.left.end;
+      return best;
+    }
+
+    Range MakeRange(uint32_t a_begin, uint32_t a_end) const
+    {
+      Range range;
+      range.begin = a_begin;
+      range.end   = a_end;
+      for (uint32_t i = a_begin; i < a_end; i++)
+      {
+        const uint32_t id = m_ids[i];
+        range.bounds.include(m_boxes[id].boxMin);
+        range.bounds.include(m_boxes[id].boxMax);
+        range.centers.include(m_centers[id]);
+      }
+      return range;
+    }
+
+    void SplitRange(const Range& a_range, Range* a_left, Range* a_right)
+    {
+      const Split split = FindSplit(a_range);
+      if (split.axis < 0)
+      {
+        // all centers are in the same point, just split in the middle
+        const uint32_t mid = (a_range.begin + a_range.end)/2;
+        *a_left  = MakeRange(a_range.begin, mid);
+        *a_right = MakeRange(mid, a_range.end);
+        return;
+      }
+
+      const int   axis  = split.axis;
+      const float cmin  = a_range.centers.boxMin[axis];
+      const float scale = BinScale(a_range.centers, axis);
+      std::partition(m_ids.begin() + a_range.begin, m_ids.begin() + a_range.end,
+                     [&](uint32_t id) { return BinId(m_centers[id][axis], cmin, scale) <= split.bin; });
+      *a_left  = split.left;
+      *a_right = split.right;
+    }
+
+    BVHNode MakeChild(const Range& a_range) const
+    {
+      BVHNode node;
+      node.boxMin      = a_range.bounds.boxMin;
+      node.boxMax      = a_range.bounds.boxMax;
+      const uint32_t size = a_range.end - a_range.begin;
+      node.leftOffset  = (size <= m_leafSize) ? PackLeaf(m_ids[a_range.begin], size) : 0;
+      node.escapeIndex = 0;
+      return node;
+    }
+
+    // serial recursive build of a subtree, returns index of its root pair in a_out
+    uint32_t BuildSubtree(const Range& a_range, std::vector<BVHNodePair>& a_out)
+    {
+      Range left, right;
+      SplitRange(a_range, &left, &right);
+
+      const uint32_t pairId = uint32_t(a_out.size());
+      a_out.push_back(BVHNodePair{MakeChild(left), MakeChild(right)});
+      if (left.end - left.begin > m_leafSize)
+      {
+        const uint32_t offset = BuildSubtree(left, a_out);
+        a_out[pairId].left.leftOffset = offset;
+      }
+      if (right.end - right.begin > m_leafSize)
+      {
+        const uint32_t offset = BuildSubtree(right, a_out);
+        a_out[pairId].right.leftOffset = offset;
+      }
+      return pairId;
+    }
+
+    // top levels are built breadth-first with parallel binning, large enough subtrees are postponed
+    void BuildTop(const Range& a_root, std::vector<BVHNodePair>& a_out, std::vector<Subtree>& a_subtrees)
+    {
+      std::vector<Subtree> queue;
+      queue.push_back({a_root, uint32_t(-1), 0});
+      for (size_t q = 0; q < queue.size(); q++)
+      {
+        const Subtree task = queue[q];
+        Range children[2];
+        SplitRange(task.range, &children[0], &children[1]);
+
+        const uint32_t pairId = uint32_t(a_out.size());
+        a_out.push_back(BVHNodePair{MakeChild(children[0]), MakeChild(children[1])});
+        if (task.parentPair != uint32_t(-1))
+          (task.side == 0 ? a_out[task.parentPair].left : a_out[task.parentPair].right).leftOffset = pairId;
+
+        for (int side = 0; side < 2; side++)
+        {
+          const uint32_t size = children[side].end - children[side].begin;
+          if (size > SUBTREE_MAX_SIZE)
+            queue.push_back({children[side], pairId, side});
+          else if (size > m_leafSize)
+            a_subtrees.push_back({children[side], pairId, side});
+        }
+      }
+    }
+  };
+}
+
+BVHTreeFat BuildBVHFatSAH(const BVHNode* a_nodes, size_t a_objNum, BuilderPresets a_presets)
+{
+  std::vector<BVHNodePair> bvhFat;
+  if (a_objNum == 0)
+    return BVHTreeFat(bvhFat, std::vector<uint32_t>());
+
+  sah::Builder builder(a_nodes, a_objNum, uint32_t(std::max(a_presets.primsInLeaf, 1)));
+
+  #pragma omp parallel for schedule(static)
+  for (int64_t i = 0; i < int64_t(a_objNum); i++)
+  {
+    builder.m_centers[i] = 0.5f*(a_nodes[i].boxMin + a_nodes[i].boxMax);
+    builder.m_ids[i]     = uint32_t(i);
+  }
+
+  if (a_objNum == 1)
+  {
+    // single object, right child is an empty leaf that traversal skips
+    BVHNode empty;
+    empty.boxMin      = float3(0.0f);
+    empty.boxMax      = float3(0.0f);
+    empty.leftOffset  = 0xFFFFFFFF;
+    empty.escapeIndex = 0;
+    bvhFat.push_back(BVHNodePair{builder.MakeChild(builder.MakeRange(0, 1)), empty});
+    return BVHTreeFat(bvhFat, builder.m_ids);
+  }
+
+  // root bounds, the only full pass over primitives except for binning
+  //
+  sah::Range root;
+  {
+    std::vector<sah::Range> threadRanges(omp_get_max_threads());
+    #pragma omp parallel for schedule(static)
+    for (int64_t i = 0; i < int64_t(a_objNum); i++)
+    {
+      sah::Range& r = threadRanges[omp_get_thread_num()];
+      r.bounds.include(a_nodes[i].boxMin);
+      r.bounds.include(a_nodes[i].boxMax);
+      r.centers.include(builder.m_centers[i]);
+    }
+    root.begin = 0;
+    root.end   = uint32_t(a_objNum);
+    for (const auto& r : threadRanges)
+    {
+      root.bounds.include(r.bounds);
+      root.centers.include(r.centers);
+    }
+  }
+
+  std::vector<sah::Builder::Subtree> subtrees;
+  bvhFat.reserve(a_objNum);
+  builder.BuildTop(root, bvhFat, subtrees);
+
+  // subtrees work on disjoint parts of m_ids, so they can be built independently
+  //
+  std::vector< std::vector<BVHNodePair> > subtreeNodes(subtrees.size());
+  #pragma omp parallel for schedule(dynamic)
+  for (int i = 0; i < int(subtrees.size()); i++)
+  {
+    subtreeNodes[i].reserve(subtrees[i].range.end - subtrees[i].range.begin);
+    builder.BuildSubtree(subtrees[i].range, subtreeNodes[i]);
+  }
+
+  for (size_t i = 0; i < subtrees.size(); i++)
+  {
+    const uint32_t base = uint32_t(bvhFat.size());
+    for (auto pair : subtreeNodes[i])
+    {
+      if ((pair.left.leftOffset & sah::LEAF_BIT) == 0)
+        pair.left.leftOffset += base;
+      if ((pair.right.leftOffset & sah::LEAF_BIT) == 0)
+        pair.right.leftOffset += base;
+      bvhFat.push_back(pair);
+    }
+    BVHNodePair& parent = bvhFat[subtrees[i].parentPair];
+    (subtrees[i].side == 0 ? parent.left : parent.right).leftOffset = base;
+  }
+
+  if (builder.m_leafSize > 1)
+    std::cout << "[BuildBVHFatSAH] warning: leaf contains more than one primitive!" << std::endl;
+
+  return BVHTreeFat(bvhFat, builder.m_ids);
+}
@@ -158,6 +158,7 @@ public:
   void SetLights(const std::vector<Light>& lights);
   
   uint32_t AddInstance(uint32_t a_geomId, const LiteMath::float4x4& a_matrix);
+  void     UpdateInstance(uint32_t a_instanceId, const LiteMath::float4x4& a_matrix); //call CommitScene on accel struct after all updates
   
 #ifndef KERNEL_SLICER 
   void add_mesh_internal(const cmesh4::SimpleMesh& mesh, unsigned geomId);
@@ -166,6 +167,7 @@ public:
 
   LiteMath::float4x4 getProj() { return m_proj; }
   LiteMath::float4x4 getWorldView() { return m_worldView; }
+  float GetPixelAngle(); //angle covered by one pixel of current camera, 0 for orthographic projection
 
   const std::vector<MultiRendererMaterial>& getMaterials() { return m_materials; }
   const std::vector<std::shared_ptr<ICombinedImageSampler>> &getTextures() { return m_textures; }
@@ -173,6 +175,10 @@ public:
   void setSeed(uint32_t seed) { m_seed = seed; }
   uint32_t getSeed() const { return m_seed; }
 
+  //render on CPU with one thread, required for per-pixel debug
+  void setDebugSingleThread(bool enable) { m_debugSingleThread = enable; }
+  bool getDebugSingleThread() const { return m_debugSingleThread; }
+
   HydraSceneProperties AnalyzeHydraScene(const std::string& a_path);
 
 protected:
@@ -202,6 +208,7 @@ protected:
   uint32_t m_packedXY_height;
   MultiRenderPreset m_preset;
   uint32_t m_seed;
+  bool m_debugSingleThread = false;
 
   LiteMath::float4x4 m_proj;
   LiteMath::float4x4 m_worldView;
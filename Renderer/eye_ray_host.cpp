@@ -1,5 +1,6 @@
 #include <cfloat>
 #include <cstring>
+#include <algorithm>
 #include <sstream>
 #include <fstream>
 
@@ -64,6 +65,14 @@ void MultiRenderer::UpdateCamera(const LiteMath::float4x4& worldView, const Lite
   m_worldViewInv = inverse4x4(worldView);
 }
 
+float MultiRenderer::GetPixelAngle()
+{
+  //perspective projection has zero in the bottom right corner, pixel size of orthographic one does not depend on distance
+  if (m_proj(3,3) != 0.0f || m_height == 0)
+    return 0.0f;
+  return 2.0f/(m_proj(1,1)*float(m_height));
+}
+
 bool MultiRenderer::LoadSceneHydra(const std::string& a_path)
 {
   hydra_xml::HydraScene scene;
@@ -245,6 +254,13 @@ HydraSceneProperties MultiRenderer::AnalyzeHydraScene(const std::string& a_path)
 
 void MultiRenderer::Render(uint32_t* a_outColor, uint32_t a_width, uint32_t a_height, const char* a_what, int a_passNum)
 {
+  //out-of-core SBS bricks loaded during the previous frame become visible in this one
+  if (BVHRT *bvhrt = dynamic_cast<BVHRT*>(m_pAccelStruct->UnderlyingImpl(0)))
+  {
+    bvhrt->UpdateStreaming();
+    bvhrt->SetLodPixelAngle(GetPixelAngle());
+  }
+
   profiling::Timer timer;
   for (int i=0;i<a_passNum;i++)
     CastRaySingleBlock(m_packedXY_width*m_packedXY_height, a_outColor, a_passNum);
@@ -253,17 +269,37 @@ void MultiRenderer::Render(uint32_t* a_outColor, uint32_t a_width, uint32_t a_he
 
 void MultiRenderer::CastRaySingleBlock(uint32_t tidX, uint32_t * out_color, uint32_t a_numPasses)
 {
-  //CPU version is mostly used by debug, so better make it single-threaded
-  //also per-pixel debug does not work with multithreading
-  // #ifndef _DEBUG
-  // #pragma omp parallel for default(shared) schedule(dynamic)
-  // #endif
-  for(int i=0;i<tidX;i++)
-    CastRaySingle(i, out_color);
+  //per-pixel debug does not work with multithreading, so keep single-threaded path for it
+  if (m_debugSingleThread)
+  {
+    for(int i=0;i<tidX;i++)
+      CastRaySingle(i, out_color);
+    return;
+  }
+
+  //m_packedXY stores every PACK_XY_BLOCK_SIZE x PACK_XY_BLOCK_SIZE tile as consecutive elements,
+  //so we schedule whole tiles to keep rays inside one task coherent
+  constexpr int tileSize = PACK_XY_BLOCK_SIZE*PACK_XY_BLOCK_SIZE;
+  const int tilesCount = (tidX + tileSize - 1)/tileSize;
+
+  #pragma omp parallel for default(shared) schedule(dynamic)
+  for(int tile=0;tile<tilesCount;tile++)
+  {
+    const int start = tile*tileSize;
+    const int end   = std::min<int>(start + tileSize, tidX);
+    for(int i=start;i<end;i++)
+      CastRaySingle(i, out_color);
+  }
 }
 
 void MultiRenderer::RenderFloat(float4* a_outColor, uint32_t a_width, uint32_t a_height, const char* a_what, int a_passNum)
 {
+  if (BVHRT *bvhrt = dynamic_cast<BVHRT*>(m_pAccelStruct->UnderlyingImpl(0)))
+  {
+    bvhrt->UpdateStreaming();
+    bvhrt->SetLodPixelAngle(GetPixelAngle());
+  }
+
   profiling::Timer timer;
   for (int i=0;i<a_passNum;i++)
     CastRayFloatSingleBlock(m_packedXY_width*m_packedXY_height, a_outColor, a_passNum);
@@ -272,13 +308,24 @@ void MultiRenderer::RenderFloat(float4* a_outColor, uint32_t a_width, uint32_t a
 
 void MultiRenderer::CastRayFloatSingleBlock(uint32_t tidX, float4 * out_color, uint32_t a_numPasses)
 {
-  //CPU version is mostly used by debug, so better make it single-threaded
-  //also per-pixel debug does not work with multithreading
-  //#ifndef _DEBUG
-  #pragma omp parallel for default(shared)
-  //#endif
-  for(int i=0;i<tidX;i++)
-    CastRayFloatSingle(i, out_color);
+  if (m_debugSingleThread)
+  {
+    for(int i=0;i<tidX;i++)
+      CastRayFloatSingle(i, out_color);
+    return;
+  }
+
+  constexpr int tileSize = PACK_XY_BLOCK_SIZE*PACK_XY_BLOCK_SIZE;
+  const int tilesCount = (tidX + tileSize - 1)/tileSize;
+
+  #pragma omp parallel for default(shared) schedule(dynamic)
+  for(int tile=0;tile<tilesCount;tile++)
+  {
+    const int start = tile*tileSize;
+    const int end   = std::min<int>(start + tileSize, tidX);
+    for(int i=start;i<end;i++)
+      CastRayFloatSingle(i, out_color);
+  }
 }
 
 const char* MultiRenderer::Name() const
@@ -681,6 +728,13 @@ uint32_t MultiRenderer::AddInstance(uint32_t a_geomId, const LiteMath::float4x4&
   return m_pAccelStruct->AddInstance(a_geomId, a_matrix);
 }
 
+void MultiRenderer::UpdateInstance(uint32_t a_instanceId, const LiteMath::float4x4& a_matrix)
+{
+  if (a_instanceId < m_instanceTransformInvTransposed.size())
+    m_instanceTransformInvTransposed[a_instanceId] = transpose(inverse4x4(a_matrix));
+  m_pAccelStruct->UpdateInstance(a_instanceId, a_matrix);
+}
+
 #if defined(USE_GPU)
   #if defined(USE_RTX)
     #include "eye_ray_rtx.h"
@@ -43,6 +43,7 @@ static constexpr unsigned SDF_OCTREE_NODE_INTERSECT_ANALYTIC = 1;// Explicitly f
 static constexpr unsigned SDF_OCTREE_NODE_INTERSECT_NEWTON   = 2;// Using Newton method to find ray/sdf intersection inside node
 static constexpr unsigned SDF_OCTREE_NODE_INTERSECT_BBOX     = 3;// Intersect with node bbox for debug purposes
 static constexpr unsigned SDF_OCTREE_NODE_INTERSECT_IT       = 4;// Interval tracing inside node
+static constexpr unsigned SDF_OCTREE_NODE_INTERSECT_ST_RELAXED = 5;// Over-relaxed sphere tracing with Lipschitz-bounded steps
 
 //enum MultiRenderMode
 static constexpr unsigned MULTI_RENDER_MODE_MASK                 =  0; //white object, black background
@@ -83,6 +84,10 @@ static constexpr unsigned INTERPOLATION_MODE_TRICUBIC  = 1;
 static constexpr unsigned REPRESENTATION_MODE_SURFACE = 0;
 static constexpr unsigned REPRESENTATION_MODE_VOLUME  = 1;
 
+//enum LodMode
+static constexpr unsigned LOD_MODE_NONE         = 0; //always intersect the finest level
+static constexpr unsigned LOD_MODE_SCREEN_SPACE = 1; //stop at the node whose projected size is below lod_pixel_threshold pixels
+
 struct MultiRenderPreset
 {
   unsigned render_mode;        //enum MultiRenderMode
@@ -92,6 +97,8 @@ struct MultiRenderPreset
   unsigned interpolation_mode; //enum InterpolationMode
   unsigned representation_mode;//enum RepresentationMode
   unsigned spp;                //samples per pixel
+  unsigned lod_mode;           //enum LodMode
+  float lod_pixel_threshold;   //projected node size (in pixels) below which the node is not refined
 };
 
 static MultiRenderPreset getDefaultPreset()
@@ -105,5 +112,7 @@ static MultiRenderPreset getDefaultPreset()
   p.representation_mode = REPRESENTATION_MODE_VOLUME;
 
   p.spp = 1;
+  p.lod_mode = LOD_MODE_NONE;
+  p.lod_pixel_threshold = 1.0f;
   return p;
 }
\ No newline at end of file
@@ -1,6 +1,7 @@
 #include "sdf_scene.h"
 #include <cassert>
 #include <fstream>
+#include <algorithm>
 #include "cmesh4.h"
 #include "utils/mesh.h"
 
@@ -874,4 +875,102 @@ SdfSBSAdaptView convert_sbs_to_adapt_with_split(SdfSBSAdapt &adapt_scene, const
     adapt_scene.nodes.push_back(new_node);
   }
   return adapt_scene;
-}
\ No newline at end of file
+}
+
+//interleaves lower 21 bits of x with two zero bits
+static uint64_t morton_spread_21(uint64_t x)
+{
+  x &= 0x1FFFFF;
+  x = (x | x << 32) & 0x001F00000000FFFFull;
+  x = (x | x << 16) & 0x001F0000FF0000FFull;
+  x = (x | x <<  8) & 0x100F00F00F00F00Full;
+  x = (x | x <<  4) & 0x10C30C30C30C30C3ull;
+  x = (x | x <<  2) & 0x1249249249249249ull;
+  return x;
+}
+
+//key is calculated from the brick center, so bricks from different LODs are ordered properly too
+static uint64_t sbs_brick_morton_key(const SdfSBSNode &node)
+{
+  const float px = node.pos_xy >> 16;
+  const float py = node.pos_xy & 0x0000FFFF;
+  const float pz = node.pos_z_lod_size >> 16;
+  const float sz = node.pos_z_lod_size & 0x0000FFFF;
+
+  const float max_coord = float((1u << 21) - 1);
+  const uint64_t x = std::min(max_coord, (px + 0.5f)/sz * max_coord);
+  const uint64_t y = std::min(max_coord, (py + 0.5f)/sz * max_coord);
+  const uint64_t z = std::min(max_coord, (pz + 0.5f)/sz * max_coord);
+  return morton_spread_21(x) | (morton_spread_21(y) << 1) | (morton_spread_21(z) << 2);
+}
+
+//only order of bricks is checked, order of value blocks is not, as bricks can share the same block
+bool is_sbs_morton_ordered(const SdfSBSView &scene)
+{
+  for (unsigned i = 1; i < scene.size; i++)
+  {
+    if (sbs_brick_morton_key(scene.nodes[i-1]) > sbs_brick_morton_key(scene.nodes[i]))
+      return false;
+  }
+  return true;
+}
+
+void reorder_sbs_morton(SdfSBS &scene)
+{
+  const unsigned n = scene.nodes.size();
+  if (n < 2)
+    return;
+
+  std::vector<std::pair<uint64_t, uint32_t>> keys(n);
+  for (unsigned i = 0; i < n; i++)
+    keys[i] = {sbs_brick_morton_key(scene.nodes[i]), i};
+  std::sort(keys.begin(), keys.end());
+
+  std::vector<uint32_t> new_index(n);
+  for (unsigned i = 0; i < n; i++)
+    new_index[keys[i].second] = i;
+
+  //value blocks are not required to have the same size, but they are contiguous,
+  //so size of each block is a distance to the next one. Some bricks can share the same block
+  std::vector<uint32_t> block_offsets(n);
+  for (unsigned i = 0; i < n; i++)
+    block_offsets[i] = scene.nodes[i].data_offset;
+  std::sort(block_offsets.begin(), block_offsets.end());
+  block_offsets.erase(std::unique(block_offsets.begin(), block_offsets.end()), block_offsets.end());
+  std::vector<uint32_t> block_new_offsets(block_offsets.size(), INVALID_IDX);
+
+  const unsigned v_size = scene.header.brick_size + 2*scene.header.brick_pad + 1;
+  const unsigned nbr_offset = v_size*v_size*v_size + 8;
+  const bool with_neighbors = (scene.header.aux_data & SDF_SBS_NODE_LAYOUT_MASK) == SDF_SBS_NODE_LAYOUT_ID32F_IRGB32F_IN;
+
+  std::vector<SdfSBSNode> new_nodes(n);
+  std::vector<uint32_t> new_values;
+  new_values.reserve(scene.values.size());
+
+  for (unsigned i = 0; i < n; i++)
+  {
+    SdfSBSNode node = scene.nodes[keys[i].second];
+    unsigned block_id = std::lower_bound(block_offsets.begin(), block_offsets.end(), node.data_offset) - block_offsets.begin();
+    if (block_new_offsets[block_id] == INVALID_IDX)
+    {
+      unsigned block_end = block_id + 1 < block_offsets.size() ? block_offsets[block_id + 1] : scene.values.size();
+      block_new_offsets[block_id] = new_values.size();
+      new_values.insert(new_values.end(), scene.values.begin() + node.data_offset, scene.values.begin() + block_end);
+
+      if (with_neighbors)
+      {
+        for (unsigned j = 0; j < 27; j++)
+        {
+          uint32_t &nbr = new_values[block_new_offsets[block_id] + nbr_offset + j];
+          if (nbr != INVALID_IDX)
+            nbr = new_index[nbr];
+        }
+      }
+    }
+    node.data_offset = block_new_offsets[block_id];
+    new_nodes[i] = node;
+  }
+
+  scene.nodes = std::move(new_nodes);
+  scene.values = std::move(new_values);
+}
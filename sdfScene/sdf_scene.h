@@ -474,8 +474,14 @@ class ISdfGridFunction
 public:
   virtual void init(SdfGridView octree) = 0; 
   virtual float eval_distance(float3 pos) = 0;
+  virtual void eval_distance(const float3 *pos, float *dist, unsigned n)
+  {
+    for (unsigned i = 0; i < n; i++)
+      dist[i] = eval_distance(pos[i]);
+  }
 };
 std::shared_ptr<ISdfGridFunction> get_SdfGridFunction(SdfGridView scene);
+std::shared_ptr<ISdfGridFunction> get_SdfSBSFunction(SdfSBSView scene); //eval_distance works for SBS, init is not used
 
 struct ModelInfo
 {
@@ -537,4 +543,9 @@ void save_sdf_scene_hydra(const SdfScene &scene, const std::string &folder, cons
 
 SdfSBSAdaptView convert_sbs_to_adapt(SdfSBSAdapt &adapt_scene, const SdfSBSView &scene);
 SdfSBSAdaptView convert_sbs_to_adapt_with_split(SdfSBSAdapt &adapt_scene, const SdfSBSView &scene);
+
+//reorders bricks and their value blocks along Z-order curve, so that bricks close in space are close in memory
+//data_offset and neighbor indices (for SDF_SBS_NODE_LAYOUT_ID32F_IRGB32F_IN) are remapped, values_f are not changed
+void reorder_sbs_morton(SdfSBS &scene);
+bool is_sbs_morton_ordered(const SdfSBSView &scene);
 #endif
\ No newline at end of file
@@ -0,0 +1,205 @@
+#include "sdf_scene_mapped.h"
+#include <cassert>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define SDF_CONTAINER_USE_MMAP
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+static uint64_t align_up(uint64_t v)
+{
+  return (v + SDF_CONTAINER_ALIGNMENT - 1) / SDF_CONTAINER_ALIGNMENT * SDF_CONTAINER_ALIGNMENT;
+}
+
+//arrays are written one after another, each one starts from the page boundary
+static void save_container(uint32_t type, const void *scene_header, uint32_t scene_header_size,
+                           uint32_t arrays_count, const void *const *arrays, const uint64_t *sizes,
+                           const std::string &path)
+{
+  SdfContainerHeader header;
+  memset(&header, 0, sizeof(SdfContainerHeader));
+  header.magic = SDF_CONTAINER_MAGIC;
+  header.version = SDF_CONTAINER_VERSION;
+  header.type = type;
+  header.arrays_count = arrays_count;
+  assert(scene_header_size <= sizeof(header.scene_header));
+  if (scene_header)
+    memcpy(header.scene_header, scene_header, scene_header_size);
+
+  uint64_t offset = align_up(sizeof(SdfContainerHeader));
+  for (uint32_t i = 0; i < arrays_count; i++)
+  {
+    header.array_offsets[i] = offset;
+    header.array_sizes[i] = sizes[i];
+    offset = align_up(offset + sizes[i]);
+  }
+
+  std::ofstream fs(path, std::ios::binary);
+  const std::vector<char> zeros(SDF_CONTAINER_ALIGNMENT, 0);
+  uint64_t pos = sizeof(SdfContainerHeader);
+  fs.write((const char *)&header, sizeof(SdfContainerHeader));
+  for (uint32_t i = 0; i < arrays_count; i++)
+  {
+    fs.write(zeros.data(), header.array_offsets[i] - pos);
+    fs.write((const char *)arrays[i], sizes[i]);
+    pos = header.array_offsets[i] + sizes[i];
+  }
+  fs.write(zeros.data(), offset - pos); //file size is a multiple of page size too
+  fs.flush();
+  fs.close();
+}
+
+void save_sdf_SBS_container(const SdfSBSView &scene, const std::string &path)
+{
+  const void *arrays[3] = {scene.nodes, scene.values, scene.values_f};
+  uint64_t sizes[3] = {uint64_t(scene.size) * sizeof(SdfSBSNode),
+                       uint64_t(scene.values_count) * sizeof(uint32_t),
+                       uint64_t(scene.values_f_count) * sizeof(float)};
+  save_container(SDF_CONTAINER_SBS, &scene.header, sizeof(SdfSBSHeader), 3, arrays, sizes, path);
+}
+
+void save_coctree_v3_container(const COctreeV3View &scene, const std::string &path)
+{
+  const void *arrays[1] = {scene.data};
+  uint64_t sizes[1] = {uint64_t(scene.size) * sizeof(uint32_t)};
+  save_container(SDF_CONTAINER_COCTREE_V3, &scene.header, sizeof(COctreeV3Header), 1, arrays, sizes, path);
+}
+
+void save_sdf_frame_octree_container(const SdfFrameOctreeView &scene, const std::string &path)
+{
+  const void *arrays[1] = {scene.nodes};
+  uint64_t sizes[1] = {uint64_t(scene.size) * sizeof(SdfFrameOctreeNode)};
+  save_container(SDF_CONTAINER_FRAME_OCTREE, nullptr, 0, 1, arrays, sizes, path);
+}
+
+bool is_sdf_container(const std::string &path)
+{
+  std::ifstream fs(path, std::ios::binary);
+  uint32_t magic = 0;
+  fs.read((char *)&magic, sizeof(uint32_t));
+  return fs.good() && magic == SDF_CONTAINER_MAGIC;
+}
+
+bool MappedSdfScene::open(const std::string &path)
+{
+  close();
+
+#ifdef SDF_CONTAINER_USE_MMAP
+  int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0)
+  {
+    printf("[MappedSdfScene::open] cannot open file %s\n", path.c_str());
+    return false;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(SdfContainerHeader))
+  {
+    printf("[MappedSdfScene::open] file %s is too small to be an SDF container\n", path.c_str());
+    ::close(fd);
+    return false;
+  }
+  void *ptr = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  ::close(fd); //mapping keeps its own reference to the file
+  if (ptr == MAP_FAILED)
+  {
+    printf("[MappedSdfScene::open] mmap failed for file %s\n", path.c_str());
+    return false;
+  }
+  //bricks are usually consumed front to back by a single copy to BVHRT/GPU buffers
+  madvise(ptr, st.st_size, MADV_SEQUENTIAL);
+  m_data = (const uint8_t *)ptr;
+  m_size = st.st_size;
+#else
+  std::ifstream fs(path, std::ios::binary | std::ios::ate);
+  if (!fs.is_open())
+  {
+    printf("[MappedSdfScene::open] cannot open file %s\n", path.c_str());
+    return false;
+  }
+  m_fallback.resize(fs.tellg());
+  fs.seekg(0);
+  fs.read((char *)m_fallback.data(), m_fallback.size());
+  m_data = m_fallback.data();
+  m_size = m_fallback.size();
+#endif
+
+  const SdfContainerHeader *header = (const SdfContainerHeader *)m_data;
+  bool valid = m_size >= sizeof(SdfContainerHeader) && header->magic == SDF_CONTAINER_MAGIC &&
+               header->arrays_count <= SDF_CONTAINER_MAX_ARRAYS;
+  if (valid && header->version != SDF_CONTAINER_VERSION)
+  {
+    printf("[MappedSdfScene::open] file %s has container version %u, expected %u\n", path.c_str(), header->version, SDF_CONTAINER_VERSION);
+    valid = false;
+  }
+  for (uint32_t i = 0; valid && i < header->arrays_count; i++)
+    valid = header->array_offsets[i] % SDF_CONTAINER_ALIGNMENT == 0 &&
+            header->array_offsets[i] + header->array_sizes[i] <= m_size;
+  if (!valid)
+  {
+    printf("[MappedSdfScene::open] file %s is not a valid SDF container\n", path.c_str());
+    close();
+    return false;
+  }
+
+  m_header = header;
+  return true;
+}
+
+void MappedSdfScene::close()
+{
+#ifdef SDF_CONTAINER_USE_MMAP
+  if (m_data)
+    munmap((void *)m_data, m_size);
+#endif
+  m_fallback = std::vector<uint8_t>();
+  m_data = nullptr;
+  m_size = 0;
+  m_header = nullptr;
+}
+
+void MappedSdfScene::release_pages()
+{
+#ifdef SDF_CONTAINER_USE_MMAP
+  if (m_data)
+    madvise((void *)m_data, m_size, MADV_DONTNEED);
+#endif
+}
+
+SdfSBSView MappedSdfScene::sbs_view() const
+{
+  assert(type() == SDF_CONTAINER_SBS);
+  SdfSBSView view;
+  memcpy(&view.header, m_header->scene_header, sizeof(SdfSBSHeader));
+  view.size = m_header->array_sizes[0] / sizeof(SdfSBSNode);
+  view.nodes = (const SdfSBSNode *)array_ptr(0);
+  view.values_count = m_header->array_sizes[1] / sizeof(uint32_t);
+  view.values = (const uint32_t *)array_ptr(1);
+  view.values_f_count = m_header->array_sizes[2] / sizeof(float);
+  view.values_f = view.values_f_count > 0 ? (const float *)array_ptr(2) : nullptr;
+  return view;
+}
+
+COctreeV3View MappedSdfScene::coctree_v3_view() const
+{
+  assert(type() == SDF_CONTAINER_COCTREE_V3);
+  COctreeV3View view;
+  memcpy(&view.header, m_header->scene_header, sizeof(COctreeV3Header));
+  view.size = m_header->array_sizes[0] / sizeof(uint32_t);
+  view.data = (const uint32_t *)array_ptr(0);
+  return view;
+}
+
+SdfFrameOctreeView MappedSdfScene::frame_octree_view() const
+{
+  assert(type() == SDF_CONTAINER_FRAME_OCTREE);
+  SdfFrameOctreeView view;
+  view.size = m_header->array_sizes[0] / sizeof(SdfFrameOctreeNode);
+  view.nodes = (const SdfFrameOctreeNode *)array_ptr(0);
+  return view;
+}
@@ -0,0 +1,71 @@
+#pragma once
+#include "sdf_scene.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+//################################################################################
+// Versioned page-aligned container for large SDF models. Every array starts at a
+// page boundary, so the file can be mapped into memory and used through
+// SdfSBSView/COctreeV3View/SdfFrameOctreeView without reading it to vectors.
+//################################################################################
+
+static constexpr uint32_t SDF_CONTAINER_MAGIC     = 0x4354524C; //"LRTC"
+static constexpr uint32_t SDF_CONTAINER_VERSION   = 1;          //change version if layout changes
+static constexpr uint32_t SDF_CONTAINER_ALIGNMENT = 4096;
+static constexpr uint32_t SDF_CONTAINER_MAX_ARRAYS = 4;
+
+enum SdfContainerType
+{
+  SDF_CONTAINER_SBS          = 0, //arrays: nodes, values, values_f
+  SDF_CONTAINER_COCTREE_V3   = 1, //arrays: data
+  SDF_CONTAINER_FRAME_OCTREE = 2, //arrays: nodes
+  SDF_CONTAINER_UNKNOWN      = 0xFFFFFFFF
+};
+
+struct SdfContainerHeader
+{
+  uint32_t magic;
+  uint32_t version;
+  uint32_t type;               //SdfContainerType
+  uint32_t arrays_count;
+  uint32_t scene_header[8];    //SdfSBSHeader or COctreeV3Header, copied as is
+  uint64_t array_offsets[SDF_CONTAINER_MAX_ARRAYS]; //in bytes from the start of file, multiple of SDF_CONTAINER_ALIGNMENT
+  uint64_t array_sizes[SDF_CONTAINER_MAX_ARRAYS];   //in bytes
+};
+
+//read-only mapping of a container, views returned by it are valid while it is alive
+class MappedSdfScene
+{
+public:
+  MappedSdfScene() = default;
+  ~MappedSdfScene() { close(); }
+  MappedSdfScene(const MappedSdfScene &) = delete;
+  MappedSdfScene &operator=(const MappedSdfScene &) = delete;
+
+  bool open(const std::string &path);
+  void close();
+
+  //tell OS that mapped pages are not required anymore (i.e. after data was copied to GPU)
+  void release_pages();
+
+  uint32_t type() const { return m_header ? m_header->type : SDF_CONTAINER_UNKNOWN; }
+  uint64_t array_file_offset(uint32_t id) const { return m_header->array_offsets[id]; }
+  SdfSBSView         sbs_view() const;
+  COctreeV3View      coctree_v3_view() const;
+  SdfFrameOctreeView frame_octree_view() const;
+
+private:
+  const void *array_ptr(uint32_t id) const { return m_data + m_header->array_offsets[id]; }
+
+  const uint8_t *m_data = nullptr;
+  uint64_t m_size = 0;
+  const SdfContainerHeader *m_header = nullptr;
+  std::vector<uint8_t> m_fallback; //used instead of mapping where mmap is not available
+};
+
+bool is_sdf_container(const std::string &path);
+
+void save_sdf_SBS_container(const SdfSBSView &scene, const std::string &path);
+void save_coctree_v3_container(const COctreeV3View &scene, const std::string &path);
+void save_sdf_frame_octree_container(const SdfFrameOctreeView &scene, const std::string &path);
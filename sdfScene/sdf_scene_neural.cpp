@@ -0,0 +1,248 @@
+#include "sdf_scene_neural.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+//AVX2 kernel is compiled with target attribute and chosen at runtime, so it does not need -mavx2 -mfma
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define NEURAL_SDF_USE_AVX2
+#include <immintrin.h>
+#endif
+
+static constexpr float SIN_INV_2PI  = 0.15915494309189535f;
+static constexpr float SIN_2PI      = 6.283185307179586f;
+static constexpr float SIN_PI       = 3.141592653589793f;
+static constexpr float SIN_HALF_PI  = 1.5707963267948966f;
+
+//odd Taylor polynomial up to x^11 on [-pi/2, pi/2], error is below 6e-8
+static constexpr float SIN_C3  = -1.0f/6.0f;
+static constexpr float SIN_C5  =  1.0f/120.0f;
+static constexpr float SIN_C7  = -1.0f/5040.0f;
+static constexpr float SIN_C9  =  1.0f/362880.0f;
+static constexpr float SIN_C11 = -1.0f/39916800.0f;
+
+static inline float fast_sin(float x)
+{
+  //reduce to [-pi, pi], then fold to [-pi/2, pi/2] using sin(x) = sin(+-pi - x)
+  float r = x - std::floor(x*SIN_INV_2PI + 0.5f)*SIN_2PI;
+  if (r > SIN_HALF_PI)
+    r = SIN_PI - r;
+  else if (r < -SIN_HALF_PI)
+    r = -SIN_PI - r;
+  const float r2 = r*r;
+  return r*(1.0f + r2*(SIN_C3 + r2*(SIN_C5 + r2*(SIN_C7 + r2*(SIN_C9 + r2*SIN_C11)))));
+}
+
+#ifdef NEURAL_SDF_USE_AVX2
+__attribute__((target("avx2,fma")))
+static inline __m256 fast_sin_avx2(__m256 x)
+{
+  const __m256 k = _mm256_round_ps(_mm256_mul_ps(x, _mm256_set1_ps(SIN_INV_2PI)), _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+  __m256 r = _mm256_fnmadd_ps(k, _mm256_set1_ps(SIN_2PI), x);
+
+  const __m256 sign_mask = _mm256_set1_ps(-0.0f);
+  const __m256 folded = _mm256_sub_ps(_mm256_or_ps(_mm256_set1_ps(SIN_PI), _mm256_and_ps(r, sign_mask)), r);
+  const __m256 need_fold = _mm256_cmp_ps(_mm256_andnot_ps(sign_mask, r), _mm256_set1_ps(SIN_HALF_PI), _CMP_GT_OQ);
+  r = _mm256_blendv_ps(r, folded, need_fold);
+
+  const __m256 r2 = _mm256_mul_ps(r, r);
+  __m256 p = _mm256_fmadd_ps(r2, _mm256_set1_ps(SIN_C11), _mm256_set1_ps(SIN_C9));
+  p = _mm256_fmadd_ps(r2, p, _mm256_set1_ps(SIN_C7));
+  p = _mm256_fmadd_ps(r2, p, _mm256_set1_ps(SIN_C5));
+  p = _mm256_fmadd_ps(r2, p, _mm256_set1_ps(SIN_C3));
+  p = _mm256_fmadd_ps(r2, p, _mm256_set1_ps(1.0f));
+  return _mm256_mul_ps(r, p);
+}
+#endif
+
+//in: [in_size][NEURAL_SDF_BATCH_SIZE], out: [out_blocks*NEURAL_SDF_OUT_BLOCK][NEURAL_SDF_BATCH_SIZE]
+//every 8x8 tile of (outputs x points) is accumulated in registers over the whole input
+static void dense_layer(const float *weights, const float *bias, unsigned in_size, unsigned out_blocks, bool is_sine,
+                        const float *in, float *out, unsigned batch)
+{
+  constexpr unsigned OB = NEURAL_SDF_OUT_BLOCK;
+  constexpr unsigned B  = NEURAL_SDF_BATCH_SIZE;
+
+  for (unsigned ob = 0; ob < out_blocks; ob++)
+  {
+    const float *w = weights + ob*in_size*OB;
+    for (unsigned b = 0; b < batch; b += 8)
+    {
+      float acc[OB][8];
+      for (unsigned k = 0; k < OB; k++)
+        for (unsigned i = 0; i < 8; i++)
+          acc[k][i] = bias[ob*OB + k];
+      for (unsigned j = 0; j < in_size; j++)
+      {
+        const float *x = in + j*B + b;
+        for (unsigned k = 0; k < OB; k++)
+          for (unsigned i = 0; i < 8; i++)
+            acc[k][i] += w[j*OB + k]*x[i];
+      }
+      for (unsigned k = 0; k < OB; k++)
+        for (unsigned i = 0; i < 8; i++)
+          out[(ob*OB + k)*B + b + i] = is_sine ? fast_sin(acc[k][i]) : acc[k][i];
+    }
+  }
+}
+
+#ifdef NEURAL_SDF_USE_AVX2
+//the same tiles, one register per output
+__attribute__((target("avx2,fma")))
+static void dense_layer_avx2(const float *weights, const float *bias, unsigned in_size, unsigned out_blocks, bool is_sine,
+                             const float *in, float *out, unsigned batch)
+{
+  constexpr unsigned OB = NEURAL_SDF_OUT_BLOCK;
+  constexpr unsigned B  = NEURAL_SDF_BATCH_SIZE;
+
+  for (unsigned ob = 0; ob < out_blocks; ob++)
+  {
+    const float *w = weights + ob*in_size*OB;
+    for (unsigned b = 0; b < batch; b += 8)
+    {
+      __m256 acc[OB];
+      for (unsigned k = 0; k < OB; k++)
+        acc[k] = _mm256_set1_ps(bias[ob*OB + k]);
+      for (unsigned j = 0; j < in_size; j++)
+      {
+        const __m256 x = _mm256_loadu_ps(in + j*B + b);
+        for (unsigned k = 0; k < OB; k++)
+          acc[k] = _mm256_fmadd_ps(_mm256_broadcast_ss(w + j*OB + k), x, acc[k]);
+      }
+      for (unsigned k = 0; k < OB; k++)
+        _mm256_storeu_ps(out + (ob*OB + k)*B + b, is_sine ? fast_sin_avx2(acc[k]) : acc[k]);
+    }
+  }
+}
+#endif
+
+bool NeuralSdfEvaluator::init(const SdfSceneView &scene, unsigned object_id, bool allow_simd)
+{
+  m_layers.clear();
+  m_max_width = 0;
+  m_dense_layer = dense_layer;
+  m_simd = false;
+#ifdef NEURAL_SDF_USE_AVX2
+  static const bool has_avx2_fma = __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+  if (allow_simd && has_avx2_fma)
+  {
+    m_dense_layer = dense_layer_avx2;
+    m_simd = true;
+  }
+#endif
+  if (object_id >= scene.objects_count || scene.objects[object_id].type != SDF_PRIM_SIREN)
+  {
+    printf("[NeuralSdfEvaluator::init] object %u is not a neural SDF\n", object_id);
+    return false;
+  }
+
+  const SdfObject &obj = scene.objects[object_id];
+  if (obj.neural_id >= scene.neural_properties_count)
+  {
+    printf("[NeuralSdfEvaluator::init] invalid neural_id %u\n", obj.neural_id);
+    return false;
+  }
+  const NeuralProperties &prop = scene.neural_properties[obj.neural_id];
+  if (prop.layer_count == 0 || prop.layer_count > NEURAL_SDF_MAX_LAYERS || prop.layers[0].in_size != 3 ||
+      prop.layers[prop.layer_count - 1].out_size != 1)
+  {
+    printf("[NeuralSdfEvaluator::init] unsupported network layout\n");
+    return false;
+  }
+
+  //every layer is stored as out_size x in_size row-major weights followed by out_size biases
+  m_layers.resize(prop.layer_count);
+  for (unsigned l = 0; l < prop.layer_count; l++)
+  {
+    const NeuralDenseLayer &src = prop.layers[l];
+    const float *params = scene.parameters + obj.params_offset + src.offset;
+    if (obj.params_offset + src.offset + (src.in_size + 1)*src.out_size > scene.parameters_count ||
+        src.out_size > NEURAL_SDF_MAX_LAYER_SIZE || (l > 0 && src.in_size != prop.layers[l - 1].out_size))
+    {
+      printf("[NeuralSdfEvaluator::init] invalid layer %u\n", l);
+      m_layers.clear();
+      return false;
+    }
+
+    PackedLayer &dst = m_layers[l];
+    dst.in_size = src.in_size;
+    dst.out_size = src.out_size;
+    dst.out_blocks = (src.out_size + NEURAL_SDF_OUT_BLOCK - 1)/NEURAL_SDF_OUT_BLOCK;
+    dst.is_sine = l + 1 < prop.layer_count;
+
+    //padded outputs get zero weights and are never read by the next layer
+    const float scale = dst.is_sine ? SIREN_W0 : 1.0f;
+    dst.weights.assign(dst.out_blocks*dst.in_size*NEURAL_SDF_OUT_BLOCK, 0.0f);
+    dst.bias.assign(dst.out_blocks*NEURAL_SDF_OUT_BLOCK, 0.0f);
+    for (unsigned o = 0; o < src.out_size; o++)
+    {
+      const unsigned ob = o / NEURAL_SDF_OUT_BLOCK, k = o % NEURAL_SDF_OUT_BLOCK;
+      for (unsigned j = 0; j < src.in_size; j++)
+        dst.weights[(ob*dst.in_size + j)*NEURAL_SDF_OUT_BLOCK + k] = scale*params[o*src.in_size + j];
+      dst.bias[o] = scale*params[src.in_size*src.out_size + o];
+    }
+
+    m_max_width = std::max(m_max_width, std::max(dst.in_size, dst.out_blocks*NEURAL_SDF_OUT_BLOCK));
+  }
+
+  m_transform = obj.transform;
+  m_distance_mult = obj.distance_mult;
+  m_distance_add = obj.distance_add;
+  m_complement = obj.complement != 0;
+  return true;
+}
+
+void NeuralSdfEvaluator::eval_block(const float3 *points, float *distances, unsigned count, float *buf0, float *buf1) const
+{
+  constexpr unsigned B = NEURAL_SDF_BATCH_SIZE;
+
+  //tail of the block is filled with copies of the last point
+  const unsigned batch = (count + 7) / 8 * 8;
+  for (unsigned i = 0; i < batch; i++)
+  {
+    const float4 p = m_transform * to_float4(points[std::min(i, count - 1)], 1.0f);
+    buf0[0*B + i] = p.x;
+    buf0[1*B + i] = p.y;
+    buf0[2*B + i] = p.z;
+  }
+
+  float *in = buf0, *out = buf1;
+  for (const PackedLayer &layer : m_layers)
+  {
+    m_dense_layer(layer.weights.data(), layer.bias.data(), layer.in_size, layer.out_blocks, layer.is_sine, in, out, batch);
+    std::swap(in, out);
+  }
+
+  for (unsigned i = 0; i < count; i++)
+  {
+    const float d = m_distance_mult*in[i] + m_distance_add;
+    distances[i] = m_complement ? -d : d;
+  }
+}
+
+void NeuralSdfEvaluator::eval_batch(const float3 *points, float *distances, unsigned count) const
+{
+  if (m_layers.empty())
+  {
+    std::fill(distances, distances + count, 1e6f);
+    return;
+  }
+
+  thread_local std::vector<float> buf0, buf1;
+  const size_t buf_size = size_t(m_max_width)*NEURAL_SDF_BATCH_SIZE;
+  if (buf0.size() < buf_size)
+  {
+    buf0.resize(buf_size);
+    buf1.resize(buf_size);
+  }
+
+  for (unsigned first = 0; first < count; first += NEURAL_SDF_BATCH_SIZE)
+    eval_block(points + first, distances + first, std::min(NEURAL_SDF_BATCH_SIZE, count - first), buf0.data(), buf1.data());
+}
+
+float NeuralSdfEvaluator::eval(const float3 &p) const
+{
+  float d = 0.0f;
+  eval_batch(&p, &d, 1);
+  return d;
+}
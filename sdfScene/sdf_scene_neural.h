@@ -0,0 +1,56 @@
+#pragma once
+#include "sdf_scene.h"
+#include <vector>
+
+//################################################################################
+// CPU-only batched inference of neural SDF objects (SDF_PRIM_SIREN).
+// Points are evaluated in blocks of up to NEURAL_SDF_BATCH_SIZE, each dense layer
+// is a small GEMM of prepacked weights and block activations, sin is replaced
+// with a polynomial approximation. Used for baking neural SDFs into other
+// representations, where millions of points are evaluated at once.
+//################################################################################
+
+static constexpr unsigned NEURAL_SDF_BATCH_SIZE = 64; //points in block, multiple of 8
+static constexpr unsigned NEURAL_SDF_OUT_BLOCK  = 8;  //outputs computed at once by GEMM kernel
+
+class NeuralSdfEvaluator
+{
+public:
+  NeuralSdfEvaluator() = default;
+  NeuralSdfEvaluator(const SdfSceneView &scene, unsigned object_id = 0, bool allow_simd = true) { init(scene, object_id, allow_simd); }
+
+  //packs weights of the object, it should have type SDF_PRIM_SIREN
+  //AVX2 kernel is used if allow_simd is set and CPU supports it, otherwise the scalar one
+  bool init(const SdfSceneView &scene, unsigned object_id = 0, bool allow_simd = true);
+  bool valid() const { return !m_layers.empty(); }
+  bool simd() const { return m_simd; }
+
+  //thread-safe, any count is allowed, points are split into blocks internally
+  void eval_batch(const float3 *points, float *distances, unsigned count) const;
+  float eval(const float3 &p) const;
+
+private:
+  struct PackedLayer
+  {
+    unsigned in_size;
+    unsigned out_size;
+    unsigned out_blocks;        //out_size rounded up to NEURAL_SDF_OUT_BLOCK, in blocks
+    bool is_sine;               //all layers except the last one are sin(SIREN_W0*(Wx+b))
+    std::vector<float> weights; //[out_blocks][in_size][NEURAL_SDF_OUT_BLOCK], SIREN_W0 is already applied
+    std::vector<float> bias;    //[out_blocks*NEURAL_SDF_OUT_BLOCK]
+  };
+
+  typedef void (*DenseLayerFunc)(const float *weights, const float *bias, unsigned in_size, unsigned out_blocks, bool is_sine,
+                                 const float *in, float *out, unsigned batch);
+
+  void eval_block(const float3 *points, float *distances, unsigned count, float *buf0, float *buf1) const;
+
+  std::vector<PackedLayer> m_layers;
+  DenseLayerFunc m_dense_layer = nullptr;
+  bool m_simd = false;
+  unsigned m_max_width = 0;
+  float4x4 m_transform;
+  float m_distance_mult = 1.0f;
+  float m_distance_add = 0.0f;
+  bool m_complement = false;
+};
@@ -46,8 +46,9 @@ void benchmark_framed_octree_intersection()
   std::vector<std::string> scene_paths = {"scenes/01_simple_scenes/data/teapot.vsgf"}; 
   std::vector<std::string> scene_names = {"Teapot", "Bunny"};
 
-  std::vector<unsigned> render_modes = {MULTI_RENDER_MODE_LAMBERT_NO_TEX};
-  std::vector<std::string> render_names = {"lambert"};
+  //iteration count images show how many sphere tracing steps every pixel took
+  std::vector<unsigned> render_modes = {MULTI_RENDER_MODE_LAMBERT_NO_TEX, MULTI_RENDER_MODE_ST_ITERATIONS};
+  std::vector<std::string> render_names = {"lambert", "st_iterations"};
 
   std::vector<unsigned> AS_types = {TYPE_SDF_FRAME_OCTREE, TYPE_SDF_SVS, TYPE_SDF_SBS, TYPE_MESH_TRIANGLE};
   std::vector<std::string> AS_names = {"framed_octree", "sparse_voxel_set", "sparse_brick_set", "mesh"};
@@ -56,37 +57,42 @@ void benchmark_framed_octree_intersection()
   std::vector<std::vector<std::string>> preset_names(5);
 
   presets_oi[0] = {SDF_OCTREE_NODE_INTERSECT_ST, 
+                   SDF_OCTREE_NODE_INTERSECT_ST_RELAXED,
                    SDF_OCTREE_NODE_INTERSECT_ANALYTIC, 
                    SDF_OCTREE_NODE_INTERSECT_NEWTON,
                    SDF_OCTREE_NODE_INTERSECT_IT,
                    SDF_OCTREE_NODE_INTERSECT_BBOX};
 
   preset_names[0] = {"bvh_sphere_tracing",
+                     "bvh_relaxed_sphere_tracing",
                      "bvh_analytic",
                      "bvh_newton",
                      "bvh_interval_tracing",
                      "bvh_nodes"};
 
   presets_oi[1] = {SDF_OCTREE_NODE_INTERSECT_ST, 
+                   SDF_OCTREE_NODE_INTERSECT_ST_RELAXED,
                    SDF_OCTREE_NODE_INTERSECT_ANALYTIC, 
                    SDF_OCTREE_NODE_INTERSECT_NEWTON,
                    SDF_OCTREE_NODE_INTERSECT_IT,
                    SDF_OCTREE_NODE_INTERSECT_BBOX};
 
   preset_names[1] = {"bvh_sphere_tracing",
+                     "bvh_relaxed_sphere_tracing",
                      "bvh_analytic",
                      "bvh_newton",
                      "bvh_interval_tracing",
                      "bvh_nodes"};
 
   presets_oi[2] = {SDF_OCTREE_NODE_INTERSECT_ST, 
+                   SDF_OCTREE_NODE_INTERSECT_ST_RELAXED,
                    SDF_OCTREE_NODE_INTERSECT_ANALYTIC, 
                    SDF_OCTREE_NODE_INTERSECT_NEWTON,
                    SDF_OCTREE_NODE_INTERSECT_IT,
                    SDF_OCTREE_NODE_INTERSECT_BBOX};
 
-  preset_names[2] = {"bvh_traversal",
-                     "bvh_sphere_tracing",
+  preset_names[2] = {"bvh_sphere_tracing",
+                     "bvh_relaxed_sphere_tracing",
                      "bvh_analytic",
                      "bvh_newton",
                      "bvh_interval_tracing",
@@ -278,12 +284,14 @@ void main_benchmark(const std::string &path, const std::string &mesh_name, unsig
 
   //different render settings
   std::vector<unsigned> intersect_modes = {SDF_OCTREE_NODE_INTERSECT_ST, 
+                                           SDF_OCTREE_NODE_INTERSECT_ST_RELAXED,
                                            SDF_OCTREE_NODE_INTERSECT_ANALYTIC, 
                                            SDF_OCTREE_NODE_INTERSECT_NEWTON,
                                            SDF_OCTREE_NODE_INTERSECT_IT,
                                            SDF_OCTREE_NODE_INTERSECT_BBOX};
 
   std::vector<std::string> intersect_mode_names = {"bvh_sphere_tracing",
+                                                   "bvh_relaxed_sphere_tracing",
                                                    "bvh_analytic",
                                                    "bvh_newton",
                                                    "bvh_interval_tracing",
@@ -7,6 +7,8 @@
 #include "LiteMath/Image2d.h"
 #include "../utils/sdf_converter.h"
 #include "../utils/sparse_octree_builder.h"
+#include "../sdfScene/sdf_scene_mapped.h"
+#include "../sdfScene/sdf_scene_neural.h"
 #include "../utils/marching_cubes.h"
 #include "../utils/sdf_smoother.h"
 #include "../utils/demo_meshes.h"
@@ -22,6 +24,7 @@
 #include <cassert>
 #include <chrono>
 #include <filesystem>
+#include <fstream>
 #include <map>
 
 std::string scenes_folder_path = "./";
@@ -3334,8 +3337,9 @@ void litert_test_35_SBSAdapt_greed_creating()
   auto mesh = cmesh4::LoadMeshFromVSGF((scenes_folder_path+"scenes/01_simple_scenes/data/teapot.vsgf").c_str());
   cmesh4::rescale_mesh(mesh, float3(-0.9, -0.9, -0.9), float3(0.9, 0.9, 0.9));
 
-  std::vector<MeshBVH> bvh(1);
-    for (unsigned i = 0; i < 1; i++)
+  unsigned max_threads = 16;
+  std::vector<MeshBVH> bvh(max_threads);
+    for (unsigned i = 0; i < max_threads; i++)
       bvh[i].init(mesh);
     auto real_sdf = [&](const float3 &p, unsigned idx) -> float 
     { return bvh[idx].get_signed_distance(p); /*return std::sqrt(p.x * p.x + p.y * p.y + p.z * p.z) - 0.8;*/};
@@ -3366,7 +3370,7 @@ void litert_test_35_SBSAdapt_greed_creating()
   SdfSBSAdapt sbsa_scene;
   SdfSBSAdaptView sbsa_view = convert_sbs_to_adapt(sbsa_scene, sbs_1_1);
 
-  SdfSBSAdapt sbs_adapt = sdf_converter::greed_sbs_adapt(real_sdf, 4);
+  SdfSBSAdapt sbs_adapt = sdf_converter::greed_sbs_adapt(real_sdf, 4, max_threads);
 
   {
     auto pRender = CreateMultiRenderer(DEVICE_GPU);
@@ -3471,8 +3475,9 @@ void litert_test_37_sbs_adapt_comparison()
     render(image, pRender, float3(0, 0, 3), float3(0, 0, 0), float3(0, 1, 0), preset);
   }
 
-  std::vector<MeshBVH> bvh(1);
-    for (unsigned i = 0; i < 1; i++)
+  unsigned max_threads = 16;
+  std::vector<MeshBVH> bvh(max_threads);
+    for (unsigned i = 0; i < max_threads; i++)
       bvh[i].init(mesh);
     auto real_sdf = [&](const float3 &p, unsigned idx) -> float 
     { return bvh[idx].get_signed_distance(p);};
@@ -3486,7 +3491,7 @@ void litert_test_37_sbs_adapt_comparison()
     SparseOctreeSettings settings(SparseOctreeBuildType::DEFAULT, depth + 3);
     SdfSBSHeader header{2,0,4,SDF_SBS_NODE_LAYOUT_DX};
 
-    SdfSBSAdapt sbs_adapt = sdf_converter::greed_sbs_adapt(real_sdf, depth);
+    SdfSBSAdapt sbs_adapt = sdf_converter::greed_sbs_adapt(real_sdf, depth, max_threads);
     
 
     {
@@ -4786,6 +4791,1543 @@ void litert_test_48_openvdb()
   #endif
 }
 
+//Common fixture of the tests below: normalized bunny, its SBS, CPU renderers with a given BLAS build name
+//and primary rays cast directly through BVHRT for the tests that compare hits rather than images
+
+static cmesh4::SimpleMesh load_normalized_bunny()
+{
+  auto mesh = cmesh4::LoadMeshFromVSGF((scenes_folder_path+"scenes/01_simple_scenes/data/bunny.vsgf").c_str());
+  cmesh4::normalize_mesh(mesh);
+  return mesh;
+}
+
+static SdfSBS create_bunny_SBS(const cmesh4::SimpleMesh &mesh, unsigned depth, unsigned brick_size, unsigned bytes_per_value,
+                               SparseOctreeBuildType build_type = SparseOctreeBuildType::MESH_TLO)
+{
+  SdfSBSHeader header;
+  header.brick_size = brick_size;
+  header.brick_pad = 0;
+  header.bytes_per_value = bytes_per_value;
+  header.aux_data = SDF_SBS_NODE_LAYOUT_DX;
+  return sdf_converter::create_sdf_SBS(SparseOctreeSettings(build_type, depth), header, mesh);
+}
+
+static std::shared_ptr<MultiRenderer> create_cpu_renderer(const char *build_name, MultiRenderPreset preset)
+{
+  auto pRender = CreateMultiRenderer(DEVICE_CPU);
+  pRender->SetAccelStruct(CreateSceneRT("BVH2Common", build_name, "SuperTreeletAlignedMerged4"));
+  pRender->SetPreset(preset);
+  return pRender;
+}
+
+static BVHRT *get_bvh(std::shared_ptr<MultiRenderer> pRender)
+{
+  return dynamic_cast<BVHRT*>(pRender->GetAccelStruct()->UnderlyingImpl(0));
+}
+
+//W*H rays from pos with directions float3(2*(x+0.5)/W - 1, 2*(y+0.5)/H - 1, 0) + dir_shift, returns time in ms
+static float trace_primary_rays(BVHRT *bvh, float3 pos, float3 dir_shift, unsigned W, unsigned H, std::vector<CRT_Hit> &hits)
+{
+  hits.resize(W*H);
+  auto t1 = std::chrono::steady_clock::now();
+  for (unsigned y = 0; y < H; y++)
+  {
+    for (unsigned x = 0; x < W; x++)
+    {
+      float3 dir = normalize(float3(2.0f*(x+0.5f)/W - 1.0f, 2.0f*(y+0.5f)/H - 1.0f, 0.0f) + dir_shift);
+      hits[y*W+x] = bvh->RayQuery_NearestHit(to_float4(pos, 0.0f), to_float4(dir, 1000.0f));
+    }
+  }
+  auto t2 = std::chrono::steady_clock::now();
+  return std::chrono::duration_cast<std::chrono::microseconds>(t2 - t1).count()/1000.0f;
+}
+
+//hits are the same if rays hit the same instance of the same geometry at the same distance,
+//primitives are not compared for BLAS built in different ways
+static unsigned count_hit_mismatches(const std::vector<CRT_Hit> &hits_1, const std::vector<CRT_Hit> &hits_2, float t_eps,
+                                     bool compare_prim = true)
+{
+  unsigned mismatches = 0;
+  for (size_t i = 0; i < std::min(hits_1.size(), hits_2.size()); i++)
+  {
+    if (hits_1[i].geomId != hits_2[i].geomId || hits_1[i].instId != hits_2[i].instId ||
+        (compare_prim && hits_1[i].primId != hits_2[i].primId) || std::abs(hits_1[i].t - hits_2[i].t) > t_eps)
+      mismatches++;
+  }
+  return mismatches + unsigned(std::max(hits_1.size(), hits_2.size()) - std::min(hits_1.size(), hits_2.size()));
+}
+
+void litert_test_49_packet_traversal()
+{
+  printf("TEST 49. PACKET TRAVERSAL\n");
+  unsigned W = 512, H = 512;
+
+  MultiRenderPreset preset = getDefaultPreset();
+  auto mesh = load_normalized_bunny();
+  SdfSBS sbs = create_bunny_SBS(mesh, 7, 4, 1);
+
+  //primary rays, grouped in 8x8 tiles the same way as MultiRenderer does
+  std::vector<float4> ray_pos(W*H), ray_dir(W*H);
+  for (unsigned i = 0; i < W*H; i++)
+  {
+    unsigned tile = i / 64, in_tile = i % 64;
+    unsigned x = (tile % (W/8))*8 + in_tile % 8;
+    unsigned y = (tile / (W/8))*8 + in_tile / 8;
+    float3 dir = normalize(float3(2.0f*(x+0.5f)/W - 1.0f, 2.0f*(y+0.5f)/H - 1.0f, -1.5f));
+    ray_pos[i] = float4(0, 0, 3, 0);
+    ray_dir[i] = to_float4(dir, 1000.0f);
+  }
+
+  //packet traversal is checked with both SIMD and scalar box tests
+  auto check = [&](int test_n, const char *name, std::shared_ptr<MultiRenderer> pRender)
+  {
+    BVHRT *bvh = get_bvh(pRender);
+    std::vector<CRT_Hit> hits_scalar(W*H), hits_packet(W*H), hits_packet_no_simd(W*H);
+
+    auto t1 = std::chrono::steady_clock::now();
+    for (unsigned i = 0; i < W*H; i++)
+      hits_scalar[i] = bvh->RayQuery_NearestHit(ray_pos[i], ray_dir[i]);
+    auto t2 = std::chrono::steady_clock::now();
+    bvh->RayQuery_NearestHitPacket(ray_pos.data(), ray_dir.data(), hits_packet.data(), W*H);
+    auto t3 = std::chrono::steady_clock::now();
+    bvh->SetPacketSIMD(false);
+    bvh->RayQuery_NearestHitPacket(ray_pos.data(), ray_dir.data(), hits_packet_no_simd.data(), W*H);
+    auto t4 = std::chrono::steady_clock::now();
+    bvh->SetPacketSIMD(true);
+
+    unsigned mismatches         = count_hit_mismatches(hits_scalar, hits_packet, 1e-5f);
+    unsigned mismatches_no_simd = count_hit_mismatches(hits_scalar, hits_packet_no_simd, 1e-5f);
+
+    float time_scalar         = std::chrono::duration_cast<std::chrono::microseconds>(t2 - t1).count()/1000.0f;
+    float time_packet         = std::chrono::duration_cast<std::chrono::microseconds>(t3 - t2).count()/1000.0f;
+    float time_packet_no_simd = std::chrono::duration_cast<std::chrono::microseconds>(t4 - t3).count()/1000.0f;
+    printf("  scalar %.1f ms, packet %.1f ms, packet without SIMD %.1f ms\n", time_scalar, time_packet, time_packet_no_simd);
+    printf("  49.%d. %-64s", test_n, name);
+    if (mismatches == 0 && mismatches_no_simd == 0)
+      printf("passed\n");
+    else
+      printf("FAILED, %u mismatches with SIMD, %u without\n", mismatches, mismatches_no_simd);
+  };
+
+  {
+    auto pRender = create_cpu_renderer("cbvh_embree2", preset);
+    pRender->SetScene(mesh);
+    check(1, "[CPU] mesh, packet and scalar traversal give the same hits ", pRender);
+  }
+
+  {
+    auto pRender = create_cpu_renderer("cbvh_embree2", preset);
+    pRender->SetScene(sbs);
+    check(2, "[CPU] SBS, packet and scalar traversal give the same hits ", pRender);
+  }
+
+  //box test alone, with axis-aligned rays that give 0*inf inside the test
+  {
+    const uint32_t N = BVHRT::RAY_PACKET_SIZE;
+    BVHRT::PacketBoxTestFunc test_simd   = BVHRT::GetPacketBoxTest(true);
+    BVHRT::PacketBoxTestFunc test_scalar = BVHRT::GetPacketBoxTest(false);
+    auto dist = [](){ return float(urand(-2, 2)); };
+
+    float o[3][N], inv[3][N], tn[N], tf[N], tm_simd[N], tm_scalar[N];
+    unsigned mismatches = 0;
+    for (unsigned iter = 0; iter < 10000; iter++)
+    {
+      for (uint32_t i = 0; i < N; i++)
+      {
+        float3 dir = normalize(float3(dist(), dist(), dist()));
+        if (i % 4 == 0)
+          dir[i % 3] = 0.0f;
+        float3 pos = (i % 8 == 0) ? float3(-1.0f, dist(), dist()) : float3(dist(), dist(), dist());
+        for (int k = 0; k < 3; k++)
+        {
+          o[k][i] = pos[k];
+          inv[k][i] = 1.0f/dir[k];
+        }
+        tn[i] = 0.0f;
+        tf[i] = std::abs(dist());
+      }
+      float3 boxMin = float3(-1.0f, dist() - 0.5f, -0.5f);
+      float3 boxMax = boxMin + float3(std::abs(dist()), std::abs(dist()), 1.0f);
+
+      uint32_t mask_simd   = test_simd  (o[0], o[1], o[2], inv[0], inv[1], inv[2], tn, tf, boxMin, boxMax, tm_simd);
+      uint32_t mask_scalar = test_scalar(o[0], o[1], o[2], inv[0], inv[1], inv[2], tn, tf, boxMin, boxMax, tm_scalar);
+      if (mask_simd != mask_scalar)
+        mismatches++;
+      for (uint32_t i = 0; i < N; i++)
+        if (((mask_scalar >> i) & 1) && tm_simd[i] != tm_scalar[i])
+          mismatches++;
+    }
+
+    printf("  49.3. %-64s", "[CPU] SIMD and scalar packet box tests give the same masks ");
+    if (mismatches == 0)
+      printf("passed\n");
+    else
+      printf("FAILED, %u mismatches\n", mismatches);
+  }
+}
+
+void litert_test_50_tlas_refit()
+{
+  printf("TEST 50. TLAS REFIT\n");
+  unsigned W = 512, H = 512;
+  const unsigned grid = 8;
+
+  auto mesh = load_normalized_bunny();
+
+  auto instance_matrix = [&](unsigned i, float time)
+  {
+    float3 pos = float3(2.5f*(i % grid) - 1.25f*grid, 2.5f*(i / grid) - 1.25f*grid, 0);
+    return LiteMath::translate4x4(pos + float3(time*std::sin(float(i)), time*std::cos(float(i)), 0)) * 
+           LiteMath::rotate4x4Y(time*float(i)/grid);
+  };
+
+  auto create_scene = [&](float time)
+  {
+    auto pRender = create_cpu_renderer("cbvh_embree2", getDefaultPreset());
+    pRender->SetScene(mesh);
+    pRender->GetAccelStruct()->ClearScene();
+    for (unsigned i = 0; i < grid*grid; i++)
+      pRender->AddInstance(0, instance_matrix(i, time));
+    pRender->GetAccelStruct()->CommitScene();
+    return pRender;
+  };
+
+  auto pRenderDynamic = create_scene(0.0f);
+  BVHRT *bvh_dynamic = get_bvh(pRenderDynamic);
+  const uint32_t rebuilds_before = bvh_dynamic->GetTLASRebuildCount();
+  for (int frame = 1; frame <= 4; frame++)
+  {
+    for (unsigned i = 0; i < grid*grid; i++)
+      pRenderDynamic->UpdateInstance(i, instance_matrix(i, 0.25f*frame));
+    pRenderDynamic->GetAccelStruct()->CommitScene();
+  }
+  const uint32_t rebuilds = bvh_dynamic->GetTLASRebuildCount() - rebuilds_before;
+
+  auto pRenderRef = create_scene(1.0f);
+  BVHRT *bvh_ref = get_bvh(pRenderRef);
+
+  std::vector<CRT_Hit> hits_dynamic, hits_ref;
+  trace_primary_rays(bvh_dynamic, float3(0, 0, 1.25f*grid), float3(0, 0, -1.0f), W, H, hits_dynamic);
+  trace_primary_rays(bvh_ref,     float3(0, 0, 1.25f*grid), float3(0, 0, -1.0f), W, H, hits_ref);
+  unsigned mismatches = count_hit_mismatches(hits_dynamic, hits_ref, 1e-4f);
+
+  printf("  %u full rebuilds of TLAS in 4 frames\n", rebuilds);
+  printf("  50.1. %-64s", "[CPU] refitted TLAS gives the same hits as a new one ");
+  if (mismatches == 0)
+    printf("passed\n");
+  else
+    printf("FAILED, %u mismatches\n", mismatches);
+}
+
+void litert_test_51_native_sah_builder()
+{
+  printf("TEST 51. NATIVE SAH BUILDER\n");
+  unsigned W = 512, H = 512;
+
+  auto mesh = load_normalized_bunny();
+  SdfSBS sbs = create_bunny_SBS(mesh, 7, 2, 1);
+
+  auto create_renderer = [&](const char *build_name)
+  {
+    auto pRender = create_cpu_renderer(build_name, getDefaultPreset());
+    auto t1 = std::chrono::steady_clock::now();
+    pRender->SetScene(sbs);
+    auto t2 = std::chrono::steady_clock::now();
+    printf("  %-12s %u bricks, scene set in %.1f ms\n", build_name, unsigned(sbs.nodes.size()), 
+           std::chrono::duration_cast<std::chrono::microseconds>(t2 - t1).count()/1000.0f);
+    return pRender;
+  };
+
+  auto pRenderRef    = create_renderer("cbvh_embree2");
+  auto pRenderNative = create_renderer("cbvh_sah");
+
+  //leaves of BLAS are in different order, so only distances are compared
+  std::vector<CRT_Hit> hits_ref, hits_native;
+  trace_primary_rays(get_bvh(pRenderRef),    float3(0, 0, 3), float3(0, 0, -1.5f), W, H, hits_ref);
+  trace_primary_rays(get_bvh(pRenderNative), float3(0, 0, 3), float3(0, 0, -1.5f), W, H, hits_native);
+  unsigned mismatches = count_hit_mismatches(hits_ref, hits_native, 1e-4f, false);
+
+  printf("  51.1. %-64s", "[CPU] native SAH and embree BLAS give the same hits ");
+  if (mismatches == 0)
+    printf("passed\n");
+  else
+    printf("FAILED, %u mismatches\n", mismatches);
+}
+
+void litert_test_52_mapped_sbs_container()
+{
+  printf("TEST 52. MEMORY-MAPPED SBS CONTAINER\n");
+
+  auto mesh = load_normalized_bunny();
+  SdfSBS sbs = create_bunny_SBS(mesh, 7, 2, 1);
+  save_sdf_SBS_container(sbs, "saves/test_52_sbs.lrtc");
+
+  MappedSdfScene mapped;
+  bool opened = mapped.open("saves/test_52_sbs.lrtc") && mapped.type() == SDF_CONTAINER_SBS;
+  bool same = false;
+  if (opened)
+  {
+    SdfSBSView view = mapped.sbs_view();
+    same = memcmp(&view.header, &sbs.header, sizeof(SdfSBSHeader)) == 0 &&
+           view.size == sbs.nodes.size() && view.values_count == sbs.values.size() &&
+           memcmp(view.nodes, sbs.nodes.data(), sbs.nodes.size()*sizeof(SdfSBSNode)) == 0 &&
+           memcmp(view.values, sbs.values.data(), sbs.values.size()*sizeof(uint32_t)) == 0;
+  }
+
+  printf("  52.1. %-64s", "[CPU] mapped container matches saved SBS ");
+  if (opened && same)
+    printf("passed\n");
+  else
+    printf("FAILED, opened = %d, same = %d\n", (int)opened, (int)same);
+}
+
+void litert_test_53_blas_cache()
+{
+  printf("TEST 53. CACHED BLAS\n");
+
+  auto mesh = load_normalized_bunny();
+  SdfSBS sbs = create_bunny_SBS(mesh, 7, 2, 1);
+
+  auto create_renderer = [&](const char *name)
+  {
+    auto pRender = create_cpu_renderer("cbvh_embree2", getDefaultPreset());
+    get_bvh(pRender)->SetBLASCacheFolder("saves");
+    auto t1 = std::chrono::steady_clock::now();
+    pRender->SetScene(sbs);
+    auto t2 = std::chrono::steady_clock::now();
+    printf("  %-12s scene set in %.1f ms\n", name, std::chrono::duration_cast<std::chrono::microseconds>(t2 - t1).count()/1000.0f);
+    return pRender;
+  };
+
+  auto pRender1 = create_renderer("first");  //builds BLAS, unless cache is left from the previous run
+  auto pRender2 = create_renderer("cached");
+  BVHRT *bvh1 = get_bvh(pRender1);
+  BVHRT *bvh2 = get_bvh(pRender2);
+
+  bool same = bvh1->m_allNodePairs.size() == bvh2->m_allNodePairs.size() &&
+              memcmp(bvh1->m_allNodePairs.data(), bvh2->m_allNodePairs.data(), bvh1->m_allNodePairs.size()*sizeof(BVHNodePair)) == 0;
+
+  printf("  53.1. %-64s", "[CPU] BLAS is loaded from cache and matches built one ");
+  if (bvh2->GetBLASCacheHits() > 0 && same)
+    printf("passed\n");
+  else
+    printf("FAILED, cache hits = %u, same = %d\n", bvh2->GetBLASCacheHits(), (int)same);
+
+  //sidecar cache of a model loaded from file, the first load always builds BLAS as the old sidecar is removed
+  const std::string sbs_path = "saves/test_53_sbs.bin";
+  save_sdf_SBS(sbs, sbs_path);
+  std::filesystem::remove(sbs_path + ".blas");
+
+  auto load_from_file = [&]()
+  {
+    std::shared_ptr<BVHRT> bvh(new BVHRT("cbvh_embree2", "SuperTreeletAlignedMerged4"));
+    bvh->SetBLASSidecarCache(true);
+    bvh->AddCustomGeom_FromFile("sdf_sbs", sbs_path.c_str(), bvh.get());
+    return bvh;
+  };
+  auto bvh3 = load_from_file();
+  auto bvh4 = load_from_file();
+
+  bool sidecar_same = bvh3->m_allNodePairs.size() == bvh4->m_allNodePairs.size() && !bvh3->m_allNodePairs.empty() &&
+                      memcmp(bvh3->m_allNodePairs.data(), bvh4->m_allNodePairs.data(), bvh3->m_allNodePairs.size()*sizeof(BVHNodePair)) == 0;
+
+  printf("  53.2. %-64s", "[CPU] BLAS is loaded from model sidecar and matches built one ");
+  if (bvh3->GetBLASCacheHits() == 0 && bvh4->GetBLASCacheHits() == 1 && sidecar_same && std::filesystem::exists(sbs_path + ".blas"))
+    printf("passed\n");
+  else
+    printf("FAILED, cache hits = %u %u, same = %d\n", bvh3->GetBLASCacheHits(), bvh4->GetBLASCacheHits(), (int)sidecar_same);
+}
+
+void litert_test_54_batched_ray_queries()
+{
+  printf("TEST 54. BATCHED RAY QUERIES\n");
+  const unsigned N = 256*1024;
+
+  auto mesh = load_normalized_bunny();
+  SdfSBS sbs = create_bunny_SBS(mesh, 7, 4, 1);
+
+  auto pRender = create_cpu_renderer("cbvh_embree2", getDefaultPreset());
+  pRender->SetScene(sbs);
+  BVHRT *bvh = get_bvh(pRender);
+
+  //incoherent rays from random points on a sphere to random points inside the scene
+  std::vector<float> px(N), py(N), pz(N), dx(N), dy(N), dz(N), tf(N, 1000.0f);
+  for (unsigned i = 0; i < N; i++)
+  {
+    float3 from = 2.0f*normalize(float3(urand(-1,1), urand(-1,1), urand(-1,1)));
+    float3 to = float3(urand(-0.5f,0.5f), urand(-0.5f,0.5f), urand(-0.5f,0.5f));
+    float3 dir = normalize(to - from);
+    px[i] = from.x; py[i] = from.y; pz[i] = from.z;
+    dx[i] = dir.x;  dy[i] = dir.y;  dz[i] = dir.z;
+  }
+  RayBatchSoA rays = {px.data(), py.data(), pz.data(), nullptr, dx.data(), dy.data(), dz.data(), tf.data()};
+
+  std::vector<CRT_Hit> hits_scalar(N), hits_batch(N), hits_stream(N);
+  auto t1 = std::chrono::steady_clock::now();
+  for (unsigned i = 0; i < N; i++)
+    hits_scalar[i] = bvh->RayQuery_NearestHit(float4(px[i], py[i], pz[i], 0), float4(dx[i], dy[i], dz[i], tf[i]));
+  auto t2 = std::chrono::steady_clock::now();
+  bvh->RayQuery_NearestHitBatch(rays, hits_batch.data(), N);
+  auto t3 = std::chrono::steady_clock::now();
+
+  size_t read = 0, written = 0;
+  bvh->RayQuery_NearestHitStream([&](float4 *pos, float4 *dir, size_t maxCount)
+  {
+    size_t cnt = std::min<size_t>(maxCount, N - read);
+    for (size_t i = 0; i < cnt; i++, read++)
+    {
+      pos[i] = float4(px[read], py[read], pz[read], 0);
+      dir[i] = float4(dx[read], dy[read], dz[read], tf[read]);
+    }
+    return cnt;
+  },
+  [&](const CRT_Hit *hits, size_t count)
+  {
+    std::copy(hits, hits + count, hits_stream.begin() + written);
+    written += count;
+  }, 10000);
+
+  unsigned mismatches_batch  = count_hit_mismatches(hits_scalar, hits_batch, 1e-5f);
+  unsigned mismatches_stream = count_hit_mismatches(hits_scalar, hits_stream, 1e-5f);
+
+  printf("  scalar %.1f ms, batch %.1f ms\n", std::chrono::duration_cast<std::chrono::microseconds>(t2 - t1).count()/1000.0f,
+         std::chrono::duration_cast<std::chrono::microseconds>(t3 - t2).count()/1000.0f);
+  printf("  54.1. %-64s", "[CPU] batched queries give the same hits as scalar ones ");
+  if (mismatches_batch == 0)
+    printf("passed\n");
+  else
+    printf("FAILED, %u mismatches\n", mismatches_batch);
+
+  printf("  54.2. %-64s", "[CPU] streaming queries give the same hits as scalar ones ");
+  if (mismatches_stream == 0 && written == N)
+    printf("passed\n");
+  else
+    printf("FAILED, %u mismatches, %u rays streamed\n", mismatches_stream, (unsigned)written);
+}
+
+void litert_test_55_sbs_point_index()
+{
+  printf("TEST 55. SBS POINT INDEX\n");
+  const unsigned N = 1000000;
+
+  auto mesh = load_normalized_bunny();
+  SdfSBS sbs = create_bunny_SBS(mesh, 8, 4, 1);
+
+  auto sdf_indexed = get_SdfSBSFunction(sbs);
+  BVHRT bvh_ref("cbvh_embree2", "SuperTreeletAlignedMerged4");
+  bvh_ref.SetSBSPointIndex(false);
+  bvh_ref.AddGeom_SdfSBS(sbs, &bvh_ref);
+
+  std::vector<float3> points(N);
+  for (unsigned i = 0; i < N; i++)
+    points[i] = float3(urand(-1,1), urand(-1,1), urand(-1,1));
+
+  std::vector<float> dist_ref(N), dist_indexed(N);
+  auto t1 = std::chrono::steady_clock::now();
+  for (unsigned i = 0; i < N; i++)
+    dist_ref[i] = bvh_ref.eval_distance(points[i]);
+  auto t2 = std::chrono::steady_clock::now();
+  sdf_indexed->eval_distance(points.data(), dist_indexed.data(), N);
+  auto t3 = std::chrono::steady_clock::now();
+
+  unsigned mismatches = 0;
+  for (unsigned i = 0; i < N; i++)
+    if (std::abs(dist_ref[i] - dist_indexed[i]) > 1e-5f)
+      mismatches++;
+
+  printf("  BLAS traversal %.1f ms, batched index lookup %.1f ms\n", std::chrono::duration_cast<std::chrono::microseconds>(t2 - t1).count()/1000.0f,
+         std::chrono::duration_cast<std::chrono::microseconds>(t3 - t2).count()/1000.0f);
+  printf("  55.1. %-64s", "[CPU] SBS point index gives the same distances as BLAS ");
+  if (mismatches == 0)
+    printf("passed\n");
+  else
+    printf("FAILED, %u mismatches\n", mismatches);
+}
+
+void litert_test_56_sbs_occupancy_masks()
+{
+  printf("TEST 56. SBS OCCUPANCY MASKS\n");
+  unsigned W = 512, H = 512;
+
+  MultiRenderPreset preset = getDefaultPreset();
+  preset.render_mode = MULTI_RENDER_MODE_LAMBERT_NO_TEX;
+
+  auto mesh = load_normalized_bunny();
+  SdfSBS sbs = create_bunny_SBS(mesh, 6, 8, 2);
+
+  LiteImage::Image2D<uint32_t> image_ref(W, H), image_masks(W, H);
+  std::vector<CRT_Hit> hits_ref, hits_masks;
+  float time_ref = 0.0f, time_masks = 0.0f;
+  for (bool use_masks : {false, true})
+  {
+    auto pRender = create_cpu_renderer("cbvh_embree2", preset);
+    get_bvh(pRender)->SetSBSOccupancyMasks(use_masks);
+    pRender->SetScene(sbs);
+
+    auto t1 = std::chrono::steady_clock::now();
+    render(use_masks ? image_masks : image_ref, pRender, float3(0,0,3), float3(0,0,0), float3(0,1,0), preset);
+    auto t2 = std::chrono::steady_clock::now();
+    (use_masks ? time_masks : time_ref) = std::chrono::duration_cast<std::chrono::microseconds>(t2 - t1).count()/1000.0f;
+
+    trace_primary_rays(get_bvh(pRender), float3(0,0,3), float3(0,0,-1.5f), W, H, use_masks ? hits_masks : hits_ref);
+  }
+  LiteImage::SaveImage<uint32_t>("saves/test_56_masks.bmp", image_masks);
+
+  float psnr = image_metrics::PSNR(image_ref, image_masks);
+  unsigned mismatches = count_hit_mismatches(hits_ref, hits_masks, 1e-6f);
+
+  printf("  render without masks %.1f ms, with masks %.1f ms\n", time_ref, time_masks);
+  printf("  56.1. %-64s", "[CPU] occupancy masks do not change hits ");
+  if (mismatches == 0)
+    printf("passed\n");
+  else
+    printf("FAILED, %u mismatches\n", mismatches);
+
+  printf("  56.2. %-64s", "[CPU] images with and without occupancy masks PSNR > 45 ");
+  if (psnr >= 45)
+    printf("passed    (%.2f)\n", psnr);
+  else
+    printf("FAILED, psnr = %f\n", psnr);
+}
+
+void litert_test_57_out_of_core_sbs()
+{
+  printf("TEST 57. OUT-OF-CORE SBS\n");
+  unsigned W = 256, H = 256;
+
+  MultiRenderPreset preset = getDefaultPreset();
+  preset.render_mode = MULTI_RENDER_MODE_LAMBERT_NO_TEX;
+
+  auto mesh = load_normalized_bunny();
+  SdfSBS sbs = create_bunny_SBS(mesh, 7, 4, 1);
+  save_sdf_SBS_container(sbs, "saves/test_57_sbs.lrtc");
+
+  LiteImage::Image2D<uint32_t> image_ref(W, H), image_ooc(W, H);
+  auto pRenderRef = create_cpu_renderer("cbvh_embree2", preset);
+  pRenderRef->SetScene(sbs);
+  render(image_ref, pRenderRef, float3(0,0,3), float3(0,0,0), float3(0,1,0), preset);
+
+  //MultiRenderer has no SetScene for out-of-core SBS, so geometry is added the same way SetScene does it
+  auto pRender = create_cpu_renderer("cbvh_embree2", preset);
+  BVHRT *bvh = get_bvh(pRender);
+  pRender->GetAccelStruct()->ClearGeom();
+  uint32_t geomId = bvh->AddGeom_SdfSBS_OutOfCore("saves/test_57_sbs.lrtc", size_t(1) << 30, pRender->GetAccelStruct().get());
+  pRender->GetAccelStruct()->ClearScene();
+  pRender->AddInstance(geomId, LiteMath::float4x4());
+  pRender->GetAccelStruct()->CommitScene();
+
+  //every frame requests bricks it touched, pool is large enough to hold all of them, so it should converge to reference
+  float psnr = 0.0f;
+  unsigned frames = 0;
+  while (psnr < 100.0f && frames < 10)
+  {
+    render(image_ooc, pRender, float3(0,0,3), float3(0,0,0), float3(0,1,0), preset);
+    bvh->UpdateStreaming(true);
+    psnr = image_metrics::PSNR(image_ref, image_ooc);
+    frames++;
+  }
+  LiteImage::SaveImage<uint32_t>("saves/test_57_ooc.bmp", image_ooc);
+
+  std::vector<CRT_Hit> hits_ref, hits_ooc;
+  trace_primary_rays(get_bvh(pRenderRef), float3(0,0,3), float3(0,0,-1.5f), W, H, hits_ref);
+  trace_primary_rays(bvh, float3(0,0,3), float3(0,0,-1.5f), W, H, hits_ooc);
+  unsigned mismatches = count_hit_mismatches(hits_ref, hits_ooc, 1e-6f);
+
+  printf("  57.1. %-64s", "[CPU] out-of-core SBS converges to in-memory one ");
+  if (psnr >= 45)
+    printf("passed    (%.2f, %u frames)\n", psnr, frames);
+  else
+    printf("FAILED, psnr = %f after %u frames\n", psnr, frames);
+
+  printf("  57.2. %-64s", "[CPU] converged out-of-core SBS gives the same hits ");
+  if (mismatches == 0)
+    printf("passed\n");
+  else
+    printf("FAILED, %u mismatches\n", mismatches);
+}
+
+void litert_test_58_screen_space_lod()
+{
+  printf("TEST 58. SCREEN-SPACE LOD\n");
+  unsigned W = 512, H = 512;
+
+  auto mesh = load_normalized_bunny();
+  SdfSBS sbs = create_bunny_SBS(mesh, 7, 8, 1);
+
+  MultiRenderPreset preset = getDefaultPreset();
+  preset.render_mode = MULTI_RENDER_MODE_MASK;
+  MultiRenderPreset preset_lod = preset;
+  preset_lod.lod_mode = LOD_MODE_SCREEN_SPACE;
+  preset_lod.lod_pixel_threshold = 2.0f;
+
+  auto pRender = create_cpu_renderer("cbvh_embree2", preset);
+  pRender->SetScene(sbs);
+
+  //distant view, every brick covers only a pixel or two
+  LiteImage::Image2D<uint32_t> image_ref(W, H), image_lod(W, H);
+  auto t1 = std::chrono::steady_clock::now();
+  render(image_ref, pRender, float3(0,0,40), float3(0,0,0), float3(0,1,0), preset);
+  auto t2 = std::chrono::steady_clock::now();
+  render(image_lod, pRender, float3(0,0,40), float3(0,0,0), float3(0,1,0), preset_lod);
+  auto t3 = std::chrono::steady_clock::now();
+  LiteImage::SaveImage<uint32_t>("saves/test_58_ref.bmp", image_ref);
+  LiteImage::SaveImage<uint32_t>("saves/test_58_lod.bmp", image_lod);
+
+  float time_ref = std::chrono::duration_cast<std::chrono::microseconds>(t2 - t1).count()/1000.0f;
+  float time_lod = std::chrono::duration_cast<std::chrono::microseconds>(t3 - t2).count()/1000.0f;
+  float psnr = image_metrics::PSNR(image_ref, image_lod);
+
+  printf("  finest level %.1f ms, screen-space LOD %.1f ms\n", time_ref, time_lod);
+  printf("  58.1. %-64s", "[CPU] LOD image of distant object is close to finest one ");
+  if (psnr >= 25)
+    printf("passed    (%.2f)\n", psnr);
+  else
+    printf("FAILED, psnr = %f\n", psnr);
+
+  //close view, bricks are many pixels large even though their voxels are small, so they are not simplified
+  render(image_ref, pRender, float3(0,0,3), float3(0,0,0), float3(0,1,0), preset);
+  render(image_lod, pRender, float3(0,0,3), float3(0,0,0), float3(0,1,0), preset_lod);
+  psnr = image_metrics::PSNR(image_ref, image_lod);
+
+  printf("  58.2. %-64s", "[CPU] LOD is not used for bricks larger than threshold ");
+  if (psnr >= 100)
+    printf("passed    (%.2f)\n", psnr);
+  else
+    printf("FAILED, psnr = %f\n", psnr);
+}
+
+void litert_test_59_analytic_sdf_gradients()
+{
+  printf("TEST 59. ANALYTIC SDF GRADIENTS\n");
+
+  SparseOctreeSettings settings(SparseOctreeBuildType::DEFAULT, 6);
+  SdfSBSHeader header{};
+  header.bytes_per_value = 2;
+  header.brick_size = 4;
+  sdf_converter::DistanceFunction sphere_sdf = [&](float3 p){return length(p) - 0.8f;};
+  SdfSBS sbs = sdf_converter::create_sdf_SBS(settings, header, sphere_sdf);
+
+  std::shared_ptr<BVHRT> bvh(new BVHRT("cbvh_embree2", "SuperTreeletAlignedMerged4"));
+  bvh->SetPreset(getDefaultPreset());
+  uint32_t geomId = bvh->AddGeom_SdfSBS(sbs, bvh.get());
+  bvh->AddInstance(geomId, LiteMath::float4x4());
+  bvh->CommitScene(BUILD_HIGH);
+
+  //points on the sphere surface, gradient should point along the radius
+  unsigned tested = 0, bad = 0;
+  float max_angle = 0.0f;
+  for (unsigned i = 0; i < 1000; i++)
+  {
+    float3 dir = normalize(float3(double(rand()) / (RAND_MAX * 0.5) - 1.,
+                                  double(rand()) / (RAND_MAX * 0.5) - 1.,
+                                  double(rand()) / (RAND_MAX * 0.5) - 1.));
+    float3 grad;
+    float dist = bvh->eval_distance_and_grad_sdf(TYPE_SDF_SBS, geomId, 0.8f*dir, grad);
+    if (dist >= 10.0f || dot(grad, grad) == 0.0f)
+      continue;
+
+    float angle = std::acos(std::min(1.0f, dot(normalize(grad), dir)));
+    max_angle = std::max(max_angle, angle);
+    tested++;
+    if (angle > 0.1f)
+      bad++;
+  }
+
+  printf("  59.1. %-64s", "[CPU] SBS analytic gradient matches sphere normal ");
+  if (tested > 0 && bad == 0)
+    printf("passed    (max angle %.4f)\n", max_angle);
+  else
+    printf("FAILED, %u of %u gradients deviate, max angle %f\n", bad, tested, max_angle);
+}
+
+void litert_test_60_relaxed_sphere_tracing()
+{
+  printf("TEST 60. OVER-RELAXED SPHERE TRACING\n");
+  unsigned W = 512, H = 512;
+
+  auto mesh = load_normalized_bunny();
+  SdfSBS sbs = create_bunny_SBS(mesh, 6, 4, 2);
+
+  MultiRenderPreset preset = getDefaultPreset();
+  preset.render_mode = MULTI_RENDER_MODE_LAMBERT_NO_TEX;
+  auto pRender = create_cpu_renderer("cbvh_embree2", preset);
+  pRender->SetScene(sbs);
+
+  //grazing view, many rays pass close to the surface
+  LiteImage::Image2D<uint32_t> image_st(W, H), image_relaxed(W, H);
+  std::vector<CRT_Hit> iters_st, iters_relaxed;
+  for (unsigned node_intersect : {SDF_OCTREE_NODE_INTERSECT_ST, SDF_OCTREE_NODE_INTERSECT_ST_RELAXED})
+  {
+    bool relaxed = node_intersect == SDF_OCTREE_NODE_INTERSECT_ST_RELAXED;
+    preset.sdf_node_intersect = node_intersect;
+    render(relaxed ? image_relaxed : image_st, pRender, float3(0,1.2f,3), float3(0,0,0), float3(0,1,0), preset);
+
+    //in MULTI_RENDER_MODE_ST_ITERATIONS primId of hit is the number of sphere tracing iterations
+    MultiRenderPreset preset_iters = preset;
+    preset_iters.render_mode = MULTI_RENDER_MODE_ST_ITERATIONS;
+    get_bvh(pRender)->SetPreset(preset_iters);
+    trace_primary_rays(get_bvh(pRender), float3(0,1.2f,3), float3(0,-0.9f,-1.5f), W, H, relaxed ? iters_relaxed : iters_st);
+  }
+  LiteImage::SaveImage<uint32_t>("saves/test_60_relaxed.bmp", image_relaxed);
+
+  unsigned hit_count = 0;
+  double iters_sum_st = 0, iters_sum_relaxed = 0;
+  for (unsigned i = 0; i < W*H; i++)
+  {
+    if (iters_st[i].primId != uint32_t(-1) && iters_relaxed[i].primId != uint32_t(-1))
+    {
+      hit_count++;
+      iters_sum_st += iters_st[i].primId;
+      iters_sum_relaxed += iters_relaxed[i].primId;
+    }
+  }
+
+  float psnr = image_metrics::PSNR(image_st, image_relaxed);
+
+  printf("  average iterations: sphere tracing %.2f, over-relaxed %.2f\n", iters_sum_st/std::max(1u, hit_count), iters_sum_relaxed/std::max(1u, hit_count));
+  printf("  60.1. %-64s", "[CPU] over-relaxed and plain sphere tracing PSNR > 40 ");
+  if (psnr >= 40)
+    printf("passed    (%.2f)\n", psnr);
+  else
+    printf("FAILED, psnr = %f\n", psnr);
+}
+
+//random weights with SIREN initialization, in the format of load_neural_sdf_scene_SIREN (4 layers, 64 neurons)
+static SdfScene create_random_SIREN(const std::string &path)
+{
+  constexpr unsigned layers = 4;
+  constexpr unsigned sz = 64;
+  std::vector<float> weights;
+  for (unsigned l = 0; l < layers; l++)
+  {
+    unsigned in_size = l == 0 ? 3 : sz;
+    unsigned out_size = l == layers - 1 ? 1 : sz;
+    float a = l == 0 ? 1.0f/in_size : std::sqrt(6.0f/in_size)/SIREN_W0;
+    for (unsigned i = 0; i < (in_size + 1)*out_size; i++)
+      weights.push_back(urand(-a, a));
+  }
+  std::ofstream fs(path, std::ios::binary);
+  fs.write((const char *)weights.data(), weights.size()*sizeof(float));
+  fs.close();
+
+  SdfScene scene;
+  load_neural_sdf_scene_SIREN(scene, path);
+  return scene;
+}
+
+void litert_test_61_batched_siren()
+{
+  printf("TEST 61. BATCHED SIREN INFERENCE\n");
+
+  constexpr unsigned layers = 4;
+  SdfScene scene = create_random_SIREN("saves/test_61_siren.bin");
+  NeuralSdfEvaluator evaluator(scene);
+
+  unsigned count = 100003; //not a multiple of batch size
+  std::vector<float3> points(count);
+  for (unsigned i = 0; i < count; i++)
+    points[i] = float3(urand(-1, 1), urand(-1, 1), urand(-1, 1));
+
+  std::vector<float> distances(count);
+  auto t1 = std::chrono::steady_clock::now();
+  evaluator.eval_batch(points.data(), distances.data(), count);
+  auto t2 = std::chrono::steady_clock::now();
+
+  //reference is the straightforward per-point evaluation
+  float max_diff = 0.0f;
+  std::vector<float> a, b;
+  for (unsigned i = 0; i < count; i++)
+  {
+    a = {points[i].x, points[i].y, points[i].z};
+    for (unsigned l = 0; l < layers; l++)
+    {
+      const NeuralDenseLayer &layer = scene.neural_properties[0].layers[l];
+      const float *params = scene.parameters.data() + layer.offset;
+      b.resize(layer.out_size);
+      for (unsigned o = 0; o < layer.out_size; o++)
+      {
+        float s = params[layer.in_size*layer.out_size + o];
+        for (unsigned j = 0; j < layer.in_size; j++)
+          s += params[o*layer.in_size + j]*a[j];
+        b[o] = l + 1 < layers ? std::sin(SIREN_W0*s) : s;
+      }
+      std::swap(a, b);
+    }
+    max_diff = std::max(max_diff, std::abs(a[0] - distances[i]));
+  }
+  auto t3 = std::chrono::steady_clock::now();
+
+  printf("  batched %.1f ms, per-point %.1f ms\n", std::chrono::duration<float, std::milli>(t2 - t1).count(),
+         std::chrono::duration<float, std::milli>(t3 - t2).count());
+  printf("  61.1. %-64s", "[CPU] batched SIREN matches per-point evaluation ");
+  if (max_diff < 1e-4f)
+    printf("passed    (%.2e)\n", max_diff);
+  else
+    printf("FAILED, max difference %f\n", max_diff);
+}
+
+void litert_test_62_batched_distance_functions()
+{
+  printf("TEST 62. BATCHED DISTANCE FUNCTIONS\n");
+
+  auto mesh = load_normalized_bunny();
+
+  unsigned max_threads = 16;
+  std::vector<MeshBVH> bvh(max_threads);
+  for (unsigned i = 0; i < max_threads; i++)
+    bvh[i].init(mesh);
+  sdf_converter::MultithreadedDistanceFunction point_sdf = [&](const float3 &p, unsigned idx) -> float 
+  { 
+    return bvh[idx].get_signed_distance(p); 
+  };
+
+  SdfSBSHeader header;
+  header.brick_size = 4;
+  header.brick_pad = 0;
+  header.bytes_per_value = 2;
+  SparseOctreeSettings settings(SparseOctreeBuildType::DEFAULT, 6);
+
+  //single-point function goes through the adapter, mesh is converted with batched queries
+  auto t1 = std::chrono::steady_clock::now();
+  SdfSBS sbs_point = sdf_converter::create_sdf_SBS(settings, header, point_sdf, max_threads);
+  auto t2 = std::chrono::steady_clock::now();
+  SdfSBS sbs_batch = sdf_converter::create_sdf_SBS(settings, header, mesh);
+  auto t3 = std::chrono::steady_clock::now();
+
+  unsigned sbs_mismatches = 0;
+  if (sbs_point.values.size() == sbs_batch.values.size())
+  {
+    for (unsigned i = 0; i < sbs_point.values.size(); i++)
+      sbs_mismatches += sbs_point.values[i] != sbs_batch.values[i];
+  }
+
+  SdfGrid grid_point = sdf_converter::create_sdf_grid(GridSettings(64), point_sdf, max_threads);
+  SdfGrid grid_batch = sdf_converter::create_sdf_grid(GridSettings(64), mesh);
+  float grid_diff = 0.0f;
+  for (unsigned i = 0; i < grid_point.data.size(); i++)
+    grid_diff = std::max(grid_diff, std::abs(grid_point.data[i] - grid_batch.data[i]));
+
+  printf("  SBS build: per-point %.1f ms, batched %.1f ms\n", std::chrono::duration<float, std::milli>(t2 - t1).count(),
+         std::chrono::duration<float, std::milli>(t3 - t2).count());
+  printf("  62.1. %-64s", "[CPU] batched SBS build matches per-point build ");
+  if (sbs_point.nodes.size() == sbs_batch.nodes.size() && sbs_mismatches <= sbs_point.values.size()/1000)
+    printf("passed    (%u mismatches)\n", sbs_mismatches);
+  else
+    printf("FAILED, %u/%u bricks, %u mismatches\n", (unsigned)sbs_batch.nodes.size(), (unsigned)sbs_point.nodes.size(), sbs_mismatches);
+
+  printf("  62.2. %-64s", "[CPU] batched grid build matches per-point build ");
+  if (grid_diff < 1e-5f)
+    printf("passed\n");
+  else
+    printf("FAILED, max difference %f\n", grid_diff);
+}
+
+void litert_test_63_narrow_band_sbs()
+{
+  printf("TEST 63. NARROW-BAND MESH TO SBS CONVERSION\n");
+
+  auto mesh = load_normalized_bunny();
+
+  SdfSBSHeader header;
+  header.brick_size = 4;
+  header.brick_pad = 0;
+  header.bytes_per_value = 2;
+
+  auto t1 = std::chrono::steady_clock::now();
+  SdfSBS sbs_ref = sdf_converter::create_sdf_SBS(SparseOctreeSettings(SparseOctreeBuildType::DEFAULT, 7), header, mesh);
+  auto t2 = std::chrono::steady_clock::now();
+  SdfSBS sbs = sdf_converter::create_sdf_SBS(SparseOctreeSettings(SparseOctreeBuildType::MESH_NARROW_BAND, 7), header, mesh);
+  auto t3 = std::chrono::steady_clock::now();
+
+  //compare decoded voxel values with exact signed distances
+  MeshBVH bvh;
+  bvh.init(mesh);
+  unsigned v_size = header.brick_size + 2*header.brick_pad + 1;
+  double sum_error = 0.0;
+  unsigned values_count = 0, sign_errors = 0;
+  for (const SdfSBSNode &node : sbs.nodes)
+  {
+    unsigned lod_size = node.pos_z_lod_size & 0x0000FFFF;
+    float3 p0 = 2.0f*float3(node.pos_xy >> 16, node.pos_xy & 0x0000FFFF, node.pos_z_lod_size >> 16)/float(lod_size) - 1.0f;
+    float dp = 2.0f/(lod_size*header.brick_size);
+    float d_max = 2*sqrt(3)/lod_size;
+    for (unsigned i = 0; i < v_size*v_size*v_size; i++)
+    {
+      unsigned q = (sbs.values[node.data_offset + i/2] >> (16*(i%2))) & 0xFFFF;
+      float val = -d_max + 2*d_max*q/float(0xFFFF);
+      float3 pos = p0 + dp*float3(i/(v_size*v_size), (i/v_size)%v_size, i%v_size);
+      float ref = bvh.get_signed_distance(pos);
+      sum_error += std::abs(val - std::max(-d_max, std::min(d_max, ref)))/dp;
+      sign_errors += std::abs(ref) > dp && (val < 0) != (ref < 0);
+      values_count++;
+    }
+  }
+  float mean_error = sum_error/std::max(1u, values_count);
+
+  printf("  default %.1f ms (%u bricks), narrow band %.1f ms (%u bricks)\n",
+         std::chrono::duration<float, std::milli>(t2 - t1).count(), (unsigned)sbs_ref.nodes.size(),
+         std::chrono::duration<float, std::milli>(t3 - t2).count(), (unsigned)sbs.nodes.size());
+  printf("  63.1. %-64s", "[CPU] narrow-band SBS has correct distances ");
+  if (sbs.nodes.size() > 0 && mean_error < 0.1f && sign_errors <= values_count/100)
+    printf("passed    (%.3f voxels, %u sign errors)\n", mean_error, sign_errors);
+  else
+    printf("FAILED, mean error %f voxels, %u sign errors\n", mean_error, sign_errors);
+}
+
+void litert_test_64_coctree_v3_similarity_compression()
+{
+  printf("TEST 64. COMPACT OCTREE V3 SIMILARITY COMPRESSION\n");
+
+  //sphere has all 48 cube symmetries, so many of its bricks should be shared
+  auto mesh = cmesh4::LoadMeshFromVSGF((scenes_folder_path + "scenes/01_simple_scenes/data/sphere.vsgf").c_str());
+  cmesh4::normalize_mesh(mesh);
+
+  MultiRenderPreset preset = getDefaultPreset();
+  preset.render_mode = MULTI_RENDER_MODE_LAMBERT_NO_TEX;
+
+  unsigned W = 512, H = 512;
+  LiteImage::Image2D<uint32_t> image_ref(W, H);
+  LiteImage::Image2D<uint32_t> image(W, H);
+
+  unsigned max_threads = 8;
+  sdf_converter::GlobalOctree g;
+  g.header.brick_size = 4;
+  g.header.brick_pad = 1;
+  auto tlo = cmesh4::create_triangle_list_octree(mesh, 5, 0, 1.0f);
+  sdf_converter::mesh_octree_to_global_octree(mesh, tlo, g);
+
+  COctreeV3 coctree, coctree_sim;
+  coctree.header.bits_per_value = 8;
+  coctree.header.brick_size = g.header.brick_size;
+  coctree.header.brick_pad = g.header.brick_pad;
+  coctree.header.uv_size = 0;
+  coctree.header.sim_compression = 0;
+  sdf_converter::global_octree_to_compact_octree_v3(g, coctree, max_threads);
+
+  auto t1 = std::chrono::steady_clock::now();
+  sdf_converter::compact_octree_v3_similarity_compression(coctree, coctree_sim, sdf_converter::COCTREE_V3_SIM_MAX_ERROR, max_threads);
+  auto t2 = std::chrono::steady_clock::now();
+
+  {
+    auto pRender = create_cpu_renderer("cbvh_embree2", preset);
+    pRender->SetScene(coctree, 0);
+    render(image_ref, pRender, float3(0,0,3), float3(0,0,0), float3(0,1,0), preset);
+    LiteImage::SaveImage<uint32_t>("saves/test_64_ref.bmp", image_ref); 
+  }
+
+  {
+    auto pRender = create_cpu_renderer("cbvh_embree2", preset);
+    pRender->SetScene(coctree_sim, 0);
+    render(image, pRender, float3(0,0,3), float3(0,0,0), float3(0,1,0), preset);
+    LiteImage::SaveImage<uint32_t>("saves/test_64_sim.bmp", image); 
+  }
+
+  float psnr = image_metrics::PSNR(image_ref, image);
+  float ratio = float(coctree.data.size()) / float(coctree_sim.data.size());
+  printf("  compression took %.1f ms\n", std::chrono::duration<float, std::milli>(t2 - t1).count());
+
+  printf("  64.1. %-64s", "[CPU] similarity compression reduces size ");
+  if (coctree_sim.header.sim_compression == 1 && ratio > 1.0f)
+    printf("passed    (%.2fx)\n", ratio);
+  else
+    printf("FAILED, ratio = %f\n", ratio);
+
+  printf("  64.2. %-64s", "[CPU] similarity compressed octree renders the same ");
+  if (psnr >= 40)
+    printf("passed    (%.2f)\n", psnr);
+  else
+    printf("FAILED, psnr = %f\n", psnr);
+}
+
+void litert_test_65_streaming_sbs()
+{
+  printf("TEST 65. STREAMING SBS BUILD\n");
+
+  SparseOctreeSettings settings(SparseOctreeBuildType::DEFAULT, 7, 1u << 30);
+  SdfSBSHeader header;
+  header.brick_size = 4;
+  header.brick_pad = 1;
+  header.bytes_per_value = 2;
+  header.aux_data = SDF_SBS_NODE_LAYOUT_DX;
+  sdf_converter::MultithreadedDistanceFunction sdf = [](const float3 &p, unsigned idx) -> float
+  {
+    return std::min(length(p) - 0.7f, std::max(std::abs(p.x - 0.3f), std::max(std::abs(p.y), std::abs(p.z))) - 0.35f);
+  };
+
+  unsigned max_threads = 8;
+  SdfSBS sbs_ref = sdf_converter::create_sdf_SBS(settings, header, sdf, max_threads);
+  bool saved = sdf_converter::create_sdf_SBS_to_file(settings, header, sdf, max_threads, "saves/test_65_sbs.bin");
+
+  SdfSBS sbs;
+  if (saved)
+    load_sdf_SBS(sbs, "saves/test_65_sbs.bin");
+
+  bool same = saved && sbs.nodes.size() == sbs_ref.nodes.size() && sbs.values == sbs_ref.values;
+  for (unsigned i = 0; same && i < sbs.nodes.size(); i++)
+    same = sbs.nodes[i].pos_xy == sbs_ref.nodes[i].pos_xy && sbs.nodes[i].pos_z_lod_size == sbs_ref.nodes[i].pos_z_lod_size &&
+           sbs.nodes[i].data_offset == sbs_ref.nodes[i].data_offset;
+
+  printf("  65.1. %-64s", "[CPU] streaming SBS build is saved ");
+  if (saved && sbs.nodes.size() > 0)
+    printf("passed    (%u bricks)\n", (unsigned)sbs.nodes.size());
+  else
+    printf("FAILED\n");
+
+  printf("  65.2. %-64s", "[CPU] streaming SBS is the same as in-memory one ");
+  if (same)
+    printf("passed\n");
+  else
+    printf("FAILED, %u and %u bricks\n", (unsigned)sbs.nodes.size(), (unsigned)sbs_ref.nodes.size());
+}
+
+void litert_test_66_wide_bvh()
+{
+  printf("TEST 66. WIDE BVH\n");
+  unsigned W = 512, H = 512;
+
+  MultiRenderPreset preset = getDefaultPreset();
+  preset.render_mode = MULTI_RENDER_MODE_LAMBERT_NO_TEX;
+
+  auto mesh = load_normalized_bunny();
+  SdfSBS sbs = create_bunny_SBS(mesh, 7, 4, 1);
+
+  LiteImage::Image2D<uint32_t> mesh_ref(W, H), mesh_wide4(W, H), mesh_wide8(W, H);
+  LiteImage::Image2D<uint32_t> sbs_ref(W, H), sbs_wide8(W, H);
+  {
+    auto pRender = create_cpu_renderer("cbvh_embree2", preset);
+    pRender->SetScene(mesh);
+    render(mesh_ref, pRender, float3(0,0,3), float3(0,0,0), float3(0,1,0), preset);
+  }
+  {
+    auto pRender = create_cpu_renderer("cbvh_embree2_wide4", preset);
+    pRender->SetScene(mesh);
+    render(mesh_wide4, pRender, float3(0,0,3), float3(0,0,0), float3(0,1,0), preset);
+  }
+  {
+    auto pRender = create_cpu_renderer("cbvh_embree2_wide8", preset);
+    pRender->SetScene(mesh);
+    render(mesh_wide8, pRender, float3(0,0,3), float3(0,0,0), float3(0,1,0), preset);
+  }
+  {
+    auto pRender = create_cpu_renderer("cbvh_embree2", preset);
+    pRender->SetScene(sbs);
+    render(sbs_ref, pRender, float3(0,0,3), float3(0,0,0), float3(0,1,0), preset);
+  }
+  {
+    auto pRender = create_cpu_renderer("cbvh_embree2_wide8", preset);
+    pRender->SetScene(sbs);
+    render(sbs_wide8, pRender, float3(0,0,3), float3(0,0,0), float3(0,1,0), preset);
+  }
+  LiteImage::SaveImage<uint32_t>("saves/test_66_mesh_wide8.bmp", mesh_wide8);
+  LiteImage::SaveImage<uint32_t>("saves/test_66_sbs_wide8.bmp", sbs_wide8);
+
+  float psnr_1 = image_metrics::PSNR(mesh_ref, mesh_wide4);
+  float psnr_2 = image_metrics::PSNR(mesh_ref, mesh_wide8);
+  float psnr_3 = image_metrics::PSNR(sbs_ref, sbs_wide8);
+
+  printf("  66.1. %-64s", "[CPU] mesh with BVH4 and BVH2 BLAS PSNR > 45 ");
+  if (psnr_1 >= 45)
+    printf("passed    (%.2f)\n", psnr_1);
+  else
+    printf("FAILED, psnr = %f\n", psnr_1);
+
+  printf("  66.2. %-64s", "[CPU] mesh with BVH8 and BVH2 BLAS PSNR > 45 ");
+  if (psnr_2 >= 45)
+    printf("passed    (%.2f)\n", psnr_2);
+  else
+    printf("FAILED, psnr = %f\n", psnr_2);
+
+  printf("  66.3. %-64s", "[CPU] SBS with BVH8 and BVH2 BLAS PSNR > 45 ");
+  if (psnr_3 >= 45)
+    printf("passed    (%.2f)\n", psnr_3);
+  else
+    printf("FAILED, psnr = %f\n", psnr_3);
+}
+
+void litert_test_67_quantized_bvh()
+{
+  printf("TEST 67. QUANTIZED BVH\n");
+  unsigned W = 512, H = 512;
+
+  MultiRenderPreset preset = getDefaultPreset();
+  preset.render_mode = MULTI_RENDER_MODE_LAMBERT_NO_TEX;
+
+  auto mesh = load_normalized_bunny();
+
+  const char *build_names[3] = {"cbvh_embree2", "cbvh_embree2_q8", "cbvh_embree2_q16"};
+  std::vector<LiteImage::Image2D<uint32_t>> images(3, LiteImage::Image2D<uint32_t>(W, H));
+  size_t blas_size[3] = {0, 0, 0};
+  for (int i = 0; i < 3; i++)
+  {
+    auto pRender = create_cpu_renderer(build_names[i], preset);
+    pRender->SetScene(mesh);
+    render(images[i], pRender, float3(0,0,3), float3(0,0,0), float3(0,1,0), preset);
+
+    //all BLAS arrays are counted, quantized BLAS should not keep full precision copy
+    BVHRT *bvh = get_bvh(pRender);
+    blas_size[i] = bvh->m_allNodePairs.size()*sizeof(BVHNodePair) +
+                   bvh->m_allNodePairsQ8.size()*sizeof(BVHNodePairQuantized<uint8_t>) +
+                   bvh->m_allNodePairsQ16.size()*sizeof(BVHNodePairQuantized<uint16_t>);
+  }
+  LiteImage::SaveImage<uint32_t>("saves/test_67_q8.bmp", images[1]);
+  LiteImage::SaveImage<uint32_t>("saves/test_67_q16.bmp", images[2]);
+
+  float saving_1 = 100.0f*(1.0f - float(blas_size[1])/float(blas_size[0]));
+  float saving_2 = 100.0f*(1.0f - float(blas_size[2])/float(blas_size[0]));
+  printf("  BLAS size: full precision %.1f Kb, 8 bit %.1f Kb (-%.1f%%), 16 bit %.1f Kb (-%.1f%%)\n",
+         blas_size[0]/1024.0f, blas_size[1]/1024.0f, saving_1, blas_size[2]/1024.0f, saving_2);
+
+  float psnr_1 = image_metrics::PSNR(images[0], images[1]);
+  float psnr_2 = image_metrics::PSNR(images[0], images[2]);
+
+  printf("  67.1. %-64s", "[CPU] mesh with 8 bit and full precision BLAS PSNR > 45 ");
+  if (psnr_1 >= 45)
+    printf("passed    (%.2f)\n", psnr_1);
+  else
+    printf("FAILED, psnr = %f\n", psnr_1);
+
+  printf("  67.2. %-64s", "[CPU] mesh with 16 bit and full precision BLAS PSNR > 45 ");
+  if (psnr_2 >= 45)
+    printf("passed    (%.2f)\n", psnr_2);
+  else
+    printf("FAILED, psnr = %f\n", psnr_2);
+
+  printf("  67.3. %-64s", "[CPU] 8 bit BLAS takes at most half of full precision memory ");
+  if (saving_1 >= 50)
+    printf("passed    (%.2f)\n", saving_1);
+  else
+    printf("FAILED, saving = %f%%\n", saving_1);
+
+  printf("  67.4. %-64s", "[CPU] 16 bit BLAS takes at most half of full precision memory ");
+  if (saving_2 >= 50)
+    printf("passed    (%.2f)\n", saving_2);
+  else
+    printf("FAILED, saving = %f%%\n", saving_2);
+}
+
+void litert_test_68_sbs_morton_reorder()
+{
+  printf("TEST 68. SBS MORTON REORDER\n");
+  unsigned W = 512, H = 512;
+
+  MultiRenderPreset preset = getDefaultPreset();
+  preset.render_mode = MULTI_RENDER_MODE_LAMBERT_NO_TEX;
+
+  auto mesh = load_normalized_bunny();
+  SdfSBS sbs = create_bunny_SBS(mesh, 7, 4, 1);
+
+  //reversed order is not a Morton one, value blocks are left in place
+  SdfSBS sbs_reordered = sbs;
+  std::reverse(sbs_reordered.nodes.begin(), sbs_reordered.nodes.end());
+  bool was_ordered = is_sbs_morton_ordered(sbs_reordered);
+  reorder_sbs_morton(sbs_reordered);
+  bool is_ordered = is_sbs_morton_ordered(sbs_reordered);
+
+  //bricks sharing the same value block must not prevent the scene from being recognized as ordered
+  SdfSBS sbs_shared = sbs_reordered;
+  for (unsigned i = 1; i < sbs_shared.nodes.size(); i += 2)
+    sbs_shared.nodes[i].data_offset = sbs_shared.nodes[0].data_offset;
+  bool is_shared_ordered = is_sbs_morton_ordered(sbs_shared);
+
+  LiteImage::Image2D<uint32_t> image_ref(W, H), image_reordered(W, H);
+  {
+    auto pRender = create_cpu_renderer("cbvh_embree2", preset);
+    pRender->SetScene(sbs);
+    render(image_ref, pRender, float3(0,0,3), float3(0,0,0), float3(0,1,0), preset);
+  }
+  {
+    auto pRender = create_cpu_renderer("cbvh_embree2", preset);
+    pRender->SetScene(sbs_reordered);
+    render(image_reordered, pRender, float3(0,0,3), float3(0,0,0), float3(0,1,0), preset);
+  }
+  LiteImage::SaveImage<uint32_t>("saves/test_68_reordered.bmp", image_reordered);
+
+  //builder with disabled reorder keeps the order in which threads appended bricks
+  LiteImage::Image2D<uint32_t> image_unordered(W, H);
+  {
+    SdfSBSHeader header = sbs.header;
+    SparseOctreeSettings settings(SparseOctreeBuildType::MESH_TLO, 7);
+    settings.morton_order = false;
+    SdfSBS sbs_unordered = sdf_converter::create_sdf_SBS(settings, header, mesh);
+
+    auto pRender = create_cpu_renderer("cbvh_embree2", preset);
+    pRender->SetScene(sbs_unordered);
+    render(image_unordered, pRender, float3(0,0,3), float3(0,0,0), float3(0,1,0), preset);
+  }
+
+  float psnr = image_metrics::PSNR(image_ref, image_reordered);
+  float psnr_unordered = image_metrics::PSNR(image_ref, image_unordered);
+
+  printf("  68.1. %-64s", "reordered SBS is recognized as Morton ordered ");
+  if (!was_ordered && is_ordered && is_shared_ordered)
+    printf("passed\n");
+  else
+    printf("FAILED, %d %d %d\n", (int)was_ordered, (int)is_ordered, (int)is_shared_ordered);
+
+  printf("  68.2. %-64s", "[CPU] reordered and original SBS PSNR > 45 ");
+  if (psnr >= 45)
+    printf("passed    (%.2f)\n", psnr);
+  else
+    printf("FAILED, psnr = %f\n", psnr);
+
+  printf("  68.3. %-64s", "[CPU] SBS built without reorder and default one PSNR > 45 ");
+  if (psnr_unordered >= 45)
+    printf("passed    (%.2f)\n", psnr_unordered);
+  else
+    printf("FAILED, psnr = %f\n", psnr_unordered);
+}
+
+void litert_test_69_sbs_decoders()
+{
+  printf("TEST 69. SBS VOXEL DECODERS\n");
+
+  MultiRenderPreset preset = getDefaultPreset();
+  preset.render_mode = MULTI_RENDER_MODE_LAMBERT_NO_TEX;
+
+  auto mesh = load_normalized_bunny();
+
+  const unsigned bytes_per_value[3] = {1, 2, 4};
+  const unsigned brick_pad[3]       = {0, 1, 0};
+  for (int test_n = 0; test_n < 3; test_n++)
+  {
+    SdfSBSHeader header;
+    header.brick_size = 4;
+    header.brick_pad = brick_pad[test_n];
+    header.bytes_per_value = bytes_per_value[test_n];
+    header.aux_data = SDF_SBS_NODE_LAYOUT_DX;
+    SdfSBS sbs = sdf_converter::create_sdf_SBS(SparseOctreeSettings(SparseOctreeBuildType::MESH_TLO, 6), header, mesh);
+
+    auto pRender = create_cpu_renderer("cbvh_embree2", preset);
+    pRender->SetScene(sbs);
+    BVHRT *bvh = get_bvh(pRender);
+
+    //the only SBS in the scene, decoder chosen for it is replaced to compare with generic (nullptr) and scalar decoding
+    const uint32_t v_size = header.brick_size + 2*header.brick_pad + 1;
+    BVHRT::SBSDecodeFunc decoders[3] = {nullptr, BVHRT::GetSBSDecoder(header.bytes_per_value, v_size, false),
+                                        BVHRT::GetSBSDecoder(header.bytes_per_value, v_size, true)};
+    unsigned mismatches = 0;
+    for (unsigned nodeId = 0; nodeId < sbs.nodes.size(); nodeId++)
+    {
+      float sz_inv = 2.0f/float(bvh->m_SdfSBSNodes[nodeId].pos_z_lod_size & 0x0000FFFF);
+      for (unsigned vId = 0; vId < header.brick_size*header.brick_size*header.brick_size; vId++)
+      {
+        float3 voxelPos = float3(vId / (header.brick_size*header.brick_size), (vId / header.brick_size) % header.brick_size, vId % header.brick_size);
+        float values[3][8];
+        float vmin[3];
+        for (int d = 0; d < 3; d++)
+        {
+          bvh->m_SdfSBSDecoders[0] = decoders[d];
+          vmin[d] = bvh->load_distance_values(0, nodeId, voxelPos, v_size, sz_inv, header, values[d]);
+        }
+        bool match = std::abs(vmin[1] - vmin[0]) <= 1e-6f && std::abs(vmin[2] - vmin[0]) <= 1e-6f;
+        for (int i = 0; i < 8; i++)
+          match = match && std::abs(values[1][i] - values[0][i]) <= 1e-6f && std::abs(values[2][i] - values[0][i]) <= 1e-6f;
+        mismatches += match ? 0 : 1;
+      }
+    }
+
+    char name[128];
+    snprintf(name, sizeof(name), "SBS %u byte, pad %u%s decoders match generic decoding ", header.bytes_per_value, header.brick_pad,
+             decoders[1] != decoders[2] ? ", AVX2" : "");
+    printf("  69.%d. %-64s", test_n + 1, name);
+    if (mismatches == 0 && decoders[1] != nullptr)
+      printf("passed\n");
+    else
+      printf("FAILED, %u voxels mismatch\n", mismatches);
+  }
+}
+
+void litert_test_70_siren_simd()
+{
+  printf("TEST 70. SIREN SIMD KERNEL\n");
+
+  SdfScene scene = create_random_SIREN("saves/test_70_siren.bin");
+  NeuralSdfEvaluator evaluator_simd(scene, 0, true);
+  NeuralSdfEvaluator evaluator_scalar(scene, 0, false);
+
+  unsigned count = 100003; //not a multiple of batch size
+  std::vector<float3> points(count);
+  for (unsigned i = 0; i < count; i++)
+    points[i] = float3(urand(-1, 1), urand(-1, 1), urand(-1, 1));
+
+  std::vector<float> distances_simd(count), distances_scalar(count);
+  auto t1 = std::chrono::steady_clock::now();
+  evaluator_simd.eval_batch(points.data(), distances_simd.data(), count);
+  auto t2 = std::chrono::steady_clock::now();
+  evaluator_scalar.eval_batch(points.data(), distances_scalar.data(), count);
+  auto t3 = std::chrono::steady_clock::now();
+
+  //kernels differ only in FMA rounding and range reduction of sin
+  float max_diff = 0.0f;
+  for (unsigned i = 0; i < count; i++)
+    max_diff = std::max(max_diff, std::abs(distances_simd[i] - distances_scalar[i]));
+
+  printf("  %s %.1f ms, scalar %.1f ms\n", evaluator_simd.simd() ? "AVX2" : "SIMD is not supported,",
+         std::chrono::duration<float, std::milli>(t2 - t1).count(), std::chrono::duration<float, std::milli>(t3 - t2).count());
+  printf("  70.1. %-64s", "[CPU] SIMD and scalar SIREN kernels give the same distances ");
+  if (evaluator_simd.valid() && !evaluator_scalar.simd() && max_diff < 1e-4f)
+    printf("passed    (%.2e)\n", max_diff);
+  else
+    printf("FAILED, max difference %f\n", max_diff);
+}
+
+void litert_test_71_sbs_adapt_threads()
+{
+  printf("TEST 71. PARALLEL SBSAdapt GREED CREATING\n");
+
+  auto mesh = load_normalized_bunny();
+
+  unsigned max_threads = 16;
+  std::vector<MeshBVH> bvh(max_threads);
+  for (unsigned i = 0; i < max_threads; i++)
+    bvh[i].init(mesh);
+  sdf_converter::MultithreadedDistanceFunction real_sdf = [&](const float3 &p, unsigned idx) -> float 
+  { 
+    return bvh[idx].get_signed_distance(p); 
+  };
+
+  auto t1 = std::chrono::steady_clock::now();
+  SdfSBSAdapt sbs_adapt_1 = sdf_converter::greed_sbs_adapt(real_sdf, 5, 1);
+  auto t2 = std::chrono::steady_clock::now();
+  SdfSBSAdapt sbs_adapt_n = sdf_converter::greed_sbs_adapt(real_sdf, 5, max_threads);
+  auto t3 = std::chrono::steady_clock::now();
+
+  printf("  %u nodes, 1 thread %.1f ms, %u threads %.1f ms\n", (unsigned)sbs_adapt_1.nodes.size(),
+         std::chrono::duration<float, std::milli>(t2 - t1).count(), max_threads, std::chrono::duration<float, std::milli>(t3 - t2).count());
+  printf("  71.1. %-64s", "[CPU] SBSAdapt built with 1 and many threads is the same ");
+  bool same = !sbs_adapt_1.nodes.empty() &&
+              sbs_adapt_1.nodes.size() == sbs_adapt_n.nodes.size() && sbs_adapt_1.values == sbs_adapt_n.values &&
+              memcmp(sbs_adapt_1.nodes.data(), sbs_adapt_n.nodes.data(), sbs_adapt_1.nodes.size()*sizeof(SdfSBSAdaptNode)) == 0;
+  if (same)
+    printf("passed\n");
+  else
+    printf("FAILED, %u and %u nodes, %u and %u values\n", (unsigned)sbs_adapt_1.nodes.size(), (unsigned)sbs_adapt_n.nodes.size(),
+           (unsigned)sbs_adapt_1.values.size(), (unsigned)sbs_adapt_n.values.size());
+}
+
+//serial build of a subtree of frame octree, children of every node are stored together and followed by their subtrees
+static void reference_frame_octree_rec(std::vector<SdfFrameOctreeNode> &nodes, sdf_converter::MultithreadedDistanceFunction sdf, 
+                                       unsigned idx, unsigned level, unsigned max_level, float3 p, float d, float *out_center = nullptr)
+{
+  float min_val = 1000, max_val = -1000;
+  for (int cid = 0; cid < 8; cid++)
+  {
+    nodes[idx].values[cid] = sdf(2.0f * ((p + float3((cid & 4) >> 2, (cid & 2) >> 1, cid & 1)) * d) - float3(1, 1, 1), 0);
+    min_val = std::min(min_val, nodes[idx].values[cid]);
+    max_val = std::max(max_val, nodes[idx].values[cid]);
+  }
+  float center = sdf(2.0f * ((p + float3(0.5, 0.5, 0.5)) * d) - float3(1, 1, 1), 0);
+  if (out_center)
+  {
+    *out_center = center;
+    return;
+  }
+
+  if (level < max_level && (std::abs(center) < sqrtf(3) * d || min_val*max_val <= 0))
+  {
+    unsigned offset = nodes.size();
+    nodes[idx].offset = offset;
+    nodes.resize(offset + 8);
+    for (unsigned cid = 0; cid < 8; cid++)
+      reference_frame_octree_rec(nodes, sdf, offset + cid, level + 1, max_level, 2 * p + float3((cid & 4) >> 2, (cid & 2) >> 1, cid & 1), d / 2);
+  }
+}
+
+//single-threaded construct_sdf_frame_octree as it was before subtrees became tasks: top levels in BFS order,
+//then subtrees of their leaves near the surface one after another
+static std::vector<SdfFrameOctreeNode> reference_frame_octree(unsigned depth, sdf_converter::MultithreadedDistanceFunction sdf)
+{
+  struct TopNode { float3 p; float d; unsigned level; float center; };
+  const unsigned top_levels = std::min(depth, 4u);
+  std::vector<TopNode> top_nodes = {{float3(0,0,0), 1.0f, 0u, 0.0f}};
+  std::vector<SdfFrameOctreeNode> nodes(1);
+  for (unsigned i = 0; i < top_nodes.size(); i++)
+  {
+    reference_frame_octree_rec(nodes, sdf, i, top_nodes[i].level, depth, top_nodes[i].p, top_nodes[i].d, &top_nodes[i].center);
+    if (top_nodes[i].level < top_levels)
+    {
+      nodes[i].offset = top_nodes.size();
+      for (unsigned cid = 0; cid < 8; cid++)
+        top_nodes.push_back({2 * top_nodes[i].p + float3((cid & 4) >> 2, (cid & 2) >> 1, cid & 1), top_nodes[i].d / 2, top_nodes[i].level + 1, 0.0f});
+      nodes.resize(top_nodes.size());
+    }
+  }
+
+  for (unsigned i = 0; i < top_nodes.size(); i++)
+  {
+    bool border = top_nodes[i].level < 2 || std::abs(top_nodes[i].center) < sqrt(3)*pow(2, -int(top_nodes[i].level));
+    if (nodes[i].offset != 0 || !border)
+      continue;
+    std::vector<SdfFrameOctreeNode> subtree(1);
+    reference_frame_octree_rec(subtree, sdf, 0, top_nodes[i].level, depth, top_nodes[i].p, top_nodes[i].d);
+    if (subtree.size() <= 1)
+      continue;
+    int shift = int(nodes.size()) - 1;
+    nodes[i].offset = subtree[0].offset + shift;
+    for (unsigned j = 1; j < subtree.size(); j++)
+    {
+      nodes.push_back(subtree[j]);
+      if (nodes.back().offset != 0)
+        nodes.back().offset += shift;
+    }
+  }
+  return nodes;
+}
+
+void litert_test_72_frame_octree_tasks()
+{
+  printf("TEST 72. PARALLEL FRAME OCTREE BUILD\n");
+
+  auto mesh = load_normalized_bunny();
+
+  unsigned max_threads = 16;
+  std::vector<MeshBVH> bvh(max_threads);
+  for (unsigned i = 0; i < max_threads; i++)
+    bvh[i].init(mesh);
+  sdf_converter::MultithreadedDistanceFunction real_sdf = [&](const float3 &p, unsigned idx) -> float 
+  { 
+    return bvh[idx].get_signed_distance(p); 
+  };
+
+  const unsigned depth = 8;
+  auto t1 = std::chrono::steady_clock::now();
+  std::vector<SdfFrameOctreeNode> frame_ref = reference_frame_octree(depth, real_sdf);
+  auto t2 = std::chrono::steady_clock::now();
+  std::vector<SdfFrameOctreeNode> frame = sdf_converter::construct_sdf_frame_octree(SparseOctreeSettings(SparseOctreeBuildType::DEFAULT, depth),
+                                                                                   real_sdf, max_threads);
+  auto t3 = std::chrono::steady_clock::now();
+
+  printf("  %u nodes, serial %.1f ms, %u threads %.1f ms\n", (unsigned)frame_ref.size(),
+         std::chrono::duration<float, std::milli>(t2 - t1).count(), max_threads, std::chrono::duration<float, std::milli>(t3 - t2).count());
+  printf("  72.1. %-64s", "[CPU] frame octree built with tasks is the same as serial one ");
+  bool same = frame.size() == frame_ref.size();
+  for (size_t i = 0; i < frame.size() && same; i++)
+    same = frame[i].offset == frame_ref[i].offset && memcmp(frame[i].values, frame_ref[i].values, sizeof(frame[i].values)) == 0;
+  if (same)
+    printf("passed\n");
+  else
+    printf("FAILED, %u and %u nodes\n", (unsigned)frame.size(), (unsigned)frame_ref.size());
+}
+
+//compares subtree of triangle list octree with the straightforward recursive build, where every child gets triangles
+//of its parent that pass triangle_aabb_intersect. Returns the number of nodes with different type or triangles
+static unsigned count_tlo_mismatches_rec(const cmesh4::SimpleMesh &mesh, const cmesh4::TriangleListOctree &octree, unsigned idx,
+                                         const std::vector<uint32_t> &tri_ids, float3 p, float d, unsigned level,
+                                         unsigned max_depth, unsigned max_triangles_per_leaf, float search_range_mult)
+{
+  const cmesh4::TriangleListOctree::Node &node = octree.nodes[idx];
+  bool is_leaf = level >= max_depth || tri_ids.size() <= max_triangles_per_leaf;
+  if (is_leaf != (node.offset == 0))
+    return 1;
+
+  if (is_leaf)
+  {
+    std::vector<uint32_t> leaf_ids(octree.triangle_ids.begin() + node.tid_offset, octree.triangle_ids.begin() + node.tid_offset + node.tid_count);
+    std::vector<uint32_t> ref_ids = tri_ids;
+    std::sort(leaf_ids.begin(), leaf_ids.end());
+    std::sort(ref_ids.begin(), ref_ids.end());
+    return leaf_ids == ref_ids ? 0 : 1;
+  }
+
+  unsigned mismatches = 0;
+  std::vector<uint32_t> child_tri_ids;
+  for (int i = 0; i < 8; i++)
+  {
+    float ch_d = d/2;
+    float3 ch_p = 2*p + float3((i & 4) >> 2, (i & 2) >> 1, i & 1);
+    float3 ch_center = 2.0f*((ch_p + float3(0.5, 0.5, 0.5))*ch_d) - 1.0f;
+    float3 ch_half_size = 2.0f*search_range_mult*float3(ch_d);
+    child_tri_ids.clear();
+    for (uint32_t t_i : tri_ids)
+    {
+      float3 a = to_float3(mesh.vPos4f[mesh.indices[3*t_i+0]]);
+      float3 b = to_float3(mesh.vPos4f[mesh.indices[3*t_i+1]]);
+      float3 c = to_float3(mesh.vPos4f[mesh.indices[3*t_i+2]]);
+      if (cmesh4::triangle_aabb_intersect(a, b, c, ch_center, ch_half_size))
+        child_tri_ids.push_back(t_i);
+    }
+    mismatches += count_tlo_mismatches_rec(mesh, octree, node.offset + i, child_tri_ids, ch_p, ch_d, level + 1,
+                                           max_depth, max_triangles_per_leaf, search_range_mult);
+  }
+  return mismatches;
+}
+
+void litert_test_73_triangle_list_octree()
+{
+  printf("TEST 73. TRIANGLE LIST OCTREE\n");
+
+  auto mesh = load_normalized_bunny();
+  std::vector<uint32_t> all_tri_ids(mesh.TrianglesNum());
+  for (uint32_t t_i = 0; t_i < all_tri_ids.size(); t_i++)
+    all_tri_ids[t_i] = t_i;
+
+  //settings of SDF converters and the default ones
+  const unsigned max_depth[2]   = {7, 8};
+  const unsigned max_tris[2]    = {0, 4};
+  const float range_mult[2]     = {1.0f, 3.0f};
+  for (int test_n = 0; test_n < 2; test_n++)
+  {
+    auto t1 = std::chrono::steady_clock::now();
+    auto tlo = cmesh4::create_triangle_list_octree(mesh, max_depth[test_n], max_tris[test_n], range_mult[test_n]);
+    auto t2 = std::chrono::steady_clock::now();
+
+    //root is always split and its children are not tested, all of them start with the whole mesh
+    unsigned mismatches = tlo.nodes[0].offset == 0 ? 1 : 0;
+    for (int i = 0; i < 8 && mismatches == 0; i++)
+      mismatches += count_tlo_mismatches_rec(mesh, tlo, tlo.nodes[0].offset + i, all_tri_ids, float3((i & 4) >> 2, (i & 2) >> 1, i & 1), 0.5f, 1,
+                                             max_depth[test_n], max_tris[test_n], range_mult[test_n]);
+
+    printf("  %u nodes, %u triangle ids, built in %.1f ms\n", (unsigned)tlo.nodes.size(), (unsigned)tlo.triangle_ids.size(),
+           std::chrono::duration<float, std::milli>(t2 - t1).count());
+    char name[128];
+    snprintf(name, sizeof(name), "[CPU] depth %u, %u triangles in leaf, range %.0f: leaves match recursive build ",
+             max_depth[test_n], max_tris[test_n], range_mult[test_n]);
+    printf("  73.%d. %-64s", test_n + 1, name);
+    if (mismatches == 0)
+      printf("passed\n");
+    else
+      printf("FAILED, %u nodes mismatch\n", mismatches);
+  }
+}
+
+void litert_test_74_siren_to_SBS()
+{
+  printf("TEST 74. BAKING SIREN TO SBS\n");
+
+  SdfScene scene = create_random_SIREN("saves/test_74_siren.bin");
+  NeuralSdfEvaluator evaluator(scene);
+
+  unsigned max_threads = 16;
+  SparseOctreeSettings settings(SparseOctreeBuildType::DEFAULT, 5);
+  SdfSBSHeader header;
+  header.brick_size = 4;
+  header.brick_pad = 0;
+  header.bytes_per_value = 2;
+  header.aux_data = SDF_SBS_NODE_LAYOUT_DX;
+
+  //reference is the network evaluated point by point
+  sdf_converter::MultithreadedDistanceFunction point_sdf = [&](const float3 &p, unsigned idx) -> float 
+  { 
+    return evaluator.eval(p); 
+  };
+
+  auto t1 = std::chrono::steady_clock::now();
+  SdfSBS sbs_ref = sdf_converter::create_sdf_SBS(settings, header, point_sdf, max_threads);
+  auto t2 = std::chrono::steady_clock::now();
+  SdfSBS sbs = sdf_converter::create_sdf_SBS(settings, header, evaluator, max_threads);
+  auto t3 = std::chrono::steady_clock::now();
+
+  printf("  %u bricks, per-point %.1f ms, batched %.1f ms\n", (unsigned)sbs.nodes.size(),
+         std::chrono::duration<float, std::milli>(t2 - t1).count(), std::chrono::duration<float, std::milli>(t3 - t2).count());
+  printf("  74.1. %-64s", "[CPU] SIREN baked in batches is the same as baked per point ");
+  bool same = !sbs.nodes.empty() && sbs.nodes.size() == sbs_ref.nodes.size() && sbs.values == sbs_ref.values &&
+              memcmp(sbs.nodes.data(), sbs_ref.nodes.data(), sbs.nodes.size()*sizeof(SdfSBSNode)) == 0;
+  if (same)
+    printf("passed\n");
+  else
+    printf("FAILED, %u and %u bricks\n", (unsigned)sbs.nodes.size(), (unsigned)sbs_ref.nodes.size());
+}
+
 void perform_tests_litert(const std::vector<int> &test_ids)
 {
   std::vector<int> tests = test_ids;
@@ -4806,7 +6348,22 @@ void perform_tests_litert(const std::vector<int> &test_ids)
       litert_test_37_sbs_adapt_comparison, litert_test_38_direct_octree_traversal, litert_test_39_visualize_sbs_bricks,
       litert_test_40_psdf_framed_octree, litert_test_41_coctree_v3, litert_test_42_mesh_lods,
       litert_test_43_hydra_integration, litert_test_44_point_query, litert_test_45_global_octree_to_COctreeV3, 
-      litert_test_46_catmul_clark, litert_test_47_ribbon, litert_test_48_openvdb};
+      litert_test_46_catmul_clark, litert_test_47_ribbon, litert_test_48_openvdb,
+      litert_test_49_packet_traversal, litert_test_50_tlas_refit,
+      litert_test_51_native_sah_builder, litert_test_52_mapped_sbs_container,
+      litert_test_53_blas_cache, litert_test_54_batched_ray_queries,
+      litert_test_55_sbs_point_index, litert_test_56_sbs_occupancy_masks,
+      litert_test_57_out_of_core_sbs,
+      litert_test_58_screen_space_lod,
+      litert_test_59_analytic_sdf_gradients,
+      litert_test_60_relaxed_sphere_tracing,
+      litert_test_61_batched_siren,
+      litert_test_62_batched_distance_functions,
+      litert_test_63_narrow_band_sbs, litert_test_64_coctree_v3_similarity_compression,
+      litert_test_65_streaming_sbs, litert_test_66_wide_bvh, litert_test_67_quantized_bvh,
+      litert_test_68_sbs_morton_reorder, litert_test_69_sbs_decoders, litert_test_70_siren_simd,
+      litert_test_71_sbs_adapt_threads, litert_test_72_frame_octree_tasks,
+      litert_test_73_triangle_list_octree, litert_test_74_siren_to_SBS};
 
   if (tests.empty())
   {
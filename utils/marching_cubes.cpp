@@ -29,10 +29,17 @@ namespace cmesh4
   }
 
   cmesh4::SimpleMesh create_mesh_marching_cubes(MarchingCubesSettings settings, MultithreadedDensityFunction density, unsigned max_threads)
+  {
+    return create_mesh_marching_cubes(settings, [&](const float3 *p, float *out, size_t n, unsigned idx)
+                                      { for (size_t i = 0; i < n; i++) out[i] = density(p[i], idx); }, max_threads);
+  }
+
+  cmesh4::SimpleMesh create_mesh_marching_cubes(MarchingCubesSettings settings, BatchDensityFunction density, unsigned max_threads)
   {
     float3 size = settings.max_pos - settings.min_pos;
     std::vector<std::vector<float3>> vertices(max_threads);
     std::vector<std::vector<float3>> normals(max_threads);
+    const unsigned plane_size = (settings.size.y + 1)*(settings.size.z + 1);
 
     #pragma omp parallel for num_threads(max_threads) 
     for (int thread_id = 0; thread_id < max_threads; thread_id++)
@@ -40,8 +47,28 @@ namespace cmesh4
     unsigned steps = (settings.size.x + max_threads - 1) / max_threads;
     unsigned start = thread_id * steps;
     unsigned end = std::min((thread_id + 1) * steps, settings.size.x);
+
+    //density in two neighbouring planes of grid corners, every corner is evaluated once
+    std::vector<float3> plane_pos(plane_size);
+    std::vector<float> planes[2] = {std::vector<float>(plane_size), std::vector<float>(plane_size)};
+    std::vector<float3> normal_pos;
+    std::vector<float> normal_vals;
+    auto eval_plane = [&](unsigned x, std::vector<float> &vals)
+    {
+      for (unsigned yi = 0; yi <= settings.size.y; yi++)
+        for (unsigned zi = 0; zi <= settings.size.z; zi++)
+          plane_pos[yi*(settings.size.z + 1) + zi] = settings.min_pos + size*(float3(x, yi, zi) / float3(settings.size));
+      density(plane_pos.data(), vals.data(), plane_size, thread_id);
+    };
+    if (start < end)
+      eval_plane(start, planes[1]);
+
     for (int xi = start; xi < end; xi++)
     {
+      std::swap(planes[0], planes[1]);
+      eval_plane(xi + 1, planes[1]);
+      unsigned first_vertex = vertices[thread_id].size();
+
       float cubeValues[8];
       float3 cubePositions[8];
       float3 vertlist[12];
@@ -54,7 +81,7 @@ namespace cmesh4
           {
             float3 p = settings.min_pos + size*((float3(xi, yi, zi) + pOffsets[l]) / float3(settings.size));
             cubePositions[l] = p;
-            cubeValues[l] = density(p, thread_id);
+            cubeValues[l] = planes[int(pOffsets[l].x)][(yi + int(pOffsets[l].y))*(settings.size.z + 1) + zi + int(pOffsets[l].z)];
           }
 
           for (int l = 0; l < 8; l++)
@@ -97,19 +124,35 @@ namespace cmesh4
           
           for (int i = 0; edges[i] != -1; i++)
           {
-            float3 p = vertlist[edges[i]];
-
-            const float h = 0.0001f;
-            float dx = (density(p + float3(h, 0, 0), thread_id) - density(p - float3(h, 0, 0), thread_id)) / (2*h);
-            float dy = (density(p + float3(0, h, 0), thread_id) - density(p - float3(0, h, 0), thread_id)) / (2*h);
-            float dz = (density(p + float3(0, 0, h), thread_id) - density(p - float3(0, 0, h), thread_id)) / (2*h);
-            float3 n = -normalize(float3(dx, dy, dz) + float3(1e-8f, 1e-8f, 1e-8f));
-
-            vertices[thread_id].push_back(p);
-            normals[thread_id].push_back(n);
+            vertices[thread_id].push_back(vertlist[edges[i]]);
           }
         }
       }
+
+      //normals of all vertices in the slab are evaluated in one batch
+      const float h = 0.0001f;
+      unsigned count = vertices[thread_id].size() - first_vertex;
+      normal_pos.resize(6*count);
+      normal_vals.resize(6*count);
+      for (unsigned i = 0; i < count; i++)
+      {
+        float3 p = vertices[thread_id][first_vertex + i];
+        normal_pos[6*i + 0] = p + float3(h, 0, 0);
+        normal_pos[6*i + 1] = p - float3(h, 0, 0);
+        normal_pos[6*i + 2] = p + float3(0, h, 0);
+        normal_pos[6*i + 3] = p - float3(0, h, 0);
+        normal_pos[6*i + 4] = p + float3(0, 0, h);
+        normal_pos[6*i + 5] = p - float3(0, 0, h);
+      }
+      if (count > 0)
+        density(normal_pos.data(), normal_vals.data(), 6*count, thread_id);
+      for (unsigned i = 0; i < count; i++)
+      {
+        float dx = (normal_vals[6*i + 0] - normal_vals[6*i + 1]) / (2*h);
+        float dy = (normal_vals[6*i + 2] - normal_vals[6*i + 3]) / (2*h);
+        float dz = (normal_vals[6*i + 4] - normal_vals[6*i + 5]) / (2*h);
+        normals[thread_id].push_back(-normalize(float3(dx, dy, dz) + float3(1e-8f, 1e-8f, 1e-8f)));
+      }
     }
     }
 
@@ -9,6 +9,7 @@ namespace cmesh4
   using LiteMath::uint3;
   using DensityFunction = std::function<float(const float3 &)>;
   using MultithreadedDensityFunction = std::function<float(const float3 &, unsigned idx)>;
+  using BatchDensityFunction = std::function<void(const float3 *p, float *out, size_t n, unsigned idx)>;
 
   struct MarchingCubesSettings
   {
@@ -20,4 +21,5 @@ namespace cmesh4
   };
 
   cmesh4::SimpleMesh create_mesh_marching_cubes(MarchingCubesSettings settings, MultithreadedDensityFunction sdf, unsigned max_threads);
+  cmesh4::SimpleMesh create_mesh_marching_cubes(MarchingCubesSettings settings, BatchDensityFunction sdf, unsigned max_threads);
 }
\ No newline at end of file
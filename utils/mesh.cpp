@@ -7,6 +7,12 @@
 #include <fstream>
 #include <iostream>
 
+//AVX2 box test is compiled with target attribute and chosen at runtime, so it does not need -mavx2
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define TLO_CLASSIFY_AVX2
+#include <immintrin.h>
+#endif
+
 namespace cmesh4
 {
   using namespace LiteMath;
@@ -301,64 +307,165 @@ namespace cmesh4
     return dist;
   }
 
-  //thread-local function
-  void create_triangle_list_octree_rec(const cmesh4::SimpleMesh &mesh, 
-                                       std::vector<uint32_t> &tri_ids,
-                                       std::vector<TriangleListOctree::Node> &nodes,
-                                       unsigned max_depth, unsigned max_triangles_per_leaf, float search_range_mult,
-                                       const std::vector<uint32_t> &node_tri_ids,
-                                       unsigned idx, float3 p, float d, unsigned level)
+  //AABBs of all triangles, stored as separate arrays to load them for 8 triangles at once
+  struct TriangleBoundsSoA
+  {
+    std::vector<float> min_x, min_y, min_z;
+    std::vector<float> max_x, max_y, max_z;
+  };
+
+  //node that will be split on the current level, its triangles are a range in level triangle list
+  struct TLOSplitNode
   {
-    if (level >= max_depth || node_tri_ids.size() <= max_triangles_per_leaf)
+    uint32_t idx; //in octree.nodes
+    uint3 p;      //position in its level
+    uint32_t tid_offset;
+    uint32_t tid_count;
+  };
+
+  //part of split node's triangle list processed by one thread
+  struct TLOWorkItem
+  {
+    uint32_t node;        //in split nodes
+    uint32_t begin;       //in split node's triangle range
+    uint32_t end;
+    uint32_t mask_offset; //masks of children intersected by every triangle
+    uint32_t counts[8];   //how many triangles intersect every child
+    uint32_t *dst[8];     //where triangle ids of every child are written
+  };
+
+  static constexpr uint32_t TLO_WORK_ITEM_SIZE = 4096;
+
+  static TriangleBoundsSoA get_triangle_bounds(const cmesh4::SimpleMesh &mesh)
+  {
+    TriangleBoundsSoA bounds;
+    const int triangles_count = mesh.TrianglesNum();
+    bounds.min_x.resize(triangles_count);
+    bounds.min_y.resize(triangles_count);
+    bounds.min_z.resize(triangles_count);
+    bounds.max_x.resize(triangles_count);
+    bounds.max_y.resize(triangles_count);
+    bounds.max_z.resize(triangles_count);
+
+    #pragma omp parallel for schedule(static)
+    for (int t_i = 0; t_i < triangles_count; t_i++)
     {
-      //make this node a leaf
-      nodes[idx].offset = 0;
-      nodes[idx].tid_count = node_tri_ids.size();
-      nodes[idx].tid_offset = tri_ids.size();
-      for (auto &tri_idx : node_tri_ids) 
+      float3 a = to_float3(mesh.vPos4f[mesh.indices[3*t_i+0]]);
+      float3 b = to_float3(mesh.vPos4f[mesh.indices[3*t_i+1]]);
+      float3 c = to_float3(mesh.vPos4f[mesh.indices[3*t_i+2]]);
+      float3 min_f = min(a, min(b, c));
+      float3 max_f = max(a, max(b, c));
+      bounds.min_x[t_i] = min_f.x;
+      bounds.min_y[t_i] = min_f.y;
+      bounds.min_z[t_i] = min_f.z;
+      bounds.max_x[t_i] = max_f.x;
+      bounds.max_y[t_i] = max_f.y;
+      bounds.max_z[t_i] = max_f.z;
+    }
+    return bounds;
+  }
+
+  //masks of children whose boxes intersect AABBs of triangles [first, count)
+  static void tlo_box_masks(const TriangleBoundsSoA &bounds, const uint32_t *tri_ids, uint32_t first, uint32_t count,
+                            const float3 ch_centers[8], float3 ch_half_size, uint8_t *masks)
+  {
+    for (uint32_t i = first; i < count; i++)
+    {
+      const uint32_t t_i = tri_ids[i];
+      uint8_t m = 0;
+      for (int c = 0; c < 8; c++)
       {
-        tri_ids.push_back(tri_idx);    
+        bool sep = bounds.min_x[t_i] - ch_centers[c].x > ch_half_size.x || ch_centers[c].x - bounds.max_x[t_i] > ch_half_size.x ||
+                   bounds.min_y[t_i] - ch_centers[c].y > ch_half_size.y || ch_centers[c].y - bounds.max_y[t_i] > ch_half_size.y ||
+                   bounds.min_z[t_i] - ch_centers[c].z > ch_half_size.z || ch_centers[c].z - bounds.max_z[t_i] > ch_half_size.z;
+        m |= sep ? 0 : (1 << c);
       }
-      
-      //printf("created %u-leaf %u on p=(%f %f %f) with %d tris\n", level, idx, p.x, p.y, p.z, (int)node_tri_ids.size());
+      masks[i] = m;
     }
-    else
+  }
+
+#ifdef TLO_CLASSIFY_AVX2
+  //the same for 8 triangles at once, returns how many triangles are processed
+  __attribute__((target("avx2")))
+  static uint32_t tlo_box_masks_avx2(const TriangleBoundsSoA &bounds, const uint32_t *tri_ids, uint32_t count,
+                                     const float3 ch_centers[8], float3 ch_half_size, uint8_t *masks)
+  {
+    uint32_t i = 0;
+    for (; i + 8 <= count; i += 8)
     {
-      //go deeper
-      unsigned ch_idx = nodes.size();
-      nodes[idx].offset = ch_idx;
-      nodes[idx].tid_count = node_tri_ids.size();
-      nodes[idx].tid_offset = tri_ids.size();
-
-      for (int i=0;i<8;i++)
-        nodes.emplace_back();
-      
-      //printf("created %u-branch %u on p=(%f %f %f) with %d tris\n", level, idx, p.x, p.y, p.z, (int)node_tri_ids.size());
-      std::vector<uint32_t> child_tri_ids;
-      for (int i=0;i<8;i++)
+      const __m256i ids = _mm256_loadu_si256((const __m256i *)(tri_ids + i));
+      const __m256 min_x = _mm256_i32gather_ps(bounds.min_x.data(), ids, 4);
+      const __m256 min_y = _mm256_i32gather_ps(bounds.min_y.data(), ids, 4);
+      const __m256 min_z = _mm256_i32gather_ps(bounds.min_z.data(), ids, 4);
+      const __m256 max_x = _mm256_i32gather_ps(bounds.max_x.data(), ids, 4);
+      const __m256 max_y = _mm256_i32gather_ps(bounds.max_y.data(), ids, 4);
+      const __m256 max_z = _mm256_i32gather_ps(bounds.max_z.data(), ids, 4);
+      const __m256 h_x = _mm256_set1_ps(ch_half_size.x);
+      const __m256 h_y = _mm256_set1_ps(ch_half_size.y);
+      const __m256 h_z = _mm256_set1_ps(ch_half_size.z);
+
+      __m256i m = _mm256_setzero_si256();
+      for (int c = 0; c < 8; c++)
       {
-        child_tri_ids.resize(0);
-        child_tri_ids.reserve(node_tri_ids.size());
-
-        float ch_d = d/2;
-        float3 ch_p = 2*p + float3((i & 4) >> 2, (i & 2) >> 1, i & 1);
-        float3 ch_center = 2.0f*((ch_p + float3(0.5, 0.5, 0.5))*ch_d) - 1.0f;
-        float3 ch_half_size = 2.0f/*this*/*search_range_mult*float3(ch_d);
-
-        //printf("ch node (%f %f %f)-(%f %f %f)\n", ch_center.x, ch_center.y, ch_center.z, ch_half_size.x, ch_half_size.y, ch_half_size.z);
+        const __m256 c_x = _mm256_set1_ps(ch_centers[c].x);
+        const __m256 c_y = _mm256_set1_ps(ch_centers[c].y);
+        const __m256 c_z = _mm256_set1_ps(ch_centers[c].z);
+        __m256 sep = _mm256_or_ps(_mm256_cmp_ps(_mm256_sub_ps(min_x, c_x), h_x, _CMP_GT_OQ),
+                                  _mm256_cmp_ps(_mm256_sub_ps(c_x, max_x), h_x, _CMP_GT_OQ));
+        sep = _mm256_or_ps(sep, _mm256_or_ps(_mm256_cmp_ps(_mm256_sub_ps(min_y, c_y), h_y, _CMP_GT_OQ),
+                                             _mm256_cmp_ps(_mm256_sub_ps(c_y, max_y), h_y, _CMP_GT_OQ)));
+        sep = _mm256_or_ps(sep, _mm256_or_ps(_mm256_cmp_ps(_mm256_sub_ps(min_z, c_z), h_z, _CMP_GT_OQ),
+                                             _mm256_cmp_ps(_mm256_sub_ps(c_z, max_z), h_z, _CMP_GT_OQ)));
+        m = _mm256_or_si256(m, _mm256_andnot_si256(_mm256_castps_si256(sep), _mm256_set1_epi32(1 << c)));
+      }
 
-        for (int t_i : node_tri_ids)
-        {
-          float3 a = to_float3(mesh.vPos4f[mesh.indices[3*t_i+0]]);
-          float3 b = to_float3(mesh.vPos4f[mesh.indices[3*t_i+1]]);
-          float3 c = to_float3(mesh.vPos4f[mesh.indices[3*t_i+2]]);
+      alignas(32) uint32_t m_arr[8];
+      _mm256_store_si256((__m256i *)m_arr, m);
+      for (int j = 0; j < 8; j++)
+        masks[i + j] = m_arr[j];
+    }
+    return i;
+  }
+#endif
 
-          if (triangle_aabb_intersect(a, b, c, ch_center, ch_half_size))
-            child_tri_ids.push_back(t_i);
-        }
+  //finds children of the node intersected by every triangle. Triangle AABBs are checked first, it is the same 
+  //as the test of box axes in triangle_aabb_intersect, so only triangles that pass it need the full SAT test
+  static void tlo_classify_triangles(const cmesh4::SimpleMesh &mesh, const TriangleBoundsSoA &bounds,
+                                     const uint32_t *tri_ids, uint32_t count, const float3 ch_centers[8],
+                                     float3 ch_half_size, uint8_t *masks, uint32_t counts[8])
+  {
+    uint32_t i = 0;
+#ifdef TLO_CLASSIFY_AVX2
+    static const bool has_avx2 = __builtin_cpu_supports("avx2");
+    if (has_avx2)
+      i = tlo_box_masks_avx2(bounds, tri_ids, count, ch_centers, ch_half_size, masks);
+#endif
+    tlo_box_masks(bounds, tri_ids, i, count, ch_centers, ch_half_size, masks);
+
+    //triangles that are well inside the box intersect it for sure, the rest need full test
+    const float3 inner_half_size = 0.999f*ch_half_size;
+    for (i = 0; i < count; i++)
+    {
+      if (masks[i] == 0)
+        continue;
 
-        create_triangle_list_octree_rec(mesh, tri_ids, nodes, max_depth, max_triangles_per_leaf, search_range_mult,
-                                        child_tri_ids, ch_idx+i, ch_p, ch_d, level+1);
+      const uint32_t t_i = tri_ids[i];
+      float3 a = to_float3(mesh.vPos4f[mesh.indices[3*t_i+0]]);
+      float3 b = to_float3(mesh.vPos4f[mesh.indices[3*t_i+1]]);
+      float3 c = to_float3(mesh.vPos4f[mesh.indices[3*t_i+2]]);
+      float3 min_f = float3(bounds.min_x[t_i], bounds.min_y[t_i], bounds.min_z[t_i]);
+      float3 max_f = float3(bounds.max_x[t_i], bounds.max_y[t_i], bounds.max_z[t_i]);
+      for (int ch = 0; ch < 8; ch++)
+      {
+        if (!(masks[i] & (1 << ch)))
+          continue;
+        float3 lo = ch_centers[ch] - inner_half_size;
+        float3 hi = ch_centers[ch] + inner_half_size;
+        bool inside = min_f.x > lo.x && min_f.y > lo.y && min_f.z > lo.z && max_f.x < hi.x && max_f.y < hi.y && max_f.z < hi.z;
+        if (inside || triangle_aabb_intersect(a, b, c, ch_centers[ch], ch_half_size))
+          counts[ch]++;
+        else
+          masks[i] &= ~(1 << ch);
       }
     }
   }
@@ -366,65 +473,165 @@ namespace cmesh4
   TriangleListOctree create_triangle_list_octree(const cmesh4::SimpleMesh &mesh, unsigned max_depth, 
                                                  unsigned max_triangles_per_leaf, float search_range_mult)
   {
-    std::vector<unsigned> all_tri_ids(mesh.TrianglesNum());
-    for (int t_i=0;t_i<mesh.TrianglesNum();t_i++)
-      all_tri_ids[t_i] = t_i;
+    //octree is built top-down level by level. Triangle ids of all nodes that should be split are stored in one list, 
+    //each node's range is split into work items for threads, they classify triangles against children in parallel.
+    //Then child ranges are found with prefix sums and ids are scattered either to the next level list or to leaves
+    const uint32_t triangles_count = mesh.TrianglesNum();
+    TriangleBoundsSoA bounds = get_triangle_bounds(mesh);
 
-    constexpr int NUM_THREADS = 8;
-    std::vector<std::vector<uint32_t>> thread_local_tri_ids(NUM_THREADS);
-    std::vector<std::vector<TriangleListOctree::Node>> thread_local_nodes(NUM_THREADS, {TriangleListOctree::Node()});
+    TriangleListOctree octree;
+    octree.nodes.resize(9);
+    octree.nodes[0].offset = 1;
+    octree.nodes[0].tid_offset = 0;
+    octree.nodes[0].tid_count = triangles_count;
 
-    #pragma omp parallel for num_threads(NUM_THREADS)
-    for (int i=0;i<NUM_THREADS;i++)
+    //root is always split and its children are not tested, they all start with the whole mesh
+    std::vector<uint32_t> level_tri_ids(triangles_count);
+    for (uint32_t t_i = 0; t_i < triangles_count; t_i++)
+      level_tri_ids[t_i] = t_i;
+
+    std::vector<TLOSplitNode> split_nodes;
+    for (int i = 0; i < 8; i++)
     {
-      create_triangle_list_octree_rec(mesh, thread_local_tri_ids[i], thread_local_nodes[i], max_depth, max_triangles_per_leaf,
-                                      search_range_mult, all_tri_ids, 0, float3((i & 4) >> 2, (i & 2) >> 1, i & 1), 0.5f, 1);
+      TriangleListOctree::Node &node = octree.nodes[1 + i];
+      node.offset = 0;
+      node.tid_count = triangles_count;
+      if (1 >= max_depth || triangles_count <= max_triangles_per_leaf)
+      {
+        node.tid_offset = octree.triangle_ids.size();
+        octree.triangle_ids.insert(octree.triangle_ids.end(), level_tri_ids.begin(), level_tri_ids.end());
+      }
+      else
+      {
+        node.tid_offset = 0;
+        split_nodes.push_back({uint32_t(1 + i), uint3((i & 4) >> 2, (i & 2) >> 1, i & 1), 0, triangles_count});
+      }
     }
 
-    TriangleListOctree octree;
-    unsigned octree_total_nodes = 1;
-    unsigned octree_total_tri_ids = 0;
-
-    for (int i=0;i<NUM_THREADS;i++)
+    std::vector<TLOWorkItem> work_items;
+    std::vector<uint8_t> masks;
+    std::vector<uint32_t> next_tri_ids;
+    std::vector<TLOSplitNode> next_split_nodes;
+    std::vector<uint32_t> node_first_item;
+    std::vector<std::pair<bool, uint32_t>> child_dst; //is it a leaf, and offset in leaf or next level list
+    for (unsigned level = 1; !split_nodes.empty(); level++)
     {
-      octree_total_nodes += thread_local_nodes[i].size();
-      octree_total_tri_ids += thread_local_tri_ids[i].size();
-    }
+      work_items.clear();
+      node_first_item.resize(split_nodes.size() + 1);
+      uint32_t masks_count = 0;
+      for (uint32_t n = 0; n < split_nodes.size(); n++)
+      {
+        node_first_item[n] = work_items.size();
+        for (uint32_t b = 0; b < split_nodes[n].tid_count; b += TLO_WORK_ITEM_SIZE)
+        {
+          TLOWorkItem item;
+          item.node = n;
+          item.begin = b;
+          item.end = std::min(b + TLO_WORK_ITEM_SIZE, split_nodes[n].tid_count);
+          item.mask_offset = masks_count;
+          masks_count += item.end - item.begin;
+          work_items.push_back(item);
+        }
+      }
+      node_first_item[split_nodes.size()] = work_items.size();
+      masks.resize(masks_count);
 
-    octree.nodes.resize(octree_total_nodes);
-    octree.triangle_ids.resize(octree_total_tri_ids);
-    octree.nodes[0].offset = 1;
-    octree.nodes[0].tid_count = all_tri_ids.size()/3;
-    octree.nodes[0].tid_offset = 0;
+      const float d = 1.0f/(1u << level);
+      const float ch_d = d/2;
+      const float3 ch_half_size = 2.0f*search_range_mult*float3(ch_d);
 
-    unsigned node_ofs = 9;
-    unsigned tri_ids_ofs = 0;
-    for (int i=0;i<NUM_THREADS;i++)
-    {
-      bool empty_root = thread_local_nodes[i][0].offset == 0;
-      octree.nodes[i+1].offset = empty_root ? 0 : node_ofs;
-      octree.nodes[i+1].tid_count = empty_root ? 0 : thread_local_nodes[i][0].tid_count;
-      octree.nodes[i+1].tid_offset = empty_root ? 0 : thread_local_nodes[i][0].tid_offset + tri_ids_ofs;
+      #pragma omp parallel for schedule(dynamic)
+      for (int w = 0; w < int(work_items.size()); w++)
+      {
+        TLOWorkItem &item = work_items[w];
+        const TLOSplitNode &node = split_nodes[item.node];
+        float3 ch_centers[8];
+        for (int i = 0; i < 8; i++)
+        {
+          float3 ch_p = 2*float3(node.p) + float3((i & 4) >> 2, (i & 2) >> 1, i & 1);
+          ch_centers[i] = 2.0f*((ch_p + float3(0.5, 0.5, 0.5))*ch_d) - 1.0f;
+          item.counts[i] = 0;
+        }
+        tlo_classify_triangles(mesh, bounds, level_tri_ids.data() + node.tid_offset + item.begin, item.end - item.begin,
+                               ch_centers, ch_half_size, masks.data() + item.mask_offset, item.counts);
+      }
 
-      for (int j=1;j<thread_local_nodes[i].size();j++)
+      //children are added in the order of split nodes, every child's triangles are either a leaf range 
+      //or a range in the next level list, work items of a node write to their parts of this range
+      next_split_nodes.clear();
+      uint32_t next_count = 0;
+      uint32_t leaf_count = octree.triangle_ids.size();
+      child_dst.resize(8*split_nodes.size());
+      for (uint32_t n = 0; n < split_nodes.size(); n++)
       {
-        octree.nodes[node_ofs+j-1] = thread_local_nodes[i][j];
-        if (thread_local_nodes[i][j].offset == 0)
-          octree.nodes[node_ofs+j-1].tid_offset += tri_ids_ofs;
-        else
-          octree.nodes[node_ofs+j-1].offset += node_ofs-1;
+        const uint32_t ch_idx = octree.nodes.size();
+        octree.nodes[split_nodes[n].idx].offset = ch_idx;
+        octree.nodes.resize(ch_idx + 8);
+        for (int i = 0; i < 8; i++)
+        {
+          uint32_t count = 0;
+          for (uint32_t w = node_first_item[n]; w < node_first_item[n+1]; w++)
+            count += work_items[w].counts[i];
+
+          TriangleListOctree::Node &child = octree.nodes[ch_idx + i];
+          child.offset = 0;
+          child.tid_count = count;
+          if (level + 1 >= max_depth || count <= max_triangles_per_leaf)
+          {
+            child.tid_offset = leaf_count;
+            child_dst[8*n + i] = {true, leaf_count};
+            leaf_count += count;
+          }
+          else
+          {
+            child.tid_offset = 0;
+            child_dst[8*n + i] = {false, next_count};
+            const uint3 p = split_nodes[n].p;
+            const uint3 ch_p = uint3(2*p.x + ((i & 4) >> 2), 2*p.y + ((i & 2) >> 1), 2*p.z + (i & 1));
+            next_split_nodes.push_back({ch_idx + i, ch_p, next_count, count});
+            next_count += count;
+          }
+        }
+      }
+
+      octree.triangle_ids.resize(leaf_count);
+      next_tri_ids.resize(next_count);
+      for (uint32_t n = 0; n < split_nodes.size(); n++)
+      {
+        for (int i = 0; i < 8; i++)
+        {
+          uint32_t *dst = child_dst[8*n + i].first ? octree.triangle_ids.data() : next_tri_ids.data();
+          dst += child_dst[8*n + i].second;
+          for (uint32_t w = node_first_item[n]; w < node_first_item[n+1]; w++)
+          {
+            work_items[w].dst[i] = dst;
+            dst += work_items[w].counts[i];
+          }
+        }
       }
 
-      for (int j=0;j<thread_local_tri_ids[i].size();j++)
-        octree.triangle_ids[tri_ids_ofs + j] = thread_local_tri_ids[i][j];
+      #pragma omp parallel for schedule(dynamic)
+      for (int w = 0; w < int(work_items.size()); w++)
+      {
+        TLOWorkItem &item = work_items[w];
+        const uint32_t *tri_ids = level_tri_ids.data() + split_nodes[item.node].tid_offset + item.begin;
+        const uint8_t *item_masks = masks.data() + item.mask_offset;
+        for (uint32_t j = 0; j < item.end - item.begin; j++)
+        {
+          for (int i = 0; i < 8; i++)
+          {
+            if (item_masks[j] & (1 << i))
+              *(item.dst[i]++) = tri_ids[j];
+          }
+        }
+      }
 
-      node_ofs += thread_local_nodes[i].size() - 1;
-      tri_ids_ofs += thread_local_tri_ids[i].size();
+      level_tri_ids.swap(next_tri_ids);
+      split_nodes.swap(next_split_nodes);
     }
-    // for (auto i : octree.nodes)
-    // {
-    //   assert(!(i.offset != 0 && i.tid_count == 0));
-    // }
+
+    octree.nodes.shrink_to_fit();
+    octree.triangle_ids.shrink_to_fit();
     //printf("created octee with %d nodes and %d tri ids\n", (int)octree.nodes.size(), (int)octree.triangle_ids.size());
     return octree;
   }
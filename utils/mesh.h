@@ -41,6 +41,7 @@ namespace cmesh4
                                const float3 &aabb_center, const float3 &aabb_half_size);
 
   TriangleListGrid create_triangle_list_grid(const cmesh4::SimpleMesh &mesh, uint3 grid_size);
+  //built level by level in parallel, nodes are in breadth-first order, children of every node are stored together
   TriangleListOctree create_triangle_list_octree(const cmesh4::SimpleMesh &mesh, unsigned max_depth, 
                                                  unsigned max_triangles_per_leaf = 4, float search_range_mult = 3);
 
@@ -69,7 +69,8 @@ bool signed_distance_query_function(RTCPointQueryFunctionArguments *args)
   return false;
 }
 
-float MeshBVH::get_signed_distance(LiteMath::float3 p)
+//returns false if there are no triangles closer than radius
+bool MeshBVH::signed_distance_query(LiteMath::float3 p, float radius, float &distance)
 {
   RTCPointQueryContext ctx;
   RTCPointQuery q;
@@ -80,12 +81,16 @@ float MeshBVH::get_signed_distance(LiteMath::float3 p)
   q.x = p.x;
   q.y = p.y;
   q.z = p.z;
-  q.radius = 1e10f;
+  q.radius = radius;
   q.time = 0.0f;
 
   sdq_ctx.mesh = &mesh;
+  sdq_ctx.distance = std::min(radius, 1000.0f);
+  sdq_ctx.triangle_id = ~0u;
 
   rtcPointQuery(m_scene, &q, &ctx, signed_distance_query_function, &sdq_ctx);
+  if (sdq_ctx.triangle_id == ~0u)
+    return false;
 
   unsigned idx0 = mesh.indices[3*sdq_ctx.triangle_id+0];
   unsigned idx1 = mesh.indices[3*sdq_ctx.triangle_id+1];
@@ -103,5 +108,25 @@ float MeshBVH::get_signed_distance(LiteMath::float3 p)
 
   //printf("closest triangle %u with d=%f\n", sdq_ctx.triangle_id, sdq_ctx.distance);
 
-  return sdq_ctx.distance;
-}
\ No newline at end of file
+  distance = sdq_ctx.distance;
+  return true;
+}
+
+float MeshBVH::get_signed_distance(LiteMath::float3 p)
+{
+  float distance = 1000;
+  signed_distance_query(p, 1e10f, distance);
+  return distance;
+}
+
+void MeshBVH::get_signed_distance_batch(const LiteMath::float3 *p, float *out, size_t n)
+{
+  //distance to the closest triangle changes no more than the point moves, so
+  //the result for previous point bounds the search radius for the next one
+  for (size_t i = 0; i < n; i++)
+  {
+    float radius = i == 0 ? 1e10f : std::abs(out[i-1]) + length(p[i] - p[i-1]) + 1e-5f;
+    if (!signed_distance_query(p[i], radius, out[i]))
+      out[i] = get_signed_distance(p[i]);
+  }
+}
@@ -13,9 +13,13 @@ public:
   //distance from point to the closest triangle in mesh, >0 if point is outside, <0 if point is inside
   //sign is correct only with watertight meshes with geometric normals oriented outside
   float get_signed_distance(LiteMath::float3 p);
+  //same for n points, faster if consecutive points are close to each other
+  void get_signed_distance_batch(const LiteMath::float3 *p, float *out, size_t n);
 
   cmesh4::SimpleMesh mesh;
 private:
+  bool signed_distance_query(LiteMath::float3 p, float radius, float &distance);
+
   RTCDevice m_device =     nullptr;
   RTCScene  m_scene  =     nullptr;
   RTCGeometry m_geometry = nullptr;
@@ -2,11 +2,29 @@
 #include "mesh_bvh.h"
 #include "omp.h"
 #include "sparse_octree_builder.h"
+#include "../sdfScene/sdf_scene_neural.h"
 #include <chrono>
 #include "mesh.h"
 
 namespace sdf_converter
 {
+  BatchDistanceFunction to_batch_distance_function(MultithreadedDistanceFunction sdf)
+  {
+    return [sdf](const float3 *p, float *out, size_t n, unsigned idx)
+    {
+      for (size_t i = 0; i < n; i++)
+        out[i] = sdf(p[i], idx);
+    };
+  }
+
+  BatchDistanceFunction to_batch_distance_function(const NeuralSdfEvaluator &evaluator)
+  {
+    return [&evaluator](const float3 *p, float *out, size_t n, unsigned idx)
+    {
+      evaluator.eval_batch(p, out, unsigned(n));
+    };
+  }
+
   SdfGrid create_sdf_grid(GridSettings settings, DistanceFunction sdf)
   {
     MultithreadedDistanceFunction sdf_multi = [&](const float3 &p, unsigned idx) -> float { return sdf(p); };
@@ -14,6 +32,11 @@ namespace sdf_converter
   }
 
   SdfGrid create_sdf_grid(GridSettings settings, MultithreadedDistanceFunction sdf, unsigned max_threads)
+  {
+    return create_sdf_grid(settings, to_batch_distance_function(sdf), max_threads);
+  }
+
+  SdfGrid create_sdf_grid(GridSettings settings, BatchDistanceFunction sdf, unsigned max_threads)
   {
     assert(settings.size >= 1);
 
@@ -28,12 +51,20 @@ namespace sdf_converter
 
     grid.data.resize(total_size);
 
+    //one batch per row of the grid
     omp_set_num_threads(max_threads);
     #pragma omp parallel
-    for (int i = 0; i < sz; i++)
-      for (int j = 0; j < sz; j++)
+    {
+      std::vector<float3> positions(sz);
+      #pragma omp for
+      for (int row = 0; row < sz*sz; row++)
+      {
+        int i = row / sz, j = row % sz;
         for (int k = 0; k < sz; k++)
-          grid.data[i*sz*sz + j*sz + k] = sdf(2.0f*(float3(k + 0.5, j + 0.5, i + 0.5)/float(sz/* - 1*/)) - 1.0f, omp_get_thread_num());
+          positions[k] = 2.0f*(float3(k + 0.5, j + 0.5, i + 0.5)/float(sz/* - 1*/)) - 1.0f;
+        sdf(positions.data(), grid.data.data() + size_t(row)*sz, sz, omp_get_thread_num());
+      }
+    }
     omp_set_num_threads(omp_get_max_threads());
 
     return grid;
@@ -47,8 +78,8 @@ namespace sdf_converter
     for (unsigned i = 0; i < max_threads; i++)
       bvh[i].init(mesh);
     
-    return create_sdf_grid(settings, [&](const float3 &p, unsigned idx) -> float 
-                           { return bvh[idx].get_signed_distance(p); }, max_threads);
+    return create_sdf_grid(settings, [&](const float3 *p, float *out, size_t n, unsigned idx)
+                           { bvh[idx].get_signed_distance_batch(p, out, n); }, max_threads);
   }
 
   std::vector<SdfFrameOctreeNode> create_sdf_frame_octree(SparseOctreeSettings settings, DistanceFunction sdf)
@@ -70,6 +101,11 @@ namespace sdf_converter
   }
 
   std::vector<SdfFrameOctreeNode> create_sdf_frame_octree(SparseOctreeSettings settings, MultithreadedDistanceFunction sdf, unsigned max_threads)
+  {
+    return create_sdf_frame_octree(settings, to_batch_distance_function(sdf), max_threads);
+  }
+
+  std::vector<SdfFrameOctreeNode> create_sdf_frame_octree(SparseOctreeSettings settings, BatchDistanceFunction sdf, unsigned max_threads)
   {
     auto nodes = construct_sdf_frame_octree(settings, sdf, max_threads);
     frame_octree_limit_nodes(nodes, settings.nodes_limit, false);
@@ -94,8 +130,8 @@ namespace sdf_converter
       for (unsigned i = 0; i < max_threads; i++)
         bvh[i].init(mesh);
       
-      return create_sdf_frame_octree(settings, [&](const float3 &p, unsigned idx) -> float 
-                                     { return bvh[idx].get_signed_distance(p); }, max_threads);
+      return create_sdf_frame_octree(settings, [&](const float3 *p, float *out, size_t n, unsigned idx)
+                                     { bvh[idx].get_signed_distance_batch(p, out, n); }, max_threads);
     }
   }
 
@@ -167,6 +203,11 @@ namespace sdf_converter
   }
 
   SdfSBS create_sdf_SBS(SparseOctreeSettings settings, SdfSBSHeader header, MultithreadedDistanceFunction sdf, unsigned max_threads)
+  {
+    return create_sdf_SBS(settings, header, to_batch_distance_function(sdf), max_threads);
+  }
+
+  SdfSBS create_sdf_SBS(SparseOctreeSettings settings, SdfSBSHeader header, BatchDistanceFunction sdf, unsigned max_threads)
   {
     assert(settings.remove_thr >= 0);
     assert(settings.depth > 1);
@@ -176,20 +217,66 @@ namespace sdf_converter
 
     auto frame = construct_sdf_frame_octree(settings, sdf, max_threads);
     frame_octree_limit_nodes(frame, settings.nodes_limit, true);
-    auto sbs = frame_octree_to_SBS(sdf, max_threads, frame, header);
+    auto sbs = frame_octree_to_SBS(sdf, max_threads, frame, header, settings.morton_order);
     return sbs;
   }
 
+  SdfSBS create_sdf_SBS(SparseOctreeSettings settings, SdfSBSHeader header, const NeuralSdfEvaluator &evaluator, unsigned max_threads)
+  {
+    return create_sdf_SBS(settings, header, to_batch_distance_function(evaluator), max_threads);
+  }
+
   SdfSBS create_sdf_SBS(SparseOctreeSettings settings, SdfSBSHeader header, const cmesh4::SimpleMesh &mesh)
   {
+    if (settings.build_type == SparseOctreeBuildType::MESH_NARROW_BAND)
+    {
+      auto tlo = cmesh4::create_triangle_list_octree(mesh, settings.depth, 0, 1.0f);
+      return mesh_octree_to_SBS_narrow_band(mesh, tlo, header, 1.0f, settings.morton_order);
+    }
+
+    unsigned max_threads = omp_get_max_threads();
+
+    std::vector<MeshBVH> bvh(max_threads);
+    for (unsigned i = 0; i < max_threads; i++)
+      bvh[i].init(mesh);
+      
+    return create_sdf_SBS(settings, header, [&](const float3 *p, float *out, size_t n, unsigned idx)
+                          { bvh[idx].get_signed_distance_batch(p, out, n); }, max_threads);
+  }
+
+  bool create_sdf_SBS_to_file(SparseOctreeSettings settings, SdfSBSHeader header, MultithreadedDistanceFunction sdf, unsigned max_threads,
+                              const std::string &path)
+  {
+    return create_sdf_SBS_to_file(settings, header, to_batch_distance_function(sdf), max_threads, path);
+  }
+
+  bool create_sdf_SBS_to_file(SparseOctreeSettings settings, SdfSBSHeader header, BatchDistanceFunction sdf, unsigned max_threads,
+                              const std::string &path)
+  {
+    assert(settings.depth > 1);
+    assert(header.brick_size >= 1 && header.brick_size <= 16);
+    assert(header.brick_pad == 0 || header.brick_pad == 1);
+    assert(header.bytes_per_value == 1 || header.bytes_per_value == 2 || header.bytes_per_value == 4);
+
+    return construct_sdf_SBS_to_file(settings, sdf, max_threads, header, path);
+  }
+
+  bool create_sdf_SBS_to_file(SparseOctreeSettings settings, SdfSBSHeader header, const cmesh4::SimpleMesh &mesh, const std::string &path)
+  {
+    if (settings.build_type != SparseOctreeBuildType::DEFAULT)
+    {
+      printf("Streaming SBS can be built only with DEFAULT build type\n");
+      return false;
+    }
+
     unsigned max_threads = omp_get_max_threads();
 
     std::vector<MeshBVH> bvh(max_threads);
     for (unsigned i = 0; i < max_threads; i++)
       bvh[i].init(mesh);
       
-    return create_sdf_SBS(settings, header, [&](const float3 &p, unsigned idx) -> float 
-                          { return bvh[idx].get_signed_distance(p); }, max_threads);
+    return create_sdf_SBS_to_file(settings, header, [&](const float3 *p, float *out, size_t n, unsigned idx)
+                                  { bvh[idx].get_signed_distance_batch(p, out, n); }, max_threads, path);
   }
 
   std::vector<SdfFrameOctreeTexNode> create_sdf_frame_octree_tex(SparseOctreeSettings settings, const cmesh4::SimpleMesh &mesh)
@@ -243,7 +330,7 @@ namespace sdf_converter
                                              return bvh[idx].get_signed_distance(p) + x; };
     
       std::vector<SdfFrameOctreeTexNode> frame = conv_octree_2_tex(create_sdf_frame_octree(settings, mt_sdf, max_threads));
-      auto a = frame_octree_to_SBS_tex(mt_sdf, max_threads, frame, header);
+      auto a = frame_octree_to_SBS_tex(mt_sdf, max_threads, frame, header, settings.morton_order);
       //fclose(f);
       return a;
     }
@@ -253,7 +340,7 @@ namespace sdf_converter
                                            { return bvh[idx].get_signed_distance(p); };
   
       std::vector<SdfFrameOctreeTexNode> frame = create_sdf_frame_octree_tex(settings, mesh);
-      return frame_octree_to_SBS_tex(mt_sdf, max_threads, frame, header);
+      return frame_octree_to_SBS_tex(mt_sdf, max_threads, frame, header, settings.morton_order);
     }
   }
 
@@ -323,7 +410,15 @@ namespace sdf_converter
     MultithreadedDistanceFunction mt_sdf = [&](const float3 &p, unsigned idx) -> float 
                                            { return bvh[idx].get_signed_distance(p); };
     
-    return frame_octree_to_compact_octree_v3(frame, header, mt_sdf, max_threads);
+    if (header.sim_compression == 0)
+      return frame_octree_to_compact_octree_v3(frame, header, mt_sdf, max_threads);
+
+    COctreeV3 octree, compressed;
+    octree.header = header;
+    octree.header.sim_compression = 0;
+    octree.data = frame_octree_to_compact_octree_v3(frame, octree.header, mt_sdf, max_threads);
+    compact_octree_v3_similarity_compression(octree, compressed, COCTREE_V3_SIM_MAX_ERROR, max_threads);
+    return compressed.data;
   }
 
   uint32_t sbs_adapt_node_metric(SdfSBSAdaptNode &node, SdfSBSAdaptHeader &header)
@@ -354,25 +449,19 @@ namespace sdf_converter
     return (x_size + 1) * (y_size + 1) * (z_size + 1) * (sizeof(float) + sizeof(uint32_t)) + sizeof(SdfSBSAdaptNode);
   }
 
-  struct PositionHasher
+  //distance samples on the lattice of one top-level block of greed_sbs_adapt,
+  //positions are given in SDF_SBS_ADAPT_MAX_UNITS units
+  struct AdaptBlockSamples
   {
-    std::size_t operator()(const float3& k) const
-    {
-      // Compute individual hash values for first,
-      // second and third and combine them using XOR
-      // and bit shifting:
+    static constexpr uint32_t SIZE = 17; //16 voxels per block side
 
-      return (  (std::hash<float>()(k.x)
-              ^ (std::hash<float>()(k.y) << 1)) >> 1)
-              ^ (std::hash<float>()(k.z) << 1);
-    }
-  };
+    uint32_t x0 = 0, y0 = 0, z0 = 0;
+    uint32_t step = 1;
+    std::vector<float> values;
 
-  struct PositionEqual
-  {
-    bool operator()(const float3& lhs, const float3& rhs) const
+    float get(uint32_t x, uint32_t y, uint32_t z) const
     {
-      return std::abs(lhs.x - rhs.x) < 1e-12f && std::abs(lhs.y - rhs.y) < 1e-12f && std::abs(lhs.z - rhs.z) < 1e-12f;
+      return values[(((x - x0) / step) * SIZE + (y - y0) / step) * SIZE + (z - z0) / step];
     }
   };
 
@@ -424,8 +513,7 @@ namespace sdf_converter
   }
 };
 
-  void div_block(SdfSBSAdapt &sbs, MultithreadedDistanceFunction sdf, 
-                 std::unordered_map<float3, float, PositionHasher, PositionEqual> &pos_to_val,
+  void div_block(SdfSBSAdapt &sbs, const AdaptBlockSamples &samples,
                  uint16_t x_b, uint16_t y_b, uint16_t z_b,
                  uint16_t x_st, uint16_t y_st, uint16_t z_st,
                  uint8_t x_sz, uint8_t y_sz, uint8_t z_sz)
@@ -454,23 +542,14 @@ namespace sdf_converter
             {
               for (uint16_t z_neigh = 0; z_neigh <= 1; ++z_neigh)
               {
-                auto key = 2.0 * float3{(x_b + (x + x_neigh) * x_st) / (float)SDF_SBS_ADAPT_MAX_UNITS, 
-                                   (y_b + (y + y_neigh) * y_st) / (float)SDF_SBS_ADAPT_MAX_UNITS, 
-                                   (z_b + (z + z_neigh) * z_st) / (float)SDF_SBS_ADAPT_MAX_UNITS} - 1.0;
-                if (pos_to_val.find(key) == pos_to_val.end())
-                {
-                  pos_to_val[key] = sdf(key, 0);
-                  //printf("%.10f %.10f %.10f %.10f %.10f\n", key.x, key.y, key.z, pos_to_val[key], sdf(key, 0));
-                }
+                float val = samples.get(x_b + (x + x_neigh) * x_st, y_b + (y + y_neigh) * y_st, z_b + (z + z_neigh) * z_st);
                 if (is_first)
                 {
-                  sgn = pos_to_val[key];
-                  //printf("%f %f\n", pos_to_val[key], sdf(key, 0));
+                  sgn = val;
                   is_first = false;
                 }
-                else if (sgn * pos_to_val[key] <= 0)
+                else if (sgn * val <= 0)
                 {
-                  //printf("%f %f %f - %f %f %f\n", sgn, pos_to_val[key], sdf(key, 0), key.x, key.y, key.z);
                   is_vox_imp = true;
                   break;
                 }
@@ -511,10 +590,7 @@ namespace sdf_converter
         {
           for (uint8_t z = 0; z <= z_sz; ++z)
           {
-            auto key = 2.0 * float3{(x_b + (x) * x_st) / (float)SDF_SBS_ADAPT_MAX_UNITS, 
-                                   (y_b + (y) * y_st) / (float)SDF_SBS_ADAPT_MAX_UNITS, 
-                                   (z_b + (z) * z_st) / (float)SDF_SBS_ADAPT_MAX_UNITS} - 1.0;
-            printf("%f ", pos_to_val[key]);
+            printf("%f ", samples.get(x_b + x * x_st, y_b + y * y_st, z_b + z * z_st));
           }
           printf("\n");
         }
@@ -631,10 +707,10 @@ namespace sdf_converter
     //if (x_sz == 8 && y_sz == 8 && z_sz == 8) printf("-------\n");
     if (is_div)
     {
-      div_block(sbs, sdf, pos_to_val, 
+      div_block(sbs, samples, 
                 x_b + b1.x_b * x_st, y_b + b1.y_b * y_st, z_b + b1.z_b * z_st, 
                 x_st, y_st, z_st, b1.x_sz, b1.y_sz, b1.z_sz);
-      div_block(sbs, sdf, pos_to_val, 
+      div_block(sbs, samples, 
                 x_b + b2.x_b * x_st, y_b + b2.y_b * y_st, z_b + b2.z_b * z_st, 
                 x_st, y_st, z_st, b2.x_sz, b2.y_sz, b2.z_sz);
       //if (x_sz == 8 && y_sz == 8 && z_sz == 8) printf("-------\n");
@@ -653,20 +729,10 @@ namespace sdf_converter
       {
         for (uint16_t z_off = z_min; z_off <= z_max + 1; ++z_off)
         {
-          auto key = 2.0 * float3{(x_b + (x_off) * x_st) / (float)SDF_SBS_ADAPT_MAX_UNITS, 
-                                  (y_b + (y_off) * y_st) / (float)SDF_SBS_ADAPT_MAX_UNITS, 
-                                  (z_b + (z_off) * z_st) / (float)SDF_SBS_ADAPT_MAX_UNITS} - 1.0;
-          if (pos_to_val.find(key) == pos_to_val.end())
-          {
-            //printf("~~~ %.10f %.10f %.10f %.10f\n", key.x, key.y, key.z, sdf(key, 0));
-            pos_to_val[key] = sdf(key, 0);
-          }
-          //printf("%.10f %.10f %.10f %.10f %.10f\n", key.x, key.y, key.z, pos_to_val[key], sdf(key, 0));
-          unsigned d_compressed = std::max(0.0f, max_val*((pos_to_val[key]+d_max)/(2*d_max)));
+          float val = samples.get(x_b + x_off * x_st, y_b + y_off * y_st, z_b + z_off * z_st);
+          unsigned d_compressed = std::max(0.0f, max_val*((val+d_max)/(2*d_max)));
           d_compressed = std::min(d_compressed, max_val);
           sbs.values.push_back(d_compressed);
-          //printf("%f %f %u ~ %u %f %u %u\n", ((float)pos_to_val[key] + (float)d_max) / (2.0 * (float)d_max), ((float)max_val * ((float)pos_to_val[key] + (float)d_max) / (2.0 * (float)d_max)), (uint32_t)((float)max_val * ((float)pos_to_val[key] + (float)d_max) / (2.0 * (float)d_max)), d_max, 2.0 * sqrt(3.0) * ((float)max_sz / (float)SDF_SBS_ADAPT_MAX_UNITS), max_sz, SDF_SBS_ADAPT_MAX_UNITS);
-          //printf("%.8f %u ~~ %u %u %u -- %u %u %u\n", sbs.values[sbs.values.size() - 1], pos_to_val[key], x_b + x_off * x_st, y_b + y_off * y_st, z_b + z_off * z_st, x_max - x_min + 1, y_max - y_min + 1, z_max - z_min + 1);
         }
       }
     }
@@ -675,8 +741,16 @@ namespace sdf_converter
     return;
   }
 
-  SdfSBSAdapt greed_sbs_adapt(MultithreadedDistanceFunction sdf, uint8_t depth)
+  SdfSBSAdapt greed_sbs_adapt(MultithreadedDistanceFunction sdf, uint8_t depth, unsigned max_threads)
   {
+    return greed_sbs_adapt(to_batch_distance_function(sdf), depth, max_threads);
+  }
+
+  SdfSBSAdapt greed_sbs_adapt(BatchDistanceFunction sdf, uint8_t depth, unsigned max_threads)
+  {
+    constexpr uint32_t BLOCK_SAMPLES = AdaptBlockSamples::SIZE * AdaptBlockSamples::SIZE * AdaptBlockSamples::SIZE;
+    constexpr int BLOCKS_PER_PASS = 4096;
+
     SdfSBSAdapt sbs;
     sbs.header.aux_data = SDF_SBS_NODE_LAYOUT_DX;
     sbs.header.bytes_per_value = 4;
@@ -686,123 +760,77 @@ namespace sdf_converter
     sbs.values = {};
     sbs.values_f = {};
 
-    std::vector<uint32_t> imp_vox_cnt_nodes;
-    //std::map<std::pair<std::pair<uint16_t, uint16_t>, uint16_t>, float> pos_to_val;
-    std::unordered_map<float3, float, PositionHasher, PositionEqual> pos_to_val;
-    //std::map<std::pair<std::pair<uint16_t, uint16_t>, uint16_t>, uint32_t> pos_to_idx;
     std::map<int3, unsigned, SizeCmp> different_nodes;
     if (depth > 12) depth = 12;
-    uint16_t vox_size = (1u << (12 - depth));
-
-    for (uint16_t x = 0; x < SDF_SBS_ADAPT_MAX_UNITS; x += 16 * vox_size)
-    {
-      for (uint16_t y = 0; y < SDF_SBS_ADAPT_MAX_UNITS; y += 16 * vox_size)
-      {
-        for (uint16_t z = 0; z < SDF_SBS_ADAPT_MAX_UNITS; z += 16 * vox_size)
-        {
-          /*uint32_t imp_vox_cnt = 0;
-          for (uint16_t x_off = 0; x_off < 8; ++x_off)
-          {
-            for (uint16_t y_off = 0; y_off < 8; ++y_off)
-            {
-              for (uint16_t z_off = 0; z_off < 8; ++z_off)
-              {
-                float sgn = 0;
-                bool is_first = true;
-                bool is_vox_imp = false;
-                float3 pos = float3((float)(x + x_off) / (float)0x8000, (float)(y + y_off) / (float)0x8000, (float)(z + z_off) / (float)0x8000);
+    uint32_t vox_size = (1u << (12 - depth));
+    uint32_t block_units = 16 * vox_size;
+    int blocks_per_axis = std::max(1u, SDF_SBS_ADAPT_MAX_UNITS / block_units);
+    int64_t blocks_count = int64_t(blocks_per_axis) * blocks_per_axis * blocks_per_axis;
 
+    //top-level blocks are independent, so they are processed in parallel in passes of BLOCKS_PER_PASS blocks,
+    //and results of each pass are appended in the order of blocks to keep the output deterministic
+    std::vector<SdfSBSAdapt> pass_results(std::min<int64_t>(blocks_count, BLOCKS_PER_PASS));
+    for (auto &res : pass_results)
+      res.header = sbs.header;
 
-                for (uint16_t x_neigh = 0; x_neigh <= 1; ++x_neigh)
-                {
-                  for (uint16_t y_neigh = 0; y_neigh <= 1; ++y_neigh)
-                  {
-                    for (uint16_t z_neigh = 0; z_neigh <= 1; ++z_neigh)
-                    {
-                      key = std::pair(std::pair(x + x_off + x_neigh, y + y_off + y_neigh), z + z_off + z_neigh);
-                      if (pos_to_val.find(key) == pos_to_val.end())
-                      {
-                        float3 pos = float3((float)(x + x_off + x_neigh) / (float)0x8000, 
-                                            (float)(y + y_off + y_neigh) / (float)0x8000, 
-                                            (float)(z + z_off + z_neigh) / (float)0x8000);
-                        pos = pos * 2.0f - 1.0f;
-                        pos_to_val[key] = sdf(pos, 0);
-                      }
-                      if (is_first)
-                      {
-                        sgn = pos_to_val[key];
-                        is_first = false;
-                      }
-                      else if (sgn * pos_to_val[key] <= 0)
-                      {
-                        is_vox_imp = true;
-                        break;
-                      }
-                    }
-                    if (is_vox_imp) break;
-                  }
-                  if (is_vox_imp) break;
-                }
+    omp_set_num_threads(max_threads);
+    for (int64_t pass_start = 0; pass_start < blocks_count; pass_start += BLOCKS_PER_PASS)
+    {
+      int pass_size = std::min<int64_t>(BLOCKS_PER_PASS, blocks_count - pass_start);
 
+      #pragma omp parallel
+      {
+        AdaptBlockSamples samples;
+        samples.step = vox_size;
+        samples.values.resize(BLOCK_SAMPLES);
+        std::vector<float3> positions(BLOCK_SAMPLES);
 
-              }
-            }
-          }
+        #pragma omp for schedule(dynamic)
+        for (int b = 0; b < pass_size; b++)
+        {
+          int64_t block_id = pass_start + b;
+          samples.x0 = uint32_t(block_id / (blocks_per_axis * blocks_per_axis)) * block_units;
+          samples.y0 = uint32_t(block_id / blocks_per_axis % blocks_per_axis) * block_units;
+          samples.z0 = uint32_t(block_id % blocks_per_axis) * block_units;
 
-          if (imp_vox_cnt > 0)
+          //all samples of the block are evaluated at once, div_block only reads them
+          for (uint32_t i = 0; i < BLOCK_SAMPLES; i++)
           {
-            bool is_div = false;
-
-            //
-
-            //using seq vectors
+            uint32_t x = samples.x0 + (i / (AdaptBlockSamples::SIZE * AdaptBlockSamples::SIZE)) * vox_size;
+            uint32_t y = samples.y0 + (i / AdaptBlockSamples::SIZE % AdaptBlockSamples::SIZE) * vox_size;
+            uint32_t z = samples.z0 + (i % AdaptBlockSamples::SIZE) * vox_size;
+            positions[i] = 2.0f * float3{x / (float)SDF_SBS_ADAPT_MAX_UNITS, 
+                                         y / (float)SDF_SBS_ADAPT_MAX_UNITS, 
+                                         z / (float)SDF_SBS_ADAPT_MAX_UNITS} - 1.0f;
+          }
+          sdf(positions.data(), samples.values.data(), BLOCK_SAMPLES, omp_get_thread_num());
 
-            if (!is_div)
-            {
-              SdfSBSAdaptNode node;
-              node.data_offset = sbs.values.size();
-              node.pos_xy = ((uint32_t)x << 16) | (uint32_t)y;
-              node.pos_z_vox_size = ((uint32_t)z << 16) | 1;//maybe change vox size later
-              node.vox_count_xyz_pad = ((uint32_t)8 << 24) | ((uint32_t)8 << 16) | ((uint32_t)8 << 8);
-              for (uint16_t x_off = 0; x_off <= 8; ++x_off)
-              {
-                for (uint16_t y_off = 0; y_off <= 8; ++y_off)
-                {
-                  for (uint16_t z_off = 0; z_off <= 8; ++z_off)
-                  {
-                    key = std::pair(std::pair(x + x_off, y + y_off), z + z_off);
-                    if (pos_to_idx.find(key) == pos_to_idx.end())
-                    {
-                      sbs.values.push_back(sbs.values_f.size());
-                      pos_to_idx[key] = sbs.values_f.size();
-                      sbs.values_f.push_back(pos_to_val[key]);
-                    }
-                    else
-                    {
-                      sbs.values.push_back(pos_to_idx[key]);
-                    }
-                  }
-                }
-              }
-              sbs.nodes.push_back(node);
-            }
-          }*/
           //check all slices and find empties
           //if empty slice near border or have another one empty slice -> divide
           //if empty slice lonely -> check if we have better dividing after that dividing -> divide
           //we should delete this node and create different smaller nodes
-          unsigned last_sz = sbs.nodes.size();
-          div_block(sbs, sdf, pos_to_val, x, y, z, vox_size, vox_size, vox_size, 16, 16, 16);
-          for (unsigned d = last_sz; d < sbs.nodes.size(); ++d)
-          {
-            int3 sz = int3{((sbs.nodes[d].vox_count_xyz_pad >> 16) & 0xFF), ((sbs.nodes[d].vox_count_xyz_pad >> 8) & 0xFF), (sbs.nodes[d].vox_count_xyz_pad & 0xFF)};
-            if (different_nodes.find(sz) != different_nodes.end()) different_nodes[sz] += 1;
-            else different_nodes[sz] = 1;
-          }
+          pass_results[b].nodes.clear();
+          pass_results[b].values.clear();
+          div_block(pass_results[b], samples, samples.x0, samples.y0, samples.z0, vox_size, vox_size, vox_size, 16, 16, 16);
         }
       }
-    }
 
+      for (int b = 0; b < pass_size; b++)
+      {
+        uint32_t values_offset = sbs.values.size();
+        for (SdfSBSAdaptNode node : pass_results[b].nodes)
+        {
+          node.data_offset += values_offset;
+          sbs.nodes.push_back(node);
+
+          int3 sz = int3{((node.vox_count_xyz_pad >> 16) & 0xFF), ((node.vox_count_xyz_pad >> 8) & 0xFF), (node.vox_count_xyz_pad & 0xFF)};
+          if (different_nodes.find(sz) != different_nodes.end()) different_nodes[sz] += 1;
+          else different_nodes[sz] = 1;
+        }
+        sbs.values.insert(sbs.values.end(), pass_results[b].values.begin(), pass_results[b].values.end());
+      }
+    }
+    omp_set_num_threads(omp_get_max_threads());
 
     for (auto i : different_nodes)
     {
@@ -5,6 +5,8 @@
 #include "../utils/mesh.h"
 #include "../Renderer/eye_ray.h"
 
+class NeuralSdfEvaluator;
+
 struct GridSettings
 {
   GridSettings() {};
@@ -15,7 +17,8 @@ struct GridSettings
 enum class SparseOctreeBuildType
 {
   DEFAULT = 0, //build from abstrace distance function, quite slow, but reliable
-  MESH_TLO = 1 //works only if building from mesh, faster for detailed octrees and medium-sized meshes
+  MESH_TLO = 1, //works only if building from mesh, faster for detailed octrees and medium-sized meshes
+  MESH_NARROW_BAND = 2 //only SBS from mesh, exact distances near triangles, the rest of every brick is filled with fast sweeping
 };
 
 struct SparseOctreeSettings
@@ -31,6 +34,7 @@ struct SparseOctreeSettings
   float remove_thr = 0.0001; //used only with SparseOctreeBuildType::DEFAULT
   unsigned nodes_limit = 1 << 24;
   SparseOctreeBuildType build_type = SparseOctreeBuildType::DEFAULT;
+  bool morton_order = true; //SBS bricks are reordered along Z-order curve for cache-coherent traversal
 };
 
 /*
@@ -49,13 +53,21 @@ namespace sdf_converter
 {
   using DistanceFunction = std::function<float(const float3 &)>;
   using MultithreadedDistanceFunction = std::function<float(const float3 &, unsigned idx)>;
+  //evaluates distances in n points at once, idx is the thread id, as in MultithreadedDistanceFunction
+  using BatchDistanceFunction = std::function<void(const float3 *p, float *out, size_t n, unsigned idx)>;
+
+  BatchDistanceFunction to_batch_distance_function(MultithreadedDistanceFunction sdf);
+  //neural SDF evaluated in batches, evaluator is used by reference and should outlive the returned function
+  BatchDistanceFunction to_batch_distance_function(const NeuralSdfEvaluator &evaluator);
 
   SdfGrid create_sdf_grid(GridSettings settings, DistanceFunction sdf);
   SdfGrid create_sdf_grid(GridSettings settings, MultithreadedDistanceFunction sdf, unsigned max_threads);
+  SdfGrid create_sdf_grid(GridSettings settings, BatchDistanceFunction sdf, unsigned max_threads);
   SdfGrid create_sdf_grid(GridSettings settings, const cmesh4::SimpleMesh &mesh);
 
   std::vector<SdfFrameOctreeNode> create_sdf_frame_octree(SparseOctreeSettings settings, DistanceFunction sdf);
   std::vector<SdfFrameOctreeNode> create_sdf_frame_octree(SparseOctreeSettings settings, MultithreadedDistanceFunction sdf, unsigned max_threads);
+  std::vector<SdfFrameOctreeNode> create_sdf_frame_octree(SparseOctreeSettings settings, BatchDistanceFunction sdf, unsigned max_threads);
   std::vector<SdfFrameOctreeNode> create_sdf_frame_octree(SparseOctreeSettings settings, const cmesh4::SimpleMesh &mesh);
   std::vector<SdfFrameOctreeNode> create_sdf_frame_octree(SparseOctreeSettings settings, MultithreadedDistanceFunction sdf, float eps, bool is_smooth, bool fix_artefacts);
 
@@ -68,8 +80,19 @@ namespace sdf_converter
 
   SdfSBS create_sdf_SBS(SparseOctreeSettings settings, SdfSBSHeader header, DistanceFunction sdf);
   SdfSBS create_sdf_SBS(SparseOctreeSettings settings, SdfSBSHeader header, MultithreadedDistanceFunction sdf, unsigned max_threads);
+  SdfSBS create_sdf_SBS(SparseOctreeSettings settings, SdfSBSHeader header, BatchDistanceFunction sdf, unsigned max_threads);
+  //bakes neural SDF, every brick is evaluated as one batch of the network
+  SdfSBS create_sdf_SBS(SparseOctreeSettings settings, SdfSBSHeader header, const NeuralSdfEvaluator &evaluator, unsigned max_threads);
   SdfSBS create_sdf_SBS(SparseOctreeSettings settings, SdfSBSHeader header, const cmesh4::SimpleMesh &mesh);
 
+  //streaming version of create_sdf_SBS for very deep octrees, SBS is written to path chunk by chunk (in save_sdf_SBS format)
+  //and is never stored in memory as a whole. Works only with SparseOctreeBuildType::DEFAULT, nodes_limit is ignored
+  bool create_sdf_SBS_to_file(SparseOctreeSettings settings, SdfSBSHeader header, MultithreadedDistanceFunction sdf, unsigned max_threads,
+                              const std::string &path);
+  bool create_sdf_SBS_to_file(SparseOctreeSettings settings, SdfSBSHeader header, BatchDistanceFunction sdf, unsigned max_threads,
+                              const std::string &path);
+  bool create_sdf_SBS_to_file(SparseOctreeSettings settings, SdfSBSHeader header, const cmesh4::SimpleMesh &mesh, const std::string &path);
+
   std::vector<SdfFrameOctreeTexNode> create_sdf_frame_octree_tex(SparseOctreeSettings settings, const cmesh4::SimpleMesh &mesh);
   
   SdfSBS create_sdf_SBS_tex(SparseOctreeSettings settings, SdfSBSHeader header, const cmesh4::SimpleMesh &mesh, bool noisy = false);
@@ -88,7 +111,9 @@ namespace sdf_converter
                                                const std::vector<MultiRendererMaterial> &materials_lib, 
                                                const std::vector<std::shared_ptr<ICombinedImageSampler>> &textures_lib);
 
-  SdfSBSAdapt greed_sbs_adapt(MultithreadedDistanceFunction sdf, uint8_t depth);
+  //top-level blocks are built in parallel, sdf is called with thread index < max_threads
+  SdfSBSAdapt greed_sbs_adapt(MultithreadedDistanceFunction sdf, uint8_t depth, unsigned max_threads);
+  SdfSBSAdapt greed_sbs_adapt(BatchDistanceFunction sdf, uint8_t depth, unsigned max_threads);
 
   std::vector<uint32_t> create_COctree_v3(SparseOctreeSettings settings, COctreeV3Header header, const cmesh4::SimpleMesh &mesh);
 
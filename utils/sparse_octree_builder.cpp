@@ -59,8 +59,6 @@ namespace sdf_converter
     float3 p;
     float d;
     unsigned level;
-    unsigned group_idx;
-    unsigned thread_id;
     unsigned children_idx;
     float value;
   };
@@ -69,19 +67,36 @@ namespace sdf_converter
   void frame_octree_eliminate_invalid_rec(const std::vector<SdfFrameOctreeNode> &frame_old, unsigned oldNodeId, 
                                           std::vector<SdfFrameOctreeNode> &frame_new, unsigned newNodeId);
 
-  void add_node_rec(std::vector<SdfFrameOctreeNode> &nodes, SparseOctreeSettings settings, MultithreadedDistanceFunction sdf,
-                    unsigned thread_id, unsigned node_idx, unsigned depth, unsigned max_depth, float3 p, float d)
+  //evaluates distances in corners of the node, returns true if it should be subdivided
+  static bool eval_frame_node(const BatchDistanceFunction &sdf, unsigned thread_id, SdfFrameOctreeNode &node,
+                              unsigned depth, unsigned max_depth, float3 p, float d, float *out_value_center = nullptr)
   {
-    float value_center = sdf(2.0f * ((p + float3(0.5, 0.5, 0.5)) * d) - float3(1, 1, 1), thread_id);
+    //8 corners and the center
+    float3 positions[9];
+    float values[9];
+    for (int cid = 0; cid < 8; cid++)
+      positions[cid] = 2.0f * ((p + float3((cid & 4) >> 2, (cid & 2) >> 1, cid & 1)) * d) - float3(1, 1, 1);
+    positions[8] = 2.0f * ((p + float3(0.5, 0.5, 0.5)) * d) - float3(1, 1, 1);
+    sdf(positions, values, 9, thread_id);
+
+    float value_center = values[8];
     float min_val = 1000;
     float max_val = -1000;
     for (int cid = 0; cid < 8; cid++)
     {
-      nodes[node_idx].values[cid] = sdf(2.0f * ((p + float3((cid & 4) >> 2, (cid & 2) >> 1, cid & 1)) * d) - float3(1, 1, 1), thread_id);
-      min_val = std::min(min_val, nodes[node_idx].values[cid]);
-      max_val = std::max(max_val, nodes[node_idx].values[cid]);
+      node.values[cid] = values[cid];
+      min_val = std::min(min_val, node.values[cid]);
+      max_val = std::max(max_val, node.values[cid]);
     }
-    if (depth < max_depth && (std::abs(value_center) < sqrtf(3) * d || min_val*max_val <= 0))
+    if (out_value_center)
+      *out_value_center = value_center;
+    return depth < max_depth && (std::abs(value_center) < sqrtf(3) * d || min_val*max_val <= 0);
+  }
+
+  void add_node_rec(std::vector<SdfFrameOctreeNode> &nodes, SparseOctreeSettings settings, const BatchDistanceFunction &sdf,
+                    unsigned thread_id, unsigned node_idx, unsigned depth, unsigned max_depth, float3 p, float d)
+  {
+    if (eval_frame_node(sdf, thread_id, nodes[node_idx], depth, max_depth, p, d))
     {
       nodes[node_idx].offset = nodes.size();
       
@@ -95,6 +110,50 @@ namespace sdf_converter
     }
   }
 
+  //builds subtree of the node into its own vector, node itself is nodes[0]. Subtrees of children are built as separate
+  //tasks down to task_max_depth and appended in order of children, so the result is the same as with add_node_rec
+  static void add_node_task(std::vector<SdfFrameOctreeNode> &nodes, SparseOctreeSettings settings, const BatchDistanceFunction &sdf,
+                            unsigned depth, unsigned max_depth, unsigned task_max_depth, float3 p, float d)
+  {
+    if (depth >= task_max_depth)
+    {
+      add_node_rec(nodes, settings, sdf, omp_get_thread_num(), 0, depth, max_depth, p, d);
+      return;
+    }
+
+    if (!eval_frame_node(sdf, omp_get_thread_num(), nodes[0], depth, max_depth, p, d))
+      return;
+
+    std::vector<SdfFrameOctreeNode> children[8];
+    for (unsigned cid = 0; cid < 8; cid++)
+    {
+      #pragma omp task shared(children, settings, sdf)
+      {
+        children[cid].emplace_back();
+        add_node_task(children[cid], settings, sdf, depth + 1, max_depth, task_max_depth,
+                      2 * p + float3((cid & 4) >> 2, (cid & 2) >> 1, cid & 1), d / 2);
+      }
+    }
+    #pragma omp taskwait
+
+    nodes[0].offset = 1;
+    nodes.resize(9);
+    for (unsigned cid = 0; cid < 8; cid++)
+    {
+      int shift = int(nodes.size()) - 1;
+      nodes[1 + cid] = children[cid][0];
+      if (nodes[1 + cid].offset != 0)
+        nodes[1 + cid].offset += shift;
+      for (size_t j = 1; j < children[cid].size(); j++)
+      {
+        nodes.push_back(children[cid][j]);
+        if (nodes.back().offset != 0)
+          nodes.back().offset += shift;
+      }
+      std::vector<SdfFrameOctreeNode>().swap(children[cid]);
+    }
+  }
+
   void check_and_fix_sdf_sign(std::vector<SdfFrameOctreeNode> &nodes, float d_thr, unsigned idx, float d)
   {
     unsigned ofs = nodes[idx].offset;
@@ -125,6 +184,12 @@ namespace sdf_converter
   std::vector<SdfFrameOctreeNode> construct_sdf_frame_octree(SparseOctreeSettings settings, MultithreadedDistanceFunction sdf, 
                                                              unsigned max_threads)
   {
+    return construct_sdf_frame_octree(settings, to_batch_distance_function(sdf), max_threads);
+  }
+
+  std::vector<SdfFrameOctreeNode> construct_sdf_frame_octree(SparseOctreeSettings settings, BatchDistanceFunction sdf, 
+                                                             unsigned max_threads)
+  {
 std::chrono::steady_clock::time_point t1 = std::chrono::steady_clock::now();
 
     omp_set_num_threads(max_threads);
@@ -132,7 +197,7 @@ std::chrono::steady_clock::time_point t1 = std::chrono::steady_clock::now();
     unsigned min_remove_level = std::min(settings.depth, 4u);
     std::vector<LargeNode> large_nodes;
     int lg_size = pow(2, min_remove_level);
-    large_nodes.push_back({float3(0,0,0), 1.0f, 0u, 0u, 0u, 0u, 1000.0f});
+    large_nodes.push_back({float3(0,0,0), 1.0f, 0u, 0u, 1000.0f});
 
     unsigned i = 0;
     while (i < large_nodes.size())
@@ -144,82 +209,95 @@ std::chrono::steady_clock::time_point t1 = std::chrono::steady_clock::now();
         {
           float ch_d = large_nodes[i].d / 2;
           float3 ch_p = 2 * large_nodes[i].p + float3((j & 4) >> 2, (j & 2) >> 1, j & 1);
-          large_nodes.push_back({ch_p, ch_d, large_nodes[i].level+1, 0u, 0u, 0u, 1000.0f});
+          large_nodes.push_back({ch_p, ch_d, large_nodes[i].level+1, 0u, 1000.0f});
         }
       }
       i++;
     }
 
-    std::vector<unsigned> border_large_nodes;
+    //values in centers and corners of all large nodes, in chunks evaluated by different threads
+    constexpr int LARGE_NODES_CHUNK = 64;
+    const int large_chunks = (large_nodes.size() + LARGE_NODES_CHUNK - 1) / LARGE_NODES_CHUNK;
+    std::vector<float3> positions(9*large_nodes.size());
+    std::vector<float> values(9*large_nodes.size());
+    std::vector<SdfFrameOctreeNode> res_nodes(large_nodes.size());
 
-    for (int i=0;i<large_nodes.size();i++)
+    #pragma omp parallel for schedule(dynamic)
+    for (int c=0;c<large_chunks;c++)
     {
-      float3 pos = 2.0f * ((large_nodes[i].p + float3(0.5, 0.5, 0.5)) * large_nodes[i].d) - float3(1, 1, 1); 
-      large_nodes[i].value = sdf(pos, 0);
-      if (large_nodes[i].children_idx == 0 && is_border(large_nodes[i].value, large_nodes[i].level))
-        border_large_nodes.push_back(i);
+      unsigned first = c*LARGE_NODES_CHUNK;
+      unsigned count = std::min<unsigned>(LARGE_NODES_CHUNK, large_nodes.size() - first);
+      for (unsigned i=first;i<first+count;i++)
+      {
+        for (int cid = 0; cid < 8; cid++)
+          positions[9*i + cid] = 2.0f * ((large_nodes[i].p + float3((cid & 4) >> 2, (cid & 2) >> 1, cid & 1)) * large_nodes[i].d) - float3(1, 1, 1);
+        positions[9*i + 8] = 2.0f * ((large_nodes[i].p + float3(0.5, 0.5, 0.5)) * large_nodes[i].d) - float3(1, 1, 1); 
+      }
+      sdf(positions.data() + 9*first, values.data() + 9*first, 9*count, omp_get_thread_num());
+      for (unsigned i=first;i<first+count;i++)
+      {
+        for (int cid = 0; cid < 8; cid++)
+          res_nodes[i].values[cid] = values[9*i + cid];
+        res_nodes[i].offset = large_nodes[i].children_idx;
+        large_nodes[i].value = values[9*i + 8];
+      }
     }
 
-    unsigned step = (border_large_nodes.size() + max_threads - 1) / max_threads;
-    std::vector<std::vector<SdfFrameOctreeNode>> all_nodes(max_threads);
-    std::vector<std::vector<uint2>> all_groups(max_threads);
-
-    for (int i=0;i<max_threads;i++)
+    std::vector<unsigned> border_large_nodes;
+    for (int i=0;i<large_nodes.size();i++)
     {
-      all_nodes[i].reserve(std::min(1ul << 20, 1ul << 3*settings.depth));
+      if (large_nodes[i].children_idx == 0 && is_border(large_nodes[i].value, large_nodes[i].level))
+        border_large_nodes.push_back(i);
     }
 
 std::chrono::steady_clock::time_point t2 = std::chrono::steady_clock::now();
 
-    #pragma omp parallel for
-    for (int thread_id=0;thread_id<max_threads;thread_id++)
+    //every border large node is a separate task, and so are subtrees of its descendants down to a few levels below,
+    //because the surface is distributed unevenly and the cost of subtrees differs by orders of magnitude
+    std::vector<std::vector<SdfFrameOctreeNode>> subtrees(border_large_nodes.size());
+    const unsigned task_max_depth = min_remove_level + 3;
+
+    #pragma omp parallel
+    #pragma omp single
     {
-      unsigned start = thread_id * step;
-      unsigned end = std::min(start + step, (unsigned)border_large_nodes.size());
-      for (unsigned i=start;i<end;i++)
+      for (int i=0;i<border_large_nodes.size();i++)
       {
-        unsigned idx = border_large_nodes[i];
-        unsigned local_root_idx = all_nodes[thread_id].size();
-        large_nodes[idx].group_idx = all_groups[thread_id].size();
-        large_nodes[idx].thread_id = thread_id;
-        all_nodes[thread_id].emplace_back();
-        add_node_rec(all_nodes[thread_id], settings, sdf, thread_id, 
-                    local_root_idx, large_nodes[idx].level, settings.depth, large_nodes[idx].p, large_nodes[idx].d);
-      
-        all_groups[thread_id].push_back(uint2(local_root_idx, all_nodes[thread_id].size()));
+        #pragma omp task shared(subtrees, large_nodes, border_large_nodes, settings, sdf)
+        {
+          unsigned idx = border_large_nodes[i];
+          subtrees[i].emplace_back();
+          add_node_task(subtrees[i], settings, sdf, large_nodes[idx].level, settings.depth, task_max_depth, 
+                        large_nodes[idx].p, large_nodes[idx].d);
+        }
       }
     }
 
 std::chrono::steady_clock::time_point t3 = std::chrono::steady_clock::now();
 
-    std::vector<SdfFrameOctreeNode> res_nodes(large_nodes.size());
+    //subtrees are appended in the order of large nodes, their positions are given by prefix sum of sizes,
+    //root of every subtree is replaced by the large node itself
+    std::vector<size_t> subtree_offsets(border_large_nodes.size() + 1);
+    subtree_offsets[0] = large_nodes.size();
+    for (int i=0;i<border_large_nodes.size();i++)
+      subtree_offsets[i+1] = subtree_offsets[i] + subtrees[i].size() - 1;
+    res_nodes.resize(subtree_offsets.back());
 
-    for (int i=0;i<large_nodes.size();i++)
+    #pragma omp parallel for schedule(dynamic)
+    for (int i=0;i<border_large_nodes.size();i++)
     {
-      for (int cid = 0; cid < 8; cid++)
-        res_nodes[i].values[cid] = sdf(2.0f * ((large_nodes[i].p + float3((cid & 4) >> 2, (cid & 2) >> 1, cid & 1)) * large_nodes[i].d) - float3(1, 1, 1), 0);
-    
-      res_nodes[i].offset = large_nodes[i].children_idx;
-      if (large_nodes[i].children_idx == 0 && is_border(large_nodes[i].value, large_nodes[i].level))
+      if (subtrees[i].size() <= 1) //this region is empty
+        continue;
+
+      int shift = int(subtree_offsets[i]) - 1;
+      res_nodes[border_large_nodes[i]].offset = subtrees[i][0].offset + shift;
+      for (int j=1;j<subtrees[i].size();j++)
       {
-        unsigned start = all_groups[large_nodes[i].thread_id][large_nodes[i].group_idx].x + 1;
-        unsigned end = all_groups[large_nodes[i].thread_id][large_nodes[i].group_idx].y;
-        
-        if (start == end) //this region is empty
-          continue;
-        
-        unsigned prev_size = res_nodes.size();
-        int shift = int(prev_size) - int(start);
-        res_nodes[i].offset = all_nodes[large_nodes[i].thread_id][start-1].offset + shift;
-        //printf("%d offset %u start %u shift %d\n", i, res_nodes[i].offset, start, shift);
-        res_nodes.insert(res_nodes.end(), all_nodes[large_nodes[i].thread_id].begin() + start, all_nodes[large_nodes[i].thread_id].begin() + end);
-        
-        for (int j=prev_size;j<res_nodes.size();j++)
-        {
-          if (res_nodes[j].offset != 0)
-            res_nodes[j].offset += shift;
-        }
+        SdfFrameOctreeNode &node = res_nodes[subtree_offsets[i] + j - 1];
+        node = subtrees[i][j];
+        if (node.offset != 0)
+          node.offset += shift;
       }
+      std::vector<SdfFrameOctreeNode>().swap(subtrees[i]);
     }
 
 std::chrono::steady_clock::time_point t4 = std::chrono::steady_clock::now();
@@ -288,10 +366,160 @@ std::chrono::steady_clock::time_point t5 = std::chrono::steady_clock::now();
     }
   }
 
+  //distances of one brick and buffers for the points evaluated in batch, one per thread
+  struct SBSBrickBuffers
+  {
+    SBSBrickBuffers(const SdfSBSHeader &header)
+    {
+      uint32_t v_size = header.brick_size + 2*header.brick_pad + 1;
+      values.resize(v_size*v_size*v_size, 1000.0f);
+      new_positions.resize(v_size*v_size*v_size);
+      new_ids.resize(v_size*v_size*v_size);
+      new_values.resize(v_size*v_size*v_size);
+    }
+    std::vector<float> values;
+    std::vector<float3> new_positions;
+    std::vector<unsigned> new_ids;
+    std::vector<float> new_values;
+  };
+
+  static unsigned SBS_brick_values_count(const SdfSBSHeader &header)
+  {
+    uint32_t v_size = header.brick_size + 2*header.brick_pad + 1;
+    unsigned vals_per_int = 4/header.bytes_per_value;
+    return (v_size*v_size*v_size + vals_per_int - 1)/vals_per_int;
+  }
+
+  static SdfSBSNode SBS_brick_node(uint3 p, float d, unsigned data_offset)
+  {
+    unsigned lod_size = 1.0f/d;
+    SdfSBSNode node;
+    node.data_offset = data_offset;
+    node.pos_xy = (p.x << 16) | p.y;
+    node.pos_z_lod_size = (p.z << 16) | lod_size;
+    node._pad = 0;
+    return node;
+  }
+
+  //evaluates all distances in the brick of frame octree leaf (corners are taken from it), 
+  //returns true if the brick contains surface
+  static bool eval_SBS_brick(const BatchDistanceFunction &sdf, unsigned thread_id, const SdfSBSHeader &header,
+                             const SdfFrameOctreeNode &node, uint3 p, float d, SBSBrickBuffers &buffers)
+  {
+    uint32_t v_size = header.brick_size + 2*header.brick_pad + 1;
+    std::vector<float> &values = buffers.values;
+    float min_val = 1000;
+    float max_val = -1000;
+    for (int i=0;i<8;i++)
+    {
+      min_val = std::min(min_val, node.values[i]);
+      max_val = std::max(max_val, node.values[i]);
+    }
+    float3 p0 = 2.0f*(d*float3(p)) - 1.0f;
+    float dp = 2.0f*d/header.brick_size;
+    unsigned new_count = 0;
+
+    for (int i=-(int)header.brick_pad; i<=(int)(header.brick_size + header.brick_pad); i++)
+    {
+      for (int j=-(int)header.brick_pad; j<=(int)(header.brick_size + header.brick_pad); j++)
+      {
+        for (int k=-(int)header.brick_pad; k<=(int)(header.brick_size + header.brick_pad); k++)
+        {
+          float val = 2e6f;
+          // corners, reuse values
+          if (i == 0)
+          {
+            if (j == 0)
+            {
+              if (k == 0)
+                val = node.values[0];
+              else if (k == header.brick_size)
+                val = node.values[1];
+            }
+            else if (j == header.brick_size)
+            {
+              if (k == 0)
+                val = node.values[2];
+              else if (k == header.brick_size)
+                val = node.values[3];
+            }
+          }
+          else if (i == header.brick_size)
+          {
+            if (j == 0)
+            {
+              if (k == 0)
+                val = node.values[4];
+              else if (k == header.brick_size)
+                val = node.values[5];
+            }
+            else if (j == header.brick_size)
+            {
+              if (k == 0)
+                val = node.values[6];
+              else if (k == header.brick_size)
+                val = node.values[7];
+            }
+          }
+
+          //new points, evaluated later in one batch
+          if (val > 1e6f)
+          {
+            buffers.new_positions[new_count] = p0 + dp*float3(i,j,k);
+            buffers.new_ids[new_count] = SBS_v_to_i(i,j,k,v_size,header.brick_pad);
+            new_count++;
+            continue;
+          }
+
+          values[SBS_v_to_i(i,j,k,v_size,header.brick_pad)] = val;
+          min_val = std::min(min_val, val);
+          max_val = std::max(max_val, val);
+        }
+      }      
+    }
+
+    sdf(buffers.new_positions.data(), buffers.new_values.data(), new_count, thread_id);
+    for (unsigned i = 0; i < new_count; i++)
+    {
+      values[buffers.new_ids[i]] = buffers.new_values[i];
+      min_val = std::min(min_val, buffers.new_values[i]);
+      max_val = std::max(max_val, buffers.new_values[i]);
+    }
+
+    return is_border_node(min_val, max_val, 1/d);
+  }
+
+  //out_values should have SBS_brick_values_count(header) zeroed elements
+  static void quantize_SBS_brick(const SdfSBSHeader &header, const std::vector<float> &values, float d, uint32_t *out_values)
+  {
+    unsigned lod_size = 1.0f/d;
+    float d_max = 2*sqrt(3)/lod_size;
+    unsigned bits = 8*header.bytes_per_value;
+    unsigned max_val = header.bytes_per_value == 4 ? 0xFFFFFFFF : ((1 << bits) - 1);
+    unsigned vals_per_int = 4/header.bytes_per_value;
+
+    for (int i=0;i<values.size();i++)
+    {
+      unsigned d_compressed = std::max(0.0f, max_val*((values[i]+d_max)/(2*d_max)));
+      d_compressed = std::min(d_compressed, max_val);
+      out_values[i/vals_per_int] |= d_compressed << (bits*(i%vals_per_int));
+    }
+  }
+
   SdfSBS frame_octree_to_SBS(MultithreadedDistanceFunction sdf, 
                              unsigned max_threads,
                              const std::vector<SdfFrameOctreeNode> &nodes,
-                             const SdfSBSHeader &header)
+                             const SdfSBSHeader &header,
+                             bool morton_order)
+  {
+    return frame_octree_to_SBS(to_batch_distance_function(sdf), max_threads, nodes, header, morton_order);
+  }
+
+  SdfSBS frame_octree_to_SBS(BatchDistanceFunction sdf, 
+                             unsigned max_threads,
+                             const std::vector<SdfFrameOctreeNode> &nodes,
+                             const SdfSBSHeader &header,
+                             bool morton_order)
   {
 std::chrono::steady_clock::time_point t1 = std::chrono::steady_clock::now();
 
@@ -312,7 +540,7 @@ std::chrono::steady_clock::time_point t2 = std::chrono::steady_clock::now();
     #pragma omp parallel for
     for (int thread_id=0;thread_id<max_threads;thread_id++)
     {
-      std::vector<float> values(v_size*v_size*v_size, 1000.0f);
+      SBSBrickBuffers buffers(header);
       unsigned start = thread_id * step;
       unsigned end = std::min(start + step, (unsigned)nodes.size());
       for (int idx = start; idx < end; idx++)
@@ -323,109 +551,20 @@ std::chrono::steady_clock::time_point t2 = std::chrono::steady_clock::now();
           uint3 p = uint3(layers[idx].x, layers[idx].y, layers[idx].z);
           float d = layers[idx].w;
 
-          float min_val = 1000;
-          float max_val = -1000;
-          for (int i=0;i<8;i++)
-          {
-            min_val = std::min(min_val, nodes[idx].values[i]);
-            max_val = std::max(max_val, nodes[idx].values[i]);
-          }
-          float3 p0 = 2.0f*(d*float3(p)) - 1.0f;
-          float dp = 2.0f*d/header.brick_size;
-
-          for (int i=-(int)header.brick_pad; i<=(int)(header.brick_size + header.brick_pad); i++)
-          {
-            for (int j=-(int)header.brick_pad; j<=(int)(header.brick_size + header.brick_pad); j++)
-            {
-              for (int k=-(int)header.brick_pad; k<=(int)(header.brick_size + header.brick_pad); k++)
-              {
-                float val = 2e6f;
-                // corners, reuse values
-                if (i == 0)
-                {
-                  if (j == 0)
-                  {
-                    if (k == 0)
-                      val = nodes[idx].values[0];
-                    else if (k == header.brick_size)
-                      val = nodes[idx].values[1];
-                  }
-                  else if (j == header.brick_size)
-                  {
-                    if (k == 0)
-                      val = nodes[idx].values[2];
-                    else if (k == header.brick_size)
-                      val = nodes[idx].values[3];
-                  }
-                }
-                else if (i == header.brick_size)
-                {
-                  if (j == 0)
-                  {
-                    if (k == 0)
-                      val = nodes[idx].values[4];
-                    else if (k == header.brick_size)
-                      val = nodes[idx].values[5];
-                  }
-                  else if (j == header.brick_size)
-                  {
-                    if (k == 0)
-                      val = nodes[idx].values[6];
-                    else if (k == header.brick_size)
-                      val = nodes[idx].values[7];
-                  }
-                }
-
-                //new points
-                if (val > 1e6f)
-                {
-                  float3 pos = p0 + dp*float3(i,j,k);
-                  val = sdf(pos, thread_id);
-                }
-
-                values[SBS_v_to_i(i,j,k,v_size,header.brick_pad)] = val;
-                min_val = std::min(min_val, val);
-                max_val = std::max(max_val, val);
-              }
-            }      
-          }
-
-          //fix for inconsistent distances
-          //if (max_val - min_val > 2 * sqrt(3) * d)
-          //{
-            //printf("inconsistent distance %f - %f with d=%f\n", max_val, min_val, d);
-          //  for (int i = 0; i < values.size(); i++)
-          //    values[i] = LiteMath::sign(max_val) * std::abs(values[i]);
-          //}
-
           //add not only if there is really a border
-          if (is_border_node(min_val, max_val, 1/d))
+          if (eval_SBS_brick(sdf, thread_id, header, nodes[idx], p, d, buffers))
           {
             unsigned off=0, n_off=0;
-            unsigned lod_size = 1.0f/d;
-            float d_max = 2*sqrt(3)/lod_size;
-            unsigned bits = 8*header.bytes_per_value;
-            unsigned max_val = header.bytes_per_value == 4 ? 0xFFFFFFFF : ((1 << bits) - 1);
-            unsigned vals_per_int = 4/header.bytes_per_value;
-
             #pragma omp critical
             {
               off = sbs.values.size();
               n_off = sbs.nodes.size();
               sbs.nodes.emplace_back();
-              sbs.values.resize(sbs.values.size() + (values.size()+vals_per_int-1)/vals_per_int);
+              sbs.values.resize(sbs.values.size() + SBS_brick_values_count(header));
             }
 
-            sbs.nodes[n_off].data_offset = off;
-            sbs.nodes[n_off].pos_xy = (p.x << 16) | p.y;
-            sbs.nodes[n_off].pos_z_lod_size = (p.z << 16) | lod_size;
-
-            for (int i=0;i<values.size();i++)
-            {
-              unsigned d_compressed = std::max(0.0f, max_val*((values[i]+d_max)/(2*d_max)));
-              d_compressed = std::min(d_compressed, max_val);
-              sbs.values[off + i/vals_per_int] |= d_compressed << (bits*(i%vals_per_int));
-            }
+            sbs.nodes[n_off] = SBS_brick_node(p, d, off);
+            quantize_SBS_brick(header, buffers.values, d, sbs.values.data() + off);
           }
         } //end if is leaf
       }
@@ -436,6 +575,9 @@ std::chrono::steady_clock::time_point t3 = std::chrono::steady_clock::now();
     float time_2 = 1e-3f*std::chrono::duration_cast<std::chrono::microseconds>(t3 - t2).count();
     //printf("frame octree to SBS: time = %6.2f ms (%.1f+%.1f)\n", time_1 + time_2, time_1, time_2);
 
+    //bricks are appended by different threads, so their order is random without this
+    if (morton_order)
+      reorder_sbs_morton(sbs);
     sbs.nodes.shrink_to_fit();
     sbs.values.shrink_to_fit();
     omp_set_num_threads(omp_get_max_threads());
@@ -443,6 +585,358 @@ std::chrono::steady_clock::time_point t3 = std::chrono::steady_clock::now();
     return sbs;
   }
 
+  //the same subdivision as add_node_rec, but leaves are converted to bricks immediately and the frame octree is not stored
+  static void add_SBS_bricks_rec(SdfSBS &sbs, SBSBrickBuffers &buffers, const BatchDistanceFunction &sdf, unsigned thread_id,
+                                 const SdfFrameOctreeNode &node, bool subdivide, unsigned depth, unsigned max_depth, float3 p, float d)
+  {
+    if (subdivide)
+    {
+      for (unsigned cid = 0; cid < 8; cid++)
+      {
+        SdfFrameOctreeNode child;
+        float3 ch_p = 2 * p + float3((cid & 4) >> 2, (cid & 2) >> 1, cid & 1);
+        bool ch_subdivide = eval_frame_node(sdf, thread_id, child, depth + 1, max_depth, ch_p, d / 2);
+        add_SBS_bricks_rec(sbs, buffers, sdf, thread_id, child, ch_subdivide, depth + 1, max_depth, ch_p, d / 2);
+      }
+    }
+    else if (eval_SBS_brick(sdf, thread_id, sbs.header, node, uint3(p), d, buffers))
+    {
+      unsigned off = sbs.values.size();
+      sbs.nodes.push_back(SBS_brick_node(uint3(p), d, off));
+      sbs.values.resize(off + SBS_brick_values_count(sbs.header), 0u);
+      quantize_SBS_brick(sbs.header, buffers.values, d, sbs.values.data() + off);
+    }
+  }
+
+  bool construct_sdf_SBS_to_file(SparseOctreeSettings settings, BatchDistanceFunction sdf, unsigned max_threads,
+                                 const SdfSBSHeader &header, const std::string &path)
+  {
+    //chunks are the large nodes from construct_sdf_frame_octree, so the result is the same as with frame_octree_to_SBS.
+    //Chunk index is a Morton code, so chunks written in order of index keep the whole SBS Morton-ordered (with settings.morton_order)
+    const unsigned chunk_level = std::min(settings.depth, 4u);
+    const unsigned chunks_count = 1u << (3*chunk_level);
+    const unsigned chunks_per_pass = 2*max_threads;
+    const float chunk_d = 1.0f/(1 << chunk_level);
+
+    std::string values_path = path + ".values.tmp";
+    std::ofstream fs(path, std::ios::binary);
+    std::ofstream values_fs(values_path, std::ios::binary);
+    if (!fs.is_open() || !values_fs.is_open())
+    {
+      printf("[construct_sdf_SBS_to_file] cannot open %s for writing\n", path.c_str());
+      return false;
+    }
+
+    //nodes are written to the final file right away, size is patched in the end, 
+    //values go to a temporary file and are appended after all nodes
+    unsigned nodes_count = 0;
+    size_t values_count = 0;
+    fs.write((const char *)&header, sizeof(SdfSBSHeader));
+    fs.write((const char *)&nodes_count, sizeof(unsigned));
+
+    omp_set_num_threads(max_threads);
+
+    std::vector<SdfSBS> chunks(chunks_per_pass);
+    bool overflow = false;
+    for (unsigned first = 0; first < chunks_count && !overflow; first += chunks_per_pass)
+    {
+      unsigned count = std::min(chunks_per_pass, chunks_count - first);
+
+      #pragma omp parallel for schedule(dynamic, 1)
+      for (int i = 0; i < int(count); i++)
+      {
+        unsigned chunk_id = first + i;
+        uint3 p(0,0,0);
+        for (unsigned b = 0; b < chunk_level; b++)
+        {
+          p.x |= ((chunk_id >> (3*b + 0)) & 1u) << b;
+          p.y |= ((chunk_id >> (3*b + 1)) & 1u) << b;
+          p.z |= ((chunk_id >> (3*b + 2)) & 1u) << b;
+        }
+
+        SdfSBS &chunk = chunks[i];
+        chunk.header = header;
+        chunk.nodes.clear();
+        chunk.values.clear();
+
+        //large nodes far from surface are not subdivided, but can still produce bricks
+        SdfFrameOctreeNode node;
+        float value_center = 0.0f;
+        bool subdivide = eval_frame_node(sdf, omp_get_thread_num(), node, chunk_level, settings.depth, float3(p), chunk_d, &value_center);
+        subdivide = subdivide && is_border(value_center, chunk_level);
+
+        SBSBrickBuffers buffers(header);
+        add_SBS_bricks_rec(chunk, buffers, sdf, omp_get_thread_num(), node, subdivide, chunk_level, settings.depth, float3(p), chunk_d);
+        if (settings.morton_order)
+          reorder_sbs_morton(chunk);
+      }
+
+      for (unsigned i = 0; i < count; i++)
+      {
+        SdfSBS &chunk = chunks[i];
+        if (values_count + chunk.values.size() >= size_t(uint32_t(-1)) || size_t(nodes_count) + chunk.nodes.size() >= size_t(uint32_t(-1)))
+        {
+          printf("[construct_sdf_SBS_to_file] SBS is too large, data offsets do not fit in 32 bits\n");
+          overflow = true;
+          break;
+        }
+        for (SdfSBSNode &n : chunk.nodes)
+          n.data_offset += values_count;
+        fs.write((const char *)chunk.nodes.data(), chunk.nodes.size() * sizeof(SdfSBSNode));
+        values_fs.write((const char *)chunk.values.data(), chunk.values.size() * sizeof(uint32_t));
+        nodes_count += chunk.nodes.size();
+        values_count += chunk.values.size();
+
+        std::vector<SdfSBSNode>().swap(chunk.nodes);
+        std::vector<uint32_t>().swap(chunk.values);
+      }
+    }
+
+    omp_set_num_threads(omp_get_max_threads());
+    values_fs.close();
+
+    if (!overflow)
+    {
+      unsigned values_count_u = values_count;
+      fs.write((const char *)&values_count_u, sizeof(unsigned));
+
+      std::ifstream values_in(values_path, std::ios::binary);
+      std::vector<char> buf(1 << 24);
+      while (values_in.read(buf.data(), buf.size()) || values_in.gcount() > 0)
+        fs.write(buf.data(), values_in.gcount());
+      values_in.close();
+
+      fs.seekp(sizeof(SdfSBSHeader));
+      fs.write((const char *)&nodes_count, sizeof(unsigned));
+    }
+    fs.flush();
+    bool ok = !overflow && fs.good();
+    fs.close();
+    std::remove(values_path.c_str());
+
+    if (!ok)
+    {
+      printf("[construct_sdf_SBS_to_file] failed to write %s\n", path.c_str());
+      std::remove(path.c_str());
+    }
+    return ok;
+  }
+
+  struct TLOLeafInfo
+  {
+    unsigned idx;
+    uint3 p;
+    unsigned level;
+  };
+
+  static void collect_tlo_leaves_rec(const cmesh4::TriangleListOctree &tl_octree, std::vector<TLOLeafInfo> &leaves,
+                                     unsigned idx, uint3 p, unsigned level)
+  {
+    unsigned ofs = tl_octree.nodes[idx].offset;
+    if (is_leaf(ofs))
+    {
+      if (tl_octree.nodes[idx].tid_count > 0)
+        leaves.push_back({idx, p, level});
+    }
+    else
+    {
+      for (int i = 0; i < 8; i++)
+        collect_tlo_leaves_rec(tl_octree, leaves, ofs + i, 2 * p + uint3((i & 4) >> 2, (i & 2) >> 1, i & 1), level + 1);
+    }
+  }
+
+  //fast sweeping method for |grad(u)| = 1 on the n^3 grid of one brick. Fixed voxels keep their values, 
+  //others start from upper bounds (or 1000) and take the sign of the neighbour they were updated from
+  static void brick_fast_sweeping(float *dist, float *sign, const uint8_t *fixed, int n, float h)
+  {
+    auto at = [n](int i, int j, int k) { return (i*n + j)*n + k; };
+    auto axis_min = [&](int i, int j, int k, int axis, float &s) -> float
+    {
+      float m = 1000.0f;
+      for (int dir = -1; dir <= 1; dir += 2)
+      {
+        int ni = i + (axis == 0 ? dir : 0), nj = j + (axis == 1 ? dir : 0), nk = k + (axis == 2 ? dir : 0);
+        if (ni < 0 || nj < 0 || nk < 0 || ni >= n || nj >= n || nk >= n)
+          continue;
+        if (dist[at(ni, nj, nk)] < m)
+        {
+          m = dist[at(ni, nj, nk)];
+          s = sign[at(ni, nj, nk)];
+        }
+      }
+      return m;
+    };
+
+    for (int pass = 0; pass < 2; pass++)
+    {
+      for (int order = 0; order < 8; order++)
+      {
+        for (int ii = 0; ii < n; ii++)
+        for (int jj = 0; jj < n; jj++)
+        for (int kk = 0; kk < n; kk++)
+        {
+          int i = (order & 4) ? n - 1 - ii : ii;
+          int j = (order & 2) ? n - 1 - jj : jj;
+          int k = (order & 1) ? n - 1 - kk : kk;
+          int id = at(i, j, k);
+          if (fixed[id])
+            continue;
+
+          float s[3] = {1, 1, 1};
+          float v[3] = {axis_min(i, j, k, 0, s[0]), axis_min(i, j, k, 1, s[1]), axis_min(i, j, k, 2, s[2])};
+          int m = v[0] <= v[1] && v[0] <= v[2] ? 0 : (v[1] <= v[2] ? 1 : 2);
+          if (v[m] >= 1000.0f)
+            continue;
+          std::sort(v, v + 3);
+
+          //Godunov upwind solution, using as many axes as needed
+          float u = v[0] + h;
+          if (u > v[1])
+            u = 0.5f*(v[0] + v[1] + std::sqrt(std::max(0.0f, 2*h*h - (v[0] - v[1])*(v[0] - v[1]))));
+          if (u > v[2])
+          {
+            float sum = v[0] + v[1] + v[2];
+            float sum_sq = v[0]*v[0] + v[1]*v[1] + v[2]*v[2];
+            u = (sum + std::sqrt(std::max(0.0f, sum*sum - 3*(sum_sq - h*h))))/3.0f;
+          }
+
+          if (u < dist[id])
+          {
+            dist[id] = u;
+            sign[id] = s[m];
+          }
+        }
+      }
+    }
+  }
+
+  SdfSBS mesh_octree_to_SBS_narrow_band(const cmesh4::SimpleMesh &mesh,
+                                        const cmesh4::TriangleListOctree &tl_octree,
+                                        const SdfSBSHeader &header, float search_range_mult,
+                                        bool morton_order)
+  {
+    std::vector<TLOLeafInfo> leaves;
+    collect_tlo_leaves_rec(tl_octree, leaves, 0, uint3(0,0,0), 0);
+
+    SdfSBS sbs;
+    const int pad = header.brick_pad;
+    const int v_size = header.brick_size + 2*header.brick_pad + 1;
+    const int v_count = v_size*v_size*v_size;
+    sbs.header = header;
+    sbs.nodes.reserve(leaves.size());
+    sbs.values.reserve(leaves.size() * ((v_count + 4/header.bytes_per_value - 1)/(4/header.bytes_per_value)));
+
+    #pragma omp parallel
+    {
+      std::vector<float> dist(v_count), sign(v_count);
+      std::vector<uint8_t> fixed(v_count);
+
+      #pragma omp for schedule(dynamic, 16)
+      for (int l = 0; l < leaves.size(); l++)
+      {
+        const cmesh4::TriangleListOctree::Node &node = tl_octree.nodes[leaves[l].idx];
+        const uint3 p = leaves[l].p;
+        const unsigned lod_size = 1u << leaves[l].level;
+        const float d = 1.0f/lod_size; //half-size of the brick in [-1,1]^3
+        const float3 p0 = 2.0f*(d*float3(p)) - 1.0f;
+        const float3 center = p0 + float3(d);
+        const float dp = 2.0f*d/header.brick_size;
+        const float band = 1.5f*dp;
+
+        std::fill(dist.begin(), dist.end(), 1000.0f);
+        std::fill(sign.begin(), sign.end(), 1.0f);
+
+        //rasterize triangles of the leaf into voxels in the narrow band around them
+        for (int t = 0; t < node.tid_count; t++)
+        {
+          unsigned t_i = tl_octree.triangle_ids[node.tid_offset + t];
+          float3 a = to_float3(mesh.vPos4f[mesh.indices[3*t_i+0]]);
+          float3 b = to_float3(mesh.vPos4f[mesh.indices[3*t_i+1]]);
+          float3 c = to_float3(mesh.vPos4f[mesh.indices[3*t_i+2]]);
+          float3 n = cross(b - a, c - a);
+
+          float3 lo_f = (min(a, min(b, c)) - band - p0)/dp + float(pad);
+          float3 hi_f = (max(a, max(b, c)) + band - p0)/dp + float(pad);
+          int3 lo = max(int3(0,0,0), int3(ceil(lo_f)));
+          int3 hi = min(int3(v_size-1, v_size-1, v_size-1), int3(floor(hi_f)));
+
+          for (int i = lo.x; i <= hi.x; i++)
+          for (int j = lo.y; j <= hi.y; j++)
+          for (int k = lo.z; k <= hi.z; k++)
+          {
+            float3 q = p0 + dp*float3(i - pad, j - pad, k - pad);
+            float3 vt = q - cmesh4::closest_point_triangle(q, a, b, c);
+            float r = length(vt);
+            int id = (i*v_size + j)*v_size + k;
+            if (r < dist[id])
+            {
+              dist[id] = r;
+              sign[id] = dot(vt, n) < 0 ? -1.0f : 1.0f;
+            }
+          }
+        }
+
+        //distance is exact if the ball with it fits into the box used to select triangles of the leaf
+        for (int i = 0; i < v_size; i++)
+        for (int j = 0; j < v_size; j++)
+        for (int k = 0; k < v_size; k++)
+        {
+          float3 q = p0 + dp*float3(i - pad, j - pad, k - pad);
+          float3 dq = abs(q - center);
+          float in_box = 2*search_range_mult*d - std::max(dq.x, std::max(dq.y, dq.z));
+          int id = (i*v_size + j)*v_size + k;
+          fixed[id] = dist[id] <= std::min(band, in_box);
+        }
+
+        brick_fast_sweeping(dist.data(), sign.data(), fixed.data(), v_size, dp);
+
+        float min_val = 1000;
+        float max_val = -1000;
+        for (int i = 0; i < v_count; i++)
+        {
+          dist[i] *= sign[i];
+          min_val = std::min(min_val, dist[i]);
+          max_val = std::max(max_val, dist[i]);
+        }
+        if (!is_border_node(min_val, max_val, lod_size))
+          continue;
+
+        float d_max = 2*sqrt(3)/lod_size;
+        unsigned bits = 8*header.bytes_per_value;
+        unsigned max_q = header.bytes_per_value == 4 ? 0xFFFFFFFF : ((1 << bits) - 1);
+        unsigned vals_per_int = 4/header.bytes_per_value;
+        unsigned off = 0, n_off = 0;
+
+        #pragma omp critical
+        {
+          off = sbs.values.size();
+          n_off = sbs.nodes.size();
+          sbs.nodes.emplace_back();
+          sbs.values.resize(sbs.values.size() + (v_count+vals_per_int-1)/vals_per_int);
+        }
+
+        sbs.nodes[n_off].data_offset = off;
+        sbs.nodes[n_off].pos_xy = (p.x << 16) | p.y;
+        sbs.nodes[n_off].pos_z_lod_size = (p.z << 16) | lod_size;
+
+        for (int i = 0; i < v_count; i++)
+        {
+          unsigned d_compressed = std::max(0.0f, max_q*((dist[i]+d_max)/(2*d_max)));
+          d_compressed = std::min(d_compressed, max_q);
+          sbs.values[off + i/vals_per_int] |= d_compressed << (bits*(i%vals_per_int));
+        }
+      }
+    }
+
+    //bricks are appended by different threads, so their order is random without this
+    if (morton_order)
+      reorder_sbs_morton(sbs);
+    sbs.nodes.shrink_to_fit();
+    sbs.values.shrink_to_fit();
+
+    return sbs;
+  }
+
   void mesh_octree_to_sdf_frame_octree_rec(const cmesh4::SimpleMesh &mesh,
                                          const cmesh4::TriangleListOctree &tl_octree,
                                          std::vector<SdfFrameOctreeNode> &frame,
@@ -2506,7 +3000,8 @@ std::chrono::steady_clock::time_point t3 = std::chrono::steady_clock::now();
   SdfSBS frame_octree_to_SBS_tex(MultithreadedDistanceFunction sdf, 
                                  unsigned max_threads,
                                  const std::vector<SdfFrameOctreeTexNode> &nodes,
-                                 const SdfSBSHeader &header)
+                                 const SdfSBSHeader &header,
+                                 bool morton_order)
   {
 std::chrono::steady_clock::time_point t1 = std::chrono::steady_clock::now();
 
@@ -2663,6 +3158,9 @@ std::chrono::steady_clock::time_point t3 = std::chrono::steady_clock::now();
     float time_2 = 1e-3f*std::chrono::duration_cast<std::chrono::microseconds>(t3 - t2).count();
     //printf("frame octree to SBS: time = %6.2f ms (%.1f+%.1f)\n", time_1 + time_2, time_1, time_2);
 
+    //bricks are appended by different threads, so their order is random without this
+    if (morton_order)
+      reorder_sbs_morton(sbs);
     sbs.nodes.shrink_to_fit();
     sbs.values.shrink_to_fit();
     omp_set_num_threads(omp_get_max_threads());
@@ -4232,5 +4730,391 @@ void frame_octree_to_compact_octree_v3_rec(const std::vector<SdfFrameOctreeTexNo
     printf("compact octree %.1f Kb leaf, %.1f Kb non-leaf\n", stat_leaf_bytes.load() / 1024.0f, stat_nonleaf_bytes.load() / 1024.0f);
 
     compact_octree.data = global_ctx.compact;
+
+    if (compact_octree.header.sim_compression)
+    {
+      COctreeV3 octree = compact_octree;
+      octree.header.sim_compression = 0;
+      compact_octree_v3_similarity_compression(octree, compact_octree, COCTREE_V3_SIM_MAX_ERROR, max_threads);
+    }
+  }
+
+  //########################## COctreeV3 similarity compression ##########################
+
+  //offsets inside leaf brick, the same as in brick_values_compress
+  struct COctreeV3BrickLayout
+  {
+    unsigned v_size, p_size;
+    unsigned bits, vals_per_int, max_val;
+    unsigned slice_distance_flags_uints;
+    unsigned off_1, off_3, off_5; //distance flags, min value and range, distances
+  };
+
+  static COctreeV3BrickLayout get_coctree_v3_brick_layout(const COctreeV3Header &header)
+  {
+    COctreeV3BrickLayout l;
+    l.v_size = header.brick_size + 2 * header.brick_pad + 1;
+    l.p_size = header.brick_size + 2 * header.brick_pad;
+    l.bits = header.bits_per_value;
+    l.vals_per_int = 32 / header.bits_per_value;
+    l.max_val = header.bits_per_value == 32 ? 0xFFFFFFFF : ((1 << l.bits) - 1);
+    l.slice_distance_flags_uints = (l.v_size*l.v_size + 32 - 1) / 32;
+    l.off_1 = (l.p_size*l.p_size*l.p_size + 32 - 1) / 32;
+    l.off_3 = l.off_1 + l.v_size*l.slice_distance_flags_uints + (l.v_size + 2 - 1) / 2;
+    l.off_5 = l.off_3 + 2 + 8*header.uv_size;
+    return l;
+  }
+
+  //decodes all stored distances of the brick to the dense v_size^3 grid, returns brick size in uints
+  static unsigned decode_coctree_v3_brick(const uint32_t *brick, const COctreeV3BrickLayout &l,
+                                          std::vector<float> &values, std::vector<uint8_t> &flags)
+  {
+    float min_val = -float(brick[l.off_3 + 0]) / float(0xFFFFFFFFu);
+    float range   =  (float(brick[l.off_3 + 1]) / float(0xFFFFFFFFu)) / l.max_val;
+
+    unsigned vId = 0;
+    for (unsigned s = 0; s < l.v_size; s++)
+    {
+      for (unsigned k = 0; k < l.v_size*l.v_size; k++)
+      {
+        unsigned i = s*l.v_size*l.v_size + k;
+        flags[i] = (brick[l.off_1 + l.slice_distance_flags_uints*s + k/32] >> (k%32)) & 1u;
+        if (flags[i])
+        {
+          values[i] = min_val + range * ((brick[l.off_5 + vId / l.vals_per_int] >> (l.bits * (vId % l.vals_per_int))) & l.max_val);
+          vId++;
+        }
+      }
+    }
+
+    return l.off_5 + (vId + l.vals_per_int - 1) / l.vals_per_int;
+  }
+
+  static constexpr unsigned COCTREE_V3_ROT_COUNT = 48;
+  static constexpr unsigned coctree_v3_rot_perms[6][3] = {{0,1,2}, {0,2,1}, {1,0,2}, {1,2,0}, {2,0,1}, {2,1,0}};
+
+  //maps point of the n*n*n grid of a brick to the point of the brick it references with transform r,
+  //codes are the same as in initialize_rot_transforms (BVH2Common_host.cpp)
+  static inline unsigned coctree_v3_transform(unsigned r, unsigned i, unsigned n)
+  {
+    unsigned v[3] = {i / (n*n), i / n % n, i % n};
+    unsigned u[3];
+    for (int j = 0; j < 3; j++)
+    {
+      u[j] = v[coctree_v3_rot_perms[r / 8][j]];
+      if ((r % 8) & (4 >> j))
+        u[j] = n - 1 - u[j];
+    }
+    return (u[0]*n + u[1])*n + u[2];
+  }
+
+  static inline uint64_t coctree_v3_hash_combine(uint64_t h, uint64_t v)
+  {
+    v *= 0x9E3779B97F4A7C15ull;
+    v ^= v >> 29;
+    return (h ^ v) * 0xBF58476D1CE4E5B9ull + 0x94D049BB133111EBull;
+  }
+
+  //mean of stored distances and quantized mean deviation from it in each octant of the brick,
+  //points on the middle planes are skipped, as they belong to several octants
+  static float coctree_v3_brick_descriptor(const COctreeV3BrickLayout &l, const std::vector<float> &values,
+                                           const std::vector<uint8_t> &flags, float cell, int desc[8])
+  {
+    unsigned v3 = l.v_size*l.v_size*l.v_size;
+    double sum = 0.0;
+    unsigned count = 0;
+    for (unsigned i = 0; i < v3; i++)
+    {
+      if (flags[i])
+      {
+        sum += values[i];
+        count++;
+      }
+    }
+    float mean = sum / std::max(1u, count);
+
+    double o_sum[8] = {0, 0, 0, 0, 0, 0, 0, 0};
+    unsigned o_count[8] = {0, 0, 0, 0, 0, 0, 0, 0};
+    for (unsigned i = 0; i < v3; i++)
+    {
+      int x = 2*(i / (l.v_size*l.v_size)) - (l.v_size - 1);
+      int y = 2*(i / l.v_size % l.v_size) - (l.v_size - 1);
+      int z = 2*(i % l.v_size) - (l.v_size - 1);
+      if (!flags[i] || x == 0 || y == 0 || z == 0)
+        continue;
+      unsigned o = ((x > 0) << 2) | ((y > 0) << 1) | (z > 0);
+      o_sum[o] += values[i] - mean;
+      o_count[o]++;
+    }
+    for (int o = 0; o < 8; o++)
+      desc[o] = o_count[o] > 0 ? int(std::floor(o_sum[o] / o_count[o] / cell)) : INT32_MIN;
+
+    return mean;
+  }
+
+  //hash of presence flags and descriptor of the brick as it would look after transform r,
+  //bricks that can reference each other have the same key for some transform
+  static uint64_t coctree_v3_brick_key(const uint32_t *brick, const COctreeV3BrickLayout &l, unsigned lod_size,
+                                       const int desc[8], unsigned r, std::vector<uint64_t> &mask_tmp)
+  {
+    std::fill(mask_tmp.begin(), mask_tmp.end(), 0ull);
+    for (unsigned i = 0; i < l.p_size*l.p_size*l.p_size; i++)
+    {
+      if ((brick[i / 32] >> (i % 32)) & 1u)
+      {
+        unsigned j = coctree_v3_transform(r, i, l.p_size);
+        mask_tmp[j / 64] |= 1ull << (j % 64);
+      }
+    }
+
+    int desc_r[8];
+    for (unsigned o = 0; o < 8; o++)
+      desc_r[coctree_v3_transform(r, o, 2)] = desc[o];
+
+    uint64_t h = coctree_v3_hash_combine(0, lod_size);
+    for (uint64_t w : mask_tmp)
+      h = coctree_v3_hash_combine(h, w);
+    for (int o = 0; o < 8; o++)
+      h = coctree_v3_hash_combine(h, uint32_t(desc_r[o]));
+    return h;
+  }
+
+  //returns transform code if brick a can be replaced with brick b under transform r within max_error, 0 otherwise
+  static uint32_t coctree_v3_match_bricks(const uint32_t *brick_a, const uint32_t *brick_b, const COctreeV3BrickLayout &l, unsigned r,
+                                          const std::vector<float> &values_a, const std::vector<uint8_t> &flags_a,
+                                          const std::vector<float> &values_b, const std::vector<uint8_t> &flags_b,
+                                          float max_error)
+  {
+    //presence flags should be the same, otherwise a different set of voxels will be rendered
+    for (unsigned i = 0; i < l.p_size*l.p_size*l.p_size; i++)
+    {
+      unsigned j = coctree_v3_transform(r, i, l.p_size);
+      if (((brick_a[i / 32] >> (i % 32)) & 1u) != ((brick_b[j / 32] >> (j % 32)) & 1u))
+        return 0;
+    }
+
+    float min_diff = 1e6f, max_diff = -1e6f;
+    for (unsigned i = 0; i < l.v_size*l.v_size*l.v_size; i++)
+    {
+      unsigned j = coctree_v3_transform(r, i, l.v_size);
+      if (flags_a[i] != flags_b[j])
+        return 0;
+      if (flags_a[i])
+      {
+        min_diff = std::min(min_diff, values_a[i] - values_b[j]);
+        max_diff = std::max(max_diff, values_a[i] - values_b[j]);
+      }
+    }
+
+    //only offsets from [0,1] can be stored, see COctreeV3_LoadDistanceValues
+    float add = std::max(0.0f, 0.5f*(min_diff + max_diff));
+    if (add > 1.0f)
+      return 0;
+    uint32_t code = 0x80000000u | (uint32_t(add * 0x7FFFFF + 0.5f) << 8) | r;
+    add = float(code & 0x7FFFFF00u) / float(0x7FFFFF00u);
+
+    return (max_diff - add <= max_error && add - min_diff <= max_error) ? code : 0u;
+  }
+
+  struct COctreeV3SimBrick
+  {
+    unsigned offset;    //offset of the brick in source octree
+    unsigned size;      //brick size in uints
+    unsigned lod_size;
+    float mean;         //mean of all stored distances
+    uint64_t group_key; //minimal key among all transforms, only bricks with equal group keys are compared
+  };
+
+  void compact_octree_v3_similarity_compression(const COctreeV3 &octree, COctreeV3 &out_octree, float max_error, unsigned max_threads)
+  {
+    if (octree.header.sim_compression != 0 || octree.header.uv_size != 0)
+    {
+      printf("similarity compression is supported only for non-textured COctreeV3 without it, octree is not changed\n");
+      out_octree = octree;
+      return;
+    }
+
+    const COctreeV3BrickLayout l = get_coctree_v3_brick_layout(octree.header);
+    const unsigned v3 = l.v_size*l.v_size*l.v_size;
+    const unsigned mask_words = (l.p_size*l.p_size*l.p_size + 63) / 64;
+
+    //collect all leaf bricks in breadth-first order
+    std::vector<COctreeV3SimBrick> bricks;
+    std::vector<uint2> queue = {uint2(0, 1)}; //node offset, lod_size
+    for (size_t q = 0; q < queue.size(); q++)
+    {
+      uint32_t info = octree.data[queue[q].x];
+      unsigned child_pos = 1;
+      for (int i = 0; i < 8; i++)
+      {
+        if ((info & (1u << i)) == 0)
+          continue;
+        uint32_t child_offset = octree.data[queue[q].x + child_pos];
+        child_pos++;
+        if (info & (1u << (i + 8)))
+          bricks.push_back({child_offset, 0u, 2 * queue[q].y, 0.0f, 0ull});
+        else
+          queue.push_back(uint2(child_offset, 2 * queue[q].y));
+      }
+    }
+
+    auto brick_max_error = [&](unsigned lod_size) { return max_error * 2.0f / (lod_size * octree.header.brick_size); };
+    auto descriptor_cell = [&](unsigned lod_size) { return std::max(4 * max_error, 1e-3f) * 2.0f / (lod_size * octree.header.brick_size); };
+
+    //find group keys, it is the most expensive part for bricks without similar ones
+    #pragma omp parallel num_threads(max_threads)
+    {
+      std::vector<float> values(v3);
+      std::vector<uint8_t> flags(v3);
+      std::vector<uint64_t> mask_tmp(mask_words);
+      int desc[8];
+
+      #pragma omp for schedule(dynamic, 64)
+      for (int b = 0; b < (int)bricks.size(); b++)
+      {
+        const uint32_t *brick = octree.data.data() + bricks[b].offset;
+        bricks[b].size = decode_coctree_v3_brick(brick, l, values, flags);
+        bricks[b].mean = coctree_v3_brick_descriptor(l, values, flags, descriptor_cell(bricks[b].lod_size), desc);
+        bricks[b].group_key = ~0ull;
+        for (unsigned r = 0; r < COCTREE_V3_ROT_COUNT; r++)
+          bricks[b].group_key = std::min(bricks[b].group_key, coctree_v3_brick_key(brick, l, bricks[b].lod_size, desc, r, mask_tmp));
+      }
+    }
+
+    //inside each group bricks are sorted by mean distance, so that offset to the earlier brick is usually non-negative
+    std::vector<unsigned> order(bricks.size());
+    for (unsigned i = 0; i < order.size(); i++)
+      order[i] = i;
+    std::sort(order.begin(), order.end(), [&](unsigned a, unsigned b) {
+      if (bricks[a].group_key != bricks[b].group_key) return bricks[a].group_key < bricks[b].group_key;
+      if (bricks[a].mean != bricks[b].mean) return bricks[a].mean < bricks[b].mean;
+      return a < b;
+    });
+    std::vector<unsigned> group_starts;
+    for (unsigned i = 0; i < order.size(); i++)
+    {
+      if (i == 0 || bricks[order[i]].group_key != bricks[order[i - 1]].group_key)
+        group_starts.push_back(i);
+    }
+    group_starts.push_back(order.size());
+
+    //greedy matching inside each group, every brick either references one of the previous unique bricks or becomes unique
+    std::vector<unsigned> ref_brick(bricks.size());
+    std::vector<uint32_t> ref_code(bricks.size(), 0x80000000u);
+    for (unsigned i = 0; i < bricks.size(); i++)
+      ref_brick[i] = i;
+
+    #pragma omp parallel num_threads(max_threads)
+    {
+      std::vector<float> values_a(v3), values_b(v3);
+      std::vector<uint8_t> flags_a(v3), flags_b(v3);
+      std::vector<uint64_t> mask_tmp(mask_words);
+      std::vector<unsigned> unique_bricks;
+      std::vector<uint64_t> unique_keys;
+      uint64_t keys[COCTREE_V3_ROT_COUNT];
+      int desc[8];
+
+      #pragma omp for schedule(dynamic)
+      for (int g = 0; g < (int)group_starts.size() - 1; g++)
+      {
+        if (group_starts[g + 1] - group_starts[g] < 2)
+          continue;
+
+        unique_bricks.clear();
+        unique_keys.clear();
+        for (unsigned k = group_starts[g]; k < group_starts[g + 1]; k++)
+        {
+          unsigned a = order[k];
+          const uint32_t *brick_a = octree.data.data() + bricks[a].offset;
+          decode_coctree_v3_brick(brick_a, l, values_a, flags_a);
+          coctree_v3_brick_descriptor(l, values_a, flags_a, descriptor_cell(bricks[a].lod_size), desc);
+          for (unsigned r = 0; r < COCTREE_V3_ROT_COUNT; r++)
+            keys[r] = coctree_v3_brick_key(brick_a, l, bricks[a].lod_size, desc, r, mask_tmp);
+
+          for (unsigned u = 0; u < unique_bricks.size() && ref_brick[a] == a; u++)
+          {
+            unsigned b = unique_bricks[u];
+            const uint32_t *brick_b = octree.data.data() + bricks[b].offset;
+            bool decoded = false;
+            for (unsigned r = 0; r < COCTREE_V3_ROT_COUNT; r++)
+            {
+              if (keys[r] != unique_keys[u])
+                continue;
+              if (!decoded)
+              {
+                decode_coctree_v3_brick(brick_b, l, values_b, flags_b);
+                decoded = true;
+              }
+              uint32_t code = coctree_v3_match_bricks(brick_a, brick_b, l, r, values_a, flags_a, values_b, flags_b,
+                                                      brick_max_error(bricks[a].lod_size));
+              if (code != 0)
+              {
+                ref_brick[a] = b;
+                ref_code[a] = code;
+                break;
+              }
+            }
+          }
+
+          if (ref_brick[a] == a)
+          {
+            unique_bricks.push_back(a);
+            unique_keys.push_back(keys[0]);
+          }
+        }
+      }
+    }
+
+    //write octree with 2 uints per child: offset and transform code (0 for non-leaf children),
+    //nodes are visited in the same order as during collection of bricks
+    std::vector<uint32_t> data;
+    data.reserve(octree.data.size());
+    data.resize(1 + 2 * bitcount(octree.data[0] & 0xFFu), 0u);
+    std::vector<uint32_t> out_offset(bricks.size(), 0u); //0 - brick is not written yet
+    std::vector<uint2> out_queue = {uint2(0, 0)};        //node offset in source and in result
+    unsigned next_brick = 0;
+    unsigned unique_count = 0;
+    for (size_t q = 0; q < out_queue.size(); q++)
+    {
+      uint32_t info = octree.data[out_queue[q].x];
+      data[out_queue[q].y] = info;
+      unsigned child_num = 0;
+      for (int i = 0; i < 8; i++)
+      {
+        if ((info & (1u << i)) == 0)
+          continue;
+        uint32_t child_offset = octree.data[out_queue[q].x + 1 + child_num];
+        uint32_t out_pos = out_queue[q].y + 1 + 2 * child_num;
+        child_num++;
+        if (info & (1u << (i + 8)))
+        {
+          unsigned b = ref_brick[next_brick];
+          if (out_offset[b] == 0)
+          {
+            out_offset[b] = data.size();
+            data.insert(data.end(), octree.data.begin() + bricks[b].offset, octree.data.begin() + bricks[b].offset + bricks[b].size);
+            unique_count++;
+          }
+          data[out_pos] = out_offset[b];
+          data[out_pos + 1] = ref_code[next_brick];
+          next_brick++;
+        }
+        else
+        {
+          uint32_t child_out_offset = data.size();
+          data[out_pos] = child_out_offset;
+          data[out_pos + 1] = 0u;
+          out_queue.push_back(uint2(child_offset, child_out_offset));
+          data.resize(child_out_offset + 1 + 2 * bitcount(octree.data[child_offset] & 0xFFu), 0u);
+        }
+      }
+    }
+
+    printf("similarity compression: %u of %u bricks are unique, %.1f Kb -> %.1f Kb\n", unique_count, (unsigned)bricks.size(),
+           octree.data.size() * sizeof(uint32_t) / 1024.0f, data.size() * sizeof(uint32_t) / 1024.0f);
+
+    out_octree.header = octree.header;
+    out_octree.header.sim_compression = 1;
+    out_octree.data = std::move(data);
   }
 }
\ No newline at end of file
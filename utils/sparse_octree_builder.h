@@ -19,7 +19,25 @@ namespace sdf_converter
   SdfSBS frame_octree_to_SBS(MultithreadedDistanceFunction sdf, 
                              unsigned max_threads,
                              const std::vector<SdfFrameOctreeNode> &nodes,
-                             const SdfSBSHeader &header);
+                             const SdfSBSHeader &header,
+                             bool morton_order = true);
+  SdfSBS frame_octree_to_SBS(BatchDistanceFunction sdf, 
+                             unsigned max_threads,
+                             const std::vector<SdfFrameOctreeNode> &nodes,
+                             const SdfSBSHeader &header,
+                             bool morton_order = true);
+
+  //builds the same SBS as construct_sdf_frame_octree + frame_octree_to_SBS, but without storing the frame octree.
+  //Domain is processed in 8^min(depth,4) chunks, bricks of each chunk are written to path (in save_sdf_SBS format)
+  //as soon as it is finished, so only bricks of ~2*max_threads chunks are kept in memory. nodes_limit is ignored
+  bool construct_sdf_SBS_to_file(SparseOctreeSettings settings, BatchDistanceFunction sdf, unsigned max_threads,
+                                 const SdfSBSHeader &header, const std::string &path);
+
+  //tl_octree should be built with max_triangles_per_leaf = 0, so that all non-empty leaves have max depth
+  SdfSBS mesh_octree_to_SBS_narrow_band(const cmesh4::SimpleMesh &mesh,
+                                        const cmesh4::TriangleListOctree &tl_octree,
+                                        const SdfSBSHeader &header, float search_range_mult,
+                                        bool morton_order = true);
 
   std::vector<SdfFrameOctreeNode> construct_sdf_frame_octree(SparseOctreeSettings settings, MultithreadedDistanceFunction sdf, float eps, 
                                                              unsigned max_threads, bool is_smooth, bool fix_artefacts);
@@ -44,6 +62,13 @@ namespace sdf_converter
   void global_octree_to_SBS(const GlobalOctree &octree, SdfSBS &sbs);
   void global_octree_to_compact_octree_v3(const GlobalOctree &octree, COctreeV3 &compact_octree, unsigned max_threads);
 
+  //max distance error (in voxels) allowed for the brick replaced with the similar one, used if header.sim_compression is set
+  static constexpr float COCTREE_V3_SIM_MAX_ERROR = 0.1f;
+
+  //finds bricks that are equal up to one of 48 cube symmetries and a distance offset, within max_error voxels,
+  //and replaces them with references to one brick. Output has header.sim_compression = 1. Textured octrees are not supported
+  void compact_octree_v3_similarity_compression(const COctreeV3 &octree, COctreeV3 &out_octree, float max_error, unsigned max_threads);
+
   void mesh_octree_to_sdf_frame_octree_tex(const cmesh4::SimpleMesh &mesh,
                                            const cmesh4::TriangleListOctree &tl_octree, 
                                            std::vector<SdfFrameOctreeTexNode> &out_frame);
@@ -57,7 +82,8 @@ namespace sdf_converter
   SdfSBS frame_octree_to_SBS_tex(MultithreadedDistanceFunction sdf, 
                                  unsigned max_threads,
                                  const std::vector<SdfFrameOctreeTexNode> &nodes,
-                                 const SdfSBSHeader &header);
+                                 const SdfSBSHeader &header,
+                                 bool morton_order = true);
 
   SdfSBS SBS_col_to_SBS_ind(const SdfSBS &sbs);
 
@@ -65,6 +91,8 @@ namespace sdf_converter
 
   std::vector<SdfFrameOctreeNode> construct_sdf_frame_octree(SparseOctreeSettings settings, MultithreadedDistanceFunction sdf, 
                                                              unsigned max_threads);
+  std::vector<SdfFrameOctreeNode> construct_sdf_frame_octree(SparseOctreeSettings settings, BatchDistanceFunction sdf, 
+                                                             unsigned max_threads);
 
   std::vector<SdfCompactOctreeNode> frame_octree_to_compact_octree(const std::vector<SdfFrameOctreeNode> &frame);
   std::vector<uint32_t> frame_octree_to_compact_octree_v2(const std::vector<SdfFrameOctreeNode> &frame);